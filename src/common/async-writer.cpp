@@ -0,0 +1,121 @@
+/*
+ * async-writer.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include "async-writer.h"
+#include "logger.h"
+#include "timer.h"
+
+AsyncWriter::AsyncWriter(int _capacity) :
+  capacity(_capacity > 0 ? _capacity : 1), writing(false), stop(false), started(false),
+  nbuf(0), mbytes(0), writeTime(0), waitTime(0)
+{
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&ready, NULL);
+  pthread_cond_init(&done, NULL);
+}
+
+AsyncWriter::~AsyncWriter() {
+  flush();
+
+  if (started) {
+    pthread_mutex_lock(&mutex);
+    stop = true;
+    pthread_cond_signal(&ready);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+  }
+
+  if (nbuf > 0) {
+    INFO() << format("async writer: %ld buffers, %.1f MB in %.3fs, the callers waited %.3fs")
+        % nbuf % mbytes % writeTime % waitTime;
+  }
+
+  pthread_cond_destroy(&done);
+  pthread_cond_destroy(&ready);
+  pthread_mutex_destroy(&mutex);
+}
+
+void *AsyncWriter::run(void *arg) {
+  static_cast<AsyncWriter *>(arg)->loop();
+  return NULL;
+}
+
+void AsyncWriter::loop() {
+  pthread_mutex_lock(&mutex);
+  for (;;) {
+    while (queue.empty() && !stop) {
+      pthread_cond_wait(&ready, &mutex);
+    }
+    if (queue.empty()) {
+      break;
+    }
+
+    Job job;
+    job.file = queue.front().file;
+    job.data.swap(queue.front().data);
+    queue.pop_front();
+    writing = true;
+    pthread_mutex_unlock(&mutex);
+
+    Timer timer;
+    sf_floatwrite(&job.data[0], job.data.size(), job.file);
+    double t = timer.elapsed();
+
+    pthread_mutex_lock(&mutex);
+    writing = false;
+    writeTime += t;
+    pthread_cond_broadcast(&done);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+void AsyncWriter::write(sf_file file, std::vector<float> &data) {
+  if (data.empty()) {
+    return;
+  }
+
+  pthread_mutex_lock(&mutex);
+  if (!started) {
+    started = pthread_create(&thread, NULL, run, this) == 0;
+    if (!started) {
+      pthread_mutex_unlock(&mutex);
+      WARNING() << "cannot start the async writer, writing in place";
+      sf_floatwrite(&data[0], data.size(), file);
+      data.clear();
+      return;
+    }
+  }
+
+  Timer timer;
+  while ((int)queue.size() >= capacity) {
+    pthread_cond_wait(&done, &mutex);
+  }
+  waitTime += timer.elapsed();
+
+  queue.push_back(Job());
+  queue.back().file = file;
+  queue.back().data.swap(data);
+  nbuf++;
+  mbytes += queue.back().data.size() * sizeof(float) / 1e6;
+  pthread_cond_signal(&ready);
+  pthread_mutex_unlock(&mutex);
+}
+
+void AsyncWriter::write(sf_file file, const float *p, size_t n) {
+  std::vector<float> data(p, p + n);
+  write(file, data);
+}
+
+void AsyncWriter::flush() {
+  pthread_mutex_lock(&mutex);
+  Timer timer;
+  while (!queue.empty() || writing) {
+    pthread_cond_wait(&done, &mutex);
+  }
+  waitTime += timer.elapsed();
+  pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,70 @@
+/*
+ * async-writer.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_ASYNC_WRITER_H_
+#define SRC_COMMON_ASYNC_WRITER_H_
+
+extern "C" {
+#include <rsf.h>
+}
+#include <deque>
+#include <vector>
+#include <pthread.h>
+
+/**
+ * sf_floatwrite on an output thread, e.g. the model of each iteration or
+ * the snapshots of a wavefield. write() queues a buffer and returns, it only
+ * waits while capacity buffers are queued. The buffers of a file are written
+ * in the order they are queued; the caller must not touch a file with
+ * buffers in the queue, except for sf_putint and similar calls before the
+ * first write, and must flush() before sf_close. The thread starts with the
+ * first write, so a rank that writes nothing runs no thread
+ */
+class AsyncWriter {
+public:
+  explicit AsyncWriter(int capacity = 4);
+
+  /// flush() and report
+  ~AsyncWriter();
+
+  /// data is taken by swap and left empty
+  void write(sf_file file, std::vector<float> &data);
+  void write(sf_file file, const float *p, size_t n);
+
+  /// the queued buffers are written
+  void flush();
+
+private:
+  AsyncWriter(const AsyncWriter &);
+  AsyncWriter &operator=(const AsyncWriter &);
+
+  struct Job {
+    sf_file file;
+    std::vector<float> data;
+  };
+
+  static void *run(void *arg);
+  void loop();
+
+private:
+  int capacity;
+  std::deque<Job> queue;
+  bool writing;         /// the thread holds a job out of the queue
+  bool stop;
+  bool started;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t ready;   /// a job is queued or stop
+  pthread_cond_t done;    /// a job is written
+
+  long nbuf;
+  double mbytes;
+  double writeTime;     /// on the thread
+  double waitTime;      /// of write() and flush() on a full queue
+};
+
+#endif /* SRC_COMMON_ASYNC_WRITER_H_ */
@@ -0,0 +1,316 @@
+/*
+ * checkpoint.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C" {
+#include <rsf.h>
+}
+
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "logger.h"
+#include "timer.h"
+
+namespace {
+
+const char MAGIC[8] = { 'S', 'S', 'C', 'K', 'P', 'T', '0', '1' };
+
+/// FNV-1a over everything after the magic, to catch a torn file
+class Writer {
+public:
+  explicit Writer(FILE *_fp) : fp(_fp), hash(14695981039346656037ULL), good(true) {}
+
+  void put(const void *p, size_t n) {
+    const unsigned char *c = static_cast<const unsigned char *>(p);
+    for (size_t i = 0; i < n; i++) {
+      hash = (hash ^ c[i]) * 1099511628211ULL;
+    }
+    good = good && fwrite(p, 1, n, fp) == n;
+  }
+
+  FILE *fp;
+  uint64_t hash;
+  bool good;
+};
+
+class Reader {
+public:
+  explicit Reader(FILE *_fp) : fp(_fp), hash(14695981039346656037ULL), good(true) {}
+
+  void get(void *p, size_t n) {
+    good = good && fread(p, 1, n, fp) == n;
+    if (!good) {
+      return;
+    }
+    const unsigned char *c = static_cast<const unsigned char *>(p);
+    for (size_t i = 0; i < n; i++) {
+      hash = (hash ^ c[i]) * 1099511628211ULL;
+    }
+  }
+
+  FILE *fp;
+  uint64_t hash;
+  bool good;
+};
+
+} /// end of name space
+
+void CheckpointData::put(const std::string &name, const void *p, size_t bytes) {
+  std::vector<char> &b = blobs[name];
+  const char *c = static_cast<const char *>(p);
+  b.assign(c, c + bytes);
+}
+
+void CheckpointData::putString(const std::string &name, const std::string &s) {
+  put(name, s.data(), s.size());
+}
+
+bool CheckpointData::has(const std::string &name) const {
+  return blobs.find(name) != blobs.end();
+}
+
+size_t CheckpointData::size(const std::string &name) const {
+  std::map<std::string, std::vector<char> >::const_iterator it = blobs.find(name);
+  if (it == blobs.end()) {
+    sf_error("no %s in the checkpoint", name.c_str());
+  }
+  return it->second.size();
+}
+
+void CheckpointData::get(const std::string &name, void *p, size_t bytes) const {
+  if (size(name) != bytes) {
+    sf_error("%s of the checkpoint has %zu bytes instead of %zu", name.c_str(), size(name), bytes);
+  }
+  if (bytes > 0) {
+    memcpy(p, &blobs.find(name)->second[0], bytes);
+  }
+}
+
+std::string CheckpointData::getString(const std::string &name) const {
+  if (size(name) == 0) {
+    return std::string();
+  }
+  const std::vector<char> &b = blobs.find(name)->second;
+  return std::string(&b[0], b.size());
+}
+
+size_t CheckpointData::bytes() const {
+  size_t n = 0;
+  std::map<std::string, std::vector<char> >::const_iterator it;
+  for (it = blobs.begin(); it != blobs.end(); ++it) {
+    n += it->first.size() + it->second.size();
+  }
+  return n;
+}
+
+void CheckpointData::clear() {
+  blobs.clear();
+}
+
+void CheckpointData::swap(CheckpointData &other) {
+  blobs.swap(other.blobs);
+}
+
+bool CheckpointData::write(const std::string &fn, int nranks, int rank, int step, long gen) const {
+  std::string tmp = fn + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "wb");
+  if (fp == NULL) {
+    return false;
+  }
+
+  bool good = fwrite(MAGIC, 1, sizeof(MAGIC), fp) == sizeof(MAGIC);
+  Writer w(fp);
+  int32_t head[3] = { nranks, rank, step };
+  int64_t g = gen;
+  uint64_t n = blobs.size();
+  w.put(head, sizeof(head));
+  w.put(&g, sizeof(g));
+  w.put(&n, sizeof(n));
+
+  std::map<std::string, std::vector<char> >::const_iterator it;
+  for (it = blobs.begin(); it != blobs.end(); ++it) {
+    uint32_t len = it->first.size();
+    uint64_t bytes = it->second.size();
+    w.put(&len, sizeof(len));
+    w.put(it->first.data(), len);
+    w.put(&bytes, sizeof(bytes));
+    if (bytes > 0) {
+      w.put(&it->second[0], bytes);
+    }
+  }
+
+  uint64_t hash = w.hash;
+  good = good && w.good && fwrite(&hash, sizeof(hash), 1, fp) == 1;
+  good = good && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  good = fclose(fp) == 0 && good;
+
+  return good && rename(tmp.c_str(), fn.c_str()) == 0;
+}
+
+bool CheckpointData::read(const std::string &fn, int &nranks, int &rank, int &step, long &gen) {
+  FILE *fp = fopen(fn.c_str(), "rb");
+  if (fp == NULL) {
+    return false;
+  }
+
+  char magic[sizeof(MAGIC)];
+  bool good = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+  Reader r(fp);
+  int32_t head[3];
+  int64_t g = 0;
+  uint64_t n = 0;
+  r.get(head, sizeof(head));
+  r.get(&g, sizeof(g));
+  r.get(&n, sizeof(n));
+
+  blobs.clear();
+  for (uint64_t i = 0; good && r.good && i < n; i++) {
+    uint32_t len = 0;
+    uint64_t bytes = 0;
+    r.get(&len, sizeof(len));
+    std::string name(r.good ? len : 0, ' ');
+    if (len > 0) {
+      r.get(&name[0], len);
+    }
+    r.get(&bytes, sizeof(bytes));
+    std::vector<char> &b = blobs[name];
+    b.resize(r.good ? bytes : 0);
+    if (bytes > 0) {
+      r.get(&b[0], bytes);
+    }
+  }
+
+  uint64_t hash = 0;
+  uint64_t expect = r.hash;
+  good = good && r.good && fread(&hash, sizeof(hash), 1, fp) == 1 && hash == expect;
+  fclose(fp);
+
+  if (!good) {
+    blobs.clear();
+    return false;
+  }
+  nranks = head[0];
+  rank = head[1];
+  step = head[2];
+  gen = g;
+  return true;
+}
+
+Checkpoint::Checkpoint(MPI_Comm _comm, const char *_prefix, int _every) :
+  comm(_comm), rank(0), nranks(1), prefix(_prefix), every(_every), gen(-1),
+  pendingStep(0), writing(false), ok(true), seconds(0)
+{
+  if (comm != MPI_COMM_NULL) {
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nranks);
+  }
+}
+
+Checkpoint::~Checkpoint() {
+  wait();
+}
+
+bool Checkpoint::due(int step) const {
+  return every > 0 && step % every == 0;
+}
+
+std::string Checkpoint::fileName(const std::string &pre, long g) const {
+  char suffix[64];
+  snprintf(suffix, sizeof(suffix), "-%d.%ld", rank, g % 2);
+  return pre + suffix;
+}
+
+void *Checkpoint::writer(void *arg) {
+  Checkpoint *ck = static_cast<Checkpoint *>(arg);
+  Timer timer;
+  ck->ok = ck->pending.write(ck->fileName(ck->prefix, ck->gen), ck->nranks, ck->rank, ck->pendingStep, ck->gen);
+  ck->seconds = timer.elapsed();
+  return NULL;
+}
+
+void Checkpoint::wait() {
+  if (!writing) {
+    return;
+  }
+  pthread_join(thread, NULL);
+  writing = false;
+  report();
+}
+
+void Checkpoint::report() {
+  if (ok) {
+    INFO() << format("checkpoint %ld of step %d: %.1f MB in %.3f s") % gen % pendingStep % (pending.bytes() / 1e6) % seconds;
+  } else {
+    WARNING() << format("cannot write the checkpoint %s") % fileName(prefix, gen);
+  }
+  pending.clear();
+}
+
+void Checkpoint::save(int step, CheckpointData &data) {
+  wait();
+
+  /// a generation some rank failed to write is written again
+  int good = ok;
+  if (comm != MPI_COMM_NULL) {
+    MPI_Allreduce(MPI_IN_PLACE, &good, 1, MPI_INT, MPI_MIN, comm);
+  }
+  if (!good) {
+    gen--;
+  }
+
+  gen++;
+  pendingStep = step;
+  pending.swap(data);
+  data.clear();
+
+  if (pthread_create(&thread, NULL, writer, this) == 0) {
+    writing = true;
+    return;
+  }
+  writer(this);
+  report();
+}
+
+int Checkpoint::restore(const char *from, CheckpointData &data) {
+  CheckpointData cand[2];
+  long g[2] = { -1, -1 };
+  int step[2] = { 0, 0 };
+
+  for (int k = 0; k < 2; k++) {
+    int n = 0, r = 0;
+    if (!cand[k].read(fileName(from, k), n, r, step[k], g[k]) || n != nranks || r != rank) {
+      g[k] = -1;
+    }
+  }
+
+  long best = std::max(g[0], g[1]);
+  long common = best;
+  if (comm != MPI_COMM_NULL) {
+    MPI_Allreduce(&best, &common, 1, MPI_LONG, MPI_MIN, comm);
+  }
+  if (common < 0) {
+    sf_error("no complete checkpoint of %d ranks under %s", nranks, from);
+  }
+
+  int k = g[0] == common ? 0 : (g[1] == common ? 1 : -1);
+  int have = k >= 0;
+  if (comm != MPI_COMM_NULL) {
+    MPI_Allreduce(MPI_IN_PLACE, &have, 1, MPI_INT, MPI_MIN, comm);
+  }
+  if (!have) {
+    sf_error("the ranks have no common checkpoint under %s", from);
+  }
+
+  data.swap(cand[k]);
+  gen = common;
+  INFO() << format("restart from the checkpoint %ld of step %d under %s") % gen % step[k] % from;
+
+  return step[k];
+}
@@ -0,0 +1,126 @@
+/*
+ * checkpoint.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_CHECKPOINT_H_
+#define SRC_COMMON_CHECKPOINT_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <mpi.h>
+
+/**
+ * the state of one rank as named blobs. Each class with state across the
+ * iterations puts its members under a key of its own (saveState) and gets
+ * them back in the same order (loadState)
+ */
+class CheckpointData {
+public:
+  void put(const std::string &name, const void *p, size_t bytes);
+  void putString(const std::string &name, const std::string &s);
+
+  template <class T>
+  void put(const std::string &name, const std::vector<T> &v) {
+    put(name, v.empty() ? NULL : &v[0], v.size() * sizeof(T));
+  }
+
+  template <class T>
+  void putValue(const std::string &name, const T &v) {
+    put(name, &v, sizeof(T));
+  }
+
+  bool has(const std::string &name) const;
+
+  /// sf_error if name is missing or of another size
+  void get(const std::string &name, void *p, size_t bytes) const;
+  std::string getString(const std::string &name) const;
+
+  template <class T>
+  void get(const std::string &name, std::vector<T> &v) const {
+    v.resize(size(name) / sizeof(T));
+    get(name, v.empty() ? NULL : &v[0], v.size() * sizeof(T));
+  }
+
+  template <class T>
+  T getValue(const std::string &name) const {
+    T v;
+    get(name, &v, sizeof(T));
+    return v;
+  }
+
+  size_t size(const std::string &name) const;
+  size_t bytes() const;
+  void clear();
+  void swap(CheckpointData &other);
+
+  /// false if the file is truncated or does not match its checksum
+  bool write(const std::string &fn, int nranks, int rank, int step, long gen) const;
+  bool read(const std::string &fn, int &nranks, int &rank, int &step, long &gen);
+
+private:
+  std::map<std::string, std::vector<char> > blobs;
+};
+
+/**
+ * periodic checkpoints of the whole optimizer state, every rank writes its
+ * own file <prefix>-<rank>.<0|1>, alternately, so the previous generation
+ * stays complete while the next is written. A file is written under a
+ * temporary name and renamed when it is complete.
+ *
+ * save() takes the state by swap and the write runs on a thread, the
+ * iterations go on. The next save() waits for the write and agrees with the
+ * other ranks that the generation is complete, so the ranks never hold
+ * generations more than one apart and restore() finds the newest one all
+ * of them have. comm may be MPI_COMM_NULL for a single process without MPI
+ */
+class Checkpoint {
+public:
+  /// every <= 0 never saves
+  Checkpoint(MPI_Comm comm, const char *prefix, int every);
+  ~Checkpoint();
+
+  /// true after the step steps, counted from 1
+  bool due(int step) const;
+
+  /// the state after step steps, data is left empty
+  void save(int step, CheckpointData &data);
+
+  /// the write of the last save
+  void wait();
+
+  /**
+   * the state of the newest generation under prefix all ranks wrote, the
+   * saves go on from it. The step of the state, sf_error if there is none
+   */
+  int restore(const char *prefix, CheckpointData &data);
+
+private:
+  Checkpoint(const Checkpoint &);
+  Checkpoint &operator=(const Checkpoint &);
+
+  std::string fileName(const std::string &prefix, long gen) const;
+  static void *writer(void *arg);
+  void report();
+
+private:
+  MPI_Comm comm;
+  int rank;
+  int nranks;
+  std::string prefix;
+  int every;
+  long gen;               /// of the last save, -1 before the first
+
+  CheckpointData pending;
+  int pendingStep;
+  bool writing;
+  bool ok;                /// of the last write
+  double seconds;
+  pthread_t thread;
+};
+
+#endif /* SRC_COMMON_CHECKPOINT_H_ */
@@ -60,7 +60,7 @@ float ** f1dto2d(float *p, int nx, int nz) {
 	return pp;
 }
 
-void matrix_transpose(float *matrix, float *trans, int n1, int n2)
+void matrix_transpose(const float *matrix, float *trans, int n1, int n2)
 /*< matrix transpose: matrix tansposed to be trans >*/
 {
 
@@ -51,7 +51,7 @@ float variance(const T *A_Begin, const T *A_End, const T *B_Begin) {
 void filter(float *dobs, int nt, float dt, float flo, float fhi, bool phase, bool verb, int ng, int ns);
 std::vector<float> taper(int nx, int nwx);
 float ** f1dto2d(float *p, int nx, int nz);
-void matrix_transpose(float *matrix, float *trans, int n1, int n2);
+void matrix_transpose(const float *matrix, float *trans, int n1, int n2);
 void step_forward(const float *p0, const float *p1, float *p2, const float *vv, float dtz, float dtx, int nz, int nx);
 void step_backward(float *illum, float *lap, const float *p0, const float *p1, float *p2, const float *vv, float dtz, float dtx, int nz, int nx);
 
@@ -0,0 +1,52 @@
+/*
+ * ensemble.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include "ensemble.h"
+
+Ensemble::Ensemble(int n, int _nx, int _nz) : nx(_nx), nz(_nz), storage((size_t)n * _nx * _nz, 0), vels(n) {
+  for (int i = 0; i < n; i++) {
+    vels[i] = new Velocity(member(i), nx, nz);
+  }
+}
+
+Ensemble::~Ensemble() {
+  for (size_t i = 0; i < vels.size(); i++) {
+    delete vels[i];
+  }
+}
+
+int Ensemble::size() const {
+  return vels.size();
+}
+
+int Ensemble::modelSize() const {
+  return nx * nz;
+}
+
+float *Ensemble::data() {
+  return storage.empty() ? NULL : &storage[0];
+}
+
+float *Ensemble::member(int i) {
+  return data() + (size_t)i * nx * nz;
+}
+
+Velocity &Ensemble::velocity(int i) {
+  return *vels[i];
+}
+
+std::vector<Velocity *> Ensemble::velocities() {
+  return vels;
+}
+
+std::vector<float *> Ensemble::members() {
+  std::vector<float *> ret(vels.size());
+  for (size_t i = 0; i < vels.size(); i++) {
+    ret[i] = member(i);
+  }
+  return ret;
+}
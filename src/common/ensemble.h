@@ -0,0 +1,45 @@
+/*
+ * ensemble.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_ENSEMBLE_H_
+#define SRC_COMMON_ENSEMBLE_H_
+
+#include <vector>
+#include "velocity.h"
+
+/**
+ * the velocities of the ensemble members of a process in one array, member i
+ * at i * modelSize, so the analysis works on them in place as a modelSize x n
+ * column major matrix. The Velocity of a member is a view into the array, the
+ * FWI of the member updates it there
+ */
+class Ensemble {
+public:
+  Ensemble(int n, int nx, int nz);
+  ~Ensemble();
+
+  int size() const;       /// members
+  int modelSize() const;
+  float *data();
+  float *member(int i);
+  Velocity &velocity(int i);
+
+  std::vector<Velocity *> velocities();
+  std::vector<float *> members();
+
+private:
+  Ensemble(const Ensemble &);
+  Ensemble &operator=(const Ensemble &);
+
+private:
+  int nx;
+  int nz;
+  std::vector<float> storage;
+  std::vector<Velocity *> vels;
+};
+
+#endif /* SRC_COMMON_ENSEMBLE_H_ */
@@ -0,0 +1,65 @@
+/*
+ * grid-coarsen.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "grid-coarsen.h"
+
+int coarsenFactor(float vmin, float fhi, float dx, float ppw) {
+  int factor = static_cast<int>(std::floor(vmin / (fhi * ppw * dx)));
+  return std::max(factor, 1);
+}
+
+int coarseGridSize(int n, int factor) {
+  return (n - 1) / factor + 1;
+}
+
+Velocity restrictVelocity(const Velocity &v, int factor) {
+  int nxc = coarseGridSize(v.nx, factor);
+  int nzc = coarseGridSize(v.nz, factor);
+  int half = factor / 2;
+  Velocity vc(nxc, nzc);
+
+  for (int ixc = 0; ixc < nxc; ixc++) {
+    int xbeg = std::max(0, ixc * factor - half);
+    int xend = std::min(v.nx, ixc * factor + half + 1);
+    for (int izc = 0; izc < nzc; izc++) {
+      int zbeg = std::max(0, izc * factor - half);
+      int zend = std::min(v.nz, izc * factor + half + 1);
+      float sum = 0;
+      for (int ix = xbeg; ix < xend; ix++) {
+        for (int iz = zbeg; iz < zend; iz++) {
+          sum += v.dat[ix * v.nz + iz];
+        }
+      }
+      vc.dat[ixc * nzc + izc] = sum / ((xend - xbeg) * (zend - zbeg));
+    }
+  }
+
+  return vc;
+}
+
+Velocity prolongVelocity(const Velocity &vc, int nx, int nz, int factor) {
+  Velocity v(nx, nz);
+
+  for (int ix = 0; ix < nx; ix++) {
+    int ixc = std::min(ix / factor, vc.nx - 1);
+    int ixc1 = std::min(ixc + 1, vc.nx - 1);
+    float wx = static_cast<float>(ix - ixc * factor) / factor;
+    for (int iz = 0; iz < nz; iz++) {
+      int izc = std::min(iz / factor, vc.nz - 1);
+      int izc1 = std::min(izc + 1, vc.nz - 1);
+      float wz = static_cast<float>(iz - izc * factor) / factor;
+      v.dat[ix * nz + iz] =
+        (1 - wx) * ((1 - wz) * vc.dat[ixc  * vc.nz + izc] + wz * vc.dat[ixc  * vc.nz + izc1]) +
+             wx  * ((1 - wz) * vc.dat[ixc1 * vc.nz + izc] + wz * vc.dat[ixc1 * vc.nz + izc1]);
+    }
+  }
+
+  return v;
+}
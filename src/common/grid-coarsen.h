@@ -0,0 +1,26 @@
+/*
+ * grid-coarsen.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_GRID_COARSEN_H_
+#define SRC_COMMON_GRID_COARSEN_H_
+
+#include "velocity.h"
+
+/**
+ * coarse grid of a multiscale stage, coarse node i sits on fine node i * factor.
+ * the factor keeps at least ppw points per shortest wavelength vmin / fhi
+ */
+int coarsenFactor(float vmin, float fhi, float dx, float ppw);
+int coarseGridSize(int n, int factor);
+
+/// box average of the (untransformed) velocity around each coarse node
+Velocity restrictVelocity(const Velocity &v, int factor);
+
+/// bilinear interpolation back to the nx * nz fine grid
+Velocity prolongVelocity(const Velocity &vc, int nx, int nz, int factor);
+
+#endif /* SRC_COMMON_GRID_COARSEN_H_ */
@@ -0,0 +1,195 @@
+/*
+ * node-reduce.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C" {
+#include <rsf.h>
+}
+
+#include <cstring>
+#include <algorithm>
+#include "node-reduce.h"
+#include "logger.h"
+
+namespace {
+
+uint16_t toBf16(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  u += 0x7fff + ((u >> 16) & 1);    /// round to nearest even
+  return u >> 16;
+}
+
+float fromBf16(uint16_t h) {
+  uint32_t u = (uint32_t)h << 16;
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+/// the partial sums are added in float and rounded again
+void bf16SumOp(void *in, void *inout, int *n, MPI_Datatype *) {
+  const uint16_t *a = static_cast<const uint16_t *>(in);
+  uint16_t *b = static_cast<uint16_t *>(inout);
+  for (int i = 0; i < *n; i++) {
+    b[i] = toBf16(fromBf16(a[i]) + fromBf16(b[i]));
+  }
+}
+
+} /// end of name space
+
+NodeReducer::NodeReducer(MPI_Comm comm, int _n2, int _n1, int _i2beg, int _i2end, int _i1beg, int _i1end) :
+  n2(_n2), n1(_n1), i2beg(_i2beg), i2end(_i2end), i1beg(_i1beg), i1end(_i1end), bf16(false), bf16Sum(MPI_OP_NULL)
+{
+  if (!(0 <= i2beg && i2beg <= i2end && i2end <= n2 && 0 <= i1beg && i1beg <= i1end && i1end <= n1)) {
+    sf_error("window [%d, %d) x [%d, %d) is not inside %d x %d", i2beg, i2end, i1beg, i1end, n2, n1);
+  }
+  len = (i2end - i2beg) * (i1end - i1beg);
+
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+  MPI_Comm_rank(node, &nodeRank);
+  MPI_Comm_size(node, &nodeSize);
+  MPI_Comm_split(comm, nodeRank == 0 ? 0 : MPI_UNDEFINED, rank, &leaders);
+
+  /// the leader holds the whole window, the others map it
+  MPI_Aint size = nodeRank == 0 ? (MPI_Aint)(nodeSize + 1) * len * sizeof(float) : 0;
+  MPI_Win_allocate_shared(size, sizeof(float), MPI_INFO_NULL, node, &slots, &win);
+  int disp;
+  MPI_Win_shared_query(win, 0, &size, &disp, &slots);
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+
+  resetStats();
+}
+
+NodeReducer::~NodeReducer() {
+  MPI_Win_unlock_all(win);
+  MPI_Win_free(&win);
+  if (bf16Sum != MPI_OP_NULL) {
+    MPI_Op_free(&bf16Sum);
+  }
+  if (leaders != MPI_COMM_NULL) {
+    MPI_Comm_free(&leaders);
+  }
+  MPI_Comm_free(&node);
+}
+
+void NodeReducer::setCompression(const char *spec) {
+  if (std::strcmp(spec, "none") == 0) {
+    bf16 = false;
+  } else if (std::strcmp(spec, "bf16") == 0) {
+    bf16 = true;
+    if (bf16Sum == MPI_OP_NULL) {
+      MPI_Op_create(bf16SumOp, 1, &bf16Sum);
+    }
+    feedback.assign(leaders != MPI_COMM_NULL ? len : 0, 0);
+  } else {
+    sf_error("unknown compression %s, none or bf16", spec);
+  }
+}
+
+/// the stores of a rank to the window are seen by the others after it
+void NodeReducer::sync() const {
+  MPI_Win_sync(win);
+  MPI_Barrier(node);
+  MPI_Win_sync(win);
+}
+
+void NodeReducer::leaderReduce(float *sum) {
+  int nleaders;
+  MPI_Comm_size(leaders, &nleaders);
+  if (nleaders == 1) {
+    return;
+  }
+
+  if (!bf16) {
+    MPI_Allreduce(MPI_IN_PLACE, sum, len, MPI_FLOAT, MPI_SUM, leaders);
+    bytes += (double)len * sizeof(float);
+    return;
+  }
+
+  packed.resize(len);
+  for (int i = 0; i < len; i++) {
+    float x = sum[i] + feedback[i];
+    packed[i] = toBf16(x);
+    feedback[i] = x - fromBf16(packed[i]);
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &packed[0], len, MPI_UINT16_T, bf16Sum, leaders);
+  for (int i = 0; i < len; i++) {
+    sum[i] = fromBf16(packed[i]);
+  }
+  bytes += (double)len * sizeof(uint16_t);
+}
+
+void NodeReducer::allreduce(const float *in, float *out) {
+  double t0 = MPI_Wtime();
+  int nz = i1end - i1beg;
+
+  float *mine = &slots[(size_t)nodeRank * len];
+  for (int i2 = i2beg; i2 < i2end; i2++) {
+    std::copy(&in[(size_t)i2 * n1 + i1beg], &in[(size_t)i2 * n1 + i1end], &mine[(i2 - i2beg) * nz]);
+  }
+  sync();
+
+  /// each rank of the node adds up a slice of the slots
+  float *sum = &slots[(size_t)nodeSize * len];
+  int beg = (long)len * nodeRank / nodeSize;
+  int end = (long)len * (nodeRank + 1) / nodeSize;
+  std::copy(&slots[beg], &slots[end], &sum[beg]);
+  for (int r = 1; r < nodeSize; r++) {
+    const float *s = &slots[(size_t)r * len];
+    for (int i = beg; i < end; i++) {
+      sum[i] += s[i];
+    }
+  }
+  sync();
+
+  if (leaders != MPI_COMM_NULL) {
+    leaderReduce(sum);
+  }
+  sync();
+
+  std::fill(out, out + (size_t)i2beg * n1, 0.0f);
+  for (int i2 = i2beg; i2 < i2end; i2++) {
+    float *o = &out[(size_t)i2 * n1];
+    std::fill(o, o + i1beg, 0.0f);
+    std::copy(&sum[(i2 - i2beg) * nz], &sum[(i2 - i2beg + 1) * nz], o + i1beg);
+    std::fill(o + i1end, o + n1, 0.0f);
+  }
+  std::fill(out + (size_t)i2end * n1, out + (size_t)n2 * n1, 0.0f);
+
+  /// nobody reads the window again before every rank has its copy
+  sync();
+
+  calls++;
+  seconds += MPI_Wtime() - t0;
+}
+
+void NodeReducer::saveState(CheckpointData &ckpt, const std::string &key) const {
+  ckpt.put(key + ".feedback", feedback);
+}
+
+void NodeReducer::loadState(const CheckpointData &ckpt, const std::string &key) {
+  std::vector<float> f;
+  ckpt.get(key + ".feedback", f);
+  if (f.size() != feedback.size()) {
+    sf_error("%s of the checkpoint is for another grid or node layout", key.c_str());
+  }
+  feedback.swap(f);
+}
+
+void NodeReducer::resetStats() {
+  calls = 0;
+  bytes = 0;
+  seconds = 0;
+}
+
+void NodeReducer::report(const char *what, int id) const {
+  const double mb = 1.0 / (1024 * 1024);
+  INFO() << format("%s %d reduction: %ld calls, %d ranks on the node, %.2f MB sent between nodes%s, %.3f s")
+      % what % id % calls % nodeSize % (bytes * mb) % (bf16 ? " as bf16" : "") % seconds;
+}
@@ -0,0 +1,75 @@
+/*
+ * node-reduce.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_NODE_REDUCE_H_
+#define SRC_COMMON_NODE_REDUCE_H_
+
+#include <vector>
+#include <stdint.h>
+#include <mpi.h>
+#include <string>
+#include "checkpoint.h"
+
+/**
+ * sum of an n2 x n1 grid (idx = i2 * n1 + i1) over the ranks of comm in two
+ * levels: the ranks of a node add their grids in a shared memory window, each
+ * rank a slice, then one leader per node joins the allreduce between the
+ * nodes. Only the window [i2beg, i2end) x [i1beg, i1end) is summed, the sum
+ * is zero outside, e.g. the boundary maskGradient clears.
+ *
+ * with bf16 compression the leaders send the upper half of each float,
+ * rounded to nearest, and keep the rounding error to add to the next call
+ * (error feedback), so their own rounding does not build up over the
+ * iterations. The partial sums of the allreduce are rounded to bf16 as well
+ */
+class NodeReducer {
+public:
+  NodeReducer(MPI_Comm comm, int n2, int n1, int i2beg, int i2end, int i1beg, int i1end);
+  ~NodeReducer();
+
+  /// none or bf16, the reduction on a node is always exact
+  void setCompression(const char *spec);
+
+  /// in and out may be the same grid
+  void allreduce(const float *in, float *out);
+
+  /// the rounding errors the leaders carry to the next call
+  void saveState(CheckpointData &ckpt, const std::string &key) const;
+  void loadState(const CheckpointData &ckpt, const std::string &key);
+
+  void resetStats();
+  void report(const char *what, int id) const;
+
+private:
+  NodeReducer(const NodeReducer &);
+  NodeReducer &operator=(const NodeReducer &);
+
+  void sync() const;
+  void leaderReduce(float *sum);
+
+private:
+  MPI_Comm node;
+  MPI_Comm leaders;     /// MPI_COMM_NULL but on the leaders
+  MPI_Win win;
+  float *slots;         /// nodeSize slots of len floats and the node sum
+  int nodeRank;
+  int nodeSize;
+  int n2, n1;
+  int i2beg, i2end, i1beg, i1end;
+  int len;
+
+  bool bf16;
+  MPI_Op bf16Sum;
+  std::vector<float> feedback;
+  std::vector<uint16_t> packed;
+
+  long calls;
+  double bytes;         /// sent by this rank between the nodes
+  double seconds;
+};
+
+#endif /* SRC_COMMON_NODE_REDUCE_H_ */
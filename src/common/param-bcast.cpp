@@ -0,0 +1,91 @@
+/*
+ * param-bcast.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C" {
+#include <rsf.h>
+}
+
+#include <cstring>
+#include "param-bcast.h"
+
+ParamBcast::ParamBcast(MPI_Comm _comm, int _root) : comm(_comm), root(_root), rank(0), pos(0) {
+  MPI_Comm_rank(comm, &rank);
+}
+
+bool ParamBcast::reader() const {
+  return rank == root;
+}
+
+void ParamBcast::put(const void *p, size_t n) {
+  const char *c = static_cast<const char *>(p);
+  buf.insert(buf.end(), c, c + n);
+}
+
+void ParamBcast::get(void *p, size_t n) {
+  if (pos + n > buf.size()) {
+    sf_error("the broadcast parameters end at %zu bytes", buf.size());
+  }
+  if (n > 0) {
+    memcpy(p, &buf[pos], n);
+  }
+  pos += n;
+}
+
+ParamBcast &ParamBcast::operator()(int &v) {
+  reader() ? put(&v, sizeof(v)) : get(&v, sizeof(v));
+  return *this;
+}
+
+ParamBcast &ParamBcast::operator()(float &v) {
+  reader() ? put(&v, sizeof(v)) : get(&v, sizeof(v));
+  return *this;
+}
+
+ParamBcast &ParamBcast::operator()(const char *&s) {
+  int len = s ? strlen(s) : -1;
+  (*this)(len);
+  if (reader()) {
+    put(s, len > 0 ? len : 0);
+    return *this;
+  }
+
+  if (len < 0) {
+    s = NULL;
+    return *this;
+  }
+  char *t = sf_charalloc(len + 1);
+  get(t, len);
+  t[len] = '\0';
+  s = t;
+  return *this;
+}
+
+ParamBcast &ParamBcast::operator()(std::vector<int> &v) {
+  int n = v.size();
+  (*this)(n);
+  v.resize(n);
+  reader() ? put(v.empty() ? NULL : &v[0], n * sizeof(int)) : get(v.empty() ? NULL : &v[0], n * sizeof(int));
+  return *this;
+}
+
+ParamBcast &ParamBcast::operator()(std::vector<float> &v) {
+  int n = v.size();
+  (*this)(n);
+  v.resize(n);
+  reader() ? put(v.empty() ? NULL : &v[0], n * sizeof(float)) : get(v.empty() ? NULL : &v[0], n * sizeof(float));
+  return *this;
+}
+
+void ParamBcast::bcast() {
+  long n = buf.size();
+  MPI_Bcast(&n, 1, MPI_LONG, root, comm);
+  buf.resize(n);
+  if (n > 0) {
+    MPI_Bcast(&buf[0], n, MPI_CHAR, root, comm);
+  }
+  pos = 0;
+}
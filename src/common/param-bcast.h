@@ -0,0 +1,63 @@
+/*
+ * param-bcast.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_PARAM_BCAST_H_
+#define SRC_COMMON_PARAM_BCAST_H_
+
+#include <vector>
+#include <mpi.h>
+
+/**
+ * the parameters of a tool parsed once and broadcast: only the reader opens
+ * the rsf headers of the inputs and creates the outputs, the other ranks get
+ * the fields in one broadcast instead of all of them hitting the file system
+ * at startup. The Params of a tool lists its fields in
+ *
+ *   void share(ParamBcast &pb) { pb(nz)(nx)(dt)(fdcoef)(fhis); }
+ *
+ * which packs them on the reader and unpacks them on the others, in the same
+ * order. The sf_file fields are not shared, they stay NULL off the reader
+ */
+class ParamBcast {
+public:
+  explicit ParamBcast(MPI_Comm comm, int root = 0);
+
+  /// the rank which parses the parameters and writes the outputs
+  bool reader() const;
+
+  ParamBcast &operator()(int &v);
+  ParamBcast &operator()(float &v);
+  ParamBcast &operator()(const char *&s);   /// NULL stays NULL
+  ParamBcast &operator()(std::vector<int> &v);
+  ParamBcast &operator()(std::vector<float> &v);
+
+  /// params.share(*this) on the reader, the broadcast, then on the others
+  template <class T>
+  void sync(T &params) {
+    if (reader()) {
+      params.share(*this);
+    }
+    bcast();
+    if (!reader()) {
+      params.share(*this);
+    }
+  }
+
+private:
+  void put(const void *p, size_t n);
+  void get(void *p, size_t n);
+  void bcast();
+
+private:
+  MPI_Comm comm;
+  int root;
+  int rank;
+  std::vector<char> buf;
+  size_t pos;           /// of the next field to unpack
+};
+
+#endif /* SRC_COMMON_PARAM_BCAST_H_ */
@@ -1,8 +1,13 @@
+extern "C" {
+#include <rsf.h>
+}
+
 #include "random-code.h"
 #include "logger.h"
 #include <numeric>
 RandomCodes::RandomCodes(int seed) :
-  generator(seed), codes_gen(generator, distribution_type(0, 1)), codes(&codes_gen)
+  generator(seed), codes_gen(generator, distribution_type(0, 1)), codes(&codes_gen),
+  seed(seed), ndraws(0)
 {
 
 }
@@ -11,9 +16,28 @@ RandomCodes::RandomCodes(int seed) :
  * return -1 or +1
  */
 int RandomCodes::nextRand() {
+  ndraws++;
   return *codes++ * 2 - 1;
 }
 
+void RandomCodes::saveState(CheckpointData &ckpt, const std::string &key) const {
+  ckpt.putValue(key + ".seed", seed);
+  ckpt.putValue(key + ".ndraws", ndraws);
+}
+
+void RandomCodes::loadState(const CheckpointData &ckpt, const std::string &key) {
+  if (ckpt.getValue<int>(key + ".seed") != seed) {
+    sf_error("%s of the checkpoint has another seed", key.c_str());
+  }
+  long n = ckpt.getValue<long>(key + ".ndraws");
+  generator.seed(seed);
+  codes = boost::generator_iterator<gen_type>(&codes_gen);
+  ndraws = 0;
+  for (long i = 0; i < n; i++) {
+    nextRand();
+  }
+}
+
 std::vector<int> RandomCodes::genPlus1Minus1(int nshots) {
 	if(nshots % 2 != 0) {
 		printf("Error! nshots must be an even number");
@@ -13,6 +13,8 @@
 #include <boost/random/variate_generator.hpp>
 #include <boost/generator_iterator.hpp>
 #include <vector>
+#include <string>
+#include "checkpoint.h"
 
 // This is a typedef for a random number generator.
 typedef boost::minstd_rand base_generator_type;
@@ -27,9 +29,15 @@ public:
   std::vector<int> genPlus1Minus1(int nshots);
   int nextRand();
 
+  /// the codes drawn so far, loadState draws them again from the seed
+  void saveState(CheckpointData &ckpt, const std::string &key) const;
+  void loadState(const CheckpointData &ckpt, const std::string &key);
+
 private:
   base_generator_type generator;
   gen_type codes_gen;
   boost::generator_iterator<gen_type> codes;
+  int seed;
+  long ndraws;
 };
 #endif /* SRC_FWI_RANDOM_CODE_H_ */
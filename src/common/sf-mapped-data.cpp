@@ -0,0 +1,75 @@
+/*
+ * sf-mapped-data.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "sf-mapped-data.h"
+#include "logger.h"
+
+SfMappedData::SfMappedData(sf_file file) : addr(NULL), bytes(0) {
+  if (sf_gettype(file) != SF_FLOAT || sf_getform(file) != SF_NATIVE) {
+    return;
+  }
+
+  /// the header and the payload of in=stdin share the stream
+  char *in = sf_histstring(file, "in");
+  bool stdinData = in == NULL || strcmp(in, "stdin") == 0;
+  free(in);
+  FILE *fp = sf_filestream(file);
+  if (stdinData || fp == NULL) {
+    return;
+  }
+
+  off_t len = sf_bytes(file);
+  if (len <= 0) {
+    return;
+  }
+
+  void *p = mmap(NULL, len, PROT_READ, MAP_SHARED, fileno(fp), 0);
+  if (p == MAP_FAILED) {
+    DEBUG() << "cannot map the rsf payload, it is read through the stream";
+    return;
+  }
+  addr = p;
+  bytes = len;
+}
+
+SfMappedData::~SfMappedData() {
+  if (addr) {
+    munmap(addr, bytes);
+  }
+}
+
+bool SfMappedData::mapped() const {
+  return addr != NULL;
+}
+
+const float *SfMappedData::data() const {
+  return static_cast<const float *>(addr);
+}
+
+size_t SfMappedData::size() const {
+  return bytes / sizeof(float);
+}
+
+void SfMappedData::adviseSequential() const {
+  if (addr) {
+    madvise(addr, bytes, MADV_SEQUENTIAL);
+  }
+}
+
+void SfMappedData::drop(size_t n) const {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t len = std::min(n * sizeof(float), bytes) / page * page;
+  if (addr && len > 0) {
+    madvise(addr, len, MADV_DONTNEED);
+  }
+}
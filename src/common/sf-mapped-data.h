@@ -0,0 +1,47 @@
+/*
+ * sf-mapped-data.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_SF_MAPPED_DATA_H_
+#define SRC_COMMON_SF_MAPPED_DATA_H_
+
+extern "C" {
+#include <rsf.h>
+}
+#include <cstddef>
+
+/**
+ * the native float payload of an rsf input mapped read only, the readers
+ * take the samples straight from the page cache instead of through the
+ * stdio buffer and a vector of their own. The payload of a pipe, of
+ * in=stdin or in ascii or xdr cannot be mapped, mapped() is false and the
+ * readers go on with sf_floatread
+ */
+class SfMappedData {
+public:
+  explicit SfMappedData(sf_file file);
+  ~SfMappedData();
+
+  bool mapped() const;
+  const float *data() const;  /// the first sample of the payload
+  size_t size() const;        /// samples in the payload
+
+  /// the pages are read ahead in order, the payload is walked once
+  void adviseSequential() const;
+
+  /// the pages before sample n are not read again
+  void drop(size_t n) const;
+
+private:
+  SfMappedData(const SfMappedData &);
+  SfMappedData &operator=(const SfMappedData &);
+
+private:
+  void *addr;
+  size_t bytes;
+};
+
+#endif /* SRC_COMMON_SF_MAPPED_DATA_H_ */
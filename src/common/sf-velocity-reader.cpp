@@ -6,10 +6,29 @@
  */
 
 #include <mpi.h>
+#include <algorithm>
 #include "sf-velocity-reader.h"
+#include "sf-mapped-data.h"
 
 #include "logger.h"
 
+namespace {
+
+/// sf_floatread from the mapped payload when it can be mapped, the stream moves on the same
+void floatread(float *vv, size_t count, sf_file file) {
+  SfMappedData map(file);
+  off_t pos = sf_tell(file);
+  if (map.mapped() && pos % sizeof(float) == 0 && pos / sizeof(float) + count <= map.size()) {
+    const float *p = map.data() + pos / sizeof(float);
+    std::copy(p, p + count, vv);
+    sf_seek(file, count * sizeof(float), SEEK_CUR);
+    return;
+  }
+  sf_floatread(vv, count, file);
+}
+
+} /// end of name space
+
 SfVelocityReader::SfVelocityReader(sf_file& f) : file(f) {
 }
 
@@ -18,7 +37,7 @@ void SfVelocityReader::readAndBcast(float* vv, size_t count,
 {
   if (rank == 0) {
     INFO() << format("rank %d is reading velocity") % rank;
-    sf_floatread(vv, count, file);
+    floatread(vv, count, file);
   }
 
   // broadcast the velocity
@@ -31,13 +50,26 @@ void SfVelocityReader::readAndBcast(float* vv, size_t count,
 
 void SfVelocityReader::read(float* vv, size_t count) {
   INFO() << "reading velocity";
-  sf_floatread(vv, count, file);
+  floatread(vv, count, file);
 }
 
 Velocity SfVelocityReader::read(sf_file file, int nx, int nz) {
   Velocity v(nx, nz);
   sf_seek(file, 0, SEEK_SET);
-  sf_floatread(&v.dat[0], nx * nz, file);
+  floatread(&v.dat[0], nx * nz, file);
+
+  return v;
+}
+
+Velocity SfVelocityReader::bcastRead(sf_file file, int nx, int nz) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  Velocity v(nx, nz);
+  if (rank == 0) {
+    v = read(file, nx, nz);
+  }
+  MPI_Bcast(&v.dat[0], nx * nz, MPI_FLOAT, 0, MPI_COMM_WORLD);
 
   return v;
 }
@@ -18,6 +18,9 @@ class SfVelocityReader {
 public:
   static Velocity read(sf_file file, int nx, int nz);
 
+  /// read on rank 0 of MPI_COMM_WORLD, the only rank with file open
+  static Velocity bcastRead(sf_file file, int nx, int nz);
+
 public:
   SfVelocityReader(sf_file &f);
   void readAndBcast(float *vv, size_t count, int rank);
@@ -33,6 +33,19 @@ void sfFloatWrite2d(const char *fn, const float *dat, int n1, int n2,
   sf_floatwrite(const_cast<float *>(dat), n1 * n2, f);
 }
 
+/// all the n floats of the rsf file fn, whatever its dimensions
+std::vector<float> sfFloatRead(const char *fn, int n) {
+  sf_file f = sf_input(fn);
+  off_t bytes = sf_bytes(f);
+  if (bytes != (off_t)(n * sizeof(float))) {
+    sf_error("%s holds %d floats instead of %d", fn, (int)(bytes / (off_t)sizeof(float)), n);
+  }
+  std::vector<float> dat(n);
+  sf_floatread(&dat[0], n, f);
+  sf_fileclose(f);
+  return dat;
+}
+
 void sfDoubleWrite2d(const char *fn, const double *dat, int n1, int n2,
     float d1, float d2, float o1, float o2) {
   sf_file f = sf_output(fn);
@@ -10,10 +10,14 @@
 #ifndef SRC_UTIL_SFUTIL_H_
 #define SRC_UTIL_SFUTIL_H_
 
+#include <vector>
+
 void sfFloatWrite1d(const char *fn, const float *dat, int n1, float d1 = 1, float o1 = 0);
 void sfFloatWrite2d(const char *fn, const float *dat, int n1, int n2,
     float d1 = 1, float d2 = 1, float o1 = 0, float o2 = 0);
 
+std::vector<float> sfFloatRead(const char *fn, int n);
+
 void sfDoubleWrite2d(const char *fn, const double *dat, int n1, int n2,
     float d1 = 1, float d2 = 1, float o1 = 0, float o2 = 0);
 #endif /* SRC_UTIL_SFUTIL_H_ */
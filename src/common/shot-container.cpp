@@ -0,0 +1,596 @@
+/*
+ * shot-container.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C" {
+#include <rsf.h>
+}
+
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "shot-container.h"
+#include "logger.h"
+
+namespace {
+
+const char MAGIC[8] = { 'S', 'S', 'S', 'H', 'O', 'T', '0', '1' };
+const char INDEX_MAGIC[8] = { 'S', 'S', 'S', 'I', 'D', 'X', '0', '1' };
+const size_t HEADER_BYTES = 8 + 4 + 4 + 4 + 4;
+const size_t FOOTER_BYTES = 8 + 8 + 8 + 8;
+
+/// FNV-1a, of the traces and of the tables of the chunks
+uint32_t fnv32(const unsigned char *p, size_t n) {
+  uint32_t h = 2166136261U;
+  for (size_t i = 0; i < n; i++) {
+    h = (h ^ p[i]) * 16777619U;
+  }
+  return h;
+}
+
+uint64_t fnv64(const void *p, size_t n) {
+  const unsigned char *c = static_cast<const unsigned char *>(p);
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < n; i++) {
+    h = (h ^ c[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+template <typename T>
+void put(std::vector<char> &b, const T &v) {
+  const char *c = reinterpret_cast<const char *>(&v);
+  b.insert(b.end(), c, c + sizeof(T));
+}
+
+/// the fields of a blob in order, false once it is exhausted
+class Unpacker {
+public:
+  Unpacker(const char *_p, size_t _n) : p(_p), n(_n), pos(0), good(true) {}
+
+  template <typename T>
+  void get(T &v) {
+    good = good && pos + sizeof(T) <= n;
+    if (good) {
+      memcpy(&v, p + pos, sizeof(T));
+      pos += sizeof(T);
+    }
+  }
+
+  const char *p;
+  size_t n;
+  size_t pos;
+  bool good;
+};
+
+void putVarint(std::vector<unsigned char> &b, uint64_t v) {
+  while (v >= 0x80) {
+    b.push_back((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  b.push_back(v);
+}
+
+/// NULL past end
+const unsigned char *getVarint(const unsigned char *p, const unsigned char *end, uint64_t &v) {
+  v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    uint64_t c = *p++;
+    v |= (c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+void encodeTrace(const float *x, int nt, int codec, float tol, std::vector<unsigned char> &b) {
+  if (codec == SHOT_RAW) {
+    const unsigned char *c = reinterpret_cast<const unsigned char *>(x);
+    b.insert(b.end(), c, c + nt * sizeof(float));
+  } else if (codec == SHOT_LOSSLESS) {
+    uint32_t prev = 0;
+    for (int it = 0; it < nt; it++) {
+      uint32_t bits;
+      memcpy(&bits, &x[it], sizeof(bits));
+      putVarint(b, bits ^ prev);
+      prev = bits;
+    }
+  } else {
+    double step = 2.0 * tol;
+    int64_t prev = 0;
+    for (int it = 0; it < nt; it++) {
+      double q = x[it] / step;
+      if (!(std::fabs(q) < 4.0e18)) {
+        sf_error("the sample %g is out of the range of tol %g", x[it], tol);
+      }
+      int64_t qi = llrint(q);
+      int64_t d = qi - prev;
+      putVarint(b, ((uint64_t)d << 1) ^ (uint64_t)(d >> 63));  /// zigzag
+      prev = qi;
+    }
+  }
+}
+
+/// the samples [itbeg, itend) of a trace, false if it is broken
+bool decodeTrace(const unsigned char *p, size_t n, int codec, float tol, int nt, int itbeg, int itend, float *out) {
+  const unsigned char *end = p + n;
+  if (codec == SHOT_RAW) {
+    if (n != nt * sizeof(float)) {
+      return false;
+    }
+    memcpy(out, p + itbeg * sizeof(float), (itend - itbeg) * sizeof(float));
+    return true;
+  }
+
+  if (codec == SHOT_LOSSLESS) {
+    uint32_t prev = 0;
+    for (int it = 0; it < itend; it++) {
+      uint64_t v;
+      if ((p = getVarint(p, end, v)) == NULL) {
+        return false;
+      }
+      prev ^= (uint32_t)v;
+      if (it >= itbeg) {
+        memcpy(&out[it - itbeg], &prev, sizeof(prev));
+      }
+    }
+    return true;
+  }
+
+  if (codec == SHOT_BOUNDED) {
+    double step = 2.0 * tol;
+    int64_t prev = 0;
+    for (int it = 0; it < itend; it++) {
+      uint64_t v;
+      if ((p = getVarint(p, end, v)) == NULL) {
+        return false;
+      }
+      prev += (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+      if (it >= itbeg) {
+        out[it - itbeg] = prev * step;
+      }
+    }
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * the chunk of a gather: the end offset of each trace in the payload, the
+ * checksum of each trace, the traces. The checksum of the table of ends and
+ * checksums goes to the index
+ */
+uint64_t encodeChunk(const float *gather, int nt, int ng, int codec, float tol, std::vector<char> &chunk) {
+  std::vector<uint64_t> ends(ng);
+  std::vector<uint32_t> hashes(ng);
+  std::vector<unsigned char> payload;
+  std::vector<unsigned char> trace;
+  payload.reserve(codec == SHOT_RAW ? (size_t)nt * ng * sizeof(float) : (size_t)nt * ng * 2);
+  for (int ig = 0; ig < ng; ig++) {
+    trace.clear();
+    encodeTrace(gather + (size_t)ig * nt, nt, codec, tol, trace);
+    hashes[ig] = fnv32(trace.empty() ? NULL : &trace[0], trace.size());
+    payload.insert(payload.end(), trace.begin(), trace.end());
+    ends[ig] = payload.size();
+  }
+
+  chunk.clear();
+  for (int ig = 0; ig < ng; ig++) {
+    put(chunk, ends[ig]);
+  }
+  for (int ig = 0; ig < ng; ig++) {
+    put(chunk, hashes[ig]);
+  }
+  uint64_t tableHash = fnv64(chunk.empty() ? NULL : &chunk[0], chunk.size());
+  chunk.insert(chunk.end(), payload.begin(), payload.end());
+  return tableHash;
+}
+
+size_t tableBytes(int ng) {
+  return (size_t)ng * (sizeof(uint64_t) + sizeof(uint32_t));
+}
+
+} /// end of name space
+
+ShotContainerWriter::ShotContainerWriter(MPI_Comm _comm, const char *_path, int _ns, int _nt, float dt,
+    int _codec, float _tol, int _root) :
+  comm(_comm), rank(0), root(_root), path(_path), fd(-1), ns(_ns), nt(_nt), codec(_codec), tol(_tol),
+  end(HEADER_BYTES), opened(false)
+{
+  if (codec < SHOT_RAW || codec > SHOT_BOUNDED) {
+    sf_error("unknown codec %d of the shot container", codec);
+  }
+  if (codec == SHOT_BOUNDED && !(tol > 0)) {
+    sf_error("the bounded codec of the shot container needs tol > 0, not %g", tol);
+  }
+  if (comm != MPI_COMM_NULL) {
+    MPI_Comm_rank(comm, &rank);
+  }
+
+  /// root creates the file and its header, then the others open it
+  if (rank == root) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      sf_error("cannot create %s: %s", path.c_str(), strerror(errno));
+    }
+    std::vector<char> head(MAGIC, MAGIC + sizeof(MAGIC));
+    int32_t reserved = 0;
+    put(head, (int32_t)ns);
+    put(head, (int32_t)nt);
+    put(head, dt);
+    put(head, reserved);
+    writeAt(0, &head[0], head.size());
+  }
+  if (comm != MPI_COMM_NULL) {
+    MPI_Barrier(comm);
+  }
+  if (rank != root) {
+    fd = open(path.c_str(), O_WRONLY);
+    if (fd < 0) {
+      sf_error("cannot open %s: %s", path.c_str(), strerror(errno));
+    }
+  }
+  opened = true;
+}
+
+ShotContainerWriter::~ShotContainerWriter() {
+  close();
+}
+
+void ShotContainerWriter::writeAt(uint64_t offset, const void *p, size_t bytes) {
+  const char *c = static_cast<const char *>(p);
+  while (bytes > 0) {
+    ssize_t n = pwrite(fd, c, bytes, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      sf_error("cannot write %s: %s", path.c_str(), strerror(errno));
+    }
+    c += n;
+    offset += n;
+    bytes -= n;
+  }
+}
+
+void ShotContainerWriter::write(int is, const float *gather, const ShotGeometry &geo) {
+  if (is < 0 || is >= ns) {
+    sf_error("shot %d is out of the %d shots of %s", is, ns, path.c_str());
+  }
+
+  std::vector<char> chunk;
+  Entry e;
+  e.is = is;
+  e.tableHash = encodeChunk(gather, nt, geo.ng(), codec, tol, chunk);
+  e.bytes = chunk.size();
+  e.geo = geo;
+
+  if (comm == MPI_COMM_NULL) {
+    e.offset = end;
+    if (!chunk.empty()) {
+      writeAt(end, &chunk[0], chunk.size());
+    }
+    end += chunk.size();
+  } else {
+    e.offset = pending.size();
+    pending.insert(pending.end(), chunk.begin(), chunk.end());
+  }
+  entries.push_back(e);
+
+  DEBUG() << format("shot %d of %s: %.1f KB of %.1f KB") % is % path % (e.bytes / 1e3) % ((double)nt * geo.ng() * sizeof(float) / 1e3);
+}
+
+void ShotContainerWriter::close() {
+  if (!opened) {
+    return;
+  }
+  opened = false;
+
+  /// the chunks of the ranks one after the other, in the order of the ranks
+  uint64_t total = end;
+  if (comm != MPI_COMM_NULL) {
+    unsigned long long mine = pending.size();
+    unsigned long long base = 0;
+    unsigned long long all = 0;
+    MPI_Exscan(&mine, &base, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+    MPI_Allreduce(&mine, &all, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) {
+      base = 0;   /// undefined from MPI_Exscan
+    }
+    if (!pending.empty()) {
+      writeAt(HEADER_BYTES + base, &pending[0], pending.size());
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+      entries[i].offset += HEADER_BYTES + base;
+    }
+    std::vector<char>().swap(pending);
+    total = HEADER_BYTES + all;
+  }
+
+  /// the index entries of this rank, is first
+  std::vector<char> local;
+  for (size_t i = 0; i < entries.size(); i++) {
+    const Entry &e = entries[i];
+    put(local, (int32_t)e.is);
+    put(local, e.offset);
+    put(local, e.bytes);
+    put(local, e.tableHash);
+    put(local, (int32_t)codec);
+    put(local, tol);
+    put(local, e.geo.sz);
+    put(local, e.geo.sx);
+    put(local, (int32_t)e.geo.ng());
+    for (size_t k = 0; k < e.geo.geozx.size(); k++) {
+      put(local, e.geo.geozx[k]);
+    }
+  }
+  std::vector<Entry>().swap(entries);
+
+  std::vector<char> gathered;
+  if (comm == MPI_COMM_NULL) {
+    gathered.swap(local);
+  } else {
+    int nranks = 1;
+    MPI_Comm_size(comm, &nranks);
+    int n = local.size();
+    std::vector<int> counts(nranks);
+    std::vector<int> displs(nranks);
+    MPI_Gather(&n, 1, MPI_INT, &counts[0], 1, MPI_INT, root, comm);
+    if (rank == root) {
+      for (int i = 1; i < nranks; i++) {
+        displs[i] = displs[i - 1] + counts[i - 1];
+      }
+      gathered.resize(displs[nranks - 1] + counts[nranks - 1] + 1);
+    }
+    local.push_back(0);
+    MPI_Gatherv(&local[0], n, MPI_CHAR, rank == root ? &gathered[0] : NULL, &counts[0], &displs[0], MPI_CHAR, root, comm);
+    if (rank == root) {
+      gathered.pop_back();
+    }
+  }
+
+  if (rank == root) {
+    /// the entries in the order of the shots, those never written with no traces
+    std::vector<std::vector<char> > records(ns);
+    Unpacker u(gathered.empty() ? NULL : &gathered[0], gathered.size());
+    while (u.pos < u.n) {
+      int32_t is = 0;
+      u.get(is);
+      size_t from = u.pos;
+      uint64_t skip;
+      int32_t i32, ng = 0;
+      float f;
+      u.get(skip); u.get(skip); u.get(skip);
+      u.get(i32); u.get(f); u.get(f); u.get(f);
+      u.get(ng);
+      u.pos += (size_t)ng * 2 * sizeof(float);
+      records[is].assign(gathered.begin() + from, gathered.begin() + u.pos);
+    }
+
+    std::vector<char> index;
+    for (int is = 0; is < ns; is++) {
+      if (records[is].empty()) {
+        put(index, (uint64_t)0); put(index, (uint64_t)0); put(index, (uint64_t)0);
+        put(index, (int32_t)SHOT_RAW); put(index, 0.0f); put(index, 0.0f); put(index, 0.0f);
+        put(index, (int32_t)0);
+      } else {
+        index.insert(index.end(), records[is].begin(), records[is].end());
+      }
+    }
+
+    std::vector<char> foot;
+    put(foot, total);
+    put(foot, (uint64_t)index.size());
+    put(foot, fnv64(index.empty() ? NULL : &index[0], index.size()));
+    foot.insert(foot.end(), INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+    index.insert(index.end(), foot.begin(), foot.end());
+    writeAt(total, &index[0], index.size());
+    if (ftruncate(fd, total + index.size()) != 0 || fsync(fd) != 0) {
+      sf_error("cannot finish %s: %s", path.c_str(), strerror(errno));
+    }
+    INFO() << format("%s: %d shots, %.1f MB") % path % ns % ((total + index.size()) / 1e6);
+  }
+
+  ::close(fd);
+  fd = -1;
+  if (comm != MPI_COMM_NULL) {
+    MPI_Barrier(comm);
+  }
+}
+
+ShotContainerReader::ShotContainerReader(const char *_path) : path(_path), fd(-1), ns(0), nt(0), dt(0) {
+  fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    sf_error("cannot open %s: %s", path.c_str(), strerror(errno));
+  }
+
+  char head[HEADER_BYTES];
+  readAt(0, head, sizeof(head));
+  if (memcmp(head, MAGIC, sizeof(MAGIC)) != 0) {
+    sf_error("%s is not a shot container", path.c_str());
+  }
+  Unpacker h(head + sizeof(MAGIC), sizeof(head) - sizeof(MAGIC));
+  int32_t n3, n1;
+  h.get(n3);
+  h.get(n1);
+  h.get(dt);
+  ns = n3;
+  nt = n1;
+
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (size < (off_t)(HEADER_BYTES + FOOTER_BYTES)) {
+    sf_error("%s is truncated", path.c_str());
+  }
+  char foot[FOOTER_BYTES];
+  readAt(size - FOOTER_BYTES, foot, sizeof(foot));
+  Unpacker f(foot, sizeof(foot));
+  uint64_t at, bytes, hash;
+  f.get(at);
+  f.get(bytes);
+  f.get(hash);
+  if (memcmp(foot + 24, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || at + bytes + FOOTER_BYTES != (uint64_t)size) {
+    sf_error("%s has no index, it was not closed", path.c_str());
+  }
+
+  std::vector<char> index(bytes + 1);
+  readAt(at, &index[0], bytes);
+  if (fnv64(&index[0], bytes) != hash) {
+    sf_error("the index of %s is broken", path.c_str());
+  }
+
+  entries.resize(ns);
+  geos.resize(ns);
+  Unpacker u(&index[0], bytes);
+  for (int is = 0; is < ns; is++) {
+    Entry &e = entries[is];
+    ShotGeometry &g = geos[is];
+    int32_t codec = SHOT_RAW, ng = 0;
+    u.get(e.offset);
+    u.get(e.bytes);
+    u.get(e.tableHash);
+    u.get(codec);
+    u.get(e.tol);
+    u.get(g.sz);
+    u.get(g.sx);
+    u.get(ng);
+    e.codec = codec;
+    g.geozx.resize(u.good && ng > 0 ? 2 * ng : 0);
+    for (size_t k = 0; k < g.geozx.size(); k++) {
+      u.get(g.geozx[k]);
+    }
+    if (!u.good || e.offset + e.bytes > at) {
+      sf_error("the index of %s is broken at shot %d", path.c_str(), is);
+    }
+  }
+}
+
+ShotContainerReader::~ShotContainerReader() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+int ShotContainerReader::getns() const {
+  return ns;
+}
+
+int ShotContainerReader::getnt() const {
+  return nt;
+}
+
+float ShotContainerReader::getdt() const {
+  return dt;
+}
+
+int ShotContainerReader::getng(int is) const {
+  return geometry(is).ng();
+}
+
+const ShotGeometry &ShotContainerReader::geometry(int is) const {
+  if (is < 0 || is >= ns) {
+    sf_error("shot %d is out of the %d shots of %s", is, ns, path.c_str());
+  }
+  return geos[is];
+}
+
+void ShotContainerReader::readAt(uint64_t offset, void *p, size_t bytes) const {
+  char *c = static_cast<char *>(p);
+  while (bytes > 0) {
+    ssize_t n = pread(fd, c, bytes, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      sf_error("cannot read %s: %s", path.c_str(), n < 0 ? strerror(errno) : "truncated");
+    }
+    c += n;
+    offset += n;
+    bytes -= n;
+  }
+}
+
+void ShotContainerReader::readTable(int is, std::vector<uint64_t> &ends, std::vector<uint32_t> &hashes) const {
+  int ng = getng(is);
+  const Entry &e = entries[is];
+  std::vector<char> table(tableBytes(ng) + 1);
+  if (e.bytes < tableBytes(ng)) {
+    sf_error("shot %d is not in %s", is, path.c_str());
+  }
+  readAt(e.offset, &table[0], tableBytes(ng));
+  if (fnv64(&table[0], tableBytes(ng)) != e.tableHash) {
+    sf_error("the chunk of shot %d in %s is broken", is, path.c_str());
+  }
+
+  ends.resize(ng);
+  hashes.resize(ng);
+  Unpacker u(&table[0], tableBytes(ng));
+  for (int ig = 0; ig < ng; ig++) {
+    u.get(ends[ig]);
+  }
+  for (int ig = 0; ig < ng; ig++) {
+    u.get(hashes[ig]);
+  }
+  for (int ig = 0; ig < ng; ig++) {
+    if (ends[ig] < (ig > 0 ? ends[ig - 1] : 0) || tableBytes(ng) + ends[ig] > e.bytes) {
+      sf_error("the chunk of shot %d in %s is broken", is, path.c_str());
+    }
+  }
+}
+
+void ShotContainerReader::read(int is, float *gather) const {
+  std::vector<int> traces(getng(is));
+  for (size_t ig = 0; ig < traces.size(); ig++) {
+    traces[ig] = ig;
+  }
+  read(is, gather, 0, nt, traces);
+}
+
+void ShotContainerReader::read(int is, float *gather, int itbeg, int itend, const std::vector<int> &traces) const {
+  int ng = getng(is);
+  if (!(0 <= itbeg && itbeg <= itend && itend <= nt)) {
+    sf_error("the window [%d, %d) is out of the %d samples of %s", itbeg, itend, nt, path.c_str());
+  }
+
+  std::vector<uint64_t> ends;
+  std::vector<uint32_t> hashes;
+  readTable(is, ends, hashes);
+
+  /// all the traces in one read, a subset trace by trace
+  const Entry &e = entries[is];
+  uint64_t payload = e.offset + tableBytes(ng);
+  bool all = (int)traces.size() == ng;
+  std::vector<unsigned char> buf;
+  if (all && ng > 0) {
+    buf.resize(ends[ng - 1] + 1);
+    readAt(payload, &buf[0], ends[ng - 1]);
+  }
+
+  int nw = itend - itbeg;
+  std::vector<unsigned char> one;
+  for (size_t j = 0; j < traces.size(); j++) {
+    int ig = traces[j];
+    if (ig < 0 || ig >= ng) {
+      sf_error("trace %d is out of the %d traces of shot %d in %s", ig, ng, is, path.c_str());
+    }
+    uint64_t from = ig > 0 ? ends[ig - 1] : 0;
+    uint64_t n = ends[ig] - from;
+    const unsigned char *p;
+    if (all) {
+      p = &buf[from];
+    } else {
+      one.resize(n + 1);
+      readAt(payload + from, &one[0], n);
+      p = &one[0];
+    }
+    if (fnv32(p, n) != hashes[ig] || !decodeTrace(p, n, e.codec, e.tol, nt, itbeg, itend, gather + j * (size_t)nw)) {
+      sf_error("trace %d of shot %d in %s is broken", ig, is, path.c_str());
+    }
+  }
+}
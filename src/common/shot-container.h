@@ -0,0 +1,150 @@
+/*
+ * shot-container.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_SHOT_CONTAINER_H_
+#define SRC_COMMON_SHOT_CONTAINER_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <mpi.h>
+
+/**
+ * the gathers of a survey in one file, a chunk per shot:
+ *
+ *   header   magic SSSHOT01, ns, nt, dt
+ *   chunks   of each shot, the end offset and checksum of each trace,
+ *            then the traces, each compressed on its own
+ *   index    of each shot the offset, size, codec and checksum of its
+ *            chunk, the (z, x) of the source and of its ng receivers
+ *   footer   offset, size and checksum of the index, magic SSSIDX01
+ *
+ * so a shot is one seek through the index, a receiver subset reads only
+ * its traces and a time window decodes only up to its end. The receivers
+ * of each shot are its own, ng may change from shot to shot. The positions
+ * are in grid points, as the srcfile and geofile of the tools
+ */
+enum ShotCodec {
+  SHOT_RAW = 0,         /// the floats as they are
+  SHOT_LOSSLESS = 1,    /// each sample xor the previous one of the trace, as varints
+  SHOT_BOUNDED = 2      /// the samples on a grid of 2 * tol, differences as varints, error <= tol
+};
+
+/// the geometry of a shot, the receivers as (z, x) pairs
+struct ShotGeometry {
+  ShotGeometry() : sz(0), sx(0) {}
+
+  float sz;
+  float sx;
+  std::vector<float> geozx;
+
+  int ng() const { return geozx.size() / 2; }
+};
+
+/**
+ * writes the chunks of the shots as they are done, in any order. comm may
+ * be MPI_COMM_NULL for a single process, which writes each chunk through.
+ * On several ranks each rank keeps its chunks and close() writes all of
+ * them at offsets agreed on by the ranks, the index on root
+ */
+class ShotContainerWriter {
+public:
+  /// collective, tol is the error bound of SHOT_BOUNDED
+  ShotContainerWriter(MPI_Comm comm, const char *path, int ns, int nt, float dt,
+      int codec = SHOT_LOSSLESS, float tol = 0, int root = 0);
+
+  /// close()
+  ~ShotContainerWriter();
+
+  /// the gather of shot is, nt x geo.ng() with t running fastest
+  void write(int is, const float *gather, const ShotGeometry &geo);
+
+  /// collective, the file holds the index of all the shots written on any rank
+  void close();
+
+private:
+  ShotContainerWriter(const ShotContainerWriter &);
+  ShotContainerWriter &operator=(const ShotContainerWriter &);
+
+  void writeAt(uint64_t offset, const void *p, size_t bytes);
+
+  struct Entry {
+    int is;
+    uint64_t offset;              /// in pending until close() on several ranks
+    uint64_t bytes;
+    uint64_t tableHash;
+    ShotGeometry geo;
+  };
+
+private:
+  MPI_Comm comm;
+  int rank;
+  int root;
+  std::string path;
+  int fd;
+  int ns;
+  int nt;
+  int codec;
+  float tol;
+  uint64_t end;                   /// of the chunks written through
+  bool opened;
+
+  std::vector<Entry> entries;     /// the shots of this rank
+  std::vector<char> pending;      /// their chunks, several ranks only
+};
+
+/**
+ * the shots of a container, the index is read and checked on open, the
+ * chunks on each read. A broken checksum is an sf_error
+ */
+class ShotContainerReader {
+public:
+  explicit ShotContainerReader(const char *path);
+  ~ShotContainerReader();
+
+  int getns() const;
+  int getnt() const;
+  float getdt() const;
+  int getng(int is) const;
+  const ShotGeometry &geometry(int is) const;
+
+  /// the gather of shot is, nt x ng with t running fastest
+  void read(int is, float *gather) const;
+
+  /**
+   * the samples [itbeg, itend) of the traces of shot is, (itend - itbeg) x
+   * traces.size() with t running fastest. Only the chunk table and these
+   * traces are read
+   */
+  void read(int is, float *gather, int itbeg, int itend, const std::vector<int> &traces) const;
+
+private:
+  ShotContainerReader(const ShotContainerReader &);
+  ShotContainerReader &operator=(const ShotContainerReader &);
+
+  struct Entry {
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t tableHash;
+    int codec;
+    float tol;
+  };
+
+  void readAt(uint64_t offset, void *p, size_t bytes) const;
+  void readTable(int is, std::vector<uint64_t> &ends, std::vector<uint32_t> &hashes) const;
+
+private:
+  std::string path;
+  int fd;
+  int ns;
+  int nt;
+  float dt;
+  std::vector<Entry> entries;
+  std::vector<ShotGeometry> geos;
+};
+
+#endif /* SRC_COMMON_SHOT_CONTAINER_H_ */
@@ -7,6 +7,7 @@
 
 #include "shot-position.h"
 #include <algorithm>
+#include <cmath>
 
 ShotPosition::ShotPosition(int szbeg, int sxbeg, int jsz, int jsx, int _ns, int _nz) :
     ns(_ns), pos(_ns), nz(_nz)
@@ -19,6 +20,33 @@ ShotPosition::ShotPosition(int szbeg, int sxbeg, int jsz, int jsx, int _ns, int
   }
 }
 
+/**
+ * positions of ns points in grid units, zx holds (z, x) pairs. points off the
+ * grid nodes are injected and recorded with windowed sinc weights
+ */
+ShotPosition::ShotPosition(const std::vector<float> &zx, int _ns, int _nz) :
+    ns(_ns), pos(_ns), nz(_nz)
+{
+  bool onGrid = true;
+  for (int is = 0; is < ns; is++) {
+    onGrid = onGrid && zx[2 * is] == std::floor(zx[2 * is]) && zx[2 * is + 1] == std::floor(zx[2 * is + 1]);
+  }
+
+  if (!onGrid) {
+    fz.resize(ns);
+    fx.resize(ns);
+  }
+  for (int is = 0; is < ns; is++) {
+    int sz = std::floor(zx[2 * is]);
+    int sx = std::floor(zx[2 * is + 1]);
+    pos[is] = sz + nz * sx;
+    if (!onGrid) {
+      fz[is] = zx[2 * is] - sz;
+      fx[is] = zx[2 * is + 1] - sx;
+    }
+  }
+}
+
 int ShotPosition::getx(int idx) const {
   return pos[idx] / nz;
 }
@@ -28,6 +56,11 @@ ShotPosition ShotPosition::clipRange(int begin, int end) const {
   ret.ns = end - begin + 1;
   ret.pos.resize(ret.ns);
   std::copy(&pos[begin], &pos[end + 1], &ret.pos[0]);
+  if (offGrid()) {
+    ret.fz.assign(&fz[begin], &fz[end + 1]);
+    ret.fx.assign(&fx[begin], &fx[end + 1]);
+  }
+  ret.tableKey.clear();
 
   return ret;
 }
@@ -36,6 +69,64 @@ int ShotPosition::getz(int idx) const {
   return pos[idx] % nz;
 }
 
+/// fractional offsets from the node, 0 on the grid
+float ShotPosition::getfx(int idx) const {
+  return offGrid() ? fx[idx] : 0;
+}
+
+float ShotPosition::getfz(int idx) const {
+  return offGrid() ? fz[idx] : 0;
+}
+
 ShotPosition ShotPosition::clip(int idx) const {
   return clipRange(idx, idx);
 }
+
+/**
+ * positions on a grid coarsened by factor (see grid-coarsen.h), rounded to
+ * the nearest coarse node, off-grid points stay where they are
+ */
+ShotPosition ShotPosition::coarsen(int factor, int nxc, int nzc) const {
+  ShotPosition ret = *this;
+  ret.nz = nzc;
+  ret.tableKey.clear();
+  for (int is = 0; is < ns; is++) {
+    if (offGrid()) {
+      float x = std::min((getx(is) + fx[is]) / factor, nxc - 1.0f);
+      float z = std::min((getz(is) + fz[is]) / factor, nzc - 1.0f);
+      int sx = std::floor(x);
+      int sz = std::floor(z);
+      ret.pos[is] = sz + nzc * sx;
+      ret.fx[is] = x - sx;
+      ret.fz[is] = z - sz;
+      continue;
+    }
+    int sx = std::min((getx(is) + factor / 2) / factor, nxc - 1);
+    int sz = std::min((getz(is) + factor / 2) / factor, nzc - 1);
+    ret.pos[is] = sz + nzc * sx;
+  }
+
+  return ret;
+}
+
+bool ShotPosition::offGrid() const {
+  return !fx.empty();
+}
+
+const SpreadTable &ShotPosition::spreadTable(int nxpad, int nzpad, int bx0, int bz0) const {
+  int key[] = { nxpad, nzpad, bx0, bz0 };
+  if (tableKey.size() == 4 && std::equal(key, key + 4, tableKey.begin())) {
+    return table;
+  }
+
+  std::vector<int> ix(ns);
+  std::vector<int> iz(ns);
+  for (int is = 0; is < ns; is++) {
+    ix[is] = getx(is) + bx0;
+    iz[is] = getz(is) + bz0;
+  }
+  table.build(&ix[0], &iz[0], offGrid() ? &fx[0] : NULL, offGrid() ? &fz[0] : NULL, ns, nxpad, nzpad);
+  tableKey.assign(key, key + 4);
+
+  return table;
+}
@@ -9,21 +9,35 @@
 #define SRC_COMMON_SHOT_POSITION_H_
 
 #include <vector>
+#include "spread-table.h"
 
 class ShotPosition {
 public:
   ShotPosition(int szbeg, int sxbeg, int jsz, int jsx, int ns, int nz);
+  ShotPosition(const std::vector<float> &zx, int ns, int nz);
   ShotPosition clipRange(int begin, int end) const;
   ShotPosition clip(int idx) const;
+  ShotPosition coarsen(int factor, int nxc, int nzc) const;
   int getx(int idx) const;
   int getz(int idx) const;
+  float getfx(int idx) const;
+  float getfz(int idx) const;
+  bool offGrid() const;
+
+  /// built on first use for a padded grid, rebuilt when the padding changes
+  const SpreadTable &spreadTable(int nxpad, int nzpad, int bx0, int bz0) const;
 
 public:
   int ns;
 
 private:
   std::vector<int> pos;
+  std::vector<float> fz;    /// fractional offsets of off-grid points, empty on the grid
+  std::vector<float> fx;
   int nz;
+
+  mutable SpreadTable table;
+  mutable std::vector<int> tableKey;
 };
 
 #endif /* SRC_COMMON_SHOT_POSITION_H_ */
@@ -8,6 +8,8 @@
 #include <cstdio>
 #include <mpi.h>
 #include "shotdata-reader.h"
+#include "sf-mapped-data.h"
+#include "shot-container.h"
 #include "logger.h"
 #include "common.h"
 
@@ -54,6 +56,18 @@ void ShotDataReader::parallelRead(const char *datapath, float* dobs, int nshots,
 void ShotDataReader::serialRead(sf_file file, float* dobs, int nshots,
     int nt, int ng) {
 
+  /// each shot is transposed straight out of the page cache
+  size_t shotSize = (size_t)nt * ng;
+  SfMappedData map(file);
+  if (map.mapped() && map.size() >= nshots * shotSize) {
+    map.adviseSequential();
+    for (int is = 0; is < nshots; is++) {
+      matrix_transpose(map.data() + is * shotSize, &dobs[is * shotSize], nt, ng);
+      map.drop((is + 1) * shotSize);
+    }
+    return;
+  }
+
   sf_seek(file, 0, SEEK_SET);
   for (int is = 0; is < nshots; is++) {
     std::vector<float> trans(nt * ng);
@@ -63,6 +77,21 @@ void ShotDataReader::serialRead(sf_file file, float* dobs, int nshots,
   }
 }
 
+void ShotDataReader::bcastRead(sf_file file, float* dobs, int nshots,
+    int nt, int ng) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  if (rank == 0) {
+    serialRead(file, dobs, nshots, nt, ng);
+  }
+
+  /// shot by shot, the count of all of them may not fit an int
+  for (int is = 0; is < nshots; is++) {
+    MPI_Bcast(&dobs[(size_t)is * nt * ng], nt * ng, MPI_FLOAT, 0, MPI_COMM_WORLD);
+  }
+}
+
 void ShotDataReader::readAndEncode(sf_file file, const std::vector<int>& codes,
     float* dobs, int nshots, int nt, int ng)
 {
@@ -72,6 +101,23 @@ void ShotDataReader::readAndEncode(sf_file file, const std::vector<int>& codes,
   sf_seek(file, 0, SEEK_SET);
   std::fill(dobs, dobs + nt * ng, 0);
 
+  /// the shots are added up straight out of the page cache, dobs is ng * nt and the shots nt * ng
+  size_t shotSize = (size_t)nt * ng;
+  SfMappedData map(file);
+  if (map.mapped() && map.size() >= nshots * shotSize) {
+    map.adviseSequential();
+    for (int is = 0; is < nshots; is++) {
+      const float *shot = map.data() + is * shotSize;
+      for (int ig = 0; ig < ng; ig++) {
+        for (int it = 0; it < nt; it++) {
+          dobs[it * ng + ig] += shot[ig * nt + it] * codes[is];
+        }
+      }
+      map.drop((is + 1) * shotSize);
+    }
+    return;
+  }
+
   for (int is = 0; is < nshots; is++) {
     std::vector<float> trans(nt * ng);
     std::vector<float> tmp(nt * ng);
@@ -85,3 +131,32 @@ void ShotDataReader::readAndEncode(sf_file file, const std::vector<int>& codes,
     }
   }
 }
+
+void ShotDataReader::containerRead(const char *path, float *dobs, int nshots, int nt, int ng) {
+  ShotContainerReader reader(path);
+  if (reader.getns() < nshots || reader.getnt() != nt) {
+    sf_error("%s has %d shots of %d samples instead of %d of %d", path, reader.getns(), reader.getnt(), nshots, nt);
+  }
+
+  std::vector<float> trans((size_t)nt * ng);
+  for (int is = 0; is < nshots; is++) {
+    if (reader.getng(is) != ng) {
+      sf_error("shot %d of %s has %d receivers instead of %d", is, path, reader.getng(is), ng);
+    }
+    reader.read(is, &trans[0]);
+    matrix_transpose(&trans[0], &dobs[(size_t)is * trans.size()], nt, ng);
+  }
+}
+
+void ShotDataReader::bcastContainerRead(const char *path, float *dobs, int nshots, int nt, int ng) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  if (rank == 0) {
+    containerRead(path, dobs, nshots, nt, ng);
+  }
+
+  for (int is = 0; is < nshots; is++) {
+    MPI_Bcast(&dobs[(size_t)is * nt * ng], nt * ng, MPI_FLOAT, 0, MPI_COMM_WORLD);
+  }
+}
@@ -18,7 +18,16 @@ class ShotDataReader {
 public:
   static void parallelRead(const char *datapath, float *dobs, int nshots, int nt, int ng);
   static void serialRead(sf_file file, float *dobs, int nshots, int nt, int ng);
+
+  /// serialRead on rank 0 of MPI_COMM_WORLD, the only rank with file open
+  static void bcastRead(sf_file file, float *dobs, int nshots, int nt, int ng);
   static void readAndEncode(sf_file file, const std::vector<int> &codes, float *dobs, int nshots, int nt, int ng);
+
+  /// serialRead from a shot container, see ShotContainerReader, every shot with ng receivers
+  static void containerRead(const char *path, float *dobs, int nshots, int nt, int ng);
+
+  /// containerRead on rank 0 of MPI_COMM_WORLD, as bcastRead
+  static void bcastContainerRead(const char *path, float *dobs, int nshots, int nt, int ng);
 };
 
 #endif /* SRC_COMMON_SHOTDATA_READER_H_ */
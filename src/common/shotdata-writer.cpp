@@ -0,0 +1,71 @@
+/*
+ * shotdata-writer.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "shotdata-writer.h"
+#include "logger.h"
+
+ShotDataWriter::ShotDataWriter(MPI_Comm _comm, sf_file file, int _nt, int _ng, int ns, int root) :
+  comm(_comm), fh(MPI_FILE_NULL), nt(_nt), ng(_ng), opened(false)
+{
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+
+  /// the path of the binary, known before the header is flushed
+  std::vector<char> path;
+  if (rank == root) {
+    char *in = sf_histstring(file, "in");
+    if (in == NULL || strcmp(in, "stdout") == 0) {
+      sf_error("the ranks write the gathers at their offsets, the output cannot be a pipe");
+    }
+    sf_fileflush(file, NULL);
+    path.assign(in, in + strlen(in) + 1);
+    free(in);
+  }
+
+  int len = path.size();
+  MPI_Bcast(&len, 1, MPI_INT, root, comm);
+  path.resize(len);
+  MPI_Bcast(&path[0], len, MPI_CHAR, root, comm);
+
+  int err = MPI_File_open(comm, &path[0], MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh);
+  if (err != MPI_SUCCESS) {
+    char msg[MPI_MAX_ERROR_STRING];
+    int n;
+    MPI_Error_string(err, msg, &n);
+    sf_error("cannot open %s: %s", &path[0], msg);
+  }
+  MPI_File_set_size(fh, (MPI_Offset)ns * nt * ng * sizeof(float));
+  opened = true;
+
+  if (rank == root) {
+    INFO() << format("the ranks write the %d gathers into %s") % ns % &path[0];
+  }
+}
+
+ShotDataWriter::~ShotDataWriter() {
+  close();
+}
+
+void ShotDataWriter::write(int is, const float *gather) {
+  MPI_Offset offset = (MPI_Offset)is * nt * ng * sizeof(float);
+  MPI_Status status;
+  int err = MPI_File_write_at(fh, offset, const_cast<float *>(gather), nt * ng, MPI_FLOAT, &status);
+  if (err != MPI_SUCCESS) {
+    sf_error("cannot write the gather of shot %d", is);
+  }
+}
+
+void ShotDataWriter::close() {
+  if (!opened) {
+    return;
+  }
+  MPI_File_close(&fh);
+  opened = false;
+}
@@ -0,0 +1,49 @@
+/*
+ * shotdata-writer.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_SHOTDATA_WRITER_H_
+#define SRC_COMMON_SHOTDATA_WRITER_H_
+
+extern "C" {
+#include <rsf.h>
+}
+#include <mpi.h>
+
+/**
+ * the ns gathers of nt x ng floats of an rsf output, written by the ranks
+ * which model them. The root holds the file, flushes its header and
+ * creates the binary; then every rank opens the binary with MPI-IO
+ * and writes each gather at its own offset as soon as the gather is
+ * done, so the gathers do not pass through the root
+ */
+class ShotDataWriter {
+public:
+  /// collective, file is the output with its header complete on root, NULL on the others
+  ShotDataWriter(MPI_Comm comm, sf_file file, int nt, int ng, int ns, int root = 0);
+
+  /// close()
+  ~ShotDataWriter();
+
+  /// the gather of shot is, nt x ng with t running fastest
+  void write(int is, const float *gather);
+
+  /// collective, the file holds all the gathers written on any rank
+  void close();
+
+private:
+  ShotDataWriter(const ShotDataWriter &);
+  ShotDataWriter &operator=(const ShotDataWriter &);
+
+private:
+  MPI_Comm comm;
+  MPI_File fh;
+  int nt;
+  int ng;
+  bool opened;
+};
+
+#endif /* SRC_COMMON_SHOTDATA_WRITER_H_ */
@@ -0,0 +1,203 @@
+/*
+ * spread-table.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C" {
+#include <rsf.h>
+#include "mksinc.h"
+}
+
+#include <algorithm>
+#include "spread-table.h"
+
+namespace {
+
+/**
+ * the LSINC samples starting from *start interpolating node i + f, the window
+ * is shifted inside [0, n) and the weights falling outside are dropped
+ */
+void sincWindow(int i, float f, int n, int *start, float *w) {
+  const int LSINC = SpreadTable::LSINC;
+  float ws[LSINC];
+  mksinc(f, LSINC, ws);
+
+  int d0 = i - (LSINC / 2 - 1);
+  int s = std::max(0, std::min(d0, n - LSINC));
+  for (int k = 0; k < LSINC; k++) {
+    int j = s + k - d0;
+    w[k] = (j >= 0 && j < LSINC) ? ws[j] : 0;
+  }
+  *start = s;
+}
+
+class FirstOffsetLess {
+public:
+  FirstOffsetLess(const std::vector<int> &_col, int _ncol) : col(_col), ncol(_ncol) {}
+  bool operator()(int a, int b) const {
+    return col[a * ncol] < col[b * ncol];
+  }
+
+private:
+  const std::vector<int> &col;
+  int ncol;
+};
+
+} /// end of name space
+
+SpreadTable::SpreadTable() : npts(0), ncol(1), nlen(1) {
+}
+
+void SpreadTable::build(const int *ix, const int *iz, const float *fx, const float *fz,
+    int _npts, int nxpad, int nzpad) {
+  npts = _npts;
+  ncol = nlen = (fx != NULL || fz != NULL) ? LSINC : 1;
+
+  std::vector<int> c(npts * ncol);
+  std::vector<float> x(npts * ncol);
+  std::vector<float> z(npts * nlen);
+
+  for (int i = 0; i < npts; i++) {
+    if (ncol == 1) {
+      c[i] = ix[i] * nzpad + iz[i];
+      x[i] = z[i] = 1;
+      continue;
+    }
+
+    int x0, z0;
+    sincWindow(ix[i], fx ? fx[i] : 0, nxpad, &x0, &x[i * ncol]);
+    sincWindow(iz[i], fz ? fz[i] : 0, nzpad, &z0, &z[i * nlen]);
+    for (int k = 0; k < ncol; k++) {
+      c[i * ncol + k] = (x0 + k) * nzpad + z0;
+    }
+  }
+
+  trace.resize(npts);
+  for (int i = 0; i < npts; i++) {
+    trace[i] = i;
+  }
+  std::stable_sort(trace.begin(), trace.end(), FirstOffsetLess(c, ncol));
+
+  col.resize(npts * ncol);
+  wx.resize(npts * ncol);
+  wz.resize(npts * nlen);
+  for (int r = 0; r < npts; r++) {
+    int i = trace[r];
+    std::copy(&c[i * ncol], &c[i * ncol] + ncol, &col[r * ncol]);
+    std::copy(&x[i * ncol], &x[i * ncol] + ncol, &wx[r * ncol]);
+    std::copy(&z[i * nlen], &z[i * nlen] + nlen, &wz[r * nlen]);
+  }
+}
+
+void SpreadTable::inject(float *p, const float *amp, float sign) const {
+  for (int r = 0; r < npts; r++) {
+    float a = sign * amp[trace[r]];
+    const int *c = &col[r * ncol];
+    const float *x = &wx[r * ncol];
+    const float *z = &wz[r * nlen];
+    for (int j = 0; j < ncol; j++) {
+      float *q = p + c[j];
+      float ax = x[j] * a;
+      for (int k = 0; k < nlen; k++) {
+        q[k] += z[k] * ax;
+      }
+    }
+  }
+}
+
+void SpreadTable::inject(float *p, const float *amp, float sign, const float *scale) const {
+  for (int r = 0; r < npts; r++) {
+    float a = sign * amp[trace[r]];
+    const int *c = &col[r * ncol];
+    const float *x = &wx[r * ncol];
+    const float *z = &wz[r * nlen];
+    for (int j = 0; j < ncol; j++) {
+      float *q = p + c[j];
+      const float *g = scale + c[j];
+      float ax = x[j] * a;
+      for (int k = 0; k < nlen; k++) {
+        q[k] += z[k] * ax * g[k];
+      }
+    }
+  }
+}
+
+void SpreadTable::extract(const float *p, float *seis) const {
+  for (int r = 0; r < npts; r++) {
+    const int *c = &col[r * ncol];
+    const float *x = &wx[r * ncol];
+    const float *z = &wz[r * nlen];
+    float acc = 0;
+    for (int j = 0; j < ncol; j++) {
+      const float *q = p + c[j];
+      float s = 0;
+      for (int k = 0; k < nlen; k++) {
+        s += z[k] * q[k];
+      }
+      acc += x[j] * s;
+    }
+    seis[trace[r]] = acc;
+  }
+}
+
+void SpreadTable::extract(const float *p, float *seis, const float *scale) const {
+  for (int r = 0; r < npts; r++) {
+    const int *c = &col[r * ncol];
+    const float *x = &wx[r * ncol];
+    const float *z = &wz[r * nlen];
+    float acc = 0;
+    for (int j = 0; j < ncol; j++) {
+      const float *q = p + c[j];
+      const float *g = scale + c[j];
+      float s = 0;
+      for (int k = 0; k < nlen; k++) {
+        s += z[k] * q[k] * g[k];
+      }
+      acc += x[j] * s;
+    }
+    seis[trace[r]] = acc;
+  }
+}
+
+void SpreadTable::inject(float *p, const float *amp, float sign, int nm) const {
+  for (int r = 0; r < npts; r++) {
+    const float *a = &amp[trace[r] * nm];
+    const int *c = &col[r * ncol];
+    const float *x = &wx[r * ncol];
+    const float *z = &wz[r * nlen];
+    for (int j = 0; j < ncol; j++) {
+      float *q = p + c[j] * nm;
+      for (int k = 0; k < nlen; k++) {
+        for (int m = 0; m < nm; m++) {
+          q[k * nm + m] += z[k] * (x[j] * (sign * a[m]));
+        }
+      }
+    }
+  }
+}
+
+void SpreadTable::extract(const float *p, float *seis, int nm) const {
+  for (int r = 0; r < npts; r++) {
+    const int *c = &col[r * ncol];
+    const float *x = &wx[r * ncol];
+    const float *z = &wz[r * nlen];
+    for (int m = 0; m < nm; m++) {
+      float acc = 0;
+      for (int j = 0; j < ncol; j++) {
+        const float *q = p + c[j] * nm + m;
+        float s = 0;
+        for (int k = 0; k < nlen; k++) {
+          s += z[k] * q[k * nm];
+        }
+        acc += x[j] * s;
+      }
+      seis[trace[r] * nm + m] = acc;
+    }
+  }
+}
+
+int SpreadTable::size() const {
+  return npts;
+}
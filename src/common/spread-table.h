@@ -0,0 +1,66 @@
+/*
+ * spread-table.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_SPREAD_TABLE_H_
+#define SRC_COMMON_SPREAD_TABLE_H_
+
+#include <vector>
+
+/**
+ * precomputed injection (scatter) and extraction (gather) of point sources or
+ * receivers on a padded grid, idx = ix * nzpad + iz. A point on a grid node
+ * takes one tap, an off-grid point takes the 8 x 8 windowed sinc weights of
+ * mksinc, as a column of 8 contiguous z samples on each of 8 x columns.
+ * every point of a table has the same number of taps, so both loops have no
+ * branch, and the points are sorted by their first offset
+ */
+class SpreadTable {
+public:
+  SpreadTable();
+
+  /**
+   * ix, iz are the grid nodes of the points in the padded grid, fx and fz
+   * their fractional offsets in [0, 1) or NULL for points on the nodes
+   */
+  void build(const int *ix, const int *iz, const float *fx, const float *fz,
+      int npts, int nxpad, int nzpad);
+
+  /// p[point] += sign * amp[i] for the point i
+  void inject(float *p, const float *amp, float sign) const;
+
+  /// as above with every tap also scaled by the grid scale at its point
+  void inject(float *p, const float *amp, float sign, const float *scale) const;
+
+  /// seis[i] = p[point] for the point i
+  void extract(const float *p, float *seis) const;
+
+  /// as above with every tap scaled by the grid scale at its point
+  void extract(const float *p, float *seis, const float *scale) const;
+
+  /**
+   * inject and extract of nm fields interleaved with the member innermost,
+   * p[idx * nm + m], amp and seis are [point][nm]
+   */
+  void inject(float *p, const float *amp, float sign, int nm) const;
+  void extract(const float *p, float *seis, int nm) const;
+
+  int size() const;
+
+public:
+  static const int LSINC = 8;
+
+private:
+  int npts;
+  int ncol;                 /// x columns of each point, 1 or LSINC
+  int nlen;                 /// z samples of each column, 1 or LSINC
+  std::vector<int> col;     /// [npts][ncol] offset of the first z sample
+  std::vector<float> wx;    /// [npts][ncol]
+  std::vector<float> wz;    /// [npts][nlen]
+  std::vector<int> trace;   /// the source or receiver of each sorted point
+};
+
+#endif /* SRC_COMMON_SPREAD_TABLE_H_ */
@@ -11,6 +11,9 @@
 #include <vector>
 #include <numeric>
 
+class VelocityData;
+float sum(const VelocityData &v);
+
 template <typename T>
 T sum(const std::vector<T> &v) {
   return std::accumulate(v.begin(), v.end(), static_cast<T>(0));
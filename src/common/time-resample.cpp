@@ -0,0 +1,145 @@
+/*
+ * time-resample.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C" {
+#include <rsf.h>
+}
+#include <cmath>
+#include <algorithm>
+
+#include "time-resample.h"
+#include "common.h"
+
+namespace {
+
+/// half length of the interpolation/anti-alias kernel, in coarse samples
+const int SINC_HALF_LEN = 8;
+
+float windowedSinc(float t) {
+  if (std::abs(t) >= SINC_HALF_LEN) {
+    return 0;
+  }
+  if (t == 0) {
+    return 1;
+  }
+  float pt = M_PI * t;
+  return std::sin(pt) / pt * 0.5f * (1 + std::cos(pt / SINC_HALF_LEN));
+}
+
+float sinc(float x) {
+  return x == 0 ? 1.0f : std::sin(x) / x;
+}
+
+} /// end of name space
+
+int coarseTimeSamples(int nt, int ratio) {
+  return nt / ratio;
+}
+
+void decimateTraces(const float *fine, float *coarse, int nt, int ntrace, int ratio) {
+  int ntc = coarseTimeSamples(nt, ratio);
+  int half = SINC_HALF_LEN * ratio;
+
+#ifdef USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for (int itr = 0; itr < ntrace; itr++) {
+    const float *in = &fine[(size_t)itr * nt];
+    float *out = &coarse[(size_t)itr * ntc];
+    for (int i = 0; i < ntc; i++) {
+      int m0 = (i + 1) * ratio - 1;
+      int mbeg = std::max(0, m0 - half + 1);
+      int mend = std::min(nt, m0 + half);
+      float s = 0;
+      for (int m = mbeg; m < mend; m++) {
+        s += in[m] * windowedSinc((m0 - m) / static_cast<float>(ratio));
+      }
+      out[i] = s / ratio;
+    }
+  }
+}
+
+void decimateGathers(const float *fine, float *coarse, int nt, int ng, int ns, int ratio) {
+  int ntc = coarseTimeSamples(nt, ratio);
+  std::vector<float> trans((size_t)nt * ng);
+  std::vector<float> transc((size_t)ntc * ng);
+  for (int is = 0; is < ns; is++) {
+    matrix_transpose(&fine[(size_t)is * nt * ng], &trans[0], ng, nt);
+    decimateTraces(&trans[0], &transc[0], nt, ng, ratio);
+    matrix_transpose(&transc[0], &coarse[(size_t)is * ntc * ng], ntc, ng);
+  }
+}
+
+void interpolateTraces(const float *coarse, float *fine, int nt, int ntrace, int ratio) {
+  int ntc = coarseTimeSamples(nt, ratio);
+
+#ifdef USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for (int itr = 0; itr < ntrace; itr++) {
+    const float *in = &coarse[(size_t)itr * ntc];
+    float *out = &fine[(size_t)itr * nt];
+    for (int j = 0; j < nt; j++) {
+      float t = (j + 1) / static_cast<float>(ratio) - 1;
+      int i0 = static_cast<int>(std::floor(t));
+      int ibeg = std::max(0, i0 - SINC_HALF_LEN + 1);
+      int iend = std::min(ntc, i0 + SINC_HALF_LEN + 1);
+      float s = 0;
+      for (int i = ibeg; i < iend; i++) {
+        s += in[i] * windowedSinc(t - i);
+      }
+      out[j] = s;
+    }
+  }
+}
+
+std::vector<float> coarseSourceWavelet(const std::vector<float> &wlt, int ratio, int dxRatio) {
+  int nt = wlt.size();
+  int ntc = coarseTimeSamples(nt, ratio);
+  int nfft = kiss_fft_next_fast_size(2 * nt);
+
+  std::vector<kiss_fft_cpx> trace(nfft);
+  std::vector<kiss_fft_cpx> spec(nfft);
+  for (int it = 0; it < nfft; it++) {
+    trace[it].r = it < nt ? wlt[it] : 0;
+    trace[it].i = 0;
+  }
+
+  kiss_fft_cfg fwd = kiss_fft_alloc(nfft, 0, NULL, NULL);
+  kiss_fft_cfg inv = kiss_fft_alloc(nfft, 1, NULL, NULL);
+  kiss_fft(fwd, &trace[0], &spec[0]);
+
+  /**
+   * injecting s into one cell once per step of length dt amounts to a
+   * source of s * dx^2 / (dt^2 * sinc(w * dt)), the filter keeps the source
+   * the same and cuts everything beyond the coarse Nyquist
+   */
+  float weight = static_cast<float>(ratio * ratio) / (dxRatio * dxRatio);
+  for (int k = 0; k < nfft; k++) {
+    int kk = k <= nfft / 2 ? k : nfft - k;
+    float x = 2 * M_PI * kk / nfft;
+    float h = 0;
+    if (x * ratio < M_PI) {
+      h = weight * sinc(x * ratio) / sinc(x) / nfft;
+    }
+    spec[k].r *= h;
+    spec[k].i *= h;
+  }
+  kiss_fft(inv, &spec[0], &trace[0]);
+
+  kiss_fft_free(fwd);
+  kiss_fft_free(inv);
+
+  /// the injection leads the recording by one step, delay it by the difference of the steps
+  std::vector<float> ret(ntc);
+  for (int i = 0; i < ntc; i++) {
+    int it = i * ratio - (ratio - 1);
+    ret[i] = trace[(it + nfft) % nfft].r;
+  }
+
+  return ret;
+}
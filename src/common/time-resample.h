@@ -0,0 +1,41 @@
+/*
+ * time-resample.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_TIME_RESAMPLE_H_
+#define SRC_COMMON_TIME_RESAMPLE_H_
+
+#include <vector>
+
+/**
+ * resampling between the native time sampling dt and a coarse one ratio * dt.
+ * traces are stored continuously in time (trace-major, as in the shot files).
+ * coarse sample i is aligned with native sample (i + 1) * ratio - 1, which is
+ * the sample recorded after the same modeling time in both samplings
+ */
+int coarseTimeSamples(int nt, int ratio);
+
+/// anti-alias filtering then decimation, fine: ntrace * nt, coarse: ntrace * coarseTimeSamples(nt, ratio)
+void decimateTraces(const float *fine, float *coarse, int nt, int ntrace, int ratio);
+
+/**
+ * decimateTraces() on the ns gathers of the shot files as they are read,
+ * nt x ng each with the receivers running fastest (time-major)
+ */
+void decimateGathers(const float *fine, float *coarse, int nt, int ng, int ns, int ratio);
+
+/// band-limited (windowed sinc) interpolation back to the native sampling
+void interpolateTraces(const float *coarse, float *fine, int nt, int ntrace, int ratio);
+
+/**
+ * source wavelet for a propagator whose step is ratio * dt and which has no
+ * time dispersion (see rem10s-nobndry.h), it compensates the change of the
+ * injection weight (dt / dx)^2 * sinc(w * dt) and the one step lag of the
+ * injection. dxRatio is the coarsening of the grid, if any
+ */
+std::vector<float> coarseSourceWavelet(const std::vector<float> &wlt, int ratio, int dxRatio = 1);
+
+#endif /* SRC_COMMON_TIME_RESAMPLE_H_ */
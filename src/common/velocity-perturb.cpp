@@ -0,0 +1,85 @@
+/*
+ * velocity-perturb.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C" {
+#include <rsf.h>
+}
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include "velocity-perturb.h"
+
+namespace {
+
+/// the inverse fft of the n2 sequences of n1 of a, n1 running fastest, in place
+void inverseFft(std::vector<kiss_fft_cpx> &a, int n1, int n2, int stride, int dist) {
+  kiss_fft_cfg cfg = kiss_fft_alloc(n1, 1, NULL, NULL);
+  std::vector<kiss_fft_cpx> in(n1);
+  std::vector<kiss_fft_cpx> out(n1);
+  for (int i2 = 0; i2 < n2; i2++) {
+    kiss_fft_cpx *p = &a[i2 * dist];
+    for (int i1 = 0; i1 < n1; i1++) {
+      in[i1] = p[i1 * stride];
+    }
+    kiss_fft(cfg, &in[0], &out[0]);
+    for (int i1 = 0; i1 < n1; i1++) {
+      p[i1 * stride] = out[i1];
+    }
+  }
+  kiss_fft_free(cfg);
+}
+
+} /// end of name space
+
+void genVelPerturb(float *perturb, int nx, int nz, float maxPerturb, int seed, int member, int nfre) {
+  int gx = nx + nfre;
+  int gz = nz + nfre;
+
+  /// the wavenumbers kept are the ones of genVelPerturb.m, the band on x is scaled by the aspect of the grid
+  float cutx = static_cast<float>(nfre) * gx / gz;
+
+  boost::mt19937 engine(seed + member);
+  boost::uniform_real<> dist(-1, 1);
+  boost::variate_generator<boost::mt19937 &, boost::uniform_real<> > uniform(engine, dist);
+
+  std::vector<kiss_fft_cpx> spec((size_t)gx * gz);
+  for (int ix = 0; ix < gx; ix++) {
+    bool lowx = ix + 1 >= gx - nfre || ix + 1 <= cutx;
+    for (int iz = 0; iz < gz; iz++) {
+      kiss_fft_cpx &c = spec[(size_t)ix * gz + iz];
+      c.r = 0;
+      c.i = 0;
+      if (lowx && (iz + 1 >= gz - nfre || iz + 1 <= nfre)) {
+        c.r = uniform();
+        c.i = uniform();
+      }
+    }
+  }
+
+  inverseFft(spec, gz, gx, 1, gz);  /// along z
+  inverseFft(spec, gx, gz, gz, 1);  /// along x
+
+  int ox = nfre / 2;
+  int oz = nfre / 2;
+  float maxabs = 0;
+  for (int ix = 0; ix < nx; ix++) {
+    for (int iz = 0; iz < nz; iz++) {
+      float v = spec[(size_t)(ix + ox) * gz + iz + oz].r;
+      perturb[(size_t)ix * nz + iz] = v;
+      maxabs = std::max(maxabs, std::fabs(v));
+    }
+  }
+
+  float scale = maxabs > 0 ? maxPerturb / maxabs : 0;
+  for (size_t i = 0; i < (size_t)nx * nz; i++) {
+    perturb[i] *= scale;
+  }
+}
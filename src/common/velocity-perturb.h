@@ -0,0 +1,24 @@
+/*
+ * velocity-perturb.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_VELOCITY_PERTURB_H_
+#define SRC_COMMON_VELOCITY_PERTURB_H_
+
+/**
+ * a spatially correlated random perturbation of an nx * nz velocity (z
+ * running fastest), the generator of matlab/genVelPerturb.m in process:
+ * uniform random complex values on the lowest wavenumbers of a grid nfre
+ * samples larger than the model on each axis, the real part of their
+ * inverse fft cropped to the model and scaled to a maximum absolute value of
+ * maxPerturb.
+ *
+ * member i depends only on seed and i, so the perturbation of a member is
+ * the same whichever process generates it and however many there are
+ */
+void genVelPerturb(float *perturb, int nx, int nz, float maxPerturb, int seed, int member, int nfre = 20);
+
+#endif /* SRC_COMMON_VELOCITY_PERTURB_H_ */
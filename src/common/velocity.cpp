@@ -5,8 +5,86 @@
  *      Author: rice
  */
 
+extern "C" {
+#include <rsf.h>
+}
+
+#include <algorithm>
 #include "velocity.h"
 #include "logger.h"
+#include "sum.h"
+
+VelocityData::VelocityData() : p(NULL), n(0) {
+}
+
+VelocityData::VelocityData(size_t _n, float v) : own(_n, v), p(NULL), n(0) {
+}
+
+VelocityData::VelocityData(const std::vector<float> &v) : own(v), p(NULL), n(0) {
+}
+
+VelocityData::VelocityData(float *_p, size_t _n) : p(_p), n(_n) {
+}
+
+VelocityData::VelocityData(const VelocityData &rhs) : own(rhs.begin(), rhs.end()), p(NULL), n(0) {
+}
+
+VelocityData &VelocityData::operator=(const VelocityData &rhs) {
+  if (this == &rhs) {
+    return *this;
+  }
+  if (p) {
+    if (rhs.size() != n) {
+      sf_error("assign %zu samples to a view of %zu", rhs.size(), n);
+    }
+    std::copy(rhs.begin(), rhs.end(), p);
+    return *this;
+  }
+  own.assign(rhs.begin(), rhs.end());
+  return *this;
+}
+
+VelocityData &VelocityData::operator=(const std::vector<float> &rhs) {
+  if (p) {
+    if (rhs.size() != n) {
+      sf_error("assign %zu samples to a view of %zu", rhs.size(), n);
+    }
+    std::copy(rhs.begin(), rhs.end(), p);
+    return *this;
+  }
+  own = rhs;
+  return *this;
+}
+
+void VelocityData::resize(size_t _n) {
+  if (p) {
+    if (_n != n) {
+      sf_error("resize a view of %zu samples to %zu", n, _n);
+    }
+    return;
+  }
+  own.resize(_n);
+}
+
+void VelocityData::assign(size_t _n, float v) {
+  resize(_n);
+  std::fill(begin(), end(), v);
+}
+
+std::vector<float> &VelocityData::vector() {
+  if (p) {
+    sf_error("a view has no vector of its own");
+  }
+  return own;
+}
+
+std::vector<float> VelocityData::toVector() const {
+  return std::vector<float>(begin(), end());
+}
+
+float sum(const VelocityData &v) {
+  return sum(v.data(), v.size());
+}
 
 Velocity::Velocity() {
 }
@@ -19,9 +97,11 @@ Velocity::Velocity(const std::vector<float>& _dat, int _nx, int _nz) :
 {
 }
 
+Velocity::Velocity(float *p, int _nx, int _nz) : dat(p, (size_t)_nx * _nz), nx(_nx), nz(_nz) {
+}
+
 void Velocity::resize(int _nx, int _nz) {
 	nx = _nx;
 	nz = _nz;
-	dat.resize(nx, nz);
 	dat.assign(nx * nz, 0.0f);
 }
@@ -8,16 +8,69 @@
 #ifndef SRC_FM2D_VELOCITY_H_
 #define SRC_FM2D_VELOCITY_H_
 
+#include <cstddef>
 #include <vector>
 
+/**
+ * the samples of a Velocity, in a vector of their own or a view into the
+ * storage of another object, e.g. a member of an Ensemble. A copy always owns
+ * its samples, an assignment to a view writes through it. The interface is
+ * the part of std::vector the code uses
+ */
+class VelocityData {
+public:
+  typedef float value_type;
+  typedef float *iterator;
+  typedef const float *const_iterator;
+
+  VelocityData();
+  explicit VelocityData(size_t n, float v = 0);
+  VelocityData(const std::vector<float> &v);
+  VelocityData(float *p, size_t n);         /// a view of n samples at p
+  VelocityData(const VelocityData &rhs);
+
+  VelocityData &operator=(const VelocityData &rhs);
+  VelocityData &operator=(const std::vector<float> &rhs);
+
+  bool isView() const { return p != NULL; }
+  size_t size() const { return p ? n : own.size(); }
+  bool empty() const { return size() == 0; }
+
+  float *data() { return p ? p : (own.empty() ? NULL : &own[0]); }
+  const float *data() const { return p ? p : (own.empty() ? NULL : &own[0]); }
+  float &operator[](size_t i) { return p ? p[i] : own[i]; }
+  const float &operator[](size_t i) const { return p ? p[i] : own[i]; }
+
+  iterator begin() { return data(); }
+  iterator end() { return data() + size(); }
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + size(); }
+
+  /// a view keeps its size and storage
+  void resize(size_t n);
+  void assign(size_t n, float v);
+
+  /// the vector of an owner, e.g. to borrow a WorkBuffer into it
+  std::vector<float> &vector();
+
+  /// a copy, for the interfaces on std::vector
+  std::vector<float> toVector() const;
+
+private:
+  std::vector<float> own;
+  float *p;
+  size_t n;
+};
+
 class Velocity {
 public:
   Velocity();
   Velocity(int _nx, int _nz);
   Velocity (const std::vector<float> &dat, int nx, int nz);
+  Velocity(float *p, int nx, int nz);   /// a view of the nx * nz samples at p
 	void resize(int nx, int nz);
 public:
-  std::vector<float> dat;
+  VelocityData dat;
   int nx;
   int nz;
 };
@@ -0,0 +1,102 @@
+/*
+ * workspace.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "workspace.h"
+#include "logger.h"
+
+Workspace::FreeList Workspace::freeList;
+Workspace::Stats Workspace::counters = { 0, 0, 0, 0, 0 };
+
+namespace {
+
+/// a reused buffer may be at most this much larger than asked for
+const size_t MAX_SLACK = 2;
+
+void adviseHugePages(std::vector<float> &v) {
+#ifdef MADV_HUGEPAGE
+  long page = sysconf(_SC_PAGESIZE);
+  unsigned long beg = (reinterpret_cast<unsigned long>(&v[0]) + page - 1) / page * page;
+  unsigned long end = reinterpret_cast<unsigned long>(&v[0] + v.capacity()) / page * page;
+  if (end > beg) {
+    madvise(reinterpret_cast<void *>(beg), end - beg, MADV_HUGEPAGE);
+  }
+#endif
+}
+
+} /// end of name space
+
+std::vector<float> *Workspace::acquire(size_t n, bool zero, bool &isFresh) {
+  std::vector<float> *buf = NULL;
+
+  FreeList::iterator it = freeList.lower_bound(n);
+  if (it != freeList.end() && it->first <= n * MAX_SLACK) {
+    buf = it->second;
+    freeList.erase(it);
+    buf->resize(n);
+    if (zero) {
+      std::fill(buf->begin(), buf->end(), 0.0f);
+    }
+    isFresh = false;
+  } else {
+    buf = new std::vector<float>();
+    buf->reserve(n);           /// no page is touched yet
+    if (n > 0) {
+      buf->push_back(0);
+      adviseHugePages(*buf);
+    }
+    buf->resize(n, 0.0f);
+    isFresh = true;
+
+    counters.fresh++;
+    counters.freshBytes += n * sizeof(float);
+    counters.heldBytes += n * sizeof(float);
+  }
+
+  counters.borrows++;
+  counters.bytes += n * sizeof(float);
+
+  return buf;
+}
+
+void Workspace::release(std::vector<float> *buf) {
+  freeList.insert(std::make_pair(buf->capacity(), buf));
+}
+
+Workspace::Stats Workspace::stats() {
+  return counters;
+}
+
+void Workspace::resetStats() {
+  size_t held = counters.heldBytes;
+  counters = Stats();
+  counters.heldBytes = held;
+}
+
+void Workspace::report(const char *what, int id) {
+  const double mb = 1.0 / (1024 * 1024);
+  INFO() << format("%s %d workspace: %ld borrows (%.1f MB), %ld allocations (%.1f MB), %.1f MB held")
+      % what % id % counters.borrows % (counters.bytes * mb) % counters.fresh % (counters.freshBytes * mb)
+      % (counters.heldBytes * mb);
+}
+
+WorkBuffer::WorkBuffer(std::vector<float> &_target, size_t n, bool zero) :
+  target(_target), buf(Workspace::acquire(n, zero, isFresh))
+{
+  target.swap(*buf);
+}
+
+WorkBuffer::~WorkBuffer() {
+  target.swap(*buf);
+  Workspace::release(buf);
+}
+
+bool WorkBuffer::fresh() const {
+  return isFresh;
+}
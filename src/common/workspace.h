@@ -0,0 +1,68 @@
+/*
+ * workspace.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_COMMON_WORKSPACE_H_
+#define SRC_COMMON_WORKSPACE_H_
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+/**
+ * process wide arena of float buffers for the per-shot and per-trial work
+ * arrays. A released buffer keeps its pages, so the next shot borrows it
+ * without page faults. New buffers ask for transparent huge pages before
+ * their first touch. Borrow from the serial parts only, it is not thread safe
+ */
+class Workspace {
+public:
+  struct Stats {
+    long borrows;       /// buffers handed out
+    long fresh;         /// buffers which had to be allocated
+    size_t bytes;       /// bytes handed out
+    size_t freshBytes;  /// bytes allocated
+    size_t heldBytes;   /// bytes owned by the arena, in use or not
+  };
+
+  static std::vector<float> *acquire(size_t n, bool zero, bool &isFresh);
+  static void release(std::vector<float> *buf);
+
+  static Stats stats();
+  static void resetStats();
+  static void report(const char *what, int id);
+
+private:
+  typedef std::multimap<size_t, std::vector<float> *> FreeList;
+  static FreeList freeList;
+  static Stats counters;
+};
+
+/**
+ * borrows a buffer of n floats into target for the lifetime of this object.
+ * the previous storage of target is put back on destruction, so declare the
+ * WorkBuffer right after its target. zero = false leaves a reused buffer
+ * with its old content, for arrays which are overwritten anyway
+ */
+class WorkBuffer {
+public:
+  WorkBuffer(std::vector<float> &target, size_t n, bool zero = true);
+  ~WorkBuffer();
+
+  /// true if the pages are new, e.g. to place them (ForwardModeling::firstTouch)
+  bool fresh() const;
+
+private:
+  WorkBuffer(const WorkBuffer &);
+  void operator=(const WorkBuffer &);
+
+private:
+  std::vector<float> &target;
+  std::vector<float> *buf;
+  bool isFresh;
+};
+
+#endif /* SRC_COMMON_WORKSPACE_H_ */
@@ -15,6 +15,9 @@
 #include <cmath>
 #include <sstream>
 #include <cstring>
+#include <cstdlib>
+#include <map>
+#include <pthread.h>
 #include <mpi.h>
 
 #include "Matrix.h"
@@ -40,21 +43,96 @@ std::streampos getFileSize(const std::string &filePath) {
   return fsize;
 }
 
+const size_t ALIGNMENT = 64;
+
+/// never destroyed, a matrix may go away after the static objects
+typedef std::multimap<size_t, void *> Pool;
+Pool *pool = new Pool;
+size_t poolBytes = 0;
+size_t poolLimit = 256 << 20;
+pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void *allocate(size_t bytes) {
+  void *p = NULL;
+  pthread_mutex_lock(&poolMutex);
+  Pool::iterator it = pool->find(bytes);
+  if (it != pool->end()) {
+    p = it->second;
+    poolBytes -= bytes;
+    pool->erase(it);
+  }
+  pthread_mutex_unlock(&poolMutex);
+
+  if (p == NULL && posix_memalign(&p, ALIGNMENT, bytes) != 0) {
+    p = NULL;
+  }
+  return p;
+}
+
+void deallocate(void *p, size_t bytes) {
+  if (p == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&poolMutex);
+  if (poolBytes + bytes <= poolLimit) {
+    pool->insert(std::make_pair(bytes, p));
+    poolBytes += bytes;
+    p = NULL;
+  }
+  pthread_mutex_unlock(&poolMutex);
+  free(p);
+}
+
 }
 
 Matrix::Matrix(int ncol, int nrow) :
   mData(NULL), mNumRow(nrow), mNumCol(ncol) {
-  mData = (value_type *)malloc(nrow * ncol * sizeof(value_type));
+  size_t bytes = (size_t)nrow * ncol * sizeof(value_type);
+  if (bytes == 0) {
+    return;
+  }
+  mData = (value_type *)allocate(bytes);
   if (mData == NULL) {
     ERROR() << __PRETTY_FUNCTION__ << ": malloc fails";
     perror("reason is:");
     exit(0);
   }
-  std::fill(mData, mData + nrow * ncol, 0);
+  std::fill(mData, mData + (size_t)nrow * ncol, 0);
 }
 
 Matrix::~Matrix() {
-  free(mData);
+  release();
+}
+
+void Matrix::swap(Matrix &rhs) {
+  std::swap(mData, rhs.mData);
+  std::swap(mNumRow, rhs.mNumRow);
+  std::swap(mNumCol, rhs.mNumCol);
+}
+
+void Matrix::release() {
+  deallocate(mData, (size_t)mNumRow * mNumCol * sizeof(value_type));
+  mData = NULL;
+  mNumRow = 0;
+  mNumCol = 0;
+}
+
+void Matrix::setPoolLimit(size_t bytes) {
+  std::vector<void *> freed;
+  pthread_mutex_lock(&poolMutex);
+  poolLimit = bytes;
+  while (poolBytes > poolLimit) {
+    Pool::iterator it = --pool->end();
+    poolBytes -= it->first;
+    freed.push_back(it->second);
+    pool->erase(it);
+  }
+  pthread_mutex_unlock(&poolMutex);
+
+  for (size_t i = 0; i < freed.size(); i++) {
+    free(freed[i]);
+  }
 }
 
 
@@ -140,13 +218,13 @@ Matrix::value_type getSum(const Matrix &M) {
   return sum;
 }
 
-Matrix::value_type pGetSum(const Matrix &M, const int nSamples) {
+Matrix::value_type pGetSum(const Matrix &M, const int nSamples, MPI_Comm comm) {
   const Matrix::value_type *p = M.getData();
   const int size = M.getNumRow() * M.getNumCol();
   Matrix::value_type sum = std::accumulate(p, p + size, 0.0);
 	//printf("sum = %e\n", sum);
 	Matrix::value_type ret = 0;
-	MPI_Reduce(&sum, &ret, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+	MPI_Reduce(&sum, &ret, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
 	//printf("ret = %e\n", ret);
   return ret;
 }
@@ -10,7 +10,15 @@
 
 #include <vector>
 #include <string>
+#include <cstddef>
+#include <mpi.h>
 
+/**
+ * column major, the storage is aligned for the blas and comes from a pool:
+ * the block of a matrix which goes away is kept for the next one of the same
+ * size, so the matrices of each analysis reuse the pages of the previous one
+ * instead of faulting in fresh ones
+ */
 class Matrix {
  public:
   typedef double value_type;
@@ -28,7 +36,20 @@ class Matrix {
   value_type *getData();
   const value_type *getData() const;
 
+  /// exchanges the storage of the two, hands a matrix over without copying it
+  void swap(Matrix &rhs);
+
+  /// gives the storage back early, the matrix is 0 x 0 afterwards
+  void release();
+
+  /// bytes of released blocks the pool keeps, 0 frees every block at once
+  static void setPoolLimit(size_t bytes);
+
  private:
+  /// the pool would hand the block of a copy out twice, swap hands it over
+  Matrix(const Matrix &);
+  Matrix &operator=(const Matrix &);
+
   value_type *mData;
   int mNumRow;
   int mNumCol;
@@ -40,7 +61,7 @@ void A_plus_B(const Matrix &A, const Matrix &B, Matrix &C);
 void A_minus_B(const Matrix &A, const Matrix &B, Matrix &C);
 
 Matrix::value_type getSum(const Matrix &M);
-Matrix::value_type pGetSum(const Matrix &M, const int nSamples);
+Matrix::value_type pGetSum(const Matrix &M, const int nSamples, MPI_Comm comm = MPI_COMM_WORLD);
 Matrix::value_type pGetSum2(const Matrix &M, const int nSamples);
 
 /// compute clip position
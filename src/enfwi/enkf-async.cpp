@@ -0,0 +1,121 @@
+/*
+ * enkf-async.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include <algorithm>
+#include "enkf-async.h"
+#include "common.h"
+#include "logger.h"
+#include "timer.h"
+
+AsyncEnkf::AsyncEnkf(EnkfAnalyze &_enkf, Ensemble &_ens, Matrix &_lambdaSet, Matrix &_ratioSet,
+    int _nx, int _nz, float _dx, float _dt) :
+  enkf(_enkf), ens(_ens), lambdaSet(_lambdaSet), ratioSet(_ratioSet), nx(_nx), nz(_nz), dx(_dx), dt(_dt),
+  snapshot(NULL), snapLambda(_lambdaSet.getNumCol(), _lambdaSet.getNumRow()),
+  snapRatio(_ratioSet.getNumCol(), _ratioSet.getNumRow()), busy(false), threaded(false)
+{
+}
+
+AsyncEnkf::~AsyncEnkf() {
+  finish();
+  delete snapshot;
+}
+
+bool AsyncEnkf::running() const {
+  return busy;
+}
+
+void *AsyncEnkf::analyzer(void *arg) {
+  AsyncEnkf *a = static_cast<AsyncEnkf *>(arg);
+  Timer timer;
+  a->enkf.pAnalyze(*a->snapshot, a->snapLambda, a->snapRatio);
+  DEBUG() << format("the asynchronous enkf analysis took %.3f s") % timer.elapsed();
+  return NULL;
+}
+
+void AsyncEnkf::start() {
+  finish();
+
+  if (snapshot == NULL) {
+    snapshot = new Ensemble(ens.size(), nx, nz);
+  }
+  size_t n = (size_t)ens.size() * ens.modelSize();
+  before.assign(ens.data(), ens.data() + n);
+  std::copy(before.begin(), before.end(), snapshot->data());
+  std::copy(lambdaSet.getData(), lambdaSet.getData() + lambdaSet.size(), snapLambda.getData());
+  std::copy(ratioSet.getData(), ratioSet.getData() + ratioSet.size(), snapRatio.getData());
+
+  busy = true;
+  threaded = pthread_create(&thread, NULL, analyzer, this) == 0;
+  if (!threaded) {
+    WARNING() << "cannot start the enkf analysis on a thread, it runs in place";
+    analyzer(this);
+  }
+}
+
+/// the thread of the analysis is done, its correction is not applied yet
+void AsyncEnkf::wait() {
+  if (!threaded) {
+    return;
+  }
+
+  Timer timer;
+  pthread_join(thread, NULL);
+  threaded = false;
+  DEBUG() << format("waited %.3f s for the enkf analysis") % timer.elapsed();
+}
+
+void AsyncEnkf::finish() {
+  if (!busy) {
+    return;
+  }
+
+  wait();
+  busy = false;
+
+  /// the correction is taken in velocity, the members are in the transformed velocity
+  size_t n = (size_t)ens.size() * ens.modelSize();
+  float *vel = ens.data();
+  const float *after = snapshot->data();
+  for (size_t i = 0; i < n; i++) {
+    float v = velRecover<float>(vel[i], dx, dt) + velRecover<float>(after[i], dx, dt) - velRecover<float>(before[i], dx, dt);
+    vel[i] = velTrans<float>(v, dx, dt);
+  }
+  std::vector<float>().swap(before);
+
+  std::copy(snapLambda.getData(), snapLambda.getData() + snapLambda.size(), lambdaSet.getData());
+  std::copy(snapRatio.getData(), snapRatio.getData() + snapRatio.size(), ratioSet.getData());
+}
+
+std::vector<float *> AsyncEnkf::analyzed() {
+  return snapshot->members();
+}
+
+void AsyncEnkf::saveState(CheckpointData &ckpt, const std::string &key) {
+  wait();
+  ckpt.putValue(key + ".busy", busy);
+  if (busy) {
+    ckpt.put(key + ".before", before);
+    ckpt.put(key + ".after", snapshot->data(), before.size() * sizeof(float));
+    ckpt.put(key + ".lambdaSet", snapLambda.getData(), snapLambda.size() * sizeof(Matrix::value_type));
+    ckpt.put(key + ".ratioSet", snapRatio.getData(), snapRatio.size() * sizeof(Matrix::value_type));
+  }
+}
+
+void AsyncEnkf::loadState(const CheckpointData &ckpt, const std::string &key) {
+  finish();
+  busy = ckpt.getValue<bool>(key + ".busy");
+  if (busy) {
+    if (snapshot == NULL) {
+      snapshot = new Ensemble(ens.size(), nx, nz);
+    }
+    before.resize((size_t)ens.size() * ens.modelSize());
+    ckpt.get(key + ".before", &before[0], before.size() * sizeof(float));
+    ckpt.get(key + ".after", snapshot->data(), before.size() * sizeof(float));
+    ckpt.get(key + ".lambdaSet", snapLambda.getData(), snapLambda.size() * sizeof(Matrix::value_type));
+    ckpt.get(key + ".ratioSet", snapRatio.getData(), snapRatio.size() * sizeof(Matrix::value_type));
+  }
+}
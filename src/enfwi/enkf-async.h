@@ -0,0 +1,83 @@
+/*
+ * enkf-async.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_ENFWI_ENKF_ASYNC_H_
+#define SRC_ENFWI_ENKF_ASYNC_H_
+
+#include <vector>
+#include <pthread.h>
+#include "enkfanalyze.h"
+#include "ensemble.h"
+#include "Matrix.h"
+#include "checkpoint.h"
+
+/**
+ * the EnKF analysis of an ensemble overlapped with the FWI of the next
+ * iteration. start() copies the members and the weights and runs the
+ * analysis of the copy on a thread, the FWI goes on with the members.
+ * finish() waits for it and adds the correction of the analysis, the
+ * analyzed copy minus the copy in velocity, to the members which went on
+ * meanwhile, and takes the weights of the analysis. analyzed() keeps the
+ * members the analysis produced, i.e. the ones the synchronous path has.
+ *
+ * The analysis communicates on the comm of enkf, which must be a duplicate
+ * of the one of the FWI, and MPI must provide MPI_THREAD_MULTIPLE. Nothing
+ * else may use enkf between start() and finish()
+ */
+class AsyncEnkf {
+public:
+  AsyncEnkf(EnkfAnalyze &enkf, Ensemble &ens, Matrix &lambdaSet, Matrix &ratioSet,
+      int nx, int nz, float dx, float dt);
+  ~AsyncEnkf();
+
+  /// the analysis of the members as they are now
+  void start();
+
+  /// the correction of the last start() on the members, nothing if none runs
+  void finish();
+
+  bool running() const;
+
+  /// the members of the last analysis before its correction, once finish() returned
+  std::vector<float *> analyzed();
+
+  /**
+   * an analysis which runs is waited for but not applied, the checkpoint
+   * keeps it and a restore applies it at the next finish() as if the run
+   * had not stopped
+   */
+  void saveState(CheckpointData &ckpt, const std::string &key);
+  void loadState(const CheckpointData &ckpt, const std::string &key);
+
+private:
+  AsyncEnkf(const AsyncEnkf &);
+  AsyncEnkf &operator=(const AsyncEnkf &);
+
+  static void *analyzer(void *arg);
+  void wait();
+
+private:
+  EnkfAnalyze &enkf;
+  Ensemble &ens;
+  Matrix &lambdaSet;
+  Matrix &ratioSet;
+  int nx;
+  int nz;
+  float dx;
+  float dt;
+
+  Ensemble *snapshot;         /// analyzed in place by the thread, NULL before the first start()
+  std::vector<float> before;  /// the members at start()
+  Matrix snapLambda;
+  Matrix snapRatio;
+
+  bool busy;                  /// the correction of an analysis waits for finish()
+  bool threaded;              /// on a thread of its own, to be joined
+  pthread_t thread;
+};
+
+#endif /* SRC_ENFWI_ENKF_ASYNC_H_ */
@@ -7,6 +7,7 @@
 
 #include <boost/bind.hpp>
 #include <mpi.h>
+#include <sstream>
 
 #include "enkfanalyze.h"
 #include "logger.h"
@@ -17,6 +18,13 @@
 #include "dgesvd.h"
 #include "aux.h"
 #include "ReguFactor.h"
+#include "node-reduce.h"
+#include "timer.h"
+
+extern "C" {
+void sgemm_(char *transA, char *transB, int *m, int *n, int *k, float *alpha, float *A, int *lda,
+    float *B, int *ldb, float *beta, float *C, int *ldc);
+}
 
 namespace {
 //std::vector<float> createAMean(const std::vector<float *> &velSet, int modelSize) {
@@ -34,94 +42,273 @@ namespace {
 //  return ret;
 //}
 
-void initAPerturb(Matrix &matAPerturb, const std::vector<float *> &velSet,
-    const std::vector<float> &AMean, int modelSize) {
-  assert((size_t)matAPerturb.getNumCol() == velSet.size()); // the matrix is row-majored
-  assert(matAPerturb.getNumRow() == modelSize);
-
-	//printf("initAPerturb, col = %d, row = %d\n", matAPerturb.getNumCol(), matAPerturb.getNumRow()); 
-  for (int i = 0; i < matAPerturb.getNumCol(); i++) {
-    Matrix::value_type *p = matAPerturb.getData() + (i * matAPerturb.getNumRow());
-    std::transform(velSet[i], velSet[i] + modelSize, AMean.begin(), p, std::minus<Matrix::value_type>());
-  }
-}
-
 } /// end of name space
 
 
 EnkfAnalyze::EnkfAnalyze(const ForwardModeling &fm, const std::vector<float> &wlt,
     const std::vector<float> &dobs, float sigmafactor) :
-  fm(fm), wlt(wlt), dobs(dobs), enkfRandomCodes(ENKF_SEED), sigmaFactor(sigmafactor), sigmaIter0(0), initSigma(false)
+  fm(fm), wlt(wlt), dobs(dobs), enkfRandomCodes(ENKF_SEED), sigmaFactor(sigmafactor), svdRank(0), svdPower(0), singlePrecision(false),
+  comm(MPI_COMM_WORLD), sigmaIter0(0), initSigma(false)
 {
   modelSize = fm.getnx() * fm.getnz();
 }
 
-void EnkfAnalyze::analyze(std::vector<float*>& totalVelSet, std::vector<float *> &velSet) const {
-  std::vector<int> code = enkfRandomCodes.genPlus1Minus1(fm.getns());
-  Matrix gainMatrix = calGainMatrix(velSet, code);
+void EnkfAnalyze::setLowRankSvd(int rank, int power) {
+  svdRank = rank;
+  svdPower = power;
+}
+
+void EnkfAnalyze::setSinglePrecision(bool single) {
+  singlePrecision = single;
+}
+
+void EnkfAnalyze::setComm(MPI_Comm _comm) {
+  comm = _comm;
+}
+
+bool EnkfAnalyze::lowRankSvd(int nSamples) const {
+  return svdRank > 0 && svdRank < nSamples;
+}
+
+/**
+ * t4 = HA' * U * SSqInv * U' * (D - HA) with the leading svdRank triplets of
+ * the band. band, HA_Perturb and t0 (D - HA) are the columns of the members of
+ * this process, t4 is their columns of the N * N matrix. The three are
+ * released once they are used
+ */
+void EnkfAnalyze::lowRankGain(Matrix &band, Matrix &HA_Perturb, Matrix &t0, Matrix &t4, MPI_Comm comm) const {
+  int size;
+  MPI_Comm_size(comm, &size);
+
+  int local_n = band.getNumCol();
+  int numDataSamples = band.getNumRow();
+  int N = local_n * size;
+  int l = std::min(svdRank + SVD_OVERSAMPLE, N);
+
+  Timer timer;
+  Matrix matU(l, numDataSamples);
+  Matrix matS(1, l);
+  int info = pRandSvd(band, matU, matS, svdPower, ENKF_SEED, comm);
+  if (info > 0) {
+    ERROR() << "The algorithm computing SVD failed to converge.";
+    exit(1);
+  }
+
+  int clip = std::min(clipPosition(matS), svdRank);
+  DEBUG() << format("randomized svd of rank %d/%d, %d power iterations, clip %d: %.3f s") % l % N % svdPower % clip % timer.elapsed();
+  band.release();
+
+  Matrix t1(local_n, l); /// SSqInv * U' * (D - HA)
+  alpha_ATrans_B_plus_beta_C(1, matU, t0, 0, t1);
+  t0.release();
+  const Matrix::value_type *s = matS.getData();
+  for (int j = 0; j < local_n; j++) {
+    Matrix::value_type *p = t1.getData() + j * l;
+    for (int i = 0; i < l; i++) {
+      p[i] *= i < clip ? (1 / s[i]) * (1 / s[i]) : 0;
+    }
+  }
 
+  Matrix local_t2(local_n, l); /// U' * HA
+  alpha_ATrans_B_plus_beta_C(1, matU, HA_Perturb, 0, local_t2);
+  HA_Perturb.release();
+  Matrix t2(N, l);
+  MPI_Allgather(local_t2.getData(), local_t2.size(), MPI_DOUBLE, t2.getData(), local_t2.size(), MPI_DOUBLE, comm);
+
+  alpha_ATrans_B_plus_beta_C(1, t2, t1, 0, t4);
+}
+
+/**
+ * t4 of lowRankGain with all the triplets above the clip. The band, HA and
+ * D - HA go from the columns of the members to the rows of all of them, the
+ * tall and skinny band is factored by tsqr, and U' * HA, U' * (D - HA) are
+ * summed over the processes, no process holds more than its rows. band,
+ * HA_Perturb and t0 are released once they are in rows
+ */
+void EnkfAnalyze::tsqrGain(Matrix &band, Matrix &HA_Perturb, Matrix &t0, Matrix &t4, MPI_Comm comm) const {
   int rank;
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  int local_n = band.getNumCol();
+  int numDataSamples = band.getNumRow();
+  int N = local_n * size;
+  int local_rows = pLocalRows(numDataSamples, comm);
+
+  Timer timer;
+  Matrix band_rows(N, local_rows);
+  pColumnsToRows(band, band_rows, comm);
+  band.release();
+  Matrix HA_rows(N, local_rows);
+  pColumnsToRows(HA_Perturb, HA_rows, comm);
+  HA_Perturb.release();
+  Matrix t0_rows(N, local_rows);
+  pColumnsToRows(t0, t0_rows, comm);
+  t0.release();
+
+  Matrix matU(N, local_rows);
+  Matrix matS(1, N);
+  int info = pTsqrSvd(band_rows, matU, matS, comm);
+  if (info > 0) {
+    ERROR() << "The algorithm computing SVD failed to converge.";
+    exit(1);
+  }
 
-	if(rank == 0)
-	{
-		DEBUG() << "sum of gainMatrix: " << getSum(gainMatrix);
-	}
+  int clip = clipPosition(matS);
+  DEBUG() << format("tsqr svd of %d rows, clip %d: %.3f s") % numDataSamples % clip % timer.elapsed();
+
+  band_rows.release();
+
+  Matrix t1(N, N); /// U' * (D - HA)
+  Matrix t2(N, N); /// U' * HA
+  alpha_ATrans_B_plus_beta_C(1, matU, t0_rows, 0, t1);
+  alpha_ATrans_B_plus_beta_C(1, matU, HA_rows, 0, t2);
+  t0_rows.release();
+  HA_rows.release();
+  matU.release();
+  MPI_Allreduce(MPI_IN_PLACE, t1.getData(), t1.size(), MPI_DOUBLE, MPI_SUM, comm);
+  MPI_Allreduce(MPI_IN_PLACE, t2.getData(), t2.size(), MPI_DOUBLE, MPI_SUM, comm);
+
+  Matrix local_t1(local_n, N); /// SSqInv * U' * (D - HA) of the members of this process
+  const Matrix::value_type *s = matS.getData();
+  for (int j = 0; j < local_n; j++) {
+    const Matrix::value_type *q = t1.getData() + (rank * local_n + j) * N;
+    Matrix::value_type *p = local_t1.getData() + j * N;
+    for (int i = 0; i < N; i++) {
+      p[i] = i < clip ? q[i] * (1 / s[i]) * (1 / s[i]) : 0;
+    }
+  }
 
+  alpha_ATrans_B_plus_beta_C(1, t2, local_t1, 0, t4);
+}
 
-  if (rank == 0) {
-    float dt = fm.getdt();
-    float dx = fm.getdx();
+void EnkfAnalyze::saveState(CheckpointData &ckpt, const std::string &key) const {
+  enkfRandomCodes.saveState(ckpt, key + ".codes");
+  ckpt.putValue(key + ".initSigma", initSigma);
+  ckpt.putValue(key + ".sigmaIter0", sigmaIter0);
+  if (initSigma) {
+    std::ostringstream os;
+    os << generator->engine() << " " << generator->distribution();
+    ckpt.putString(key + ".generator", os.str());
+  }
+}
+
+void EnkfAnalyze::loadState(const CheckpointData &ckpt, const std::string &key) {
+  enkfRandomCodes.loadState(ckpt, key + ".codes");
+  initSigma = ckpt.getValue<bool>(key + ".initSigma");
+  sigmaIter0 = ckpt.getValue<float>(key + ".sigmaIter0");
+  if (initSigma) {
+    /// the mean and sigma come back with the distribution
+    generator = new boost::variate_generator<boost::mt19937, boost::normal_distribution<> >(boost::mt19937(), boost::normal_distribution<>(0, sigmaIter0));
+    std::istringstream is(ckpt.getString(key + ".generator"));
+    is >> generator->engine() >> generator->distribution();
+    if (!is) {
+      sf_error("%s.generator of the checkpoint is not a generator state", key.c_str());
+    }
+  }
+}
+
+/**
+ * members += (members - mean) * gain, gain is the N * N matrix of all the
+ * members. The model rows of each process come straight from the storage of
+ * the members and the perturbations replace them in place, the product goes
+ * back into one buffer of the size of the members of this process
+ */
+void EnkfAnalyze::updateEnsemble(Ensemble &ens, Matrix &gain) const {
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+
+  int local_n = ens.size();
+  int N = gain.getNumRow();
+  float dt = fm.getdt();
+  float dx = fm.getdx();
 
-    std::vector<float *> &A = totalVelSet; /// velSet <==> matA
-    int N = totalVelSet.size();
-    std::vector<float> AMean = createAMean(A);
-    DEBUG() << "sum of AMean: " << sum(AMean);
+  TRACE() << "the model rows of all the members in each process";
+  int rows = pLocalRows(modelSize, comm);
+  std::vector<float> A_rows((size_t)rows * N + 1);
+  pColumnsToRows(ens.data(), modelSize, local_n, &A_rows[0], comm);
 
-    Matrix A_Perturb(N, modelSize);
-    initAPerturb(A_Perturb, A, AMean, modelSize);
-    DEBUG() << "sum of A_Perturb: " << getSum(A_Perturb);
+  std::vector<double> AMean(rows + 1);
+  for (int j = 0; j < N; j++) {
+    const float *p = &A_rows[(size_t)j * rows];
+    std::transform(AMean.begin(), AMean.begin() + rows, p, AMean.begin(), std::plus<double>());
+  }
+  for (int j = 0; j < N; j++) {
+    float *p = &A_rows[(size_t)j * rows];
+    for (int i = 0; i < rows; i++) {
+      p[i] -= AMean[i] / N;
+    }
+  }
+
+  std::vector<float> t5_rows((size_t)rows * N + 1);
+  if (singlePrecision) {
+    std::vector<float> g(gain.getData(), gain.getData() + gain.size());
+    char trans = 'n';
+    float alpha = 1;
+    float beta = 0;
+    int lda = std::max(rows, 1);
+    sgemm_(&trans, &trans, &rows, &N, &N, &alpha, &A_rows[0], &lda, &g[0], &N, &beta, &t5_rows[0], &lda);
+  } else {
+    Matrix A_Perturb_rows(N, rows);
+    std::copy(A_rows.begin(), A_rows.begin() + A_Perturb_rows.size(), A_Perturb_rows.getData());
+    Matrix t5(N, rows);
+    alpha_A_B_plus_beta_C(1, A_Perturb_rows, gain, 0, t5);
+    std::copy(t5.getData(), t5.getData() + t5.size(), t5_rows.begin());
+  }
+  std::vector<float>().swap(A_rows);
 
-    Matrix t5(N, modelSize);
-    alpha_A_B_plus_beta_C(1, A_Perturb, gainMatrix, 0, t5);
-    DEBUG() << "sum of t5: " << getSum(t5);
+  std::vector<float> local_t5((size_t)modelSize * local_n + 1);
+  pRowsToColumns(&t5_rows[0], &local_t5[0], modelSize, local_n, comm);
 
+  float sum_t5 = sum(local_t5);
+  MPI_Allreduce(MPI_IN_PLACE, &sum_t5, 1, MPI_FLOAT, MPI_SUM, comm);
+  if (rank == 0) {
+    DEBUG() << "sum of gainMatrix: " << getSum(gain);
+    DEBUG() << "sum of t5: " << sum_t5;
     TRACE() << "add the update back to velocity model";
-    for (size_t i = 0; i < totalVelSet.size(); i++) {
-      float *vel = totalVelSet[i];
+  }
 
-      DEBUG() << format("before vel recovery, velset[%2d/%d], min: %f, max: %f") % i % totalVelSet.size() %
-          (*std::min_element(vel, vel + modelSize)) % (*std::max_element(vel, vel + modelSize));
+  for (int i = 0; i < local_n; i++) {
+    float *vel = ens.member(i);
+    int absvel = rank * local_n + i + 1;
 
-      TRACE() << "transform velocity to original";
-      std::transform(vel, vel + modelSize, vel, boost::bind(velRecover<float>, _1, dx, dt));
+    DEBUG() << format("before vel recovery, velset[%2d/%d], min: %f, max: %f") % absvel % N %
+        (*std::min_element(vel, vel + modelSize)) % (*std::max_element(vel, vel + modelSize));
 
-      DEBUG() << format("vel recoverty,       velset[%2d/%d], min: %f, max: %f") % i % totalVelSet.size() %
-          (*std::min_element(vel, vel + modelSize)) % (*std::max_element(vel, vel + modelSize));
+    TRACE() << "transform velocity to original";
+    std::transform(vel, vel + modelSize, vel, boost::bind(velRecover<float>, _1, dx, dt));
 
-      TRACE() << "add value calculated from ENKF to velocity";
-      Matrix::value_type *pu = t5.getData() + i * t5.getNumRow();
-      std::transform(vel, vel + modelSize, pu, vel, std::plus<Matrix::value_type>());
+    TRACE() << "add value calculated from ENKF to velocity";
+    const float *pu = &local_t5[(size_t)i * modelSize];
+    std::transform(vel, vel + modelSize, pu, vel, std::plus<float>());
 
-      TRACE() << "sum velset " << i << ": " << std::accumulate(vel, vel + modelSize, 0.0f);
-      DEBUG() << format("after plus ENKF,     velset[%2d/%d], min: %f, max: %f\n") % i % totalVelSet.size() %
-          (*std::min_element(vel, vel + modelSize)) % (*std::max_element(vel, vel + modelSize));
+    DEBUG() << format("after plus ENKF,     velset[%2d/%d], min: %f, max: %f\n") % absvel % N %
+        (*std::min_element(vel, vel + modelSize)) % (*std::max_element(vel, vel + modelSize));
 
-      std::transform(vel, vel + modelSize, vel, boost::bind(velTrans<float>, _1, dx, dt));
-    }
+    std::transform(vel, vel + modelSize, vel, boost::bind(velTrans<float>, _1, dx, dt));
   }
 }
 
-void EnkfAnalyze::pAnalyze(std::vector<float *> &velSet, Matrix &lambdaSet, Matrix &ratioSet) const {
+void EnkfAnalyze::analyze(Ensemble &ens) const {
   std::vector<int> code = enkfRandomCodes.genPlus1Minus1(fm.getns());
+  Matrix gainMatrix(0, 0);
+  calGainMatrix(ens.members(), code, gainMatrix);
+  updateEnsemble(ens, gainMatrix);
+}
 
+void EnkfAnalyze::pAnalyze(Ensemble &ens, Matrix &lambdaSet, Matrix &ratioSet) const {
+  std::vector<int> code = enkfRandomCodes.genPlus1Minus1(fm.getns());
+
+  std::vector<float *> velSet = ens.members();
   int local_n = velSet.size();
   std::vector<float> resdSet(local_n);
-  Matrix pGainMatrix = pCalGainMatrix(velSet, code, resdSet);
+  Matrix pGainMatrix(0, 0);
+  pCalGainMatrix(velSet, code, resdSet, pGainMatrix);
 
 
   int rank;
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_rank(comm, &rank);
 
   /*
 	gainMatrix.print("gainMatrix");
@@ -131,66 +318,29 @@ void EnkfAnalyze::pAnalyze(std::vector<float *> &velSet, Matrix &lambdaSet, Matr
    */
 
 
-  int N = 0;
-  MPI_Reduce(&local_n, &N, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD); /// reduce # of total samples to rank 0
-  int nSamples = N;
-  MPI_Bcast(&nSamples, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  int nSamples = pGainMatrix.getNumRow();
 
-  Matrix::value_type sum_pGainMatrix = pGetSum(pGainMatrix, nSamples);
+  Matrix::value_type sum_pGainMatrix = pGetSum(pGainMatrix, nSamples, comm);
   if(rank == 0)
   {
     //DEBUG() << "sum of gainMatrix: " << getSum(gainMatrix);
     DEBUG() << "sum of pGainMatrix: " << sum_pGainMatrix;
   }
 
-
-  float dt = fm.getdt();
-  float dx = fm.getdx();
-  std::vector<float *> &local_A = velSet; /// velSet <==> matA
-  std::vector<float> pAMean = pCreateAMean(local_A, nSamples);
-  Matrix local_A_Perturb(local_n, modelSize);
-  initAPerturb(local_A_Perturb, local_A, pAMean, modelSize);
-  /*
-	char filename[20];
-	sprintf(filename, "HA_Perturb%d.txt", rank);
-	local_A_Perturb.print(filename);
-   */
-  Matrix::value_type sum_A_Perturb = pGetSum(local_A_Perturb, nSamples);
-  Matrix local_t5(local_n, modelSize);
-  pAlpha_A_B_plus_beta_C(1.0, local_A_Perturb, 1, pGainMatrix, 1, 0.0, local_t5, 1, nSamples);
-  Matrix::value_type sum_local_t5 = pGetSum(local_t5, nSamples);
-
-  if(rank == 0)
-  {
-    DEBUG() << "sum of pAMean: " << sum(pAMean);
-    DEBUG() << "sum of local_A_Perturb: " << sum_A_Perturb;
-    DEBUG() << "sum of pt5: " << sum_local_t5;
-    TRACE() << "add the update back to velocity model";
-  }
-  for (size_t i = 0; i < velSet.size(); i++) {
-    float *vel = velSet[i];
-    int absvel = rank * local_n + i + 1;
-    DEBUG() << format("before vel recovery, velset[%2d/%d], min: %f, max: %f") % absvel % nSamples %
-        (*std::min_element(vel, vel + modelSize)) % (*std::max_element(vel, vel + modelSize));
-    TRACE() << "transform velocity to original";
-    std::transform(vel, vel + modelSize, vel, boost::bind(velRecover<float>, _1, dx, dt));
-    DEBUG() << format("vel recoverty,       velset[%2d/%d], min: %f, max: %f") % absvel % nSamples %
-        (*std::min_element(vel, vel + modelSize)) % (*std::max_element(vel, vel + modelSize));
-    TRACE() << "add value calculated from ENKF to velocity";
-    Matrix::value_type *pu = local_t5.getData() + i * local_t5.getNumRow();
-    std::transform(vel, vel + modelSize, pu, vel, std::plus<Matrix::value_type>());
-    TRACE() << "sum velset " << i << ": " << std::accumulate(vel, vel + modelSize, 0.0f);
-    DEBUG() << format("after plus ENKF,     velset[%2d/%d], min: %f, max: %f\n") % absvel % nSamples %
-        (*std::min_element(vel, vel + modelSize)) % (*std::max_element(vel, vel + modelSize));
-    std::transform(vel, vel + modelSize, vel, boost::bind(velTrans<float>, _1, dx, dt));
-  }
+  /// the N * N gain is small, each process has all of it to update the rows of its members
+  Matrix gainMatrix(nSamples, nSamples);
+  MPI_Allgather(pGainMatrix.getData(), pGainMatrix.size(), MPI_DOUBLE, gainMatrix.getData(), pGainMatrix.size(), MPI_DOUBLE, comm);
+  updateEnsemble(ens, gainMatrix);
 
   TRACE() << "updating ratioset";
   Matrix ratio_Perturb(local_n, 2);
   pInitRatioPerturb(ratioSet, ratio_Perturb, nSamples);
 
+  /// the 2 * N perturbations are small, each process multiplies them by its columns of the gain
+  Matrix ratioPerturbSet(nSamples, 2);
+  MPI_Allgather(ratio_Perturb.getData(), ratio_Perturb.size(), MPI_DOUBLE, ratioPerturbSet.getData(), ratio_Perturb.size(), MPI_DOUBLE, comm);
   Matrix local_t6(local_n, 2);
-  pAlpha_A_B_plus_beta_C(1, ratio_Perturb, 1, pGainMatrix, 1, 0, local_t6, 1, nSamples);
+  alpha_A_B_plus_beta_C(1, ratioPerturbSet, pGainMatrix, 0, local_t6);
 
   A_plus_B(ratioSet, local_t6, ratioSet);
 
@@ -213,180 +363,40 @@ void EnkfAnalyze::pAnalyze(std::vector<float *> &velSet, Matrix &lambdaSet, Matr
 
 }
 
-Matrix EnkfAnalyze::calGainMatrix(const std::vector<float*>& velSet, std::vector<int> code) const {
-  int local_n = velSet.size();
-  int nt = fm.getnt();
-  int ng = fm.getng();
-  int numDataSamples = nt * ng;
-
-  int N = 0;
-  MPI_Reduce(&local_n, &N, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD); /// reduce # of total samples to rank 0
-
+void EnkfAnalyze::calGainMatrix(const std::vector<float*>& velSet, std::vector<int> code, Matrix &t4) const {
 	if(code.size() == 0)
 	{
 		code = enkfRandomCodes.genPlus1Minus1(fm.getns());
 	}
-  MPI_Bcast(&code[0], code.size(), MPI_INT, 0, MPI_COMM_WORLD);   /// broadcast the code to all other processes
-
-  Matrix local_HOnA(local_n, numDataSamples);
-  Matrix local_D(local_n, numDataSamples);
-  Matrix HOnA(N, numDataSamples);
-  Matrix D(N, numDataSamples);
-
-  for (int i = 0; i < local_n; i++) {
-    DEBUG() << format("calculate HA on velocity %2d/%d") % (i + 1) % velSet.size();
-
-    /// "making encoded shot, both sources and receivers";
-    Encoder encoder(code);
-    std::vector<float> encobs = encoder.encodeObsData(dobs, nt, ng);
-    std::vector<float> encsrc  = encoder.encodeSource(wlt);
-
-    /// "save encoded data";
-    std::vector<float> trans(encobs.size());
-    matrix_transpose(&encobs[0], &trans[0], ng, nt);
-    const float *pdata = &trans[0];
-    std::copy(pdata, pdata + numDataSamples, local_D.getData() + i * numDataSamples);
-
-    DEBUG() << format("sum D %.20f") % getSum(local_D);
-
-    /// "H operate on A, and store data in HOnA";
-    std::vector<float> dcal(encobs.size(), 0);
-
-    ///// this decrease the performance ///
-    ForwardModeling newfm = fm;
-    Velocity curvel(std::vector<float>(velSet[i], velSet[i] + modelSize), fm.getnx(), fm.getnz());
-    newfm.bindVelocity(curvel);
-
-    DEBUG() << format("   curvel %.20f") % sum(curvel.dat);
-    newfm.EssForwardModeling(encsrc, dcal);
-    matrix_transpose(&dcal[0], &trans[0], ng, nt);
-    std::copy(pdata, pdata + numDataSamples, local_HOnA.getData() + i * numDataSamples);
-
-    DEBUG() << format("   sum HonA %.20f") % getSum(local_HOnA);
-  }
-
-  int rank;
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-
-  int count = local_D.getNumCol() * local_D.getNumRow();
-  MPI_Gather(local_D.getData(), count, MPI_DOUBLE, D.getData(), count, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-  MPI_Gather(local_HOnA.getData(), count, MPI_DOUBLE, HOnA.getData(), count, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-
-  Matrix t4(N, N); /// HA' * U * SSqInv * U' * (D - HA)
-
-  if (rank == 0) {
-    DEBUG() << "sum of D: " << getSum(D);
-    DEBUG() << "sum of HOnA: " << getSum(HOnA);
-
-    Matrix HA_Perturb(N, numDataSamples);
-    initGamma(HOnA, HA_Perturb);
-    DEBUG() << "sum of HA_Perturb: " << getSum(HA_Perturb);
-
-    TRACE() << "initialize the perturbation";
-    Matrix perturbation(N, numDataSamples);
-    initPerturbation(perturbation, HA_Perturb);
-
-    DEBUG() << "sum of perturbation: " << getSum(perturbation);
-
-    TRACE() << "add perturbation to observed data";
-    std::transform(D.getData(), D.getData() + D.size(), perturbation.getData(), D.getData(), std::plus<Matrix::value_type>());
-    DEBUG() << "sum of D with perturbation added: " << getSum(D);
-
-    TRACE() << "calculate the gamma";
-    Matrix gamma(N, numDataSamples);
-    initGamma(perturbation, gamma);
-    DEBUG() << "sum of gamma: " << getSum(gamma);
-
-    TRACE() << "calculate the band";
-    Matrix band(N, numDataSamples);
-    A_plus_B(HA_Perturb, gamma, band);
-    DEBUG() << "sum of band: " << getSum(band);
-
-		//band.print("band.txt");
-
-    TRACE() << "svd of band";
-		Matrix matU(N, numDataSamples);
-		Matrix matS(1, N);
-    Matrix matVt(N, N);
-
-    int lwork = std::max(1, std::max(3 * std::min(numDataSamples, N) + std::max(numDataSamples, N), 5 * std::min(numDataSamples, N)));
-    Matrix superb(1, lwork);
-
-    int info = LAPACKE_dgesvd_col_major('S', 'S',
-        band.getNumRow(), band.getNumCol(),
-        band.getData(), band.getNumRow(),
-        matS.getData(),
-        matU.getData(), matU.getNumRow(),
-        matVt.getData(), matVt.getNumRow(),
-        superb.getData(), lwork);
-
-    /* Check for convergence */
-    if ( info > 0 ) {
-      ERROR() << "The algorithm computing SVD failed to converge.";
-      exit( 1 );
-    }
-
-    DEBUG() << "sum of matU: " << getSum(matU);
-    DEBUG() << "sum of matS: " << getSum(matS);
-
-    TRACE() << "calculate matSSqInv";
-    int clip = clipPosition(matS);
-    DEBUG() << "clip: " << clip;
-    DEBUG() << "matS: ";
-    matS.print();
-
-		Matrix matSSqInv(N, N);
-    {
-      Matrix::value_type *p = matSSqInv.getData();
-      Matrix::value_type *s = matS.getData();
-      const int nrow = matSSqInv.getNumRow();
-      for (int i = 0; i < clip; i++) {
-        p[i * nrow + i] = (1 / s[i]) * (1 / s[i]);
-      }
-    }
-    DEBUG() << "sum of matSSqInv: " << getSum(matSSqInv);
-    TRACE() << "matSSQInv: ";
-
-		Matrix t0(N, numDataSamples); /// D - HA
-    A_minus_B(D, HOnA, t0);
-    DEBUG() << "sum of t0: " << getSum(t0);
-
-		Matrix t1(N, N); /// U' * (D - HA)
-    alpha_ATrans_B_plus_beta_C(1, matU, t0, 0, t1);
-    DEBUG() << "sum of t1: " << getSum(t1);
 
-    Matrix t2(N, N); /// HA' * U
-    alpha_ATrans_B_plus_beta_C(1, HA_Perturb, matU, 0, t2);
-    DEBUG() << "sum of t2: " << getSum(t2);
+  std::vector<float> resdSet(velSet.size());
+  Matrix local_t4(0, 0);
+  pCalGainMatrix(velSet, code, resdSet, local_t4);
 
-		Matrix t3(N, N); /// HA' * U * SSqInv
-    alpha_A_B_plus_beta_C(1, t2, matSSqInv, 0, t3);
-    DEBUG() << "sum of t3: " << getSum(t3);
-
-    alpha_A_B_plus_beta_C(1, t3, t1, 0, t4);
-    DEBUG() << "sum of t4: " << getSum(t4);
-    DEBUG() << "print HA' * U * SSqInv * U' * (D - HA)";
-    t4.print();
-  }
-  return t4;
+  /// the columns of the members of each process, the N * N matrix is small
+  int N = local_t4.getNumRow();
+  Matrix all_t4(N, N); /// HA' * U * SSqInv * U' * (D - HA)
+  MPI_Allgather(local_t4.getData(), local_t4.size(), MPI_DOUBLE, all_t4.getData(), local_t4.size(), MPI_DOUBLE, comm);
+  t4.swap(all_t4);
 }
 
-Matrix EnkfAnalyze::pCalGainMatrix(const std::vector<float*>& velSet, std::vector<int> code, std::vector<float> &resdSet) const {
+void EnkfAnalyze::pCalGainMatrix(const std::vector<float*>& velSet, std::vector<int> code, std::vector<float> &resdSet,
+    Matrix &t4) const {
   int local_n = velSet.size();
   int nt = fm.getnt();
   int ng = fm.getng();
   int numDataSamples = nt * ng;
 
 	int rank;
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_rank(comm, &rank);
 
   int N = 0;
-  MPI_Reduce(&local_n, &N, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD); /// reduce # of total samples to rank 0
+  MPI_Reduce(&local_n, &N, 1, MPI_INT, MPI_SUM, 0, comm); /// reduce # of total samples to rank 0
 
 	int nSamples = N;
-	MPI_Bcast(&nSamples, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	MPI_Bcast(&nSamples, 1, MPI_INT, 0, comm);
 
-  MPI_Bcast(&code[0], code.size(), MPI_INT, 0, MPI_COMM_WORLD);   /// broadcast the code to all other processes
+  MPI_Bcast(&code[0], code.size(), MPI_INT, 0, comm);   /// broadcast the code to all other processes
 
   Matrix local_HOnA(local_n, numDataSamples);
   Matrix local_D(local_n, numDataSamples);
@@ -431,101 +441,56 @@ Matrix EnkfAnalyze::pCalGainMatrix(const std::vector<float*>& velSet, std::vecto
 
   }
 
-  int count = local_D.getNumCol() * local_D.getNumRow();
-
-  Matrix t4(N, N); /// HA' * U * SSqInv * U' * (D - HA)
-
-	Matrix::value_type sum_local_D = pGetSum(local_D, N);
-	Matrix::value_type sum_local_HOnA = pGetSum(local_HOnA, N);
+  /**
+   * each step writes over a matrix which is not needed anymore and the
+   * others are released as soon as they are used, no more than four of the
+   * data matrices are alive at once
+   */
+	Matrix::value_type sum_local_D = pGetSum(local_D, N, comm);
+	Matrix::value_type sum_local_HOnA = pGetSum(local_HOnA, N, comm);
   Matrix local_HA_Perturb(local_n, numDataSamples);
 	pInitGamma(local_HOnA, local_HA_Perturb, nSamples);
-	Matrix::value_type sum_HA_Pertrub = pGetSum(local_HA_Perturb, nSamples);
+	Matrix::value_type sum_HA_Pertrub = pGetSum(local_HA_Perturb, nSamples, comm);
   Matrix local_perturbation(local_n, numDataSamples);
   pInitPerturbation(local_perturbation, local_HA_Perturb, rank, nSamples);
-	Matrix::value_type sum_local_perturbation = pGetSum(local_perturbation, nSamples);
-  std::transform(local_D.getData(), local_D.getData() + local_D.size(), local_perturbation.getData(), local_D.getData(), std::plus<Matrix::value_type>());
-	Matrix::value_type sum_local_D2 = pGetSum(local_D, nSamples);
-  Matrix local_gamma(local_n, numDataSamples);
-  pInitGamma(local_perturbation, local_gamma, nSamples);
-	Matrix::value_type sum_local_gamma = pGetSum(local_gamma, nSamples);
-  Matrix local_band(local_n, numDataSamples);
-  A_plus_B(local_HA_Perturb, local_gamma, local_band);
-	Matrix::value_type sum_local_band = pGetSum(local_band, nSamples);
-  Matrix local_matU(local_n, numDataSamples);
-  Matrix local_matS(1, nSamples);
-  Matrix local_matVt(local_n, nSamples);
-	int info = pSvd(local_band, local_matU, local_matS, local_matVt, nSamples);
-  Matrix matU2(N, numDataSamples);
-  Matrix matVt2(N, nSamples);
-	Matrix::value_type sum_local_matU = pGetSum(local_matU, nSamples);
-  Matrix local_matSSqInv(N, N);
-	if(	rank == 0) {
+	Matrix::value_type sum_local_perturbation = pGetSum(local_perturbation, nSamples, comm);
+  A_plus_B(local_D, local_perturbation, local_D);
+	Matrix::value_type sum_local_D2 = pGetSum(local_D, nSamples, comm);
+
+  Matrix local_t0(0, 0); /// D - HA, in the storage of HA
+	A_minus_B(local_D, local_HOnA, local_HOnA);
+  local_t0.swap(local_HOnA);
+  local_D.release();
+	Matrix::value_type sum_local_t0 = pGetSum(local_t0, nSamples, comm);
+
+  Matrix local_band(0, 0); /// gamma + HA_Perturb, in the storage of the perturbation
+  pInitGamma(local_perturbation, local_perturbation, nSamples);
+  local_band.swap(local_perturbation);
+	Matrix::value_type sum_local_gamma = pGetSum(local_band, nSamples, comm);
+  A_plus_B(local_HA_Perturb, local_band, local_band);
+	Matrix::value_type sum_local_band = pGetSum(local_band, nSamples, comm);
+  Matrix local_t4(local_n, nSamples); /// HA' * U * SSqInv * U' * (D - HA)
+  if (lowRankSvd(nSamples)) {
+    lowRankGain(local_band, local_HA_Perturb, local_t0, local_t4, comm);
+  } else {
+    tsqrGain(local_band, local_HA_Perturb, local_t0, local_t4, comm);
+  }
+	Matrix::value_type sum_local_t4 = pGetSum(local_t4, nSamples, comm);
+	if(rank == 0)
+	{
     DEBUG() << "parallel: sum of local_D: " << sum_local_D;
     DEBUG() << "parallel: sum of local_HOnA: " << sum_local_HOnA;
     DEBUG() << "parallel: sum of local_HA_Perturb: " << sum_HA_Pertrub;
-    TRACE() << "parallel: initialize the perturbation";
     DEBUG() << "parallel: sum of local_perturbation: " << sum_local_perturbation;
-    TRACE() << "parallel: add perturbation to observed data";
     DEBUG() << "parallel: sum of local_D with perturbation added: " << sum_local_D2;
-    TRACE() << "parallel: calculate the gamma";
     DEBUG() << "parallel: sum of local_gamma: " << sum_local_gamma;
-    TRACE() << "parallel: calculate the band";
     DEBUG() << "parallel: sum of local_band: " << sum_local_band;
-    TRACE() << "parallel: svd of band";
-    if ( info > 0 ) {
-      ERROR() << "The algorithm computing SVD failed to converge.";
-      exit( 1 );
-    }
-    DEBUG() << "parallel: sum of local_matU: " << sum_local_matU;
-    DEBUG() << "parallel: sum of local_matS: " << getSum(local_matS);
-    TRACE() << "parallel: calculate matSSqInv";
-    int local_clip = clipPosition(local_matS);
-    DEBUG() << "parallel: local_clip: " << local_clip;
-    DEBUG() << "parallel: local_matS: ";
-    local_matS.print();
-    {
-      Matrix::value_type *p = local_matSSqInv.getData();
-      Matrix::value_type *s = local_matS.getData();
-      const int nrow = local_matSSqInv.getNumRow();
-      for (int i = 0; i < local_clip; i++) {
-        p[i * nrow + i] = (1 / s[i]) * (1 / s[i]);
-      }
-    }
-		//local_matSSqInv.print("local_matSSqInv.txt");
-	}
-  Matrix local_t0(local_n, numDataSamples); /// D - HA
-	A_minus_B(local_D, local_HOnA, local_t0);
-	Matrix::value_type sum_local_t0 = pGetSum(local_t0, nSamples);
-  Matrix local_t1(local_n, nSamples); /// U' * (D - HA)
-  pAlpha_ATrans_B_plus_beta_C(1.0, local_matU, 1, local_t0, 1, 0.0, local_t1, 1, nSamples);
-	Matrix::value_type sum_local_t1 = pGetSum(local_t1, nSamples);
-  Matrix local_t2(local_n, nSamples); /// U' * (D - HA)
-  pAlpha_ATrans_B_plus_beta_C(1.0, local_HA_Perturb, 1, local_matU, 1, 0.0, local_t2, 1, nSamples);
-	Matrix::value_type sum_local_t2 = pGetSum(local_t2, nSamples);
-  Matrix local_t3(local_n, nSamples); /// U' * (D - HA)
-  pAlpha_A_B_plus_beta_C(1.0, local_t2, 1, local_matSSqInv, 0, 0.0, local_t3, 1, nSamples);
-	Matrix::value_type sum_local_t3 = pGetSum(local_t3, nSamples);
-  Matrix local_t4(local_n, nSamples); /// U' * (D - HA)
-  pAlpha_A_B_plus_beta_C(1.0, local_t3, 1, local_t1, 1, 0.0, local_t4, 1, nSamples);
-	Matrix::value_type sum_local_t4 = pGetSum(local_t4, nSamples);
-	/*
-	char filename[20];
-	sprintf(filename, "local_t4%d.txt", rank);
-	local_t4.print(filename);
-	*/
-	if(rank == 0)
-	{
-    DEBUG() << "parallel: sum of matSSqInv: " << getSum(local_matSSqInv);
-    TRACE() << "parallel: matSSQInv: ";
     DEBUG() << "parallel: sum of t0: " << sum_local_t0;
-    DEBUG() << "parallel: sum of t1: " << sum_local_t1;
-    DEBUG() << "parallel: sum of t2: " << sum_local_t2;
-    DEBUG() << "parallel: sum of t3: " << sum_local_t3;
     DEBUG() << "parallel: sum of t4: " << sum_local_t4;
 	}
   DEBUG() << "parallel: print HA' * U * SSqInv * U' * (D - HA)";
 	local_t4.print();
-	return local_t4;
+	t4.swap(local_t4);
 }
 void EnkfAnalyze::initLambdaSet(const std::vector<float*>& velSet, Matrix& lambdaSet, const Matrix& ratioSet) const {
   DEBUG() << "initial lambda ratio is: " << ratioSet.getData()[0];
@@ -623,27 +588,32 @@ void EnkfAnalyze::initGamma(const Matrix& perturbation, Matrix& gamma) const {
 	//printf("\n");
 }
 
+/// gamma may be the perturbation itself, the columns are walked in storage order
 void EnkfAnalyze::pInitGamma(const Matrix& perturbation, Matrix& gamma, const int nSamples) const {
   assert(perturbation.isCompatible(gamma));
 
   const Matrix::value_type *p = perturbation.getData();
-	std::vector<Matrix::value_type> sum_t(gamma.getNumRow(), 0.0);
-	std::vector<Matrix::value_type> sum(gamma.getNumRow(), 0.0);
-
-  for (int irow = 0; irow < gamma.getNumRow(); irow++) {
-    for (int icol = 0; icol < gamma.getNumCol(); icol++) {
-      sum_t[irow] += p[icol * gamma.getNumRow() + irow];
+  int nrow = gamma.getNumRow();
+	std::vector<Matrix::value_type> sum_t(nrow, 0.0);
+	std::vector<Matrix::value_type> sum(nrow, 0.0);
+
+  for (int icol = 0; icol < gamma.getNumCol(); icol++) {
+    const Matrix::value_type *pc = p + (size_t)icol * nrow;
+    for (int irow = 0; irow < nrow; irow++) {
+      sum_t[irow] += pc[irow];
     }
 	}
 
-	MPI_Allreduce(&sum_t[0], &sum[0], gamma.getNumRow(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+	MPI_Allreduce(&sum_t[0], &sum[0], nrow, MPI_DOUBLE, MPI_SUM, comm);
 
-  for (int irow = 0; irow < gamma.getNumRow(); irow++) {
-		Matrix::value_type avg = sum[irow] / nSamples;
-		//printf("%f ", avg);
-    for (int icol = 0; icol < gamma.getNumCol(); icol++) {
-      int idx = icol * gamma.getNumRow() + irow;
-      gamma.getData()[idx] = p[idx] - avg;
+  for (int irow = 0; irow < nrow; irow++) {
+    sum[irow] /= nSamples;
+  }
+  for (int icol = 0; icol < gamma.getNumCol(); icol++) {
+    const Matrix::value_type *pc = p + (size_t)icol * nrow;
+    Matrix::value_type *g = gamma.getData() + (size_t)icol * nrow;
+    for (int irow = 0; irow < nrow; irow++) {
+      g[irow] = pc[irow] - sum[irow];
     }
   }
 
@@ -690,7 +660,10 @@ std::vector<float> EnkfAnalyze::pCreateAMean(const std::vector<float*>& velSet,
       sum[i] += velSet[j][i];
     }
   }
-	MPI_Allreduce(&sum[0], &ret[0], modelSize, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+	/// the members of a node are added in shared memory first. The mean is
+	/// taken by the FWI side, always on the world, see setComm
+	NodeReducer reducer(MPI_COMM_WORLD, fm.getnx(), fm.getnz(), 0, fm.getnx(), 0, fm.getnz());
+	reducer.allreduce(&sum[0], &ret[0]);
 
   for (int i = 0; i < modelSize; i++) {
 		ret[i] /= nSamples;
@@ -702,7 +675,7 @@ std::vector<float> EnkfAnalyze::pCreateAMean(const std::vector<float*>& velSet,
 void EnkfAnalyze::check(std::vector<float> a, std::vector<float> b)
 {
 	int rank;
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_rank(comm, &rank);
 	printf("Rank = %d, checking...\n", rank);
 	int counter = 0;
 	for(int i = 0 ; i < a.size() ; i ++)
@@ -746,7 +719,7 @@ void EnkfAnalyze::pInitPerturbation(Matrix& perturbation, const Matrix &HA_Pertu
     double mean = 0;
     double maxHAP = std::abs(*std::max_element(HA_Perturb.getData(), HA_Perturb.getData() + HA_Perturb.size(), abs_less<float>));
 		double totalMaxHAP = 0;
-		MPI_Allreduce(&maxHAP, &totalMaxHAP, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+		MPI_Allreduce(&maxHAP, &totalMaxHAP, 1, MPI_DOUBLE, MPI_MAX, comm);
 		double sigma = initPerturbSigma(totalMaxHAP, sigmaFactor);
 		DEBUG() << "parallel: sigmaIter0: " << sigma;
 		sigmaIter0 = sigma;
@@ -763,7 +736,7 @@ void EnkfAnalyze::pInitPerturbation2(Matrix& perturbation, const Matrix &HA_Pert
     double mean = 0;
     double maxHAP = std::abs(*std::max_element(HA_Perturb.getData(), HA_Perturb.getData() + HA_Perturb.size(), abs_less<float>));
 		double totalMaxHAP = 0;
-		MPI_Allreduce(&maxHAP, &totalMaxHAP, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+		MPI_Allreduce(&maxHAP, &totalMaxHAP, 1, MPI_DOUBLE, MPI_MAX, comm);
 		double sigma = initPerturbSigma(totalMaxHAP, sigmaFactor);
 		DEBUG() << "parallel: sigmaIter0: " << sigma;
 		sigmaIter0 = sigma;
@@ -775,5 +748,5 @@ void EnkfAnalyze::pInitPerturbation2(Matrix& perturbation, const Matrix &HA_Pert
 	{
 		std::generate(&perturbation_t[0], &perturbation_t[0] + nSamples * perturbation.getNumRow(), *generator);
 	}
-	MPI_Scatter(&perturbation_t[0], perturbation.size(), MPI_DOUBLE, perturbation.getData(), perturbation.size(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	MPI_Scatter(&perturbation_t[0], perturbation.size(), MPI_DOUBLE, perturbation.getData(), perturbation.size(), MPI_DOUBLE, 0, comm);
 }
@@ -16,22 +16,48 @@
 #include "Matrix.h"
 #include "pMatrix.h"
 #include <iostream>
+#include <string>
+#include "checkpoint.h"
 #include "random-code.h"
+#include "ensemble.h"
 
 class EnkfAnalyze {
 public:
   EnkfAnalyze(const ForwardModeling &fm, const std::vector<float> &wlt, const std::vector<float> &dobs, float sigmafactor);
 
-  void analyze(std::vector<float *> &totalVelSet, std::vector<float *> &velSet) const;
-  void pAnalyze(std::vector<float *> &velSet, Matrix &lambdaSet, Matrix &ratioSet) const;
+  /// the members stay with their processes and are updated in their storage, no process gathers the data of all of them
+  void analyze(Ensemble &ens) const;
+  void pAnalyze(Ensemble &ens, Matrix &lambdaSet, Matrix &ratioSet) const;
   std::vector<float> createAMean(const std::vector<float *> &velSet) const;
   std::vector<float> pCreateAMean(const std::vector<float *> &velSet, const int N) const;
 	void check(std::vector<float> a, std::vector<float> b);
   void initLambdaSet(const std::vector<float*>& velSet, Matrix& lambdaSet, const Matrix& ratioSet) const;
 
+  /**
+   * keep only the leading rank singular triplets of the band, from a
+   * randomized svd with power iterations instead of the full one. More power
+   * iterations are closer to the exact triplets, rank <= 0 is the full svd
+   */
+  void setLowRankSvd(int rank, int power);
+
+  /// the members times the gain in float instead of double, half the memory and traffic
+  void setSinglePrecision(bool single);
+
+  /**
+   * the processes of the analysis, MPI_COMM_WORLD by default. A duplicate of
+   * it lets the analysis run on a thread of its own while the FWI of the
+   * members goes on with the world, see AsyncEnkf. pCreateAMean stays on
+   * the world
+   */
+  void setComm(MPI_Comm comm);
+
+  /// the encoding codes and the generator of the perturbations
+  void saveState(CheckpointData &ckpt, const std::string &key) const;
+  void loadState(const CheckpointData &ckpt, const std::string &key);
+
 protected:
-  Matrix calGainMatrix(const std::vector<float *> &velSet, std::vector<int> code) const;
-  Matrix pCalGainMatrix(const std::vector<float *> &velSet, std::vector<int> code, std::vector<float> &resdSet) const;
+  void calGainMatrix(const std::vector<float *> &velSet, std::vector<int> code, Matrix &t4) const;
+  void pCalGainMatrix(const std::vector<float *> &velSet, std::vector<int> code, std::vector<float> &resdSet, Matrix &t4) const;
   double initPerturbSigma(double maxHAP, float factor) const;
   void initGamma(const Matrix &perturbation, Matrix &gamma) const;
   void pInitGamma(const Matrix &perturbation, Matrix &gamma, const int nSamples) const;
@@ -41,10 +67,15 @@ protected:
   void pInitPerturbation(Matrix& perturbation, const Matrix &HA_Perturb, const int rank, const int nSamples) const;
   void pInitPerturbation2(Matrix& perturbation, const Matrix &HA_Perturb, const int rank, const int nSamples) const;
   void pInitRatioPerturb(const Matrix &ratioSet, Matrix &ratioPerturb, int nsamples) const;
+  bool lowRankSvd(int nSamples) const;
+  void lowRankGain(Matrix &band, Matrix &HA_Perturb, Matrix &t0, Matrix &t4, MPI_Comm comm) const;
+  void tsqrGain(Matrix &band, Matrix &HA_Perturb, Matrix &t0, Matrix &t4, MPI_Comm comm) const;
+  void updateEnsemble(Ensemble &ens, Matrix &gain) const;
 
 
 protected:
   static const int ENKF_SEED = 2;
+  static const int SVD_OVERSAMPLE = 8; /// extra samples of the range beyond the rank
 
 protected:
   const ForwardModeling &fm;
@@ -54,6 +85,10 @@ protected:
 
   int modelSize;
   float sigmaFactor;
+  int svdRank;
+  int svdPower;
+  bool singlePrecision;
+  MPI_Comm comm;
 
   mutable boost::variate_generator<boost::mt19937, boost::normal_distribution<> > *generator;
   mutable float sigmaIter0;
@@ -4,7 +4,18 @@
  *  Created on: May 19, 2016
  *      Author: Bingwei Chen
  */
+#include <vector>
+#include <algorithm>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/variate_generator.hpp>
 #include "pMatrix.h"
+#include "dgesvd.h"
+
+extern "C" {
+void dgeqrf_(int *m, int *n, double *a, int *lda, double *tau, double *work, int *lwork, int *info);
+void dorgqr_(int *m, int *n, int *k, double *a, int *lda, double *tau, double *work, int *lwork, int *info);
+}
 
 int i_zero = 0;
 int i_one = 1;
@@ -380,3 +391,247 @@ int pSvd(Matrix &tA, Matrix &tU, Matrix &tS, Matrix &tVt, const int nSamples)
 	Vt.print(filename);
 	*/
 }
+
+//the columns of Y are replaced by an orthonormal basis of them, householder qr
+static void orthonormalize(Matrix &Y)
+{
+	int m = Y.getNumRow();
+	int n = Y.getNumCol();
+	int info = 0;
+	int lwork = -1;
+	double query[2];
+	std::vector<double> tau(n);
+	dgeqrf_(&m, &n, Y.getData(), &m, &tau[0], &query[0], &lwork, &info);
+	dorgqr_(&m, &n, &n, Y.getData(), &m, &tau[0], &query[1], &lwork, &info);
+	lwork = std::max(query[0], query[1]);
+	std::vector<double> work(lwork);
+	dgeqrf_(&m, &n, Y.getData(), &m, &tau[0], &work[0], &lwork, &info);
+	dorgqr_(&m, &n, &n, Y.getData(), &m, &tau[0], &work[0], &lwork, &info);
+}
+
+//A: the local columns of the band, M * n in every process, N = n * size in total
+//U: the leading l = U.getNumCol() left singular vectors, M * l, the same in every process
+//S: the leading l singular values
+//the range of A is sampled by l gaussian combinations of its columns, the only
+//communication is the sum of the M * l samples in each pass and the gather of the small l * N projection
+int pRandSvd(Matrix &tA, Matrix &tU, Matrix &tS, int power, int seed, MPI_Comm comm)
+{
+	int rank;
+	int size;
+	MPI_Comm_size(comm, &size);
+	MPI_Comm_rank(comm, &rank);
+
+	int M = tA.getNumRow();
+	int n = tA.getNumCol();
+	int l = tU.getNumCol();
+	int N = n * size;
+
+	//Y = A * Omega, every process draws the rows of Omega of its columns
+	Matrix omega(l, n);
+	boost::mt19937 engine(seed + rank);
+	boost::variate_generator<boost::mt19937 &, boost::normal_distribution<> > gauss(engine, boost::normal_distribution<>(0, 1));
+	std::generate(omega.getData(), omega.getData() + omega.size(), gauss);
+
+	Matrix Y(l, M);
+	alpha_A_B_plus_beta_C(1, tA, omega, 0, Y);
+	MPI_Allreduce(MPI_IN_PLACE, Y.getData(), Y.size(), MPI_DOUBLE, MPI_SUM, comm);
+	orthonormalize(Y);
+
+	//Y = A * A' * Y, orthonormalized in each pass
+	Matrix Z(l, n);
+	for(int i = 0 ; i < power ; i ++)
+	{
+		alpha_ATrans_B_plus_beta_C(1, tA, Y, 0, Z);
+		alpha_A_B_plus_beta_C(1, tA, Z, 0, Y);
+		MPI_Allreduce(MPI_IN_PLACE, Y.getData(), Y.size(), MPI_DOUBLE, MPI_SUM, comm);
+		orthonormalize(Y);
+	}
+
+	//svd of the l * N matrix Y' * A in every process, U = Y * Ub
+	Matrix local_W(n, l);
+	alpha_ATrans_B_plus_beta_C(1, Y, tA, 0, local_W);
+	Matrix W(N, l);
+	MPI_Allgather(local_W.getData(), local_W.size(), MPI_DOUBLE, W.getData(), local_W.size(), MPI_DOUBLE, comm);
+
+	Matrix Ub(l, l);
+	double vt = 0;
+	int lwork = std::max(1, std::max(3 * std::min(l, N) + std::max(l, N), 5 * std::min(l, N)));
+	Matrix superb(1, lwork);
+	int info = LAPACKE_dgesvd_col_major('S', 'N', l, N, W.getData(), l, tS.getData(), Ub.getData(), l, &vt, 1, superb.getData(), lwork);
+
+	alpha_A_B_plus_beta_C(1, Y, Ub, 0, tU);
+	return info;
+}
+
+//the first row of the block of process r, the rows are split as evenly as possible
+static int rowBegin(int M, int size, int r)
+{
+	return (long)M * r / size;
+}
+
+int pLocalRows(int M, MPI_Comm comm)
+{
+	int rank;
+	int size;
+	MPI_Comm_size(comm, &size);
+	MPI_Comm_rank(comm, &rank);
+	return rowBegin(M, size, rank + 1) - rowBegin(M, size, rank);
+}
+
+//the rows of process s in the n columns of A, one strided type each, none if s has no rows
+static void memberTypes(int M, int n, int size, MPI_Datatype elem, int elemSize, std::vector<int> &counts, std::vector<int> &displs, std::vector<MPI_Datatype> &types)
+{
+	counts.resize(size);
+	displs.resize(size);
+	types.resize(size);
+	for(int s = 0 ; s < size ; s ++)
+	{
+		int b = rowBegin(M, size, s);
+		int e = rowBegin(M, size, s + 1);
+		counts[s] = (e > b && n > 0) ? 1 : 0;
+		displs[s] = b * elemSize;
+		types[s] = elem;
+		if(counts[s])
+		{
+			MPI_Type_vector(n, e - b, M, elem, &types[s]);
+			MPI_Type_commit(&types[s]);
+		}
+	}
+}
+
+static void freeTypes(const std::vector<int> &counts, std::vector<MPI_Datatype> &types)
+{
+	for(size_t s = 0 ; s < types.size() ; s ++)
+		if(counts[s])
+			MPI_Type_free(&types[s]);
+}
+
+//the columns go from A to the processes of their rows without packing, the block of process s in rows is contiguous
+static void columnsToRows(const void *A, int M, int n, void *rows, MPI_Datatype elem, int elemSize, MPI_Comm comm)
+{
+	int size;
+	MPI_Comm_size(comm, &size);
+
+	int mr = pLocalRows(M, comm);
+	std::vector<int> scounts, sdispls, rcounts(size), rdispls(size);
+	std::vector<MPI_Datatype> stypes, rtypes(size, elem);
+	memberTypes(M, n, size, elem, elemSize, scounts, sdispls, stypes);
+	for(int s = 0 ; s < size ; s ++)
+	{
+		rcounts[s] = mr * n;
+		rdispls[s] = s * mr * n * elemSize;
+	}
+	MPI_Alltoallw(const_cast<void *>(A), &scounts[0], &sdispls[0], &stypes[0], rows, &rcounts[0], &rdispls[0], &rtypes[0], comm);
+	freeTypes(scounts, stypes);
+}
+
+static void rowsToColumns(const void *rows, void *A, int M, int n, MPI_Datatype elem, int elemSize, MPI_Comm comm)
+{
+	int size;
+	MPI_Comm_size(comm, &size);
+
+	int mr = pLocalRows(M, comm);
+	std::vector<int> scounts(size), sdispls(size), rcounts, rdispls;
+	std::vector<MPI_Datatype> stypes(size, elem), rtypes;
+	memberTypes(M, n, size, elem, elemSize, rcounts, rdispls, rtypes);
+	for(int s = 0 ; s < size ; s ++)
+	{
+		scounts[s] = mr * n;
+		sdispls[s] = s * mr * n * elemSize;
+	}
+	MPI_Alltoallw(const_cast<void *>(rows), &scounts[0], &sdispls[0], &stypes[0], A, &rcounts[0], &rdispls[0], &rtypes[0], comm);
+	freeTypes(rcounts, rtypes);
+}
+
+void pColumnsToRows(const Matrix &A, Matrix &rows, MPI_Comm comm)
+{
+	columnsToRows(A.getData(), A.getNumRow(), A.getNumCol(), rows.getData(), MPI_DOUBLE, sizeof(double), comm);
+}
+
+void pRowsToColumns(const Matrix &rows, Matrix &A, MPI_Comm comm)
+{
+	rowsToColumns(rows.getData(), A.getData(), A.getNumRow(), A.getNumCol(), MPI_DOUBLE, sizeof(double), comm);
+}
+
+void pColumnsToRows(const float *A, int M, int n, float *rows, MPI_Comm comm)
+{
+	columnsToRows(A, M, n, rows, MPI_FLOAT, sizeof(float), comm);
+}
+
+void pRowsToColumns(const float *rows, float *A, int M, int n, MPI_Comm comm)
+{
+	rowsToColumns(rows, A, M, n, MPI_FLOAT, sizeof(float), comm);
+}
+
+//Q: m * n on input, its first min(m, n) columns are the q factor on output, the others zero
+//R: n * n upper triangular
+static void householderQR(Matrix &Q, Matrix &R)
+{
+	int m = Q.getNumRow();
+	int n = Q.getNumCol();
+	int k = std::min(m, n);
+	std::fill(R.getData(), R.getData() + R.size(), 0);
+	if(k == 0)
+		return;
+
+	int info = 0;
+	int lwork = -1;
+	double query[2];
+	std::vector<double> tau(k);
+	dgeqrf_(&m, &n, Q.getData(), &m, &tau[0], &query[0], &lwork, &info);
+	dorgqr_(&m, &k, &k, Q.getData(), &m, &tau[0], &query[1], &lwork, &info);
+	lwork = std::max(query[0], query[1]);
+	std::vector<double> work(lwork);
+	dgeqrf_(&m, &n, Q.getData(), &m, &tau[0], &work[0], &lwork, &info);
+
+	for(int j = 0 ; j < n ; j ++)
+		for(int i = 0 ; i <= std::min(j, k - 1) ; i ++)
+			R.getData()[j * n + i] = Q.getData()[j * m + i];
+
+	dorgqr_(&m, &k, &k, Q.getData(), &m, &tau[0], &work[0], &lwork, &info);
+	std::fill(Q.getData() + k * m, Q.getData() + Q.size(), 0);
+}
+
+//A: mr * N, the rows of this process, U: mr * N, S: the N singular values
+//A = Q_r * R_r in every process, the stacked R_r = Q2 * R in every process after one gather,
+//R = Ur * S * Vt, so U = Q_r * Q2_r * Ur
+int pTsqrSvd(const Matrix &tA, Matrix &tU, Matrix &tS, MPI_Comm comm)
+{
+	int rank;
+	int size;
+	MPI_Comm_size(comm, &size);
+	MPI_Comm_rank(comm, &rank);
+
+	int mr = tA.getNumRow();
+	int N = tA.getNumCol();
+
+	Matrix Q(N, mr);
+	std::copy(tA.getData(), tA.getData() + tA.size(), Q.getData());
+	Matrix local_R(N, N);
+	householderQR(Q, local_R);
+
+	Matrix Rs(N, N * size);
+	{
+		std::vector<double> all(N * N * size);
+		MPI_Allgather(local_R.getData(), N * N, MPI_DOUBLE, &all[0], N * N, MPI_DOUBLE, comm);
+		for(int s = 0 ; s < size ; s ++)
+			for(int j = 0 ; j < N ; j ++)
+				std::copy(&all[(s * N + j) * N], &all[(s * N + j + 1) * N], Rs.getData() + j * N * size + s * N);
+	}
+	Matrix R(N, N);
+	householderQR(Rs, R);
+
+	Matrix Ur(N, N);
+	double vt = 0;
+	int lwork = std::max(1, 5 * N);
+	Matrix superb(1, lwork);
+	int info = LAPACKE_dgesvd_col_major('S', 'N', N, N, R.getData(), N, tS.getData(), Ur.getData(), N, &vt, 1, superb.getData(), lwork);
+
+	Matrix Q2(N, N);
+	for(int j = 0 ; j < N ; j ++)
+		std::copy(Rs.getData() + j * N * size + rank * N, Rs.getData() + j * N * size + (rank + 1) * N, Q2.getData() + j * N);
+	Matrix W(N, N);
+	alpha_A_B_plus_beta_C(1, Q2, Ur, 0, W);
+	alpha_A_B_plus_beta_C(1, Q, W, 0, tU);
+	return info;
+}
@@ -117,5 +117,17 @@ void pAlpha_A_B_plus_beta_C(double alpha, Matrix &A, int kindA, Matrix &B, int k
 void pAlpha_ATrans_B_plus_beta_C(double alpha, Matrix &tA, int kindA, Matrix &tB, int kindB, double beta, Matrix &tC, int kindC, const int nSamples);
 void pAlpha_A_B_plus_beta_C(char transa, char transb, double alpha, Matrix &A, int kindA, Matrix &B, int kindB, double beta, Matrix &C, int kindC, const int nSamples);
 int pSvd(Matrix &A, Matrix &U, Matrix &S, Matrix &Vt, const int nSamples);
+//randomized range finder svd of the column partitioned A, only the leading U.getNumCol() singular triplets, power iterations sharpen them
+int pRandSvd(Matrix &A, Matrix &U, Matrix &S, int power, int seed, MPI_Comm comm);
+//rows of an M row matrix owned by this process when it is row partitioned
+int pLocalRows(int M, MPI_Comm comm);
+//column partitioned A (M * n in every process) to row partitioned rows (pLocalRows(M) * N), and back
+void pColumnsToRows(const Matrix &A, Matrix &rows, MPI_Comm comm);
+void pRowsToColumns(const Matrix &rows, Matrix &A, MPI_Comm comm);
+//the same for the n members of the process stored back to back in A (M * n floats), sent from and received into A without packing
+void pColumnsToRows(const float *A, int M, int n, float *rows, MPI_Comm comm);
+void pRowsToColumns(const float *rows, float *A, int M, int n, MPI_Comm comm);
+//svd of the row partitioned tall and skinny A by tsqr, U is row partitioned as A
+int pTsqrSvd(const Matrix &A, Matrix &U, Matrix &S, MPI_Comm comm);
 
 #endif
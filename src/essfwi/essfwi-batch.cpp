@@ -0,0 +1,238 @@
+/*
+ * essfwi-batch.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C"
+{
+#include <rsf.h>
+}
+
+#include <algorithm>
+#include "logger.h"
+#include "timer.h"
+#include "essfwi-batch.h"
+
+EssFwiBatch::EssFwiBatch(const std::vector<ForwardModeling *> &_fms, const std::vector<EssFwiFramework *> &_members,
+    int _width) :
+  fms(_fms), members(_members), width(_width), batched(false)
+{
+  int n = members.size();
+  width = (width <= 0 || width > n) ? n : width;
+  batched = width > 1 && fms[0]->concurrentSteps();
+  if (width > 1 && !batched) {
+    WARNING() << "the modeling has no batched steps, the members are stepped one by one";
+  }
+}
+
+void EssFwiBatch::epoch(int iter, const std::vector<float> &lambdaX, const std::vector<float> &lambdaZ, float fhi) {
+  int n = members.size();
+  if (!batched) {
+    for (int i = 0; i < n; i++) {
+      members[i]->epoch(iter, lambdaX[i], lambdaZ[i], fhi);
+    }
+    return;
+  }
+
+  Timer timer;
+
+  /// every member draws the codes to keep its state, they draw the same ones
+  std::vector<std::vector<float> > encsrc(n);
+  std::vector<std::vector<float> > encobs(n);
+  for (int i = 0; i < n; i++) {
+    members[i]->encode(encsrc[i], encobs[i], fhi);
+    if (encsrc[i] != encsrc[0]) {
+      sf_error("the members of a batch draw different encoding codes");
+    }
+  }
+
+  std::vector<float> obj(n);
+  std::vector<std::vector<float> > grad(n);
+  for (int m0 = 0; m0 < n; m0 += width) {
+    gradients(iter, m0, std::min(n, m0 + width), encsrc[0], encobs, lambdaX, lambdaZ, fhi, obj, grad);
+  }
+
+  for (int i = 0; i < n; i++) {
+    members[i]->direction(iter, grad[i], fhi);
+    std::vector<float>().swap(grad[i]);
+  }
+
+  /// the first two trial steps of each line search
+  std::vector<float> alpha(2 * n);
+  for (int i = 0; i < n; i++) {
+    members[i]->firstSteps(alpha[2 * i], alpha[2 * i + 1]);
+  }
+
+  const ForwardModeling &fm = *fms[0];
+  for (int t0 = 0; t0 < 2 * n; t0 += width) {
+    int nm = std::min(2 * n, t0 + width) - t0;
+    std::vector<Velocity> trial(nm, Velocity(fm.getnx(), fm.getnz()));
+    std::vector<const Velocity *> vels(nm);
+    for (int m = 0; m < nm; m++) {
+      members[(t0 + m) / 2]->trialVelocity(alpha[t0 + m], trial[m]);
+      vels[m] = &trial[m];
+    }
+
+    std::vector<std::vector<float> > dcal_trans;
+    std::vector<float> p0, p1;
+    model(interleave(vels), nm, encsrc[0], dcal_trans, NULL, p0, p1);
+
+    for (int m = 0; m < nm; m++) {
+      int i = (t0 + m) / 2;
+      members[i]->presetTrial(encsrc[i], encobs[i], alpha[t0 + m], trial[m], dcal_trans[m], lambdaX[i], lambdaZ[i]);
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    members[i]->step(iter, encsrc[i], encobs[i], obj[i], lambdaX[i], lambdaZ[i]);
+  }
+
+  INFO() << format("iter %d, %d members in batches of %d: %.3f s") % iter % n % width % timer.elapsed();
+}
+
+/**
+ * EssForwardModeling and calgradient of the members [m0, m1), with the
+ * data of the forward sweep instead of another modeling
+ */
+void EssFwiBatch::gradients(int iter, int m0, int m1, const std::vector<float> &encsrc,
+    const std::vector<std::vector<float> > &encobs,
+    const std::vector<float> &lambdaX, const std::vector<float> &lambdaZ, float fhi,
+    std::vector<float> &obj, std::vector<std::vector<float> > &grad) const {
+  const ForwardModeling &fm = *fms[0];
+  const int nm = m1 - m0;
+  const int nt = fm.getnt();
+  const int ns = fm.getns();
+  const int ng = fm.getng();
+  const int n = fm.getnx() * fm.getnz();
+  const float dt = fm.getdt();
+
+  std::vector<const Velocity *> vels(nm);
+  for (int m = 0; m < nm; m++) {
+    vels[m] = &fms[m0 + m]->getVelocity();
+  }
+  std::vector<float> vb = interleave(vels);
+
+  std::vector<float> bndr;
+  std::vector<float> sp0, sp1;
+  std::vector<std::vector<float> > vsrc(nm);
+  {
+    std::vector<std::vector<float> > dcal_trans;
+    model(vb, nm, encsrc, dcal_trans, &bndr, sp0, sp1);
+    for (int m = 0; m < nm; m++) {
+      int i = m0 + m;
+      obj[i] = members[i]->misfit(iter, encobs[i], dcal_trans[m], vsrc[m], lambdaX[i], lambdaZ[i], fhi);
+    }
+  }
+
+  std::vector<float> u2(n * nm, 0);
+  std::vector<float> gp0(n * nm, 0);
+  std::vector<float> gp1(n * nm, 0);
+  std::vector<float> g(n * nm, 0);
+  std::vector<float> src(ns * nm);
+  std::vector<float> amp(ng * nm);
+
+  for(int it = nt - 1; it >= 0 ; it--) {
+    fm.readBndry(&bndr[0], &sp0[0], it, nm);
+    std::swap(sp0, sp1);
+    fm.stepBackward(sp0, sp1, vb, u2, nm);
+    spreadSource(&encsrc[it * ns], src, nm);
+    fm.subSource(&sp0[0], &src[0], fm.getAllSrcPos(), nm);
+
+    /**
+     * forward propagate receviers
+     */
+    for (int ig = 0; ig < ng; ig++) {
+      for (int m = 0; m < nm; m++) {
+        amp[ig * nm + m] = vsrc[m][ig * nt + it];
+      }
+    }
+    fm.addSource(&gp1[0], &amp[0], fm.getAllGeoPos(), nm);
+    fm.stepForward(gp0, gp1, vb, u2, nm);
+    std::swap(gp1, gp0);
+
+    float scale;
+    if (dt * it > 0.4) {
+      scale = 1.0;
+    } else if (dt * it > 0.3) {
+      scale = (dt * it - 0.3) / 0.1;
+    } else {
+      break;
+    }
+    for (int i = 0; i < n * nm; i++) {
+      g[i] -= sp0[i] * gp0[i] * scale;
+    }
+  }
+
+  for (int m = 0; m < nm; m++) {
+    std::vector<float> &gm = grad[m0 + m];
+    gm.resize(n);
+    for (int i = 0; i < n; i++) {
+      gm[i] = g[i * nm + m];
+    }
+  }
+}
+
+/**
+ * the forward sweep of nm models in vels, interleaved, with the data of each
+ * as EssForwardModeling records it, and the boundaries of each step in bndr
+ * unless it is NULL. p0 and p1 are the last two fields
+ */
+void EssFwiBatch::model(const std::vector<float> &vels, int nm, const std::vector<float> &encsrc,
+    std::vector<std::vector<float> > &dcal_trans, std::vector<float> *bndr,
+    std::vector<float> &p0, std::vector<float> &p1) const {
+  const ForwardModeling &fm = *fms[0];
+  const int nt = fm.getnt();
+  const int ns = fm.getns();
+  const int ng = fm.getng();
+  const int n = fm.getnx() * fm.getnz();
+
+  p0.assign(n * nm, 0);
+  p1.assign(n * nm, 0);
+  std::vector<float> u2(n * nm, 0);
+  std::vector<float> src(ns * nm);
+  std::vector<float> seis((size_t)nt * ng * nm);
+  if (bndr != NULL) {
+    bndr->assign(fm.initBndryLength(nt) * nm, 0);
+  }
+
+  for(int it=0; it<nt; it++) {
+    spreadSource(&encsrc[it * ns], src, nm);
+    fm.addSource(&p1[0], &src[0], fm.getAllSrcPos(), nm);
+    fm.stepForward(p0, p1, vels, u2, nm);
+    std::swap(p1, p0);
+    if (bndr != NULL) {
+      fm.writeBndry(&(*bndr)[0], &p0[0], it, nm);
+    }
+    fm.recordSeis(&seis[(size_t)it * ng * nm], &p0[0], nm);
+  }
+
+  dcal_trans.resize(nm);
+  for (int m = 0; m < nm; m++) {
+    dcal_trans[m].resize(nt * ng);
+    for (int i = 0; i < nt * ng; i++) {
+      dcal_trans[m][i] = seis[(size_t)i * nm + m];
+    }
+  }
+}
+
+std::vector<float> EssFwiBatch::interleave(const std::vector<const Velocity *> &vels) const {
+  int nm = vels.size();
+  int n = vels[0]->dat.size();
+  std::vector<float> v(n * nm);
+  for (int i = 0; i < n; i++) {
+    for (int m = 0; m < nm; m++) {
+      v[i * nm + m] = vels[m]->dat[i];
+    }
+  }
+  return v;
+}
+
+/// the encoded source of a step for every member
+void EssFwiBatch::spreadSource(const float *encsrc, std::vector<float> &src, int nm) const {
+  int ns = src.size() / nm;
+  for (int is = 0; is < ns; is++) {
+    std::fill(&src[is * nm], &src[is * nm] + nm, encsrc[is]);
+  }
+}
@@ -0,0 +1,53 @@
+/*
+ * essfwi-batch.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_ESSFWI_ESSFWI_BATCH_H_
+#define SRC_ESSFWI_ESSFWI_BATCH_H_
+
+#include <vector>
+#include "forwardmodeling.h"
+#include "essfwiframework.h"
+
+/**
+ * the epochs of the ensemble members of a rank with their modeling batched.
+ * The members model the same encoded supershot, the same sources and
+ * receivers, through their own velocities, so up to width of them are
+ * stepped together with their wavefields interleaved member innermost: the
+ * stencil streams the grid once for all of them and the source and receiver
+ * tables are shared. One forward sweep records the data and saves the
+ * boundaries of all members of a batch, one backward sweep computes all
+ * their gradients, and the first two trial steps of every line search are
+ * modeled in batches as well. The fields are the ones of the members run one
+ * by one, only the boundaries of a batch take width times the memory
+ */
+class EssFwiBatch {
+public:
+  /// fms[i] is the modeling of members[i], width <= 0 batches all of them
+  EssFwiBatch(const std::vector<ForwardModeling *> &fms, const std::vector<EssFwiFramework *> &members, int width);
+
+  /// EssFwiFramework::epoch of every member
+  void epoch(int iter, const std::vector<float> &lambdaX, const std::vector<float> &lambdaZ, float fhi = 0);
+
+private:
+  void gradients(int iter, int m0, int m1, const std::vector<float> &encsrc,
+      const std::vector<std::vector<float> > &encobs,
+      const std::vector<float> &lambdaX, const std::vector<float> &lambdaZ, float fhi,
+      std::vector<float> &obj, std::vector<std::vector<float> > &grad) const;
+  void model(const std::vector<float> &vels, int nm, const std::vector<float> &encsrc,
+      std::vector<std::vector<float> > &dcal_trans, std::vector<float> *bndr,
+      std::vector<float> &p0, std::vector<float> &p1) const;
+  std::vector<float> interleave(const std::vector<const Velocity *> &vels) const;
+  void spreadSource(const float *encsrc, std::vector<float> &src, int nm) const;
+
+private:
+  const std::vector<ForwardModeling *> &fms;
+  const std::vector<EssFwiFramework *> &members;
+  int width;
+  bool batched;   /// false steps the members one by one
+};
+
+#endif /* SRC_ESSFWI_ESSFWI_BATCH_H_ */
@@ -46,7 +46,37 @@ EssFwiFramework::EssFwiFramework(ForwardModeling &method, const UpdateSteplenOp
 {
 }
 
+void EssFwiFramework::saveState(CheckpointData &ckpt, const std::string &key) const {
+  FwiBase::saveState(ckpt, key);
+  updateStenlelOp.saveState(ckpt, key + ".steplen");
+  essRandomCodes.saveState(ckpt, key + ".codes");
+}
+
+void EssFwiFramework::loadState(const CheckpointData &ckpt, const std::string &key) {
+  FwiBase::loadState(ckpt, key);
+  updateStenlelOp.loadState(ckpt, key + ".steplen");
+  essRandomCodes.loadState(ckpt, key + ".codes");
+}
+
 void EssFwiFramework::epoch(int iter, float lambdaX, float lambdaZ, float fhi) {
+  std::vector<float> encsrc;
+  std::vector<float> encobs;
+  encode(encsrc, encobs, fhi);
+
+  std::vector<float> dcal_trans(nt * ng, 0);
+  fmMethod.EssForwardModeling(encsrc, dcal_trans);
+
+  std::vector<float> vsrc;
+  float obj1 = misfit(iter, encobs, dcal_trans, vsrc, lambdaX, lambdaZ, fhi);
+
+  std::vector<float> g1(nx * nz, 0);
+  calgradient(fmMethod, encsrc, vsrc, g1, nt, dt);
+
+  direction(iter, g1, fhi);
+  step(iter, encsrc, encobs, obj1, lambdaX, lambdaZ);
+}
+
+void EssFwiFramework::encode(std::vector<float> &encsrc, std::vector<float> &encobs, float fhi) {
   // create random codes
   const std::vector<int> encodes = essRandomCodes.genPlus1Minus1(ns);
 
@@ -55,9 +85,9 @@ void EssFwiFramework::epoch(int iter, float lambdaX, float lambdaZ, float fhi) {
   DEBUG() << "code is: " << ss.str();
 
   Encoder encoder(encodes);
-  std::vector<float> encsrc  = encoder.encodeSource(wlt);
+  encsrc  = encoder.encodeSource(wlt);
   std::vector<float> encobs_trans = encoder.encodeObsData(dobs, nt, ng);
-  std::vector<float> encobs(nt * ng, 0);
+  encobs.assign(nt * ng, 0);
 	matrix_transpose(&encobs_trans[0], &encobs[0], ng, nt);
   //cbw
   int flo = 0;
@@ -66,11 +96,17 @@ void EssFwiFramework::epoch(int iter, float lambdaX, float lambdaZ, float fhi) {
 	if(flo != -1 && fhi != -1) 
 		filter(&encobs[0], nt, dt, flo, fhi, phase, verb, ng, 1);
 
-  std::vector<float> dcal_trans(nt * ng, 0);
+  fmMethod.removeDirectArrival(&encobs[0]);
+}
+
+float EssFwiFramework::misfit(int iter, const std::vector<float> &encobs, const std::vector<float> &dcal_trans,
+    std::vector<float> &vsrc, float lambdaX, float lambdaZ, float fhi) {
   std::vector<float> dcal(nt * ng, 0);
-  fmMethod.EssForwardModeling(encsrc, dcal_trans);
-	matrix_transpose(&dcal_trans[0], &dcal[0], ng, nt);
+	matrix_transpose(const_cast<float *>(&dcal_trans[0]), &dcal[0], ng, nt);
   //cbw
+  int flo = 0;
+  bool verb = false;
+  bool phase = false;
 	if(flo != -1 && fhi != -1) 
 		filter(&dcal[0], nt, dt, flo, fhi, phase, verb, ng, 1);
 
@@ -82,10 +118,9 @@ void EssFwiFramework::epoch(int iter, float lambdaX, float lambdaZ, float fhi) {
 		filter(&dcal[0], nt, dt, 0, fhi, phase, verb, ng, 1);
     */
 
-  fmMethod.removeDirectArrival(&encobs[0]);
   fmMethod.removeDirectArrival(&dcal[0]);
 
-  std::vector<float> vsrc(nt * ng, 0);
+  vsrc.assign(nt * ng, 0);
   vectorMinus(encobs, dcal, vsrc);
   float obj1 = cal_objective(&vsrc[0], vsrc.size());
   initobj = iter == 0 ? obj1 : initobj;
@@ -100,9 +135,10 @@ void EssFwiFramework::epoch(int iter, float lambdaX, float lambdaZ, float fhi) {
 
   transVsrc(vsrc, nt, ng);
 
-  std::vector<float> g1(nx * nz, 0);
-  calgradient(fmMethod, encsrc, vsrc, g1, nt, dt);
+  return obj1;
+}
 
+void EssFwiFramework::direction(int iter, std::vector<float> &g1, float fhi) {
   DEBUG() << format("grad %.20f") % sum(g1);
 
   fmMethod.scaleGradient(&g1[0]);
@@ -124,15 +160,34 @@ void EssFwiFramework::epoch(int iter, float lambdaX, float lambdaZ, float fhi) {
     rectx = rectx > 1 ? rectx : 1;
     smooth(&g1[0], nz, nx, rectz, rectx);
   }
+#else
+  (void)fhi;  /// the smoothing band, only used with SMOOTH
 #endif
 
   updateGrad(&g0[0], &g1[0], &updateDirection[0], g0.size(), iter);
+}
+
+void EssFwiFramework::firstSteps(float &alpha2, float &alpha3) const {
+  updateStenlelOp.firstSteps(updateDirection, alpha2, alpha3);
+}
+
+void EssFwiFramework::trialVelocity(float steplen, Velocity &newVel) const {
+  updateVelOp.update(newVel, fmMethod.getVelocity(), updateDirection, steplen);
+}
+
+void EssFwiFramework::presetTrial(const std::vector<float> &encsrc, const std::vector<float> &encobs, float steplen,
+    const Velocity &newVel, const std::vector<float> &dcal_trans, float lambdaX, float lambdaZ) {
+  updateStenlelOp.bindEncSrcObs(encsrc, encobs);
+  updateStenlelOp.presetObjval(steplen, updateStenlelOp.objval(newVel, dcal_trans, lambdaX, lambdaZ));
+}
 
+void EssFwiFramework::step(int iter, const std::vector<float> &encsrc, const std::vector<float> &encobs,
+    float obj1, float lambdaX, float lambdaZ) {
   updateStenlelOp.bindEncSrcObs(encsrc, encobs);
   float steplen;
   updateStenlelOp.calsteplen(updateDirection, obj1, iter, lambdaX, lambdaZ, steplen, updateobj);
 
-//  Velocity &exvel = fmMethod.getVelocity();
+  Velocity &exvel = fmMethod.getVelocity();
   updateVelOp.update(exvel, exvel, updateDirection, steplen);
 
   fmMethod.refillBoundary(&exvel.dat[0]);
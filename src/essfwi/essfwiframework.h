@@ -26,6 +26,28 @@ public:
     std::vector<float> &g0,
     int nt, float dt);
 
+  /**
+   * the phases of epoch, EssFwiBatch runs the modeling of several members
+   * between them: the encoded supershot of the iteration with the observed
+   * data filtered, the misfit of the modeled data and its adjoint source, the
+   * update direction from the gradient and the step along it. Before step
+   * the objectives of the first trial steps can be preset from a batch
+   */
+  void encode(std::vector<float> &encsrc, std::vector<float> &encobs, float fhi);
+  float misfit(int iter, const std::vector<float> &encobs, const std::vector<float> &dcal_trans,
+      std::vector<float> &vsrc, float lambdaX, float lambdaZ, float fhi);
+  void direction(int iter, std::vector<float> &g1, float fhi);
+  void firstSteps(float &alpha2, float &alpha3) const;
+  void trialVelocity(float steplen, Velocity &newVel) const;
+  void presetTrial(const std::vector<float> &encsrc, const std::vector<float> &encobs, float steplen,
+      const Velocity &newVel, const std::vector<float> &dcal_trans, float lambdaX, float lambdaZ);
+  void step(int iter, const std::vector<float> &encsrc, const std::vector<float> &encobs,
+      float obj1, float lambdaX, float lambdaZ);
+
+  /// FwiBase::saveState, with the step length and the encoding codes
+  void saveState(CheckpointData &ckpt, const std::string &key) const;
+  void loadState(const CheckpointData &ckpt, const std::string &key);
+
 private:
   static const int ESS_SEED = 1;
 
@@ -33,7 +33,7 @@ void calMaxAlpha2_3(const Velocity &exvel,  const float *grad, float dt, float d
   const int nx = exvel.nx;
   const int nz = exvel.nz;
 
-  const std::vector<float> &vel = exvel.dat;
+  const VelocityData &vel = exvel.dat;
   float alpha2 = FLT_MAX;
   for (int i = 0; i < nx * nz; i++) {
     float tmpv = dx / (dt * std::sqrt(vel[i]));
@@ -64,10 +64,15 @@ UpdateSteplenOp::UpdateSteplenOp(const ForwardModeling &fmMethod, const UpdateVe
 
 float UpdateSteplenOp::calobjval(const std::vector<float>& grad,
     float steplen) const {
+  std::map<float, float>::const_iterator preset = presetObjs.find(steplen);
+  if (preset != presetObjs.end()) {
+    DEBUG() << format("curr_alpha = %e, pure object value = %e (batch)") % steplen % preset->second;
+    return preset->second;
+  }
+
   int nx = fmMethod.getnx();
   int nz = fmMethod.getnz();
   int nt = fmMethod.getnt();
-  float dt = fmMethod.getdt();
 
   const Velocity &oldVel = fmMethod.getVelocity();
   Velocity newVel(nx, nz);
@@ -79,9 +84,29 @@ float UpdateSteplenOp::calobjval(const std::vector<float>& grad,
   //forward modeling
   int ng = fmMethod.getng();
   std::vector<float> dcal_trans(nt * ng);
-  std::vector<float> dcal(nt * ng);
   updateMethod->EssForwardModeling(*encsrc, dcal_trans);
-	matrix_transpose(&dcal_trans[0], &dcal[0], ng, nt);
+  updateMethod->bindVelocity(oldVel);  //-test
+
+  float val = objval(newVel, dcal_trans, lambdaX, lambdaZ);
+  DEBUG() << format("curr_alpha = %e, pure object value = %e") % steplen % val;
+
+  return val;
+}
+
+/**
+ * the direct arrival is removed with the velocity the fmMethod is bound to,
+ * the model of the current iteration
+ */
+float UpdateSteplenOp::objval(const Velocity &newVel, const std::vector<float> &dcal_trans,
+    float lambdaX, float lambdaZ) const {
+  int nx = fmMethod.getnx();
+  int nz = fmMethod.getnz();
+  int nt = fmMethod.getnt();
+  int ng = fmMethod.getng();
+  float dt = fmMethod.getdt();
+
+  std::vector<float> dcal(nt * ng);
+	matrix_transpose(const_cast<float *>(&dcal_trans[0]), &dcal[0], ng, nt);
   //cbw, 20170613
   int flo = 0;
   bool verb = false;
@@ -89,8 +114,7 @@ float UpdateSteplenOp::calobjval(const std::vector<float>& grad,
 	if(flo != -1 && fhi != -1) 
 		filter(&dcal[0], nt, dt, flo, fhi, phase, verb, ng, 1);
 
-  updateMethod->bindVelocity(oldVel);  //-test
-  updateMethod->removeDirectArrival(&dcal[0]);
+  fmMethod.removeDirectArrival(&dcal[0]);
 
   std::vector<float> vdiff(nt * ng, 0);
   vectorMinus(*encobs, dcal, vdiff);
@@ -101,11 +125,19 @@ float UpdateSteplenOp::calobjval(const std::vector<float>& grad,
       val += fac.getReguTerm();
     }
 
-  DEBUG() << format("curr_alpha = %e, pure object value = %e") % steplen % val;
-
   return val;
 }
 
+void UpdateSteplenOp::presetObjval(float steplen, float objval) {
+  presetObjs[steplen] = objval;
+}
+
+void UpdateSteplenOp::firstSteps(const std::vector<float> &grad, float &alpha2, float &alpha3) const {
+  float max_alpha2, max_alpha3;
+  calMaxAlpha2_3(fmMethod.getVelocity(), &grad[0], fmMethod.getdt(), fmMethod.getdx(), maxdv, max_alpha2, max_alpha3);
+  startAlpha23(max_alpha3, alpha2, alpha3);
+}
+
 bool UpdateSteplenOp::refineAlpha(const std::vector<float> &grad, float obj_val1, float maxAlpha3,
     float& _alpha2, float& _obj_val2, float& _alpha3, float& _obj_val3) const {
 
@@ -302,6 +334,7 @@ void UpdateSteplenOp::calsteplen(const std::vector<float>& grad,
   preservedAlpha.alpha = alpha4;
   steplen = alpha4;
   objval = obj_val4;
+  presetObjs.clear();
 }
 
 void UpdateSteplenOp::bindEncSrcObs(const std::vector<float>& encsrc,
@@ -311,15 +344,31 @@ void UpdateSteplenOp::bindEncSrcObs(const std::vector<float>& encsrc,
 }
 
 void UpdateSteplenOp::initAlpha23(float maxAlpha3, float &initAlpha2, float &initAlpha3) {
-  const float minAlpha   = 1.0E-7;
-  const float resetAlpha = 1.0E-4;
-
   if (!preservedAlpha.init) {
     preservedAlpha.init = true;
     preservedAlpha.alpha = maxAlpha3;
   }
 
-  initAlpha3 = preservedAlpha.alpha;
+  startAlpha23(maxAlpha3, initAlpha2, initAlpha3);
+}
+
+/// initAlpha23 without marking the preserved alpha initialized
+void UpdateSteplenOp::startAlpha23(float maxAlpha3, float &initAlpha2, float &initAlpha3) const {
+  const float minAlpha   = 1.0E-7;
+  const float resetAlpha = 1.0E-4;
+
+  initAlpha3 = preservedAlpha.init ? preservedAlpha.alpha : maxAlpha3;
   initAlpha3 = initAlpha3 < minAlpha ? resetAlpha : initAlpha3;
   initAlpha2 = initAlpha3 * 0.5;
 }
+
+/// the step of the last iteration the next one starts from
+void UpdateSteplenOp::saveState(CheckpointData &ckpt, const std::string &key) const {
+  ckpt.putValue(key + ".alpha", preservedAlpha.alpha);
+  ckpt.putValue(key + ".alphaInit", preservedAlpha.init);
+}
+
+void UpdateSteplenOp::loadState(const CheckpointData &ckpt, const std::string &key) {
+  preservedAlpha.alpha = ckpt.getValue<float>(key + ".alpha");
+  preservedAlpha.init = ckpt.getValue<bool>(key + ".alphaInit");
+}
@@ -9,6 +9,9 @@
 #define SRC_ESS_FWI2D_UPDATESTEPLENOP_H_
 
 #include <vector>
+#include <string>
+#include <map>
+#include "checkpoint.h"
 #include "forwardmodeling.h"
 #include "updatevelop.h"
 
@@ -18,11 +21,23 @@ public:
 
   void bindEncSrcObs(const std::vector<float> &encsrc, const std::vector<float> &encobs);
   void calsteplen(const std::vector<float> &grad, float obj_val1, int iter, float lambdaX, float lambdaZ, float &steplen, float &objval);
+  void saveState(CheckpointData &ckpt, const std::string &key) const;
+  void loadState(const CheckpointData &ckpt, const std::string &key);
+
+  /// the two steps along grad calsteplen tries first
+  void firstSteps(const std::vector<float> &grad, float &alpha2, float &alpha3) const;
+
+  /// the objective of newVel from its data modeled elsewhere, as calobjval gives it
+  float objval(const Velocity &newVel, const std::vector<float> &dcal_trans, float lambdaX, float lambdaZ) const;
+
+  /// calobjval of steplen is objval instead of a modeling, until the next calsteplen returns
+  void presetObjval(float steplen, float objval);
 
 private:
   float calobjval(const std::vector<float> &grad, float steplen) const;
   bool refineAlpha(const std::vector<float> &grad, float obj_val1, float maxAlpha3, float &_alpha2, float &_obj_val2, float &_alpha3, float &_obj_val3) const;
   void initAlpha23(float maxAlpha3, float &initAlpha2, float &initAlpha3);
+  void startAlpha23(float maxAlpha3, float &initAlpha2, float &initAlpha3) const;
 
 private:
   struct PreservedAlpha {
@@ -43,6 +58,7 @@ private:
   int fhi;
 
   float lambdaX, lambdaZ;
+  std::map<float, float> presetObjs;   /// of the steps modeled in a batch
 };
 
 #endif /* SRC_ESS_FWI2D_UPDATESTEPLENOP_H_ */
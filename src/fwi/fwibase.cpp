@@ -43,6 +43,11 @@ extern "C"
 #include "fd4t10s-damp-zjh-cg.h"
 }
 #endif
+extern "C"
+{
+#include "fd4t10s-pool.h"
+#include "tpool.h"
+}
 
 FwiBase::FwiBase(ForwardModeling &method, const std::vector<float> &_wlt, const std::vector<float> &_dobs) :
     fmMethod(method), wlt(_wlt), dobs(_dobs),
@@ -52,10 +57,43 @@ FwiBase::FwiBase(ForwardModeling &method, const std::vector<float> &_wlt, const
 {
   g0.resize(nx*nz, 0);
   updateDirection.resize(nx*nz, 0);
+  fmMethod.firstTouch(g0, false);
+  fmMethod.firstTouch(updateDirection, false);
 }
 
 void FwiBase::writeVel(sf_file file) const {
-	fmMethod.sfWriteVel(fmMethod.getVelocity().dat, file);
+	fmMethod.sfWriteVel(fmMethod.getVelocity().dat.toVector(), file);
+}
+
+/// the model is copied, the write goes on while the next iteration runs
+void FwiBase::writeVel(AsyncWriter &writer, sf_file file) const {
+  std::vector<float> vv = fmMethod.outputVel(fmMethod.getVelocity().dat.toVector());
+  writer.write(file, vv);
+}
+
+void FwiBase::saveState(CheckpointData &ckpt, const std::string &key) const {
+  const VelocityData &vel = fmMethod.getVelocity().dat;
+  ckpt.put(key + ".vel", vel.data(), vel.size() * sizeof(float));
+  ckpt.put(key + ".g0", g0);
+  ckpt.put(key + ".updateDirection", updateDirection);
+  ckpt.putValue(key + ".updateobj", updateobj);
+  ckpt.putValue(key + ".initobj", initobj);
+  ckpt.putValue(key + ".obj_val4", obj_val4);
+}
+
+void FwiBase::loadState(const CheckpointData &ckpt, const std::string &key) {
+  Velocity &exvel = fmMethod.getVelocity();
+  std::vector<float> vel;
+  ckpt.get(key + ".vel", vel);
+  if (vel.size() != exvel.dat.size()) {
+    sf_error("%s of the checkpoint is for another model size", key.c_str());
+  }
+  std::copy(vel.begin(), vel.end(), exvel.dat.begin());
+  ckpt.get(key + ".g0", g0);
+  ckpt.get(key + ".updateDirection", updateDirection);
+  updateobj = ckpt.getValue<float>(key + ".updateobj");
+  initobj = ckpt.getValue<float>(key + ".initobj");
+  obj_val4 = ckpt.getValue<float>(key + ".obj_val4");
 }
 
 float FwiBase::getUpdateObj() const {
@@ -77,6 +115,10 @@ void FwiBase::cross_correlation(float *src_wave, float *vsrc_wave, float *image,
 	int nz = fmMethod.getnz();
 	cross_correlation_cg(src_wave, vsrc_wave, image, nx, nz, scale);
 #else
+  if (tpool_size() > 0 && model_size == fmMethod.getnx() * fmMethod.getnz()) {
+    cross_correlation_pool(src_wave, vsrc_wave, image, fmMethod.getnx(), fmMethod.getnz(), scale);
+    return;
+  }
   for (int i = 0; i < model_size; i ++) {
     image[i] -= src_wave[i] * vsrc_wave[i] * scale;
   }
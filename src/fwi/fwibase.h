@@ -8,7 +8,10 @@
 #ifndef SRC_FWI2D_FWIBASE_H_
 #define SRC_FWI2D_FWIBASE_H_
 
+#include <string>
 #include "forwardmodeling.h"
+#include "checkpoint.h"
+#include "async-writer.h"
 
 class FwiBase {
 public:
@@ -20,9 +23,14 @@ public:
 	void one_order_virtual_source_forth_accuracy(float *vsrc, int num);
 	void second_order_virtual_source_forth_accuracy(float *vsrc, int num);
   void writeVel(sf_file file) const;
+  void writeVel(AsyncWriter &writer, sf_file file) const;
   float getUpdateObj() const;
   float getInitObj() const;
 
+  /// the model, the previous gradient and direction and the objectives
+  void saveState(CheckpointData &ckpt, const std::string &key) const;
+  void loadState(const CheckpointData &ckpt, const std::string &key);
+
 protected:
   ForwardModeling &fmMethod;
   const std::vector<float> &wlt;  /// wavelet
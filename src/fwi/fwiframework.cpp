@@ -33,6 +33,7 @@ extern "C"
 #include "velocity.h"
 #include "sfutil.h"
 #include "parabola-vertex.h"
+#include "workspace.h"
 #include "fwiframework.h"
 
 #include "aux.h"
@@ -40,14 +41,68 @@ extern "C"
 FwiFramework::FwiFramework(ForwardModeling &method, const FwiUpdateSteplenOp &updateSteplenOp,
     const FwiUpdateVelOp &_updateVelOp,
     const std::vector<float> &_wlt, const std::vector<float> &_dobs) :
-    FwiBase(method, _wlt, _dobs), updateStenlelOp(updateSteplenOp), updateVelOp(_updateVelOp)
+    FwiBase(method, _wlt, _dobs), pipeline(NULL), pipeGrad(NULL), pipeObj(0), pipeIter(0),
+    updateStenlelOp(updateSteplenOp), updateVelOp(_updateVelOp),
+    gradReducer(MPI_COMM_WORLD, nx, nz, method.getbx0(), nx - method.getbxn(), method.getbz0(), nz - method.getbzn())
 {
 }
 
+FwiFramework::~FwiFramework() {
+  delete pipeline;
+}
+
+/// none or bf16 for the gradient sum between the nodes, see node-reduce.h
+void FwiFramework::setGradCompression(const char *spec) {
+  gradReducer.setCompression(spec);
+}
+
+/**
+ * run the forward pass of a shot, which saves the boundary, while the adjoint
+ * pass of the previous shot runs, on nthreads0 and nthreads1 OpenMP threads,
+ * depth shots at most in flight. depth <= 0 turns it off. The pipeline needs
+ * the OpenMP steps of concurrentSteps, otherwise the shots run one by one
+ */
+void FwiFramework::setShotPipeline(int depth, int nthreads0, int nthreads1) {
+  delete pipeline;
+  pipeline = NULL;
+  pipeSlots.clear();
+  if (depth <= 0) {
+    return;
+  }
+  pipeline = new ShotPipeline(depth, nthreads0, nthreads1);
+  pipeSlots.resize(depth);
+  INFO() << format("shot pipeline of %d slots") % depth;
+}
+
+/// FwiBase::saveState, with the step length and the gradient sum between the nodes
+void FwiFramework::saveState(CheckpointData &ckpt, const std::string &key) const {
+  FwiBase::saveState(ckpt, key);
+  updateStenlelOp.saveState(ckpt, key + ".steplen");
+  gradReducer.saveState(ckpt, key + ".grad");
+}
+
+void FwiFramework::loadState(const CheckpointData &ckpt, const std::string &key) {
+  FwiBase::loadState(ckpt, key);
+  updateStenlelOp.loadState(ckpt, key + ".steplen");
+  gradReducer.loadState(ckpt, key + ".grad");
+}
+
 void FwiFramework::epoch(int iter) {
-	std::vector<float> g1(nx * nz, 0);
-	std::vector<float> g2(nx * nz, 0);
-	std::vector<float> encobs(ng * nt, 0);
+	double epochBegin = MPI_Wtime();
+	Workspace::resetStats();
+	gradReducer.resetStats();
+	std::vector<float> g1;
+	WorkBuffer g1Buf(g1, nx * nz);
+	std::vector<float> g2;
+	WorkBuffer g2Buf(g2, nx * nz);
+	std::vector<float> encobs;
+	WorkBuffer encobsBuf(encobs, ng * nt, false);
+	if (g1Buf.fresh()) {
+		fmMethod.firstTouch(g1, false);
+	}
+	if (g2Buf.fresh()) {
+		fmMethod.firstTouch(g2, false);
+	}
 	int rank, np, k, ntask, shot_begin, shot_end;
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 	MPI_Comm_size(MPI_COMM_WORLD, &np);
@@ -55,151 +110,172 @@ void FwiFramework::epoch(int iter) {
 	ntask = std::min(k, ns - rank*k);
 	shot_begin = rank * k;
 	shot_end = shot_begin + ntask;
+	/// with a decomposition the shots go to the groups, see domain-decomp.h
+	DomainDecomp *decomp = fmMethod.getDecomposition();
+	if (decomp != NULL) {
+		decomp->shotRange(ns, shot_begin, shot_end);
+	}
 	float local_obj1 = 0.0f, obj1 = 0.0f;
 
-	for(int is = shot_begin ; is < shot_end ; is ++) {
-		std::vector<float> encobs_trans(nt * ng, 0.0f);
-		INFO() << format("calculate gradient, shot id: %d") % is;
-		memcpy(&encobs_trans[0], &dobs[is * ng * nt], sizeof(float) * ng * nt);
-
-		matrix_transpose(&encobs_trans[0], &encobs[0], ng, nt);
-
-		/*
-			 if(iter == 1)
-			 {
-			 sf_file sf_encobs = sf_output("encobs.rsf");
-			 sf_putint(sf_encobs, "n1", nt);
-			 sf_putint(sf_encobs, "n2", ng);
-			 sf_floatwrite(&encobs[0], nt * ng, sf_encobs);
-			 }
-			 */
-
-		/*
-			 sf_file sf_wlt = sf_output("wlt.rsf");
-			 sf_putint(sf_wlt, "n1", nt);
-			 sf_floatwrite(&wlt[0], nt, sf_wlt);
-			 */
-
-		INFO() << "sum encobs: " << std::accumulate(encobs.begin(), encobs.end(), 0.0f);
-		//INFO() << wlt[0] << " " << wlt[132];
-		//INFO() << "sum wlt: " << std::accumulate(wlt.begin(), wlt.begin() + nt, 0.0f);
-
-		std::vector<float> dcal(nt * ng, 0);
-		std::vector<float> dcal_trans(ng * nt, 0.0f);
-		fmMethod.FwiForwardModeling(wlt, dcal_trans, is);
-		matrix_transpose(&dcal_trans[0], &dcal[0], ng, nt);
-
-
-		/*
-			 if(iter == 0)
-			 {
-			 char fg2[64];
-			 sprintf(fg2, "dcal_%02d.rsf", is);
-			 sf_file sf_dcal = sf_output(fg2);
-			 sf_putint(sf_dcal, "n1", nt);
-			 sf_putint(sf_dcal, "n2", ng);
-			 sf_floatwrite(&dcal[0], nt * ng, sf_dcal);
-			 }
-			 */
-
-		/*
-			 if(iter == 1 && is == 0)
-			 {
-			 FILE *f_dcal = fopen("dcal.bin", "wb");
-			 fwrite(&trans_dcal[0], sizeof(float), ng * nt, f_dcal);
-			 fclose(f_dcal);
-			 }
-			 */
-
-		INFO() << dcal[0];
-		//INFO() << "sum dcal: " << std::accumulate(dcal.begin(), dcal.end(), 0.0f);
-
-		fmMethod.fwiRemoveDirectArrival(&encobs[0], is);
-		fmMethod.fwiRemoveDirectArrival(&dcal[0], is);
-
-		/*
-			 sf_file sf_encobs = sf_output("encobs2.rsf");
-			 sf_putint(sf_encobs, "n1", nt);
-			 sf_putint(sf_encobs, "n2", ng);
-			 sf_floatwrite(&encobs[0], nt * ng, sf_encobs);
-			 exit(1);
-			 */
-
-		/*
-			 if(iter == 1)
-			 {
-			 sf_file sf_dcal = sf_output("dcal2.rsf");
-			 sf_putint(sf_dcal, "n1", nt);
-			 sf_putint(sf_dcal, "n2", ng);
-			 sf_floatwrite(&dcal[0], nt * ng, sf_dcal);
-			 exit(1);
-			 }
-			 */
-
-		//INFO() << "sum encobs2: " << std::accumulate(encobs.begin(), encobs.end(), 0.0f);
-		//INFO() << "sum dcal2: " << std::accumulate(dcal.begin(), dcal.end(), 0.0f);
-
-		std::vector<float> vsrc(nt * ng, 0);
-		vectorMinus(encobs, dcal, vsrc);
-		local_obj1 += cal_objective(&vsrc[0], vsrc.size());
-		initobj = iter == 0 ? local_obj1 : initobj;
-		//DEBUG() << format("obj: %e") % obj1;
-		INFO() << "obj: " << local_obj1 << "\n";
-
-		transVsrc(vsrc, nt, ng);
-
-		//INFO() << "sum vsrc: " << std::accumulate(vsrc.begin(), vsrc.end(), 0.0f);
-
-		g1.assign(nx * nz, 0.0f);
-		//std::vector<float> g1(nx * nz, 0);
-		calgradient(fmMethod, wlt, vsrc, g1, nt, dt, is, rank);
-
-		/*
-			 sf_file sf_vsrc= sf_output("vsrc.rsf");
-			 sf_putint(sf_vsrc, "n1", nt);
-			 sf_putint(sf_vsrc, "n2", ng);
-			 sf_floatwrite(&vsrc[0], nt * ng, sf_vsrc);
-			 exit(1);
-			 */
-
-		DEBUG() << format("grad %.20f") % sum(g1);
-
-		//fmMethod.scaleGradient(&g1[0]);
-		fmMethod.maskGradient(&g1[0]);
-
-		/*
-			 char fg1[64];
-			 sprintf(fg1, "g1_%02d.rsf", is);
-			 sf_file sf_g1 = sf_output(fg1);
-			 sf_putint(sf_g1, "n1", nz);
-			 sf_putint(sf_g1, "n2", nx);
-			 sf_floatwrite(&g1[0], nx * nz, sf_g1);
-			 */
-
-		/*
-			 char filename[20];
-			 sprintf(filename, "gradient%02d.bin", is);
-			 FILE *f = fopen(filename,"wb");
-			 fwrite(&g1[0], sizeof(float), nx * nz, f);
-			 fclose(f);
-			 */
-
-		std::transform(g2.begin(), g2.end(), g1.begin(), g2.begin(), std::plus<float>());
-
-		/*
-			 sf_file sf_g2 = sf_output("g2.rsf");
-			 sf_putint(sf_g2, "n1", nz);
-			 sf_putint(sf_g2, "n2", nx);
-			 sf_floatwrite(&g2[0], nx * nz, sf_g2);
-			 exit(1);
-			 */
-
-		DEBUG() << format("global grad %.20f") % sum(g2);
+	if (pipeline != NULL && fmMethod.concurrentSteps()) {
+		pipelineShots(shot_begin, shot_end, iter, g2, local_obj1);
+	} else {
+		for(int is = shot_begin ; is < shot_end ; is ++) {
+			std::vector<float> encobs_trans;
+			WorkBuffer encobsTransBuf(encobs_trans, nt * ng, false);
+			INFO() << format("calculate gradient, shot id: %d") % is;
+			memcpy(&encobs_trans[0], &dobs[is * ng * nt], sizeof(float) * ng * nt);
+
+			matrix_transpose(&encobs_trans[0], &encobs[0], ng, nt);
+
+			/*
+				 if(iter == 1)
+				 {
+				 sf_file sf_encobs = sf_output("encobs.rsf");
+				 sf_putint(sf_encobs, "n1", nt);
+				 sf_putint(sf_encobs, "n2", ng);
+				 sf_floatwrite(&encobs[0], nt * ng, sf_encobs);
+				 }
+				 */
+
+			/*
+				 sf_file sf_wlt = sf_output("wlt.rsf");
+				 sf_putint(sf_wlt, "n1", nt);
+				 sf_floatwrite(&wlt[0], nt, sf_wlt);
+				 */
+
+			INFO() << "sum encobs: " << std::accumulate(encobs.begin(), encobs.end(), 0.0f);
+			//INFO() << wlt[0] << " " << wlt[132];
+			//INFO() << "sum wlt: " << std::accumulate(wlt.begin(), wlt.begin() + nt, 0.0f);
+
+			/// both are overwritten, by the modeling and by the transpose
+			std::vector<float> dcal;
+			WorkBuffer dcalBuf(dcal, nt * ng, false);
+			std::vector<float> dcal_trans;
+			WorkBuffer dcalTransBuf(dcal_trans, ng * nt, false);
+			fmMethod.FwiForwardModeling(wlt, dcal_trans, is);
+			matrix_transpose(&dcal_trans[0], &dcal[0], ng, nt);
+
+
+			/*
+				 if(iter == 0)
+				 {
+				 char fg2[64];
+				 sprintf(fg2, "dcal_%02d.rsf", is);
+				 sf_file sf_dcal = sf_output(fg2);
+				 sf_putint(sf_dcal, "n1", nt);
+				 sf_putint(sf_dcal, "n2", ng);
+				 sf_floatwrite(&dcal[0], nt * ng, sf_dcal);
+				 }
+				 */
+
+			/*
+				 if(iter == 1 && is == 0)
+				 {
+				 FILE *f_dcal = fopen("dcal.bin", "wb");
+				 fwrite(&trans_dcal[0], sizeof(float), ng * nt, f_dcal);
+				 fclose(f_dcal);
+				 }
+				 */
+
+			INFO() << dcal[0];
+			//INFO() << "sum dcal: " << std::accumulate(dcal.begin(), dcal.end(), 0.0f);
+
+			fmMethod.fwiRemoveDirectArrival(&encobs[0], is);
+			fmMethod.fwiRemoveDirectArrival(&dcal[0], is);
+
+			/*
+				 sf_file sf_encobs = sf_output("encobs2.rsf");
+				 sf_putint(sf_encobs, "n1", nt);
+				 sf_putint(sf_encobs, "n2", ng);
+				 sf_floatwrite(&encobs[0], nt * ng, sf_encobs);
+				 exit(1);
+				 */
+
+			/*
+				 if(iter == 1)
+				 {
+				 sf_file sf_dcal = sf_output("dcal2.rsf");
+				 sf_putint(sf_dcal, "n1", nt);
+				 sf_putint(sf_dcal, "n2", ng);
+				 sf_floatwrite(&dcal[0], nt * ng, sf_dcal);
+				 exit(1);
+				 }
+				 */
+
+			//INFO() << "sum encobs2: " << std::accumulate(encobs.begin(), encobs.end(), 0.0f);
+			//INFO() << "sum dcal2: " << std::accumulate(dcal.begin(), dcal.end(), 0.0f);
+
+			std::vector<float> vsrc;
+			WorkBuffer vsrcBuf(vsrc, nt * ng, false);
+			vectorMinus(encobs, dcal, vsrc);
+			local_obj1 += cal_objective(&vsrc[0], vsrc.size());
+			initobj = iter == 0 ? local_obj1 : initobj;
+			//DEBUG() << format("obj: %e") % obj1;
+			INFO() << "obj: " << local_obj1 << "\n";
+
+			transVsrc(vsrc, nt, ng);
+
+			//INFO() << "sum vsrc: " << std::accumulate(vsrc.begin(), vsrc.end(), 0.0f);
+
+			g1.assign(nx * nz, 0.0f);
+			//std::vector<float> g1(nx * nz, 0);
+			calgradient(fmMethod, wlt, vsrc, g1, nt, dt, is, rank);
+
+			/*
+				 sf_file sf_vsrc= sf_output("vsrc.rsf");
+				 sf_putint(sf_vsrc, "n1", nt);
+				 sf_putint(sf_vsrc, "n2", ng);
+				 sf_floatwrite(&vsrc[0], nt * ng, sf_vsrc);
+				 exit(1);
+				 */
+
+			DEBUG() << format("grad %.20f") % sum(g1);
+
+			//fmMethod.scaleGradient(&g1[0]);
+			fmMethod.maskGradient(&g1[0]);
+
+			/*
+				 char fg1[64];
+				 sprintf(fg1, "g1_%02d.rsf", is);
+				 sf_file sf_g1 = sf_output(fg1);
+				 sf_putint(sf_g1, "n1", nz);
+				 sf_putint(sf_g1, "n2", nx);
+				 sf_floatwrite(&g1[0], nx * nz, sf_g1);
+				 */
+
+			/*
+				 char filename[20];
+				 sprintf(filename, "gradient%02d.bin", is);
+				 FILE *f = fopen(filename,"wb");
+				 fwrite(&g1[0], sizeof(float), nx * nz, f);
+				 fclose(f);
+				 */
+
+			std::transform(g2.begin(), g2.end(), g1.begin(), g2.begin(), std::plus<float>());
+
+			/*
+				 sf_file sf_g2 = sf_output("g2.rsf");
+				 sf_putint(sf_g2, "n1", nz);
+				 sf_putint(sf_g2, "n2", nx);
+				 sf_floatwrite(&g2[0], nx * nz, sf_g2);
+				 exit(1);
+				 */
+
+			DEBUG() << format("global grad %.20f") % sum(g2);
+		}
 	}
 
 	g1.assign(nx * nz, 0.0f);
-	MPI_Allreduce(&g2[0], &g1[0], g2.size(), MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
-	MPI_Allreduce(&local_obj1, &obj1, 1, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+	if (decomp != NULL) {
+		/// every rank of a group has the residuals of its shots, count them once
+		float group_obj1 = decomp->groupRoot() ? local_obj1 : 0.0f;
+		decomp->reduceGradient(&g2[0], &g1[0]);
+		MPI_Allreduce(&group_obj1, &obj1, 1, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+	} else {
+		gradReducer.allreduce(&g2[0], &g1[0]);
+		MPI_Allreduce(&local_obj1, &obj1, 1, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+	}
 
 	if(rank == 0)
 	{
@@ -292,6 +368,9 @@ void FwiFramework::epoch(int iter) {
 
 	//fmMethod.refillBoundary(&exvel.dat[0]);
 
+	Workspace::report("epoch", iter);
+	gradReducer.report("epoch", iter);
+	INFO() << format("epoch %d: %.3f s") % iter % (MPI_Wtime() - epochBegin);
 }
 
 void FwiFramework::calgradient(const ForwardModeling &fmMethod,
@@ -301,6 +380,11 @@ void FwiFramework::calgradient(const ForwardModeling &fmMethod,
     int nt, float dt,
 		int shot_id, int rank)
 {
+  if (fmMethod.getDecomposition() != NULL) {
+    calgradientDecomp(*fmMethod.getDecomposition(), wlt, vsrc, g0, nt, dt, shot_id);
+    return;
+  }
+
   int nx = fmMethod.getnx();
   int nz = fmMethod.getnz();
   int ns = fmMethod.getns();
@@ -308,12 +392,29 @@ void FwiFramework::calgradient(const ForwardModeling &fmMethod,
   const ShotPosition &allGeoPos = fmMethod.getAllGeoPos();
   const ShotPosition &allSrcPos = fmMethod.getAllSrcPos();
 
-  std::vector<float> bndr = fmMethod.initBndryVector(nt);
-  std::vector<float> sp0(nz * nx, 0);
-  std::vector<float> sp1(nz * nx, 0);
-  std::vector<float> gp0(nz * nx, 0);
-  std::vector<float> gp1(nz * nx, 0);
-
+  /// every step of the boundary is written before it is read back
+  std::vector<float> bndr;
+  WorkBuffer bndrBuf(bndr, fmMethod.initBndryLength(nt), false);
+  std::vector<float> sp0;
+  WorkBuffer sp0Buf(sp0, nz * nx);
+  std::vector<float> sp1;
+  WorkBuffer sp1Buf(sp1, nz * nx);
+  std::vector<float> gp0;
+  WorkBuffer gp0Buf(gp0, nz * nx);
+  std::vector<float> gp1;
+  WorkBuffer gp1Buf(gp1, nz * nx);
+  if (sp0Buf.fresh()) {
+    fmMethod.firstTouch(sp0, false);
+  }
+  if (sp1Buf.fresh()) {
+    fmMethod.firstTouch(sp1, false);
+  }
+  if (gp0Buf.fresh()) {
+    fmMethod.firstTouch(gp0, false);
+  }
+  if (gp1Buf.fresh()) {
+    fmMethod.firstTouch(gp1, false);
+  }
 
   ShotPosition curSrcPos = allSrcPos.clipRange(shot_id, shot_id);
 
@@ -327,7 +428,8 @@ void FwiFramework::calgradient(const ForwardModeling &fmMethod,
   }
 
 	INFO() << "2\n";
-  std::vector<float> vsrc_trans(ng * nt, 0.0f);
+  std::vector<float> vsrc_trans;
+  WorkBuffer vsrcTransBuf(vsrc_trans, ng * nt, false);
   matrix_transpose(const_cast<float*>(&vsrc[0]), &vsrc_trans[0], nt, ng);
 
 	INFO() << "3\n";
@@ -355,3 +457,185 @@ void FwiFramework::calgradient(const ForwardModeling &fmMethod,
 	INFO() << "4\n";
 }
 
+
+/**
+ * calgradient on the subdomains of decomp, the wavefields and the saved
+ * boundary are local, g0 gets the owned cells of this rank only
+ */
+void FwiFramework::calgradientDecomp(DomainDecomp &decomp,
+    const std::vector<float> &wlt,
+    const std::vector<float> &vsrc,
+    std::vector<float> &g0,
+    int nt, float dt, int shot_id)
+{
+  int ng = fmMethod.getng();
+  int bx0 = fmMethod.getbx0();
+  int bz0 = fmMethod.getbz0();
+  decomp.bind(fmMethod);
+
+  size_t n = decomp.localSize();
+  std::vector<float> bndr;
+  WorkBuffer bndrBuf(bndr, decomp.bndryLength(nt), false);
+  std::vector<float> sp0;
+  WorkBuffer sp0Buf(sp0, n);
+  std::vector<float> sp1;
+  WorkBuffer sp1Buf(sp1, n);
+  std::vector<float> gp0;
+  WorkBuffer gp0Buf(gp0, n);
+  std::vector<float> gp1;
+  WorkBuffer gp1Buf(gp1, n);
+
+  ShotPosition curSrcPos = fmMethod.getAllSrcPos().clipRange(shot_id, shot_id);
+  DomainPoints src = decomp.localPoints(curSrcPos, bx0, bz0);
+  DomainPoints geo = decomp.localPoints(fmMethod.getAllGeoPos(), bx0, bz0);
+
+  for(int it=0; it<nt; it++) {
+    decomp.inject(&sp1[0], &wlt[it], src, 1.0f);
+    decomp.stepForward(sp0,sp1);
+    std::swap(sp1, sp0);
+    decomp.writeBndry(&bndr[0], &sp0[0], it);
+  }
+
+  std::vector<float> vsrc_trans;
+  WorkBuffer vsrcTransBuf(vsrc_trans, ng * nt, false);
+  matrix_transpose(const_cast<float*>(&vsrc[0]), &vsrc_trans[0], nt, ng);
+
+  for(int it = nt - 1; it >= 0 ; it--) {
+    decomp.readBndry(&bndr[0], &sp0[0], it);
+    std::swap(sp0, sp1);
+    decomp.stepBackward(sp0, sp1);
+    decomp.inject(&sp0[0], &wlt[it], src, -1.0f);
+
+    decomp.inject(&gp1[0], &vsrc_trans[it * ng], geo, 1.0f);
+    decomp.stepForward(gp0,gp1);
+    std::swap(gp1, gp0);
+
+    if (dt * it > 0.4) {
+      decomp.crossCorrelation(&sp0[0], &gp0[0], &g0[0], 1.0);
+    } else if (dt * it > 0.3) {
+      decomp.crossCorrelation(&sp0[0], &gp0[0], &g0[0], (dt * it - 0.3) / 0.1);
+    } else {
+      break;
+    }
+  }
+}
+
+/**
+ * the shots [shot_begin, shot_end) of epoch on the shot pipeline. The forward
+ * stage runs the modeling and the forward pass of calgradient as one, they
+ * step the same wavefield, and leaves the data, the saved boundary and the
+ * last two fields in a slot. The adjoint stage, on this thread, does the rest
+ * of the loop of epoch. The steps are pointwise, so the gradient and the
+ * objective are those of the sequential loop
+ */
+void FwiFramework::pipelineShots(int shot_begin, int shot_end, int iter, std::vector<float> &g2, float &obj) {
+  size_t bndrLen = fmMethod.initBndryLength(nt);
+  for (size_t k = 0; k < pipeSlots.size(); k++) {
+    pipeSlots[k].dcal_trans.resize(ng * nt);
+    pipeSlots[k].bndr.resize(bndrLen);
+    pipeSlots[k].sp0.resize(nx * nz);
+    pipeSlots[k].sp1.resize(nx * nz);
+  }
+  pipeU2.resize(nx * nz);
+
+  /// the receiver table is built here once, both stages only read it
+  fmMethod.getAllGeoPos().spreadTable(nx, nz, fmMethod.getbx0(), fmMethod.getbz0());
+
+  pipeGrad = &g2;
+  pipeObj = 0.0f;
+  pipeIter = iter;
+
+  MemberStage<FwiFramework> forward(*this, &FwiFramework::pipelineForward);
+  MemberStage<FwiFramework> adjoint(*this, &FwiFramework::pipelineAdjoint);
+  pipeline->run(shot_begin, shot_end, forward, adjoint);
+
+  obj += pipeObj;
+  pipeGrad = NULL;
+}
+
+/// the first stage, it must not touch the Workspace nor log
+void FwiFramework::pipelineForward(int shot_id, int k) {
+  PipeSlot &slot = pipeSlots[k];
+  std::fill(slot.sp0.begin(), slot.sp0.end(), 0.0f);
+  std::fill(slot.sp1.begin(), slot.sp1.end(), 0.0f);
+
+  ShotPosition curSrcPos = fmMethod.getAllSrcPos().clipRange(shot_id, shot_id);
+
+  for(int it=0; it<nt; it++) {
+    fmMethod.addSource(&slot.sp1[0], &wlt[it], curSrcPos);
+    fmMethod.stepForward(slot.sp0, slot.sp1, pipeU2);
+    std::swap(slot.sp1, slot.sp0);
+    fmMethod.recordSeis(&slot.dcal_trans[it * ng], &slot.sp0[0]);
+    fmMethod.writeBndry(&slot.bndr[0], &slot.sp0[0], it);
+  }
+}
+
+/// the second stage, the residual and the backward pass of calgradient
+void FwiFramework::pipelineAdjoint(int shot_id, int k) {
+  PipeSlot &slot = pipeSlots[k];
+  INFO() << format("calculate gradient, shot id: %d") % shot_id;
+
+  std::vector<float> encobs;
+  WorkBuffer encobsBuf(encobs, ng * nt, false);
+  std::vector<float> encobs_trans;
+  WorkBuffer encobsTransBuf(encobs_trans, nt * ng, false);
+  memcpy(&encobs_trans[0], &dobs[shot_id * ng * nt], sizeof(float) * ng * nt);
+  matrix_transpose(&encobs_trans[0], &encobs[0], ng, nt);
+
+  std::vector<float> dcal;
+  WorkBuffer dcalBuf(dcal, nt * ng, false);
+  matrix_transpose(&slot.dcal_trans[0], &dcal[0], ng, nt);
+
+  fmMethod.fwiRemoveDirectArrival(&encobs[0], shot_id);
+  fmMethod.fwiRemoveDirectArrival(&dcal[0], shot_id);
+
+  std::vector<float> vsrc;
+  WorkBuffer vsrcBuf(vsrc, nt * ng, false);
+  vectorMinus(encobs, dcal, vsrc);
+  pipeObj += cal_objective(&vsrc[0], vsrc.size());
+  initobj = pipeIter == 0 ? pipeObj : initobj;
+  INFO() << "obj: " << pipeObj << "\n";
+
+  transVsrc(vsrc, nt, ng);
+
+  std::vector<float> vsrc_trans;
+  WorkBuffer vsrcTransBuf(vsrc_trans, ng * nt, false);
+  matrix_transpose(&vsrc[0], &vsrc_trans[0], nt, ng);
+
+  std::vector<float> g1;
+  WorkBuffer g1Buf(g1, nx * nz);
+  std::vector<float> gp0;
+  WorkBuffer gp0Buf(gp0, nz * nx);
+  std::vector<float> gp1;
+  WorkBuffer gp1Buf(gp1, nz * nx);
+  std::vector<float> u2;
+  WorkBuffer u2Buf(u2, nz * nx, false);
+
+  ShotPosition curSrcPos = fmMethod.getAllSrcPos().clipRange(shot_id, shot_id);
+  const ShotPosition &allGeoPos = fmMethod.getAllGeoPos();
+  std::vector<float> &sp0 = slot.sp0;
+  std::vector<float> &sp1 = slot.sp1;
+
+  for(int it = nt - 1; it >= 0 ; it--) {
+    fmMethod.readBndry(&slot.bndr[0], &sp0[0], it);
+    std::swap(sp0, sp1);
+    fmMethod.stepBackward(sp0, sp1, u2);
+    fmMethod.subSource(&sp0[0], &wlt[it], curSrcPos);
+
+    fmMethod.addSource(&gp1[0], &vsrc_trans[it * ng], allGeoPos);
+    fmMethod.stepForward(gp0, gp1, u2);
+    std::swap(gp1, gp0);
+
+    if (dt * it > 0.4) {
+      cross_correlation(&sp0[0], &gp0[0], &g1[0], g1.size(), 1.0);
+    } else if (dt * it > 0.3) {
+      cross_correlation(&sp0[0], &gp0[0], &g1[0], g1.size(), (dt * it - 0.3) / 0.1);
+    } else {
+      break;
+    }
+  }
+
+  fmMethod.maskGradient(&g1[0]);
+  std::vector<float> &g2 = *pipeGrad;
+  std::transform(g2.begin(), g2.end(), g1.begin(), g2.begin(), std::plus<float>());
+}
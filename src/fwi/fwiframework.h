@@ -13,13 +13,21 @@
 #include "fwiupdatevelop.h"
 #include "fwiupdatesteplenop.h"
 #include "random-code.h"
+#include "domain-decomp.h"
+#include "node-reduce.h"
+#include "shot-pipeline.h"
 
 class FwiFramework : public FwiBase {
 public:
   FwiFramework(ForwardModeling &fmMethod, const FwiUpdateSteplenOp &updateSteplenOp,
                   const FwiUpdateVelOp &updateVelOp, const std::vector<float> &wlt,
                   const std::vector<float> &dobs);
+	~FwiFramework();
 	void epoch(int iter);
+	void setGradCompression(const char *spec);
+	void setShotPipeline(int depth, int nthreads0, int nthreads1);
+	void saveState(CheckpointData &ckpt, const std::string &key) const;
+	void loadState(const CheckpointData &ckpt, const std::string &key);
 	void calgradient(const ForwardModeling &fmMethod,
     const std::vector<float> &encSrc,
     const std::vector<float> &vsrc,
@@ -27,10 +35,36 @@ public:
     int nt, float dt,
 		int shot_id, int rank);
 
+private:
+	void calgradientDecomp(DomainDecomp &decomp,
+    const std::vector<float> &wlt,
+    const std::vector<float> &vsrc,
+    std::vector<float> &g0,
+    int nt, float dt, int shot_id);
+	void pipelineShots(int shot_begin, int shot_end, int iter, std::vector<float> &g2, float &obj);
+	void pipelineForward(int shot_id, int slot);
+	void pipelineAdjoint(int shot_id, int slot);
+
+private:
+	/// a shot between the two stages of the pipeline, see pipelineShots
+	struct PipeSlot {
+		std::vector<float> dcal_trans;
+		std::vector<float> bndr;
+		std::vector<float> sp0;
+		std::vector<float> sp1;
+	};
+	ShotPipeline *pipeline;             /// NULL runs the shots one after the other
+	std::vector<PipeSlot> pipeSlots;
+	std::vector<float> pipeU2;          /// scratch of the forward stage
+	std::vector<float> *pipeGrad;       /// the sums of the adjoint stage
+	float pipeObj;
+	int pipeIter;
+
 
 protected:
   FwiUpdateSteplenOp updateStenlelOp;
   const FwiUpdateVelOp &updateVelOp;
+  NodeReducer gradReducer;  /// the interior maskGradient keeps
 };
 
 #endif /* SRC_ESS_FWI2D_ESSFWIFRAMEWORK_H_ */
@@ -12,7 +12,9 @@
 #include "common.h"
 #include "parabola-vertex.h"
 #include "sum.h"
+#include "workspace.h"
 #include "mpi.h"
+#include "domain-decomp.h"
 
 namespace {
 typedef std::pair<float, float> ParaPoint;
@@ -28,7 +30,7 @@ void calMaxAlpha2_3(const Velocity &exvel,  const float *grad, float dt, float d
   const int nx = exvel.nx;
   const int nz = exvel.nz;
 
-  const std::vector<float> &vel = exvel.dat;
+  const VelocityData &vel = exvel.dat;
   float alpha2 = FLT_MAX;
   for (int i = 0; i < nx * nz; i++) {
     float tmpv = dx / (dt * std::sqrt(vel[i]));
@@ -64,7 +66,10 @@ float FwiUpdateSteplenOp::calobjval(const std::vector<float>& grad,
   int nt = fmMethod.getnt();
 
   const Velocity &oldVel = fmMethod.getVelocity();
-  Velocity newVel(nx, nz);
+  Velocity newVel;
+  newVel.nx = nx;
+  newVel.nz = nz;
+  WorkBuffer newVelBuf(newVel.dat.vector(), nx * nz, false); /// written by updateVelOp
 
   /*
 	sf_file sf_oldvel = sf_output("oldvel_before.rsf");
@@ -93,8 +98,10 @@ float FwiUpdateSteplenOp::calobjval(const std::vector<float>& grad,
 
   //forward modeling
   int ng = fmMethod.getng();
-  std::vector<float> dcal(nt * ng);
-  std::vector<float> dcal_trans(nt * ng);
+  std::vector<float> dcal;
+  WorkBuffer dcalBuf(dcal, nt * ng, false);
+  std::vector<float> dcal_trans;
+  WorkBuffer dcalTransBuf(dcal_trans, nt * ng, false);
   updateMethod->FwiForwardModeling(*encsrc, dcal_trans, shot_id);
 	matrix_transpose(&dcal_trans[0], &dcal[0], ng, nt);
 
@@ -118,7 +125,8 @@ float FwiUpdateSteplenOp::calobjval(const std::vector<float>& grad,
   exit(1);
 	*/
 
-  std::vector<float> vdiff(nt * ng, 0);
+  std::vector<float> vdiff;
+  WorkBuffer vdiffBuf(vdiff, nt * ng, false);
 		INFO() << "****sum encobs: " << std::accumulate((*encobs).begin(), (*encobs).begin() + ng * nt, 0.0f);
 		INFO() << "****sum2 dcal: " << std::accumulate(dcal.begin(), dcal.begin() + ng * nt, 0.0f);
 	
@@ -356,8 +364,10 @@ void FwiUpdateSteplenOp::calsteplen(const std::vector<float> &dobs, const std::v
 
 	for(int is = shot_begin ; is < shot_end ; is ++)
 	{
-		std::vector<float> t_obs(ng * nt);
-		std::vector<float> t_obs_trans(ng * nt);
+		std::vector<float> t_obs;
+		WorkBuffer tObsBuf(t_obs, ng * nt, false);
+		std::vector<float> t_obs_trans;
+		WorkBuffer tObsTransBuf(t_obs_trans, ng * nt, false);
 		memcpy(&t_obs_trans[0], &dobs[is * ng * nt], sizeof(float) * ng * nt);
 	  matrix_transpose(&t_obs_trans[0], &t_obs[0], ng, nt);
 
@@ -368,6 +378,11 @@ void FwiUpdateSteplenOp::calsteplen(const std::vector<float> &dobs, const std::v
 		local_obj_val3_sum += obj_val3;
 	}
 	obj_val1_sum = obj_val1;
+	/// the ranks of a shot group share the shots, count each once
+	if (fmMethod.getDecomposition() != NULL && !fmMethod.getDecomposition()->groupRoot()) {
+		local_obj_val2_sum = 0.0f;
+		local_obj_val3_sum = 0.0f;
+	}
 	MPI_Allreduce(&local_obj_val2_sum, &obj_val2_sum, 1, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
 	MPI_Allreduce(&local_obj_val3_sum, &obj_val3_sum, 1, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
 	if(rank == 0)
@@ -401,3 +416,31 @@ void FwiUpdateSteplenOp::initAlpha23(float maxAlpha3, float &initAlpha2, float &
 	initAlpha3 = maxAlpha3;
 	initAlpha2 = initAlpha3 * 0.5;
 }
+
+/// the step of the last iteration the next one starts from, and the trials
+void FwiUpdateSteplenOp::saveState(CheckpointData &ckpt, const std::string &key) const {
+  float trial[] = { alpha1, alpha2, alpha3, obj_val1, obj_val2, obj_val3,
+      obj_val1_sum, obj_val2_sum, obj_val3_sum, maxAlpha3 };
+  ckpt.put(key + ".trial", trial, sizeof(trial));
+  ckpt.putValue(key + ".toParabolic", toParabolic);
+  ckpt.putValue(key + ".alpha", preservedAlpha.alpha);
+  ckpt.putValue(key + ".alphaInit", preservedAlpha.init);
+}
+
+void FwiUpdateSteplenOp::loadState(const CheckpointData &ckpt, const std::string &key) {
+  float trial[10];
+  ckpt.get(key + ".trial", trial, sizeof(trial));
+  alpha1 = trial[0];
+  alpha2 = trial[1];
+  alpha3 = trial[2];
+  obj_val1 = trial[3];
+  obj_val2 = trial[4];
+  obj_val3 = trial[5];
+  obj_val1_sum = trial[6];
+  obj_val2_sum = trial[7];
+  obj_val3_sum = trial[8];
+  maxAlpha3 = trial[9];
+  toParabolic = ckpt.getValue<bool>(key + ".toParabolic");
+  preservedAlpha.alpha = ckpt.getValue<float>(key + ".alpha");
+  preservedAlpha.init = ckpt.getValue<bool>(key + ".alphaInit");
+}
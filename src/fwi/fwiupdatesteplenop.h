@@ -9,6 +9,8 @@
 #define SRC_FWI2D_UPDATESTEPLENOP_H_
 
 #include <vector>
+#include <string>
+#include "checkpoint.h"
 #include "forwardmodeling.h"
 #include "fwiupdatevelop.h"
 
@@ -19,6 +21,8 @@ public:
   void bindEncSrcObs(const std::vector<float> &encsrc, const std::vector<float> &encobs);
   void calsteplen(const std::vector<float> &dobs, const std::vector<float> &grad, float obj_val1, int iter, float &steplen, float &objval, int rank, int shot_begin, int shot_end);
 	void parabola_fit(float alpha1, float alpha2, float alpha3, float obj_val1, float obj_val2, float obj_val3, float maxAlpha3, bool toParabolic, int iter, float &steplen, float &objval);
+	void saveState(CheckpointData &ckpt, const std::string &key) const;
+	void loadState(const CheckpointData &ckpt, const std::string &key);
 
 public:
 	float alpha1, alpha2, alpha3, obj_val1, obj_val2, obj_val3;
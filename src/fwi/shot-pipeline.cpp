@@ -0,0 +1,130 @@
+/*
+ * shot-pipeline.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C" {
+#include <rsf.h>
+}
+
+#include <pthread.h>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "shot-pipeline.h"
+
+namespace {
+
+/// the state the two threads share, produced and consumed count shots
+struct Channel {
+  ShotPipeline::Stage *first;
+  int begin, end;
+  int depth;
+  int nthreads;
+  int produced;
+  int consumed;
+  pthread_mutex_t mut;
+  pthread_cond_t cond;
+};
+
+void *firstStage(void *arg) {
+  Channel *ch = static_cast<Channel *>(arg);
+#ifdef _OPENMP
+  omp_set_num_threads(ch->nthreads);
+#endif
+
+  for (int is = ch->begin; is < ch->end; is++) {
+    int k = is - ch->begin;
+    pthread_mutex_lock(&ch->mut);
+    while (k - ch->consumed >= ch->depth) {
+      pthread_cond_wait(&ch->cond, &ch->mut);
+    }
+    pthread_mutex_unlock(&ch->mut);
+
+    ch->first->run(is, k % ch->depth);
+
+    pthread_mutex_lock(&ch->mut);
+    ch->produced++;
+    pthread_cond_broadcast(&ch->cond);
+    pthread_mutex_unlock(&ch->mut);
+  }
+  return NULL;
+}
+
+} /// end of name space
+
+ShotPipeline::ShotPipeline(int _depth, int _nthreads0, int _nthreads1) :
+  depth(_depth), nthreads0(_nthreads0), nthreads1(_nthreads1)
+{
+  if (depth < 1) {
+    sf_error("the shot pipeline needs at least one slot");
+  }
+
+  int total = 1;
+#ifdef _OPENMP
+  total = omp_get_max_threads();
+#endif
+  if (nthreads0 <= 0 && nthreads1 <= 0) {
+    nthreads0 = std::max(1, total / 2);
+    nthreads1 = std::max(1, total - nthreads0);
+  } else if (nthreads0 <= 0 || nthreads1 <= 0) {
+    sf_error("give the threads of both stages of the shot pipeline");
+  }
+}
+
+int ShotPipeline::getDepth() const {
+  return depth;
+}
+
+void ShotPipeline::run(int begin, int end, Stage &first, Stage &second) {
+  if (begin >= end) {
+    return;
+  }
+
+  Channel ch;
+  ch.first = &first;
+  ch.begin = begin;
+  ch.end = end;
+  ch.depth = depth;
+  ch.nthreads = nthreads0;
+  ch.produced = ch.consumed = 0;
+  pthread_mutex_init(&ch.mut, NULL);
+  pthread_cond_init(&ch.cond, NULL);
+
+  pthread_t helper;
+  if (pthread_create(&helper, NULL, firstStage, &ch) != 0) {
+    sf_error("cannot start the first stage of the shot pipeline");
+  }
+
+#ifdef _OPENMP
+  int saved = omp_get_max_threads();
+  omp_set_num_threads(nthreads1);
+#endif
+
+  for (int is = begin; is < end; is++) {
+    int k = is - begin;
+    pthread_mutex_lock(&ch.mut);
+    while (ch.produced <= k) {
+      pthread_cond_wait(&ch.cond, &ch.mut);
+    }
+    pthread_mutex_unlock(&ch.mut);
+
+    second.run(is, k % depth);
+
+    pthread_mutex_lock(&ch.mut);
+    ch.consumed++;
+    pthread_cond_broadcast(&ch.cond);
+    pthread_mutex_unlock(&ch.mut);
+  }
+
+#ifdef _OPENMP
+  omp_set_num_threads(saved);
+#endif
+
+  pthread_join(helper, NULL);
+  pthread_mutex_destroy(&ch.mut);
+  pthread_cond_destroy(&ch.cond);
+}
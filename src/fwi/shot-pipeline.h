@@ -0,0 +1,54 @@
+/*
+ * shot-pipeline.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_FWI_SHOT_PIPELINE_H_
+#define SRC_FWI_SHOT_PIPELINE_H_
+
+/**
+ * two stage software pipeline over a range of shots. A helper thread runs
+ * the first stage of shot i + 1 while the caller runs the second stage of
+ * shot i, each with its own share of the OpenMP threads. The stages meet
+ * through depth slots, the first stage of a shot waits for a free slot and
+ * the second for a filled one, so at most depth shots are in flight
+ */
+class ShotPipeline {
+public:
+  class Stage {
+  public:
+    virtual ~Stage() {}
+    virtual void run(int shot, int slot) = 0;
+  };
+
+  /// nthreads0 + nthreads1 OpenMP threads, both <= 0 split the default evenly
+  ShotPipeline(int depth, int nthreads0 = 0, int nthreads1 = 0);
+
+  int getDepth() const;
+
+  /// the shots [begin, end) through first then second, in order
+  void run(int begin, int end, Stage &first, Stage &second);
+
+private:
+  int depth;
+  int nthreads0;
+  int nthreads1;
+};
+
+/// a member function of obj as a stage
+template <class T>
+class MemberStage : public ShotPipeline::Stage {
+public:
+  MemberStage(T &_obj, void (T::*_fn)(int, int)) : obj(_obj), fn(_fn) {}
+  void run(int shot, int slot) {
+    (obj.*fn)(shot, slot);
+  }
+
+private:
+  T &obj;
+  void (T::*fn)(int, int);
+};
+
+#endif /* SRC_FWI_SHOT_PIPELINE_H_ */
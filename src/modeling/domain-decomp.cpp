@@ -0,0 +1,491 @@
+/*
+ * domain-decomp.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C" {
+#include <rsf.h>
+#include "fd4t10s-rect.h"
+}
+
+#include <algorithm>
+#include "domain-decomp.h"
+#include "forwardmodeling.h"
+#include "workspace.h"
+#include "logger.h"
+
+namespace {
+
+/// [begin, end) of block c of n cells cut into p blocks
+void blockRange(int n, int p, int c, int &begin, int &end) {
+  begin = (long)n * c / p;
+  end = (long)n * (c + 1) / p;
+}
+
+/// the rectangles of outer which are not in inner, inner is empty or inside outer
+int frameRects(const int *outer, const int *inner, int rects[][4]) {
+  if (outer[0] >= outer[1] || outer[2] >= outer[3]) {
+    return 0;
+  }
+  if (inner[0] >= inner[1] || inner[2] >= inner[3]) {
+    std::copy(outer, outer + 4, rects[0]);
+    return 1;
+  }
+
+  int r[4][4] = {
+    { outer[0], inner[0], outer[2], outer[3] },
+    { inner[1], outer[1], outer[2], outer[3] },
+    { inner[0], inner[1], outer[2], inner[2] },
+    { inner[0], inner[1], inner[3], outer[3] },
+  };
+  int n = 0;
+  for (int i = 0; i < 4; i++) {
+    if (r[i][0] < r[i][1] && r[i][2] < r[i][3]) {
+      std::copy(r[i], r[i] + 4, rects[n++]);
+    }
+  }
+  return n;
+}
+
+} /// end of name space
+
+DomainDecomp::DomainDecomp(MPI_Comm world, int _nsub, int _nxpad, int _nzpad) :
+    nsub(_nsub), nxpad(_nxpad), nzpad(_nzpad), nreq(0)
+{
+  int wrank, wsize;
+  MPI_Comm_rank(world, &wrank);
+  MPI_Comm_size(world, &wsize);
+  if (nsub < 1 || wsize % nsub != 0) {
+    sf_error("%d ranks can not be split into groups of %d subdomains", wsize, nsub);
+  }
+
+  ngroup = wsize / nsub;
+  igroup = wrank / nsub;
+  MPI_Comm_split(world, igroup, wrank, &gcomm);
+  MPI_Comm_rank(gcomm, &rank);
+  MPI_Comm_split(world, rank, wrank, &xcomm);
+
+  /// more blocks along the longer axis
+  int dims[2] = { 0, 0 };
+  MPI_Dims_create(nsub, 2, dims);
+  px = dims[0];
+  pz = dims[1];
+  if (nzpad > nxpad) {
+    std::swap(px, pz);
+  }
+
+  int cx = rank / pz;
+  int cz = rank % pz;
+  ownedRange(rank, ox0, ox1, oz0, oz1);
+  if (ox1 - ox0 < HALO || oz1 - oz0 < HALO) {
+    sf_error("grid %d x %d is too small for %d x %d subdomains", nxpad, nzpad, px, pz);
+  }
+
+  lx0 = std::max(0, ox0 - MARGIN);
+  lx1 = std::min(nxpad, ox1 + MARGIN);
+  lz0 = std::max(0, oz0 - MARGIN);
+  lz1 = std::min(nzpad, oz1 + MARGIN);
+  lnx = lx1 - lx0;
+  lnz = lz1 - lz0;
+
+  for (int k = 0; k < 9; k++) {
+    int x = cx + k / 3 - 1;
+    int z = cz + k % 3 - 1;
+    bool inside = k != 4 && x >= 0 && x < px && z >= 0 && z < pz;
+    nbr[k] = inside ? x * pz + z : MPI_PROC_NULL;
+    if (inside) {
+      int r[4];
+      haloRange(k, true, r);
+      sendbuf[k].resize((r[1] - r[0]) * (r[3] - r[2]));
+      recvbuf[k].resize(sendbuf[k].size());
+    }
+  }
+
+  u2.assign(localSize(), 0);
+
+  INFO() << format("group %d of %d, subdomain %d of %d x %d: x [%d, %d), z [%d, %d), local grid %d x %d")
+      % igroup % ngroup % rank % px % pz % ox0 % ox1 % oz0 % oz1 % lnx % lnz;
+}
+
+DomainDecomp::~DomainDecomp() {
+  MPI_Comm_free(&gcomm);
+  MPI_Comm_free(&xcomm);
+}
+
+void DomainDecomp::ownedRange(int r, int &x0, int &x1, int &z0, int &z1) const {
+  blockRange(nxpad, px, r / pz, x0, x1);
+  blockRange(nzpad, pz, r % pz, z0, z1);
+}
+
+MPI_Comm DomainDecomp::groupComm() const {
+  return gcomm;
+}
+
+MPI_Comm DomainDecomp::crossComm() const {
+  return xcomm;
+}
+
+int DomainDecomp::group() const {
+  return igroup;
+}
+
+int DomainDecomp::ngroups() const {
+  return ngroup;
+}
+
+bool DomainDecomp::groupRoot() const {
+  return rank == 0;
+}
+
+void DomainDecomp::shotRange(int ns, int &begin, int &end) const {
+  int k = (ns + ngroup - 1) / ngroup;
+  begin = std::min(ns, igroup * k);
+  end = std::min(ns, begin + k);
+}
+
+size_t DomainDecomp::localSize() const {
+  return (size_t)lnx * lnz;
+}
+
+void DomainDecomp::scatter(const float *global, float *local) const {
+  for (int ix = lx0; ix < lx1; ix++) {
+    std::copy(&global[ix * nzpad + lz0], &global[ix * nzpad + lz1], &local[(ix - lx0) * lnz]);
+  }
+}
+
+/**
+ * the velocity is cut again on every call, the line search rebinds fm to
+ * trial models. The sponge and the boundary cells depend on the geometry only
+ */
+void DomainDecomp::bind(const ForwardModeling &fm) {
+  if (fm.getnx() != nxpad || fm.getnz() != nzpad) {
+    sf_error("the padded grid %d x %d is not the decomposed %d x %d", fm.getnx(), fm.getnz(), nxpad, nzpad);
+  }
+
+  vel.resize(localSize());
+  scatter(&fm.getVelocity().dat[0], &vel[0]);
+  if (!mask.empty()) {
+    return;
+  }
+
+  mask.assign(localSize(), 0);
+  for (int ix = ox0; ix < ox1; ix++) {
+    std::fill(&mask[(ix - lx0) * lnz + oz0 - lz0], &mask[(ix - lx0) * lnz + oz1 - lz0], 1.0f);
+  }
+
+  /// the per cell product of the sponge strips of Sponge::applySponge
+  std::vector<float> f;
+  fm.spongeFactors(f);
+  for (int ix = ox0; ix < ox1; ix++) {
+    for (int iz = oz0; iz < oz1; iz++) {
+      if (f[ix * nzpad + iz] != 1.0f) {
+        spongeIdx.push_back((ix - lx0) * lnz + iz - lz0);
+        spongeFac.push_back(f[ix * nzpad + iz]);
+      }
+    }
+  }
+
+  /// the cells of ForwardModeling::writeBndry, bottom, left and right
+  const int w = 6;
+  int bx0 = fm.getbx0(), bxn = fm.getbxn();
+  int bz0 = fm.getbz0(), bzn = fm.getbzn();
+  int xs[3][2] = { { bx0 - w, nxpad - bxn + w }, { bx0 - w, bx0 }, { nxpad - bxn, nxpad - bxn + w } };
+  int zs[3][2] = { { nzpad - bzn, nzpad - bzn + w }, { bz0, nzpad - bzn }, { bz0, nzpad - bzn } };
+  for (int s = 0; s < 3; s++) {
+    for (int ix = std::max(xs[s][0], ox0); ix < std::min(xs[s][1], ox1); ix++) {
+      for (int iz = std::max(zs[s][0], oz0); iz < std::min(zs[s][1], oz1); iz++) {
+        bndrIdx.push_back((ix - lx0) * lnz + iz - lz0);
+      }
+    }
+  }
+}
+
+/**
+ * the owned cells sent towards neighbour k, or the halo cells received from
+ * it, as [x0, x1, z0, z1) of the local grid
+ */
+void DomainDecomp::haloRange(int k, bool send, int *r) const {
+  int s[2] = { k / 3 - 1, k % 3 - 1 };
+  int o[2][2] = { { ox0 - lx0, ox1 - lx0 }, { oz0 - lz0, oz1 - lz0 } };
+  for (int a = 0; a < 2; a++) {
+    int b = o[a][0], e = o[a][1];
+    if (s[a] < 0) {
+      r[2 * a] = send ? b : b - HALO;
+      r[2 * a + 1] = send ? b + HALO : b;
+    } else if (s[a] > 0) {
+      r[2 * a] = send ? e - HALO : e;
+      r[2 * a + 1] = send ? e : e + HALO;
+    } else {
+      r[2 * a] = b;
+      r[2 * a + 1] = e;
+    }
+  }
+}
+
+/**
+ * messages travelling towards k carry the tag k, the one from neighbour k
+ * travels towards 8 - k
+ */
+void DomainDecomp::exchangeBegin(float *p) const {
+  nreq = 0;
+  for (int k = 0; k < 9; k++) {
+    if (nbr[k] != MPI_PROC_NULL) {
+      MPI_Irecv(&recvbuf[k][0], recvbuf[k].size(), MPI_FLOAT, nbr[k], 8 - k, gcomm, &reqs[nreq++]);
+    }
+  }
+
+  for (int k = 0; k < 9; k++) {
+    if (nbr[k] == MPI_PROC_NULL) {
+      continue;
+    }
+    int r[4];
+    haloRange(k, true, r);
+    float *b = &sendbuf[k][0];
+    for (int ix = r[0]; ix < r[1]; ix++) {
+      b = std::copy(&p[ix * lnz + r[2]], &p[ix * lnz + r[3]], b);
+    }
+    MPI_Isend(&sendbuf[k][0], sendbuf[k].size(), MPI_FLOAT, nbr[k], k, gcomm, &reqs[nreq++]);
+  }
+}
+
+void DomainDecomp::exchangeEnd(float *p) const {
+  MPI_Waitall(nreq, reqs, MPI_STATUSES_IGNORE);
+
+  for (int k = 0; k < 9; k++) {
+    if (nbr[k] == MPI_PROC_NULL) {
+      continue;
+    }
+    int r[4];
+    haloRange(k, false, r);
+    const float *b = &recvbuf[k][0];
+    for (int ix = r[0]; ix < r[1]; ix++) {
+      std::copy(b, b + (r[3] - r[2]), &p[ix * lnz + r[2]]);
+      b += r[3] - r[2];
+    }
+  }
+}
+
+/**
+ * lap and upd are the local ranges of the two passes, the inner parts read
+ * owned cells only and run while the halo is in flight, the frames after it
+ */
+void DomainDecomp::stencil(float *prev, const float *curr, const int *lap, const int *upd, bool inner) const {
+  int ax0 = ox0 - lx0, ax1 = ox1 - lx0;
+  int az0 = oz0 - lz0, az1 = oz1 - lz0;
+  int lapIn[4] = { std::max(lap[0], ax0 + 5), std::min(lap[1], ax1 - 5),
+                   std::max(lap[2], az0 + 5), std::min(lap[3], az1 - 5) };
+  int updIn[4] = { std::max(upd[0], ax0 + 6), std::min(upd[1], ax1 - 6),
+                   std::max(upd[2], az0 + 6), std::min(upd[3], az1 - 6) };
+
+  if (inner) {
+    if (lapIn[0] < lapIn[1] && lapIn[2] < lapIn[3]) {
+      fd4t10s_rect_laplacian(curr, &u2[0], lnz, lapIn[0], lapIn[1], lapIn[2], lapIn[3]);
+    }
+    if (updIn[0] < updIn[1] && updIn[2] < updIn[3]) {
+      fd4t10s_rect_update(prev, curr, &vel[0], &u2[0], lnz, updIn[0], updIn[1], updIn[2], updIn[3]);
+    }
+    return;
+  }
+
+  int rects[4][4];
+  int n = frameRects(lap, lapIn, rects);
+  for (int i = 0; i < n; i++) {
+    fd4t10s_rect_laplacian(curr, &u2[0], lnz, rects[i][0], rects[i][1], rects[i][2], rects[i][3]);
+  }
+  n = frameRects(upd, updIn, rects);
+  for (int i = 0; i < n; i++) {
+    fd4t10s_rect_update(prev, curr, &vel[0], &u2[0], lnz, rects[i][0], rects[i][1], rects[i][2], rects[i][3]);
+  }
+}
+
+void DomainDecomp::step(std::vector<float> &p0, std::vector<float> &p1, bool sponge) const {
+  /// the owned cells the global kernel updates, and the laplacian they need
+  int upd[4] = { std::max(ox0, 6) - lx0, std::min(ox1, nxpad - 6) - lx0,
+                 std::max(oz0, 6) - lz0, std::min(oz1, nzpad - 6) - lz0 };
+  int lap[4] = { upd[0] - 1, upd[1] + 1, upd[2] - 1, upd[3] + 1 };
+  if (upd[0] >= upd[1] || upd[2] >= upd[3]) {
+    std::fill(lap, lap + 4, 0);
+  }
+
+  exchangeBegin(&p1[0]);
+  stencil(&p0[0], &p1[0], lap, upd, true);
+  exchangeEnd(&p1[0]);
+  stencil(&p0[0], &p1[0], lap, upd, false);
+
+  if (sponge) {
+    for (size_t i = 0; i < spongeIdx.size(); i++) {
+      p0[spongeIdx[i]] *= spongeFac[i];
+      p1[spongeIdx[i]] *= spongeFac[i];
+    }
+  }
+}
+
+void DomainDecomp::stepForward(std::vector<float> &p0, std::vector<float> &p1) const {
+  step(p0, p1, true);
+}
+
+void DomainDecomp::stepBackward(std::vector<float> &p0, std::vector<float> &p1) const {
+  step(p0, p1, false);
+}
+
+/**
+ * a point on the grid belongs to the subdomain owning its node, an off-grid
+ * point to every subdomain its sinc window (see SpreadTable) touches, each
+ * of them injecting and recording the owned taps only
+ */
+DomainPoints DomainDecomp::localPoints(const ShotPosition &pos, int bx0, int bz0) const {
+  const int LSINC = SpreadTable::LSINC;
+  std::vector<int> ix, iz;
+  std::vector<float> fx, fz;
+
+  DomainPoints pts;
+  for (int i = 0; i < pos.ns; i++) {
+    int gx = pos.getx(i) + bx0;
+    int gz = pos.getz(i) + bz0;
+    int x0 = gx, x1 = gx + 1, z0 = gz, z1 = gz + 1;
+    if (pos.offGrid()) {
+      x0 = std::max(0, std::min(gx - (LSINC / 2 - 1), nxpad - LSINC));
+      z0 = std::max(0, std::min(gz - (LSINC / 2 - 1), nzpad - LSINC));
+      x1 = x0 + LSINC;
+      z1 = z0 + LSINC;
+    }
+    if (x1 <= ox0 || x0 >= ox1 || z1 <= oz0 || z0 >= oz1) {
+      continue;
+    }
+
+    pts.ids.push_back(i);
+    ix.push_back(gx - lx0);
+    iz.push_back(gz - lz0);
+    if (pos.offGrid()) {
+      fx.push_back(pos.getfx(i));
+      fz.push_back(pos.getfz(i));
+    }
+  }
+
+  int n = pts.ids.size();
+  pts.buf.resize(n);
+  if (n > 0) {
+    pts.table.build(&ix[0], &iz[0], fx.empty() ? NULL : &fx[0], fz.empty() ? NULL : &fz[0], n, lnx, lnz);
+  }
+  return pts;
+}
+
+void DomainDecomp::inject(float *p, const float *amp, const DomainPoints &pts, float sign) const {
+  for (size_t i = 0; i < pts.ids.size(); i++) {
+    pts.buf[i] = amp[pts.ids[i]];
+  }
+  pts.table.inject(p, &pts.buf[0], sign, &mask[0]);
+}
+
+void DomainDecomp::extract(const float *p, float *seis, const DomainPoints &pts) const {
+  pts.table.extract(p, &pts.buf[0], &mask[0]);
+  for (size_t i = 0; i < pts.ids.size(); i++) {
+    seis[pts.ids[i]] = pts.buf[i];
+  }
+}
+
+void DomainDecomp::reduceSeis(std::vector<float> &seis) const {
+  MPI_Allreduce(MPI_IN_PLACE, &seis[0], seis.size(), MPI_FLOAT, MPI_SUM, gcomm);
+}
+
+size_t DomainDecomp::bndryLength(int nt) const {
+  return (size_t)nt * bndrIdx.size();
+}
+
+void DomainDecomp::writeBndry(float *bndr, const float *p, int it) const {
+  float *b = &bndr[it * bndrIdx.size()];
+  for (size_t i = 0; i < bndrIdx.size(); i++) {
+    b[i] = p[bndrIdx[i]];
+  }
+}
+
+void DomainDecomp::readBndry(const float *bndr, float *p, int it) const {
+  const float *b = &bndr[it * bndrIdx.size()];
+  for (size_t i = 0; i < bndrIdx.size(); i++) {
+    p[bndrIdx[i]] = b[i];
+  }
+}
+
+void DomainDecomp::crossCorrelation(const float *p, const float *q, float *image, float scale) const {
+  for (int ix = ox0; ix < ox1; ix++) {
+    int l = (ix - lx0) * lnz - lz0;
+    float *g = &image[ix * nzpad];
+    for (int iz = oz0; iz < oz1; iz++) {
+      g[iz] -= p[l + iz] * q[l + iz] * scale;
+    }
+  }
+}
+
+void DomainDecomp::reduceGradient(const float *g, float *sum) const {
+  std::vector<int> counts(nsub);
+  std::vector<int> displs(nsub + 1, 0);
+  for (int r = 0; r < nsub; r++) {
+    int x0, x1, z0, z1;
+    ownedRange(r, x0, x1, z0, z1);
+    counts[r] = (x1 - x0) * (z1 - z0);
+    displs[r + 1] = displs[r] + counts[r];
+  }
+
+  std::vector<float> blk(counts[rank]);
+  for (int ix = ox0; ix < ox1; ix++) {
+    std::copy(&g[ix * nzpad + oz0], &g[ix * nzpad + oz1], &blk[(ix - ox0) * (oz1 - oz0)]);
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &blk[0], blk.size(), MPI_FLOAT, MPI_SUM, xcomm);
+
+  std::vector<float> all(displs[nsub]);
+  MPI_Allgatherv(&blk[0], blk.size(), MPI_FLOAT, &all[0], &counts[0], &displs[0], MPI_FLOAT, gcomm);
+
+  for (int r = 0; r < nsub; r++) {
+    int x0, x1, z0, z1;
+    ownedRange(r, x0, x1, z0, z1);
+    const float *b = &all[displs[r]];
+    for (int ix = x0; ix < x1; ix++) {
+      std::copy(&b[(ix - x0) * (z1 - z0)], &b[(ix - x0 + 1) * (z1 - z0)], &sum[ix * nzpad + z0]);
+    }
+  }
+}
+
+/**
+ * ForwardModeling::FwiForwardModeling on the subdomains of the group, every
+ * rank of the group gets the whole dcal
+ */
+void DomainDecomp::forwardModeling(const ForwardModeling &fm, const std::vector<float> &encsrc,
+    std::vector<float> &dcal, int shot_id) {
+  propagate(fm, fm.getAllSrcPos().clipRange(shot_id, shot_id), &encsrc[0], 1, dcal);
+}
+
+/**
+ * ForwardModeling::EssForwardModeling on the subdomains of the group, the
+ * sources outside the local grid are skipped by localPoints
+ */
+void DomainDecomp::essForwardModeling(const ForwardModeling &fm, const std::vector<float> &encsrc,
+    std::vector<float> &dcal) {
+  propagate(fm, fm.getAllSrcPos(), &encsrc[0], fm.getns(), dcal);
+}
+
+/// src is nt x nsrc, one amplitude of each source of srcPos per step
+void DomainDecomp::propagate(const ForwardModeling &fm, const ShotPosition &srcPos, const float *src, int nsrc,
+    std::vector<float> &dcal) {
+  bind(fm);
+
+  int nt = fm.getnt();
+  int ng = fm.getng();
+  std::vector<float> p0;
+  WorkBuffer p0Buf(p0, localSize());
+  std::vector<float> p1;
+  WorkBuffer p1Buf(p1, localSize());
+
+  DomainPoints srcPts = localPoints(srcPos, fm.getbx0(), fm.getbz0());
+  DomainPoints geo = localPoints(fm.getAllGeoPos(), fm.getbx0(), fm.getbz0());
+
+  std::fill(dcal.begin(), dcal.begin() + nt * ng, 0.0f);
+  for (int it = 0; it < nt; it++) {
+    inject(&p1[0], &src[it * nsrc], srcPts, 1.0f);
+    stepForward(p0, p1);
+    std::swap(p1, p0);
+    extract(&p0[0], &dcal[it * ng], geo);
+  }
+  reduceSeis(dcal);
+}
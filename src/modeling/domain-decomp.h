@@ -0,0 +1,140 @@
+/*
+ * domain-decomp.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_MDLIB_DOMAIN_DECOMP_H_
+#define SRC_MDLIB_DOMAIN_DECOMP_H_
+
+#include <vector>
+#include <mpi.h>
+#include "shot-position.h"
+#include "spread-table.h"
+
+class ForwardModeling;
+
+/**
+ * the sources or receivers of a shot which touch the cells of one subdomain,
+ * with their tables on the local grid, see DomainDecomp::localPoints
+ */
+struct DomainPoints {
+  SpreadTable table;
+  std::vector<int> ids;       /// the source or receiver of each local point
+  mutable std::vector<float> buf;
+};
+
+/**
+ * single-shot propagation on a px x pz block decomposition of the padded
+ * grid. The ranks of the world are split into groups of nsub, a group runs
+ * one shot at a time on its nsub subdomains and the groups share the shots.
+ *
+ * a subdomain owns [ox0, ox1) x [oz0, oz1) and keeps the local grid
+ * [lx0, lx1) x [lz0, lz1), which is the owned block grown by MARGIN cells and
+ * clipped to the padded grid, idx = ix * lnz + iz. HALO = 6 cells of the
+ * margin are exchanged every step with the 8 neighbours, the 10th order
+ * laplacian reaches 5 cells and the 4th order correction of the update one
+ * more, the laplacian of the halo cells reaches into the corners. The margin is wider
+ * than the halo so that the 8 x 8 sinc window of any off-grid point which
+ * touches an owned cell stays on the local grid
+ */
+class DomainDecomp {
+public:
+  DomainDecomp(MPI_Comm world, int nsub, int nxpad, int nzpad);
+  ~DomainDecomp();
+
+  /// the ranks running the same shot, and those holding the same subdomain
+  MPI_Comm groupComm() const;
+  MPI_Comm crossComm() const;
+  int group() const;
+  int ngroups() const;
+  bool groupRoot() const;
+
+  /// [begin, end) of the ns shots for the group of this rank
+  void shotRange(int ns, int &begin, int &end) const;
+
+  size_t localSize() const;
+
+  /// the local grid cut from a padded grid
+  void scatter(const float *global, float *local) const;
+
+  /// local velocity, sponge and boundary cells of fm, once per modeling
+  void bind(const ForwardModeling &fm);
+
+  /// as ForwardModeling::stepForward, with the sponge, and stepBackward
+  void stepForward(std::vector<float> &p0, std::vector<float> &p1) const;
+  void stepBackward(std::vector<float> &p0, std::vector<float> &p1) const;
+
+  DomainPoints localPoints(const ShotPosition &pos, int bx0, int bz0) const;
+  void inject(float *p, const float *amp, const DomainPoints &pts, float sign) const;
+
+  /// seis[id] is set for the local points only, a point cut by the border
+  /// gets the part of its owned taps, the group sum in reduceSeis completes it
+  void extract(const float *p, float *seis, const DomainPoints &pts) const;
+  void reduceSeis(std::vector<float> &seis) const;
+
+  /// the owned cells of the boundary ForwardModeling::writeBndry saves
+  size_t bndryLength(int nt) const;
+  void writeBndry(float *bndr, const float *p, int it) const;
+  void readBndry(const float *bndr, float *p, int it) const;
+
+  /// p(owned) * q(owned) * scale subtracted from image(owned), as FwiBase::cross_correlation
+  void crossCorrelation(const float *p, const float *q, float *image, float scale) const;
+
+  /**
+   * sum holds the sum over all ranks of g, which is zero outside the owned
+   * cells. The owned blocks are summed over crossComm, the groups, and the
+   * sums gathered over groupComm, each rank moves one block instead of a grid
+   */
+  void reduceGradient(const float *g, float *sum) const;
+
+  void forwardModeling(const ForwardModeling &fm, const std::vector<float> &encsrc,
+      std::vector<float> &dcal, int shot_id);
+
+  /// the supershot of all the sources, encsrc is nt x ns, every rank of the group gets the whole dcal
+  void essForwardModeling(const ForwardModeling &fm, const std::vector<float> &encsrc,
+      std::vector<float> &dcal);
+
+public:
+  static const int HALO = 6;
+  static const int MARGIN = 8;
+
+private:
+  void ownedRange(int r, int &x0, int &x1, int &z0, int &z1) const;
+  void haloRange(int k, bool send, int *r) const;
+  void step(std::vector<float> &p0, std::vector<float> &p1, bool sponge) const;
+  void exchangeBegin(float *p) const;
+  void exchangeEnd(float *p) const;
+  void stencil(float *prev, const float *curr, const int *lap, const int *upd, bool inner) const;
+  void propagate(const ForwardModeling &fm, const ShotPosition &srcPos, const float *src, int nsrc,
+      std::vector<float> &dcal);
+
+private:
+  MPI_Comm gcomm;
+  MPI_Comm xcomm;
+  int ngroup;
+  int igroup;
+  int nsub;
+  int rank;                 /// in the group
+  int px, pz;
+  int nxpad, nzpad;
+  int ox0, ox1, oz0, oz1;   /// owned, padded grid
+  int lx0, lx1, lz0, lz1;   /// local, padded grid
+  int lnx, lnz;
+  int nbr[9];               /// rank at (dx, dz) = (k / 3 - 1, k % 3 - 1)
+
+  std::vector<float> vel;
+  std::vector<float> mask;        /// 1 on the owned cells
+  std::vector<int> spongeIdx;     /// owned cells the sponge scales
+  std::vector<float> spongeFac;
+  std::vector<int> bndrIdx;       /// owned cells of the saved boundary
+
+  mutable std::vector<float> u2;
+  mutable std::vector<float> sendbuf[9];
+  mutable std::vector<float> recvbuf[9];
+  mutable MPI_Request reqs[16];
+  mutable int nreq;
+};
+
+#endif /* SRC_MDLIB_DOMAIN_DECOMP_H_ */
@@ -0,0 +1,68 @@
+/*
+ * fd4t10s-batch.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include "fd4t10s-batch.h"
+#include "fdcoef.h"
+
+/**
+ * please note that the velocity is transformed
+ */
+void fd4t10s_batch_2d_vtrans(float *prev_wave, const float *curr_wave, const float *vel, float *u2, int nx, int nz, int nm) {
+  float a[6];
+
+  const int d = 6;
+  const int sz = nm;      /// stride of z
+  const int sx = nz * nm; /// stride of x
+  int ix, iz, im;
+
+  /// Zhang, Jinhai's method by default, see fdcoef.h
+  fdcoef_load(a);
+
+#ifdef USE_OPENMP
+  #pragma omp parallel for default(shared) private(ix, iz, im)
+#endif
+  for (ix = d - 1; ix < nx - (d - 1); ix++) {
+    for (iz = d - 1; iz < nz - (d - 1); iz++) {
+      const float *c = curr_wave + (ix * nz + iz) * nm;
+      float *u = u2 + (ix * nz + iz) * nm;
+      for (im = 0; im < nm; im++) {
+        u[im] = -4.0 * a[0] * c[im] +
+                a[1] * (c[im - sz]  +  c[im + sz]  +
+                        c[im - sx]  +  c[im + sx])  +
+                a[2] * (c[im - 2 * sz]  +  c[im + 2 * sz]  +
+                        c[im - 2 * sx]  +  c[im + 2 * sx])  +
+                a[3] * (c[im - 3 * sz]  +  c[im + 3 * sz]  +
+                        c[im - 3 * sx]  +  c[im + 3 * sx])  +
+                a[4] * (c[im - 4 * sz]  +  c[im + 4 * sz]  +
+                        c[im - 4 * sx]  +  c[im + 4 * sx])  +
+                a[5] * (c[im - 5 * sz]  +  c[im + 5 * sz]  +
+                        c[im - 5 * sx]  +  c[im + 5 * sx]);
+      }
+    }
+  }
+
+#ifdef USE_OPENMP
+  #pragma omp parallel for default(shared) private(ix, iz, im)
+#endif
+  for (ix = d; ix < nx - d; ix++) { /// the range of ix is different from that in previous for loop
+    for (iz = d; iz < nz - d; iz++) { /// be careful of the range of iz
+      int curPos = (ix * nz + iz) * nm;
+      float *p = prev_wave + curPos;
+      const float *c = curr_wave + curPos;
+      const float *v = vel + curPos;
+      const float *u = u2 + curPos;
+      for (im = 0; im < nm; im++) {
+        float curvel = v[im];
+
+        p[im] = 2. * c[im] - 1 * p[im]  +
+                (1.0f / curvel) * u[im] + /// 2nd order
+                1.0f / 12 * (1.0f / curvel) * (1.0f / curvel) *
+                (u[im - sz] + u[im + sz] + u[im - sx] + u[im + sx] - 4 * u[im]); /// 4th order
+      }
+    }
+  }
+}
@@ -0,0 +1,19 @@
+/*
+ * fd4t10s-batch.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_MDLIB_FD4T10S_BATCH_H_
+#define SRC_MDLIB_FD4T10S_BATCH_H_
+
+/**
+ * fd4t10s_nobndry_2d_vtrans of nm wavefields of the same grid at once, each
+ * with its own velocity. The fields, velocities and u2 are interleaved with
+ * the member innermost, p[(ix * nz + iz) * nm + m], so the stencil reads
+ * every neighbour once for all members and the inner loop runs over them
+ */
+void fd4t10s_batch_2d_vtrans(float *prev_wave, const float *curr_wave, const float *vel, float *u2, int nx, int nz, int nm);
+
+#endif /* SRC_MDLIB_FD4T10S_BATCH_H_ */
@@ -0,0 +1,70 @@
+/*
+ * fd4t10s-born-fused.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include "fd4t10s-born-fused.h"
+#include "fdcoef.h"
+
+void fd4t10s_born_fused_2d_vtrans(float *prev_wave, const float *curr_wave,
+    float *prev_born, const float *curr_born, const float *vel, const float *bcoef,
+    float wnext, float wcurr, float wprev, float *u2, float *ru2, int nx, int nz) {
+  float a[6];
+
+  const int d = 6;
+  int ix, iz;
+
+  /// Zhang, Jinhai's method by default, see fdcoef.h
+  fdcoef_load(a);
+
+  /// both laplacians in one sweep, the two stencils share the loop overhead
+#ifdef USE_OPENMP
+  #pragma omp parallel for default(shared) private(ix, iz)
+#endif
+  for (ix = d - 1; ix < nx - (d - 1); ix++) {
+    for (iz = d - 1; iz < nz - (d - 1); iz++) {
+      int curPos = ix * nz + iz;
+      const float *c = curr_wave;
+      const float *r = curr_born;
+      u2[curPos] = -4.0 * a[0] * c[curPos] +
+                   a[1] * (c[curPos - 1]  +  c[curPos + 1]  +  c[curPos - nz]  +  c[curPos + nz])  +
+                   a[2] * (c[curPos - 2]  +  c[curPos + 2]  +  c[curPos - 2 * nz]  +  c[curPos + 2 * nz])  +
+                   a[3] * (c[curPos - 3]  +  c[curPos + 3]  +  c[curPos - 3 * nz]  +  c[curPos + 3 * nz])  +
+                   a[4] * (c[curPos - 4]  +  c[curPos + 4]  +  c[curPos - 4 * nz]  +  c[curPos + 4 * nz])  +
+                   a[5] * (c[curPos - 5]  +  c[curPos + 5]  +  c[curPos - 5 * nz]  +  c[curPos + 5 * nz]);
+      ru2[curPos] = -4.0 * a[0] * r[curPos] +
+                   a[1] * (r[curPos - 1]  +  r[curPos + 1]  +  r[curPos - nz]  +  r[curPos + nz])  +
+                   a[2] * (r[curPos - 2]  +  r[curPos + 2]  +  r[curPos - 2 * nz]  +  r[curPos + 2 * nz])  +
+                   a[3] * (r[curPos - 3]  +  r[curPos + 3]  +  r[curPos - 3 * nz]  +  r[curPos + 3 * nz])  +
+                   a[4] * (r[curPos - 4]  +  r[curPos + 4]  +  r[curPos - 4 * nz]  +  r[curPos + 4 * nz])  +
+                   a[5] * (r[curPos - 5]  +  r[curPos + 5]  +  r[curPos - 5 * nz]  +  r[curPos + 5 * nz]);
+    }
+  }
+
+#ifdef USE_OPENMP
+  #pragma omp parallel for default(shared) private(ix, iz)
+#endif
+  for (ix = d; ix < nx - d; ix++) { /// the range of ix is different from that in previous for loop
+    for (iz = d; iz < nz - d; iz++) { /// be careful of the range of iz
+      int curPos = ix * nz + iz;
+      float curvel = vel[curPos];
+      float curr = curr_wave[curPos];
+      float prev = prev_wave[curPos];
+
+      float next = 2. * curr - 1 * prev  +
+                   (1.0f / curvel) * u2[curPos] + /// 2nd order
+                   1.0f / 12 * (1.0f / curvel) * (1.0f / curvel) *
+                   (u2[curPos - 1] + u2[curPos + 1] + u2[curPos - nz] + u2[curPos + nz] - 4 * u2[curPos]); /// 4th order
+      float src = bcoef[curPos] * (wnext * next + wcurr * curr + wprev * prev);
+
+      prev_born[curPos] = 2. * curr_born[curPos] - 1 * prev_born[curPos]  +
+                          (1.0f / curvel) * ru2[curPos] + /// 2nd order
+                          1.0f / 12 * (1.0f / curvel) * (1.0f / curvel) *
+                          (ru2[curPos - 1] + ru2[curPos + 1] + ru2[curPos - nz] + ru2[curPos + nz] - 4 * ru2[curPos]) + /// 4th order
+                          src;
+      prev_wave[curPos] = next;
+    }
+  }
+}
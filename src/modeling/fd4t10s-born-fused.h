@@ -0,0 +1,26 @@
+/*
+ * fd4t10s-born-fused.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_MDLIB_FD4T10S_BORN_FUSED_H_
+#define SRC_MDLIB_FD4T10S_BORN_FUSED_H_
+
+/**
+ * one step of the background and the scattered wavefields together, both as
+ * fd4t10s_nobndry_2d_vtrans (vel is transformed). The Born source
+ *
+ *   bcoef * (wnext * next + wcurr * curr + wprev * prev)
+ *
+ * of the background is formed in registers from the new value and added to
+ * the new scattered value, so no copy of the background is kept. (1, -2, 1)
+ * is the second time difference, bcoef is -2 * dm / vel and zero wherever no
+ * scattering is wanted. u2 and ru2 are scratch grids of nx * nz
+ */
+void fd4t10s_born_fused_2d_vtrans(float *prev_wave, const float *curr_wave,
+    float *prev_born, const float *curr_born, const float *vel, const float *bcoef,
+    float wnext, float wcurr, float wprev, float *u2, float *ru2, int nx, int nz);
+
+#endif /* SRC_MDLIB_FD4T10S_BORN_FUSED_H_ */
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include "fd4t10s-damp-zjh.h"
+#include "fdcoef.h"
 
 /**
  * please note that the velocity is transformed
@@ -20,13 +21,8 @@ void fd4t10s_damp_zjh_2d_vtrans(float *prev_wave, const float *curr_wave, const
   const float max_delta = 0.05;
   int ix, iz;
 
-  /// Zhang, Jinhai's method
-  a[0] = +1.53400796;
-  a[1] = +1.78858721;
-  a[2] = -0.31660756;
-  a[3] = +0.07612173;
-  a[4] = -0.01626042;
-  a[5] = +0.00216736;
+  /// Zhang, Jinhai's method by default, see fdcoef.h
+  fdcoef_load(a);
 
   //printf("fm 1\n");
 #ifdef USE_OPENMP
@@ -114,13 +110,8 @@ void fd4t10s_damp_zjh_2d_vtrans_test(float *prev_wave, const float *curr_wave, c
   const float max_delta = 0.05;
   int ix, iz;
 
-  /// Zhang, Jinhai's method
-  a[0] = +1.53400796;
-  a[1] = +1.78858721;
-  a[2] = -0.31660756;
-  a[3] = +0.07612173;
-  a[4] = -0.01626042;
-  a[5] = +0.00216736;
+  /// Zhang, Jinhai's method by default, see fdcoef.h
+  fdcoef_load(a);
 
   for (ix = d - 1; ix < nx - (d - 1); ix++) {
     for (iz = d - 1; iz < nz - (d - 1); iz++) {
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include "fd4t10s-nobndry.h"
+#include "fdcoef.h"
 
 /**
  * please note that the velocity is transformed
@@ -20,13 +21,8 @@ void fd4t10s_nobndry_2d_vtrans(float *prev_wave, const float *curr_wave, const f
   const float max_delta = 0.05;
   int ix, iz;
 
-  /// Zhang, Jinhai's method
-  a[0] = +1.53400796;
-  a[1] = +1.78858721;
-  a[2] = -0.31660756;
-  a[3] = +0.07612173;
-  a[4] = -0.01626042;
-  a[5] = +0.00216736;
+  /// Zhang, Jinhai's method by default, see fdcoef.h
+  fdcoef_load(a);
 
 #ifdef USE_OPENMP
   #pragma omp parallel for default(shared) private(ix, iz)
@@ -80,13 +76,8 @@ void fd4t10s_nobndry_2d_vtrans_3vars(const float *prev_wave, const float *curr_w
   const float max_delta = 0.05;
   int ix, iz;
 
-  /// Zhang, Jinhai's method
-  a[0] = +1.53400796;
-  a[1] = +1.78858721;
-  a[2] = -0.31660756;
-  a[3] = +0.07612173;
-  a[4] = -0.01626042;
-  a[5] = +0.00216736;
+  /// Zhang, Jinhai's method by default, see fdcoef.h
+  fdcoef_load(a);
 
 #ifdef USE_OPENMP
   #pragma omp parallel for default(shared) private(ix, iz)
@@ -140,13 +131,8 @@ void fd4t10s_nobndry_2d(float *prev_wave, const float *curr_wave, const float *v
   const float max_delta = 0.05;
   int ix, iz;
 
-  /// Zhang, Jinhai's method
-  a[0] = +1.53400796;
-  a[1] = +1.78858721;
-  a[2] = -0.31660756;
-  a[3] = +0.07612173;
-  a[4] = -0.01626042;
-  a[5] = +0.00216736;
+  /// Zhang, Jinhai's method by default, see fdcoef.h
+  fdcoef_load(a);
 
 #ifdef USE_OPENMP
   #pragma omp parallel for default(shared) private(ix, iz)
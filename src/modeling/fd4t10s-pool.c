@@ -0,0 +1,180 @@
+/*
+ * fd4t10s-pool.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include <stdio.h>
+#include "fd4t10s-pool.h"
+#include "fdcoef.h"
+#include "tpool.h"
+
+static const int d = 6;
+
+struct step_args {
+  float *prev_wave;
+  float *curr_wave;
+  const float *vel;
+  float *u2;
+  int nx;
+  int nz;
+  const float *bndr;
+  int nb;
+  int freeSurface;
+  float a[FDCOEF_LEN];
+};
+
+struct xcorr_args {
+  const float *src_wave;
+  const float *vsrc_wave;
+  float *image;
+  int nx;
+  int nz;
+  float scale;
+};
+
+static int imax(int x, int y) {
+  return x > y ? x : y;
+}
+
+static int imin(int x, int y) {
+  return x < y ? x : y;
+}
+
+/**
+ * the cells of the tile damped by Sponge::applySponge: the top/bottom rows
+ * within [d, nx - d) and the left/right columns within [d, nz - d)
+ */
+static void sponge_tile(float *p, const struct step_args *s, const struct tpool_tile *t) {
+  const int nx = s->nx;
+  const int nz = s->nz;
+  const int nb = s->nb;
+  int ix, iz;
+
+  for (ix = imax(t->x0, d); ix < imin(t->x1, nx - d); ix++) {
+    float *col = p + ix * nz;
+    if (!s->freeSurface) {
+      for (iz = t->z0; iz < imin(t->z1, nb); iz++) {
+        col[iz] *= s->bndr[iz];
+      }
+    }
+    for (iz = imax(t->z0, nz - nb); iz < t->z1; iz++) {
+      col[iz] *= s->bndr[nz - 1 - iz];
+    }
+  }
+
+  for (ix = t->x0; ix < t->x1; ix++) {
+    float w = 1;
+    float *col = p + ix * nz;
+    if (ix < nb) {
+      w *= s->bndr[ix];
+    }
+    if (ix >= nx - nb) {
+      w *= s->bndr[nx - 1 - ix];
+    }
+    if (w == 1) {
+      continue;
+    }
+    for (iz = imax(t->z0, d); iz < imin(t->z1, nz - d); iz++) {
+      col[iz] *= w;
+    }
+  }
+}
+
+static void step_task(void *arg, int tid, int nthreads) {
+  const struct step_args *s = (const struct step_args *)arg;
+  const float *a = s->a;
+  const float *curr_wave = s->curr_wave;
+  float *prev_wave = s->prev_wave;
+  const float *vel = s->vel;
+  float *u2 = s->u2;
+  const int nx = s->nx;
+  const int nz = s->nz;
+  struct tpool_tile t;
+  int ix, iz;
+
+  tpool_tile(tid, nthreads, nx, nz, &t);
+
+  for (ix = imax(t.x0, d - 1); ix < imin(t.x1, nx - (d - 1)); ix++) {
+    for (iz = imax(t.z0, d - 1); iz < imin(t.z1, nz - (d - 1)); iz++) {
+      int curPos = ix * nz + iz;
+      u2[curPos] = -4.0 * a[0] * curr_wave[curPos] +
+                   a[1] * (curr_wave[curPos - 1]  +  curr_wave[curPos + 1]  +
+                           curr_wave[curPos - nz]  +  curr_wave[curPos + nz])  +
+                   a[2] * (curr_wave[curPos - 2]  +  curr_wave[curPos + 2]  +
+                           curr_wave[curPos - 2 * nz]  +  curr_wave[curPos + 2 * nz])  +
+                   a[3] * (curr_wave[curPos - 3]  +  curr_wave[curPos + 3]  +
+                           curr_wave[curPos - 3 * nz]  +  curr_wave[curPos + 3 * nz])  +
+                   a[4] * (curr_wave[curPos - 4]  +  curr_wave[curPos + 4]  +
+                           curr_wave[curPos - 4 * nz]  +  curr_wave[curPos + 4 * nz])  +
+                   a[5] * (curr_wave[curPos - 5]  +  curr_wave[curPos + 5]  +
+                           curr_wave[curPos - 5 * nz]  +  curr_wave[curPos + 5 * nz]);
+    }
+  }
+
+  /// u2 of the neighbour tiles
+  tpool_barrier();
+
+  for (ix = imax(t.x0, d); ix < imin(t.x1, nx - d); ix++) {
+    for (iz = imax(t.z0, d); iz < imin(t.z1, nz - d); iz++) {
+      int curPos = ix * nz + iz;
+      float curvel = vel[curPos];
+
+      prev_wave[curPos] = 2. * curr_wave[curPos] - prev_wave[curPos]  +
+                          (1.0f / curvel) * u2[curPos] + /// 2nd order
+                          1.0f / 12 * (1.0f / curvel) * (1.0f / curvel) *
+                          (u2[curPos - 1] + u2[curPos + 1] + u2[curPos - nz] + u2[curPos + nz] - 4 * u2[curPos]); /// 4th order
+    }
+  }
+
+  /// curr_wave is no longer read by the other tiles after the barrier
+  if (s->bndr) {
+    sponge_tile(s->prev_wave, s, &t);
+    sponge_tile(s->curr_wave, s, &t);
+  }
+}
+
+void fd4t10s_pool_2d_vtrans(float *prev_wave, float *curr_wave, const float *vel, float *u2, int nx, int nz,
+    const float *bndr, int nb, int freeSurface)
+{
+  struct step_args s;
+  s.prev_wave = prev_wave;
+  s.curr_wave = curr_wave;
+  s.vel = vel;
+  s.u2 = u2;
+  s.nx = nx;
+  s.nz = nz;
+  s.bndr = bndr;
+  s.nb = nb;
+  s.freeSurface = freeSurface;
+  fdcoef_load(s.a);
+
+  tpool_run(step_task, &s);
+}
+
+static void xcorr_task(void *arg, int tid, int nthreads) {
+  const struct xcorr_args *c = (const struct xcorr_args *)arg;
+  struct tpool_tile t;
+  int ix, iz;
+
+  tpool_tile(tid, nthreads, c->nx, c->nz, &t);
+  for (ix = t.x0; ix < t.x1; ix++) {
+    for (iz = t.z0; iz < t.z1; iz++) {
+      int curPos = ix * c->nz + iz;
+      c->image[curPos] -= c->src_wave[curPos] * c->vsrc_wave[curPos] * c->scale;
+    }
+  }
+}
+
+void cross_correlation_pool(const float *src_wave, const float *vsrc_wave, float *image, int nx, int nz, float scale) {
+  struct xcorr_args c;
+  c.src_wave = src_wave;
+  c.vsrc_wave = vsrc_wave;
+  c.image = image;
+  c.nx = nx;
+  c.nz = nz;
+  c.scale = scale;
+
+  tpool_run(xcorr_task, &c);
+}
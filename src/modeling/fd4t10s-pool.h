@@ -0,0 +1,23 @@
+/*
+ * fd4t10s-pool.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_MDLIB_FD4T10S_POOL_H_
+#define SRC_MDLIB_FD4T10S_POOL_H_
+
+/**
+ * fd4t10s_nobndry_2d_vtrans on the tiles of the thread pool (tpool.h), one
+ * dispatch per step: stencil, barrier, update then the sponge on both
+ * wavefields. bndr is the sponge taper of width nb, NULL to skip the sponge
+ * (stepBackward). curr_wave is damped in place as by Sponge::applySponge
+ */
+void fd4t10s_pool_2d_vtrans(float *prev_wave, float *curr_wave, const float *vel, float *u2, int nx, int nz,
+    const float *bndr, int nb, int freeSurface);
+
+/// image -= src_wave * vsrc_wave * scale on the tiles of the pool
+void cross_correlation_pool(const float *src_wave, const float *vsrc_wave, float *image, int nx, int nz, float scale);
+
+#endif /* SRC_MDLIB_FD4T10S_POOL_H_ */
@@ -0,0 +1,57 @@
+/*
+ * fd4t10s-rect.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include "fd4t10s-rect.h"
+#include "fdcoef.h"
+
+void fd4t10s_rect_laplacian(const float *curr_wave, float *u2, int nz, int x0, int x1, int z0, int z1) {
+  float a[6];
+  int ix, iz;
+
+  /// Zhang, Jinhai's method by default, see fdcoef.h
+  fdcoef_load(a);
+
+#ifdef USE_OPENMP
+  #pragma omp parallel for default(shared) private(ix, iz)
+#endif
+  for (ix = x0; ix < x1; ix++) {
+    for (iz = z0; iz < z1; iz++) {
+      int curPos = ix * nz + iz;
+      u2[curPos] = -4.0 * a[0] * curr_wave[curPos] +
+                   a[1] * (curr_wave[curPos - 1]  +  curr_wave[curPos + 1]  +
+                           curr_wave[curPos - nz]  +  curr_wave[curPos + nz])  +
+                   a[2] * (curr_wave[curPos - 2]  +  curr_wave[curPos + 2]  +
+                           curr_wave[curPos - 2 * nz]  +  curr_wave[curPos + 2 * nz])  +
+                   a[3] * (curr_wave[curPos - 3]  +  curr_wave[curPos + 3]  +
+                           curr_wave[curPos - 3 * nz]  +  curr_wave[curPos + 3 * nz])  +
+                   a[4] * (curr_wave[curPos - 4]  +  curr_wave[curPos + 4]  +
+                           curr_wave[curPos - 4 * nz]  +  curr_wave[curPos + 4 * nz])  +
+                   a[5] * (curr_wave[curPos - 5]  +  curr_wave[curPos + 5]  +
+                           curr_wave[curPos - 5 * nz]  +  curr_wave[curPos + 5 * nz]);
+    }
+  }
+}
+
+void fd4t10s_rect_update(float *prev_wave, const float *curr_wave, const float *vel, const float *u2,
+    int nz, int x0, int x1, int z0, int z1) {
+  int ix, iz;
+
+#ifdef USE_OPENMP
+  #pragma omp parallel for default(shared) private(ix, iz)
+#endif
+  for (ix = x0; ix < x1; ix++) {
+    for (iz = z0; iz < z1; iz++) {
+      int curPos = ix * nz + iz;
+      float curvel = vel[curPos];
+
+      prev_wave[curPos] = 2. * curr_wave[curPos] - prev_wave[curPos]  +
+                          (1.0f / curvel) * u2[curPos] + /// 2nd order
+                          1.0f / 12 * (1.0f / curvel) * (1.0f / curvel) *
+                          (u2[curPos - 1] + u2[curPos + 1] + u2[curPos - nz] + u2[curPos + nz] - 4 * u2[curPos]); /// 4th order
+    }
+  }
+}
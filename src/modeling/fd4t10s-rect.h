@@ -0,0 +1,22 @@
+/*
+ * fd4t10s-rect.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_MDLIB_FD4T10S_RECT_H_
+#define SRC_MDLIB_FD4T10S_RECT_H_
+
+/**
+ * the two passes of fd4t10s_zjh_2d_vtrans restricted to the rectangle
+ * [x0, x1) x [z0, z1) of a grid with nz samples per column, so a subdomain
+ * can update the cells which do not depend on its halo while the halo is
+ * still in flight. The caller keeps the rectangles inside the ranges of the
+ * global kernel, [5, n - 5) for the laplacian and [6, n - 6) for the update
+ */
+void fd4t10s_rect_laplacian(const float *curr_wave, float *u2, int nz, int x0, int x1, int z0, int z1);
+void fd4t10s_rect_update(float *prev_wave, const float *curr_wave, const float *vel, const float *u2,
+    int nz, int x0, int x1, int z0, int z1);
+
+#endif /* SRC_MDLIB_FD4T10S_RECT_H_ */
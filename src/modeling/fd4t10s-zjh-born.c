@@ -6,6 +6,7 @@
  */
 
 #include "fd4t10s-zjh-born.h"
+#include "fdcoef.h"
 
 void fd4t10s_zjh_born(float *prev_wave, const float *curr_wave, const float *born_coff, int nx, int nz) {
   float a[6];
@@ -13,13 +14,8 @@ void fd4t10s_zjh_born(float *prev_wave, const float *curr_wave, const float *bor
   const int d = 6;
   int ix, iz;
 
-  /// Zhang, Jinhai's method
-  a[0] = +1.53400796;
-  a[1] = +1.78858721;
-  a[2] = -0.31660756;
-  a[3] = +0.07612173;
-  a[4] = -0.01626042;
-  a[5] = +0.00216736;
+  /// Zhang, Jinhai's method by default, see fdcoef.h
+  fdcoef_load(a);
 
   //printf("fm 1\n");
 #ifdef USE_OPENMP
@@ -6,6 +6,7 @@
  */
 
 #include "fd4t10s-zjh.h"
+#include "fdcoef.h"
 
 void fd4t10s_zjh_2d_vtrans(float *prev_wave, const float *curr_wave, const float *vel, float *u2, int nx, int nz) {
   float a[6];
@@ -13,13 +14,8 @@ void fd4t10s_zjh_2d_vtrans(float *prev_wave, const float *curr_wave, const float
   const int d = 6;
   int ix, iz;
 
-  /// Zhang, Jinhai's method
-  a[0] = +1.53400796;
-  a[1] = +1.78858721;
-  a[2] = -0.31660756;
-  a[3] = +0.07612173;
-  a[4] = -0.01626042;
-  a[5] = +0.00216736;
+  /// Zhang, Jinhai's method by default, see fdcoef.h
+  fdcoef_load(a);
 
   #pragma omp parallel for default(shared) private(ix, iz)
   for (ix = d - 1; ix < nx - (d - 1); ix ++) {
@@ -0,0 +1,190 @@
+/*
+ * fdcoef.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include <math.h>
+#include <string.h>
+#include "fdcoef.h"
+
+static float active[FDCOEF_LEN] = {
+  /// Zhang, Jinhai's method
+  +1.53400796,
+  +1.78858721,
+  -0.31660756,
+  +0.07612173,
+  -0.01626042,
+  +0.00216736
+};
+
+void fdcoef_zjh(float *a) {
+  a[0] = +1.53400796;
+  a[1] = +1.78858721;
+  a[2] = -0.31660756;
+  a[3] = +0.07612173;
+  a[4] = -0.01626042;
+  a[5] = +0.00216736;
+}
+
+void fdcoef_load(float *a) {
+  memcpy(a, active, sizeof(active));
+}
+
+void fdcoef_set(const float *a) {
+  memcpy(active, a, sizeof(active));
+}
+
+/**
+ * 1d symbol of the stencil, -(k * dx)^2 for the exact second derivative.
+ * a[0] is taken as sum a[m], otherwise its rounding dominates the long waves
+ */
+static double symbol1d(const float *a, double k) {
+  double s = 0;
+  int m;
+  for (m = 1; m < FDCOEF_LEN; m++) {
+    double h = sin(0.5 * m * k);
+    s -= 4 * a[m] * h * h;
+  }
+  return s;
+}
+
+/**
+ * the stencil is consistent (a[0] = sum a[m]), so the symbol is
+ *   sum_m a[m] * phi_m(k), phi_m(k) = 2 * (cos(m k) - 1)
+ * and the relative error sum_m a[m] * phi_m(k) / k^2 + 1 is linear in a[1..5]
+ */
+int fdcoef_lsq(float *a, float kmax) {
+  const int n = FDCOEF_LEN - 1;
+  const int nk = 256;
+  double ata[FDCOEF_LEN - 1][FDCOEF_LEN - 1];
+  double atb[FDCOEF_LEN - 1];
+  double x[FDCOEF_LEN - 1];
+  int i, j, m, ik;
+
+  if (!(kmax > 0) || kmax > M_PI) {
+    return -1;
+  }
+
+  memset(ata, 0, sizeof(ata));
+  memset(atb, 0, sizeof(atb));
+  for (ik = 0; ik < nk; ik++) {
+    double k = kmax * (ik + 0.5) / nk;
+    double phi[FDCOEF_LEN - 1];
+    for (m = 0; m < n; m++) {
+      phi[m] = 2 * (cos((m + 1) * k) - 1) / (k * k);
+    }
+    for (i = 0; i < n; i++) {
+      for (j = 0; j < n; j++) {
+        ata[i][j] += phi[i] * phi[j];
+      }
+      atb[i] -= phi[i];
+    }
+  }
+
+  /// gaussian elimination with partial pivoting
+  for (i = 0; i < n; i++) {
+    int p = i;
+    for (j = i + 1; j < n; j++) {
+      if (fabs(ata[j][i]) > fabs(ata[p][i])) {
+        p = j;
+      }
+    }
+    if (ata[p][i] == 0) {
+      return -1;
+    }
+    if (p != i) {
+      double t;
+      for (m = 0; m < n; m++) {
+        t = ata[i][m]; ata[i][m] = ata[p][m]; ata[p][m] = t;
+      }
+      t = atb[i]; atb[i] = atb[p]; atb[p] = t;
+    }
+    for (j = i + 1; j < n; j++) {
+      double f = ata[j][i] / ata[i][i];
+      for (m = i; m < n; m++) {
+        ata[j][m] -= f * ata[i][m];
+      }
+      atb[j] -= f * atb[i];
+    }
+  }
+  for (i = n - 1; i >= 0; i--) {
+    double s = atb[i];
+    for (m = i + 1; m < n; m++) {
+      s -= ata[i][m] * x[m];
+    }
+    x[i] = s / ata[i][i];
+  }
+
+  a[0] = 0;
+  for (m = 0; m < n; m++) {
+    a[m + 1] = x[m];
+    a[0] += x[m];
+  }
+
+  return 0;
+}
+
+float fdcoef_kmax(float fmax, float vmin, float dx) {
+  return 2 * M_PI * fmax * dx / vmin;
+}
+
+/**
+ * a plane wave of the scheme obeys
+ *   2 * cos(w * dt) - 2 = c^2 * S + c^4 / 12 * S * S5
+ * where S is the symbol of the stencil and S5 the one of the 5 points laplacian
+ */
+float fdcoef_dispersion(const float *a, float courant, float kdx, float angle) {
+  double kx = kdx * cos(angle);
+  double kz = kdx * sin(angle);
+  double s = symbol1d(a, kx) + symbol1d(a, kz);
+  double c2 = (double)courant * courant;
+  double s5 = 2 * cos(kx) + 2 * cos(kz) - 4;
+  double x;
+
+  if (kdx <= 0) {
+    return 0;
+  }
+  if (courant <= 0) {
+    return s < 0 ? sqrt(-s) / kdx - 1 : -1;
+  }
+
+  x = 1 + 0.5 * (c2 * s + c2 * c2 / 12 * s * s5);
+  if (x < -1 || x > 1) {
+    return 2;
+  }
+  return acos(x) / (courant * kdx) - 1;
+}
+
+float fdcoef_max_courant(const float *a) {
+  const int nk = 64;
+  double lo = 0, hi = 2;
+  int it, ix, iz;
+
+  for (it = 0; it < 30; it++) {
+    double c = 0.5 * (lo + hi);
+    double c2 = c * c;
+    int stable = 1;
+    for (ix = 0; ix <= nk && stable; ix++) {
+      double kx = M_PI * ix / nk;
+      for (iz = 0; iz <= nk; iz++) {
+        double kz = M_PI * iz / nk;
+        double s = symbol1d(a, kx) + symbol1d(a, kz);
+        double s5 = 2 * cos(kx) + 2 * cos(kz) - 4;
+        double x = 1 + 0.5 * (c2 * s + c2 * c2 / 12 * s * s5);
+        if (x < -1 || x > 1) {
+          stable = 0;
+          break;
+        }
+      }
+    }
+    if (stable) {
+      lo = c;
+    } else {
+      hi = c;
+    }
+  }
+
+  return lo;
+}
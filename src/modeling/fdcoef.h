@@ -0,0 +1,45 @@
+/*
+ * fdcoef.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_MDLIB_FDCOEF_H_
+#define SRC_MDLIB_FDCOEF_H_
+
+/**
+ * coefficients of the 10th order (radius 5) second derivative stencil shared
+ * by the fd4t10s_* and rem10s_* kernels:
+ *   d2u/dx2 * dx^2 ~= -2 * a[0] * u[i] + sum_m a[m] * (u[i - m] + u[i + m])
+ * the kernels read the active set with fdcoef_load, it defaults to the
+ * Zhang, Jinhai's coefficients
+ */
+#define FDCOEF_LEN 6
+
+void fdcoef_zjh(float *a);
+void fdcoef_load(float *a);
+void fdcoef_set(const float *a);
+
+/**
+ * least-squares design which minimizes the relative error of the stencil
+ * symbol for the normalized wavenumbers k * dx in (0, kmax], i.e. for
+ * the wavelengths longer than 2 * pi / kmax points, returns 0 on success
+ */
+int fdcoef_lsq(float *a, float kmax);
+
+/// normalized wavenumber of the frequency fmax at the velocity vmin
+float fdcoef_kmax(float fmax, float vmin, float dx);
+
+/**
+ * relative phase velocity error of the fd4t10s scheme (4th order in time,
+ * a as the spatial stencil) for the courant number vel * dt / dx, normalized
+ * wavenumber kdx and propagation angle (radians), a courant of 0 gives the
+ * error of the spatial stencil only. returns a value > 1 if the step is unstable
+ */
+float fdcoef_dispersion(const float *a, float courant, float kdx, float angle);
+
+/// largest stable courant number of the fd4t10s scheme with the stencil a
+float fdcoef_max_courant(const float *a);
+
+#endif /* SRC_MDLIB_FDCOEF_H_ */
@@ -12,6 +12,8 @@
 #include "sum.h"
 #include "sfutil.h"
 #include "common.h"
+#include "workspace.h"
+#include "domain-decomp.h"
 
 extern "C" {
 #include <rsf.h>
@@ -20,6 +22,13 @@ extern "C" {
 #include "fd4t10s-zjh-born.h"
 #include "fd4t10s-zjh.h"
 #include "fd4t10s-nobndry.h"
+#include "rem10s-nobndry.h"
+#include "fdcoef.h"
+#include "fd4t10s-pool.h"
+#include "fd4t10s-born-fused.h"
+#include "fd4t10s-batch.h"
+#include "tpool.h"
+#include "numa-util.h"
 }
 #include <sys/time.h>
 
@@ -51,7 +60,7 @@ static void fillForStencil(Velocity &exvel, int halo) {
   int nx = nxpad - 2 * halo;
   int nz = nzpad - 2 * halo;
 
-  std::vector<float> &vel_e = exvel.dat;
+  VelocityData &vel_e = exvel.dat;
 
   //expand z direction first
   for (int ix = halo; ix < nx + halo; ix++) {
@@ -79,8 +88,8 @@ static void expandForStencil(Velocity &exvel, const Velocity &v0, int halo) {
   int nz = v0.nz;
   int nzpad = nz + 2 * halo;
 
-  const std::vector<float> &vel = v0.dat;
-  std::vector<float> &vel_e = exvel.dat;
+  const VelocityData &vel = v0.dat;
+  VelocityData &vel_e = exvel.dat;
 
   //copy the vel into vel_e
   for (int ix = halo; ix < nx + halo; ix++) {
@@ -102,8 +111,8 @@ static void expandBndry(Velocity &exvel, const Velocity &v0, int nb, int freeSur
 		nzpad = nz + nb;
 	else
 		nzpad = nz + 2 * nb;
-  const std::vector<float> &a = v0.dat;
-  std::vector<float> &b = exvel.dat;
+  const VelocityData &a = v0.dat;
+  VelocityData &b = exvel.dat;
 
 	if(freeSurface) {
 		/// internal
@@ -152,13 +161,15 @@ static void expandBndry(Velocity &exvel, const Velocity &v0, int nb, int freeSur
 	}
 }
 
-static void transvel(std::vector<float> &vel, float dx, float dt) {
+template <class V>
+static void transvel(V &vel, float dx, float dt) {
   for (size_t i = 0; i < vel.size(); i ++) {
     vel[i] = (dx * dx) / (dt * dt * vel[i] * vel[i]);
   }
 }
 
-static void recoverVel(std::vector<float> &vel, float dx, float dt) {
+template <class V>
+static void recoverVel(V &vel, float dx, float dt) {
   for (size_t i = 0; i < vel.size(); i ++) {
     vel[i] = std::sqrt(dx*dx / (dt*dt*vel[i]));
   }
@@ -226,6 +237,40 @@ Velocity ForwardModeling::expandDomain(const Velocity& _vel) {
   return ret;
 }
 
+/**
+ * the padding of expandDomain without the velocity transform, for fields
+ * on the model grid such as perturbations of the velocity
+ */
+Velocity ForwardModeling::expandDomain_notrans(const Velocity &_vel) const {
+  int nb = bx0 - EXFDBNDRYLEN;
+
+  Velocity exvelForBndry(_vel.nx + 2 * nb, freeSurface ? _vel.nz + nb : _vel.nz + 2 * nb);
+  expandBndry(exvelForBndry, _vel, nb, freeSurface);
+
+  Velocity ret(exvelForBndry.nx+2*EXFDBNDRYLEN, exvelForBndry.nz+2*EXFDBNDRYLEN);
+  expandForStencil(ret, exvelForBndry, EXFDBNDRYLEN);
+
+  return ret;
+}
+
+/**
+ * inverse of expandDomain, the interior of exvel in m/s
+ */
+Velocity ForwardModeling::shrinkDomain(const Velocity &exvel) const {
+  int nx = exvel.nx - bx0 - bxn;
+  int nz = exvel.nz - bz0 - bzn;
+  Velocity ret(nx, nz);
+
+  for (int ix = 0; ix < nx; ix++) {
+    for (int iz = 0; iz < nz; iz++) {
+      ret.dat[ix * nz + iz] = exvel.dat[(ix + bx0) * exvel.nz + (iz + bz0)];
+    }
+  }
+  recoverVel(ret.dat, dx, dt);
+
+  return ret;
+}
+
 void ForwardModeling::addBornwv(float *fullwv_t0, float *fullwv_t1, float *fullwv_t2, const float *exvel_m, float dt, int it, float *rp1) const {
 	int nx = vel->nx;
 	int nz = vel->nz;
@@ -275,7 +320,7 @@ void ForwardModeling::swStepForward(std::vector<float> &p0, std::vector<float> &
 
 void ForwardModeling::stepForward(std::vector<float> &p0, std::vector<float> &p1) const {
 
-  static std::vector<float> u2(vel->nx * vel->nz, 0);
+  std::vector<float> &u2 = stepScratch();
 //#ifdef USE_SW
   //struct timeval t1, t2;	
 	//float gflop = 0;
@@ -291,7 +336,15 @@ void ForwardModeling::stepForward(std::vector<float> &p0, std::vector<float> &p1
 	//printf("Finish stepForward on accelerator. Time: %0.9lfs FLOPS:%.5f GFLOPS\n\n\n", TIME(t1, t2), gflop/(TIME(t1, t2))); 
 	
 	//sponge
-  fd4t10s_nobndry_2d_vtrans(&p0[0], &p1[0], &vel->dat[0], &u2[0], vel->nx, vel->nz, bx0, freeSurface);
+	if (!remCoef.empty()) {
+		stepRapidExpansion(p0, p1);
+	} else if (tpool_size() > 0) {
+		/// the sponge is applied on the tiles of the same dispatch
+		fd4t10s_pool_2d_vtrans(&p0[0], &p1[0], &vel->dat[0], &u2[0], vel->nx, vel->nz, spng->getbndr(), bx0, freeSurface);
+		return;
+	} else {
+		fd4t10s_nobndry_2d_vtrans(&p0[0], &p1[0], &vel->dat[0], &u2[0], vel->nx, vel->nz, bx0, freeSurface);
+	}
 	spng->applySponge(&p0[0], &vel->dat[0], vel->nx, vel->nz, bx0, dt, dx, freeSurface);
 	spng->applySponge(&p1[0], &vel->dat[0], vel->nx, vel->nz, bx0, dt, dx, freeSurface);
 //#endif 
@@ -303,6 +356,169 @@ void ForwardModeling::stepForward(std::vector<float> &p0, std::vector<float> &p1
 	//sponge2d_apply(pp0, sp, fd);
 	//sponge2d_apply(pp1, sp, fd);
 }
+void ForwardModeling::stepRapidExpansion(std::vector<float> &p0, std::vector<float> &p1) const {
+  std::vector<float> &q0 = stepScratch(1);
+  std::vector<float> &q1 = stepScratch(2);
+
+  rem10s_nobndry_2d_vtrans(&p0[0], &p1[0], &vel->dat[0], &q0[0], &q1[0],
+      &remCoef[0], remCoef.size(), remMaxInvVel, vel->nx, vel->nz);
+}
+
+/**
+ * switch the time stepping of stepForward/stepBackward to the rapid expansion,
+ * dt of this object may then be several times the fd4t10s limit. vmax bounds
+ * the velocity during the whole inversion, stepRatio is dt over the native dt
+ */
+void ForwardModeling::enableRapidExpansion(float vmax, int stepRatio) {
+  if (decomp != NULL) {
+    sf_error("the rapid expansion does not run on decomposed domains");
+  }
+  float courant = vmax * dt / dx;
+  remMaxInvVel = courant * courant;
+
+  int nterms = rem10s_nterms(remMaxInvVel);
+  remCoef.resize(nterms);
+  rem10s_coef(&remCoef[0], nterms, remMaxInvVel);
+
+  /// the boundary strip of calgradient must cover the reach of a whole step
+  int width = stepReach();
+  if (width > std::min(bx0, std::min(bxn, bzn))) {
+    sf_error("the rapid expansion with %d terms reaches %d points per step, nb must be at least %d",
+        nterms, width, width - EXFDBNDRYLEN);
+  }
+
+  spng->initbndr(bndr.size(), stepRatio);
+
+  /// a ricker has almost no energy beyond 2.5 * fm
+  float maxdt = rem10s_max_dt(vmax, dx, 2.5f * fm);
+  if (dt > maxdt) {
+    WARNING() << format("dt %f exceeds %f, the rapid expansion will be polluted by aliased grid modes") % dt % maxdt;
+  }
+  INFO() << format("rapid expansion time stepping, dt %f, %d terms per step") % dt % nterms;
+}
+
+/**
+ * run FwiForwardModeling (and FwiFramework::calgradient) of each shot on the
+ * subdomains of decomp, see domain-decomp.h. NULL goes back to the whole grid
+ */
+void ForwardModeling::setDecomposition(DomainDecomp *_decomp) {
+  if (_decomp != NULL && !remCoef.empty()) {
+    sf_error("the rapid expansion does not run on decomposed domains");
+  }
+  decomp = _decomp;
+}
+
+DomainDecomp *ForwardModeling::getDecomposition() const {
+  return decomp;
+}
+
+/**
+ * the factor each cell gets from one call of Sponge::applySponge, 1 outside
+ * the sponge, for steppers which scale the cells themselves
+ */
+void ForwardModeling::spongeFactors(std::vector<float> &f) const {
+  f.assign(vel->nx * vel->nz, 1.0f);
+  spng->applySponge(&f[0], &vel->dat[0], vel->nx, vel->nz, bx0, dt, dx, freeSurface);
+}
+
+/**
+ * run stepForward/stepBackward (and FwiBase::cross_correlation) on a pool of
+ * nthreads pinned threads instead of the OpenMP loops, nthreads <= 0 takes the
+ * whole affinity mask. The pool is shared by the process
+ */
+void ForwardModeling::enableThreadPool(int nthreads) {
+  int n = tpool_init(nthreads);
+  INFO() << format("time stepping on a pool of %d pinned threads") % n;
+}
+
+/**
+ * policy is compact, scatter or none (see numa-util.h), set it before
+ * enableThreadPool and before the grids are placed with firstTouch
+ */
+void ForwardModeling::setAffinity(const char *policy) {
+  if (numautil_set_policy(policy) != 0) {
+    WARNING() << format("cannot apply the affinity policy %s") % policy;
+    return;
+  }
+  INFO() << format("affinity policy %s on %d numa node(s)") % policy % numautil_nodes();
+}
+
+/**
+ * moves the pages of a grid (or any array) to the nodes of the threads which
+ * step it, the content is zeroed unless keep. no-op without affinity policy
+ */
+void ForwardModeling::firstTouch(std::vector<float> &v, bool keep) const {
+  if (v.empty()) {
+    return;
+  }
+  numautil_first_touch(&v[0], v.size(), vel->nz, keep);
+}
+
+/**
+ * spec is "zjh" (default coefficients), "lsq" (least-squares design for the
+ * wavelengths down to vmin / fmax) or a rsf file of FDCOEF_LEN floats.
+ * the coefficients are shared by all the kernels, so select them before
+ * enableRapidExpansion
+ */
+void ForwardModeling::selectFdCoef(const char *spec, float vmin, float vmax, float fmax) {
+  float a[FDCOEF_LEN];
+  std::string s(spec);
+
+  if (s == "zjh") {
+    fdcoef_zjh(a);
+  } else if (s == "lsq") {
+    float kmax = fdcoef_kmax(fmax, vmin, dx);
+    if (fdcoef_lsq(a, kmax) != 0) {
+      sf_error("cannot design fd coefficients for %f points per wavelength", 2 * M_PI / kmax);
+    }
+  } else {
+    sf_file fcoef = sf_input(spec);
+    if (sf_bytes(fcoef) != (off_t)(FDCOEF_LEN * sizeof(float))) {
+      sf_error("%s should contain %d fd coefficients", spec, FDCOEF_LEN);
+    }
+    sf_floatread(a, FDCOEF_LEN, fcoef);
+    sf_fileclose(fcoef);
+  }
+  fdcoef_set(a);
+
+  INFO() << format("fd coefficients (%s): %.8f %.8f %.8f %.8f %.8f %.8f") % spec % a[0] % a[1] % a[2] % a[3] % a[4] % a[5];
+  reportDispersion(vmin, vmax, fmax);
+}
+
+/**
+ * maximum relative phase velocity error of the waves up to fmax, along the
+ * axis and the diagonal, for the slowest and the fastest velocity
+ */
+void ForwardModeling::reportDispersion(float vmin, float vmax, float fmax) const {
+  const int nk = 64;
+  const int nangle = 3;
+  float a[FDCOEF_LEN];
+  fdcoef_load(a);
+
+  float vs[2] = { vmin, vmax };
+  for (int iv = 0; iv < 2; iv++) {
+    float kmax = fdcoef_kmax(fmax, vs[iv], dx);
+    float courant = remCoef.empty() ? vs[iv] * dt / dx : 0; /// the rapid expansion has no time dispersion
+    float espace = 0;
+    float etotal = 0;
+    for (int ik = 1; ik <= nk; ik++) {
+      float k = kmax * ik / nk;
+      for (int ia = 0; ia < nangle; ia++) {
+        float angle = M_PI / 4 * ia / (nangle - 1);
+        espace = std::max(espace, std::abs(fdcoef_dispersion(a, 0, k, angle)));
+        etotal = std::max(etotal, std::abs(fdcoef_dispersion(a, courant, k, angle)));
+      }
+    }
+    INFO() << format("dispersion at v %.1f, fmax %.1f: %.2f points per wavelength, courant %.3f, phase velocity error %.2e (space) %.2e (total)")
+              % vs[iv] % fmax % (2 * M_PI / kmax) % courant % espace % etotal;
+  }
+
+  float maxCourant = fdcoef_max_courant(a);
+  if (remCoef.empty() && vmax * dt / dx > maxCourant) {
+    WARNING() << format("courant %.3f exceeds the stability limit %.3f of the fd coefficients") % (vmax * dt / dx) % maxCourant;
+  }
+}
+
 void ForwardModeling::stepForward(std::vector<float> &p0, std::vector<float> &p1, bool vtrans) const {
 	static std::vector<float> u2(vel->nx * vel->nz, 0);
 	if(vtrans){
@@ -340,8 +556,8 @@ void ForwardModeling::stepForward(std::vector<float> &p0, std::vector<float> &p1
 	//std::vector<float> vel_0(nx * nz, vel->dat);
 	std::vector<float> bff(vel->nx * vel->nz, 0.0f);
 	//vectorMinus(vel_real.dat, vel.dat, vel_m);
-	vel_trans = localvel.dat;
-	vel_real_trans = localvel_real.dat;
+	vel_trans = localvel.dat.toVector();
+	vel_real_trans = localvel_real.dat.toVector();
 	//recoverVel(vel_trans, dx, dt);
 	//recoverVel(vel_real_trans, dx, dt);
 	//vectorMinus(vel_real_trans, vel_trans, vel_m);
@@ -376,6 +592,14 @@ void ForwardModeling::stepForward(std::vector<float> &p0, std::vector<float> &p1
 	std::swap(p0, p2);
 }
 
+/// the scratch of the stepping kernels, zero outside the cells they write
+std::vector<float> &ForwardModeling::stepScratch(int i) const {
+  if (scratch[i].size() != (size_t)vel->nx * vel->nz) {
+    scratch[i].assign((size_t)vel->nx * vel->nz, 0);
+  }
+  return scratch[i];
+}
+
 void ForwardModeling::bindVelocity(const Velocity& _vel) {
   this->vel = &_vel;
 }
@@ -392,21 +616,7 @@ void ForwardModeling::bindBornCoff( std::vector<float> &b) {
 
 void ForwardModeling::recordSeis(float* seis_it, const float* p,
     const ShotPosition& geoPos) const {
-
-  int ng = geoPos.ns;
-  int nzpad = vel->nz;
-
-//  DEBUG() << format("ng %d") % ng;
-//  float sum = 0;
-  for (int ig = 0; ig < ng; ig++) {
-    int gx = geoPos.getx(ig) + bx0;
-    int gz = geoPos.getz(ig) + bz0;	
-    int idx = gx * nzpad + gz;
-    seis_it[ig] = p[idx];
-//    DEBUG() << format("ig %d, idx %d, v %.20f") % ig % idx % seis_it[ig];
-  }
-//  DEBUG() << format("sum %.20f") % sum;
-
+  geoPos.spreadTable(vel->nx, vel->nz, bx0, bz0).extract(p, seis_it);
 }
 
 
@@ -423,38 +633,88 @@ void ForwardModeling::stepBackward(std::vector<float> &p0, std::vector<float> &p
 */
 
 void ForwardModeling::stepBackward(std::vector<float> &p0, std::vector<float> &p1) const {
-  static std::vector<float> u2(vel->nx * vel->nz, 0);
+  std::vector<float> &u2 = stepScratch();
+  if (!remCoef.empty()) {
+    stepRapidExpansion(p0, p1);
+    return;
+  }
 #ifdef USE_SW
   static std::vector<float> p2(vel->nx * vel->nz, 0);
   fd4t10s_nobndry_zjh_2d_vtrans_cg(&p0[0], &p1[0], &p2[0], &vel->dat[0], &u2[0], vel->nx, vel->nz, bx0, nt, freeSurface);
 	std::swap(p0, p2);
 #else
+  if (tpool_size() > 0) {
+    fd4t10s_pool_2d_vtrans(&p0[0], &p1[0], &vel->dat[0], &u2[0], vel->nx, vel->nz, NULL, bx0, freeSurface);
+  } else {
+    fd4t10s_zjh_2d_vtrans(&p0[0], &p1[0], &vel->dat[0], &u2[0], vel->nx, vel->nz);
+  }
+#endif
+}
+
+/**
+ * stepForward and stepBackward with the scratch u2 of the caller, nx * nz,
+ * instead of the one of the object, so that two threads can step two wavefields.
+ * Only the OpenMP loops, see concurrentSteps
+ */
+void ForwardModeling::stepForward(std::vector<float> &p0, std::vector<float> &p1, std::vector<float> &u2) const {
+  fd4t10s_nobndry_2d_vtrans(&p0[0], &p1[0], &vel->dat[0], &u2[0], vel->nx, vel->nz, bx0, freeSurface);
+  spng->applySponge(&p0[0], &vel->dat[0], vel->nx, vel->nz, bx0, dt, dx, freeSurface);
+  spng->applySponge(&p1[0], &vel->dat[0], vel->nx, vel->nz, bx0, dt, dx, freeSurface);
+}
+
+void ForwardModeling::stepBackward(std::vector<float> &p0, std::vector<float> &p1, std::vector<float> &u2) const {
   fd4t10s_zjh_2d_vtrans(&p0[0], &p1[0], &vel->dat[0], &u2[0], vel->nx, vel->nz);
+}
+
+/// true when the steps with a scratch of the caller give the same fields as stepForward/stepBackward
+bool ForwardModeling::concurrentSteps() const {
+#ifdef USE_SW
+  return false;
+#else
+  return remCoef.empty() && tpool_size() == 0 && decomp == NULL;
 #endif
 }
 
+void ForwardModeling::stepForward(std::vector<float> &p0, std::vector<float> &p1, const std::vector<float> &vels,
+    std::vector<float> &u2, int nm) const {
+  fd4t10s_batch_2d_vtrans(&p0[0], &p1[0], &vels[0], &u2[0], vel->nx, vel->nz, nm);
+  spng->applySponge(&p0[0], vel->nx, vel->nz, nm, bx0, freeSurface);
+  spng->applySponge(&p1[0], vel->nx, vel->nz, nm, bx0, freeSurface);
+}
+
+void ForwardModeling::stepBackward(std::vector<float> &p0, std::vector<float> &p1, const std::vector<float> &vels,
+    std::vector<float> &u2, int nm) const {
+  fd4t10s_batch_2d_vtrans(&p0[0], &p1[0], &vels[0], &u2[0], vel->nx, vel->nz, nm);
+}
+
 
 void ForwardModeling::addSource(float* p, const float* source,
     const ShotPosition& pos) const
 {
-  manipSource(p, source, pos, std::plus<float>());
+  manipSource(p, source, pos, 1.0f);
 }
 
 void ForwardModeling::subSource(float* p, const float* source,
     const ShotPosition& pos) const {
-  manipSource(p, source, pos, std::minus<float>());
+  manipSource(p, source, pos, -1.0f);
 }
 
-void ForwardModeling::manipSource(float* p, const float* source,
-    const ShotPosition& pos, boost::function2<float, float, float> op) const {
-  int nzpad = vel->nz;
+void ForwardModeling::addSource(float* p, const float* source,
+    const ShotPosition& pos, int nm) const {
+  pos.spreadTable(vel->nx, vel->nz, bx0, bz0).inject(p, source, 1.0f, nm);
+}
 
-  for (int is = 0; is < pos.ns; is++) {
-    int sx = pos.getx(is) + bx0;
-    int sz = pos.getz(is) + bz0; 
-    p[sx * nzpad + sz] = op(p[sx * nzpad + sz], source[is]);
-//    DEBUG() << format("sx %d, sz %d, source[%d] %f") % sx % sz % is % source[is];
-  }
+void ForwardModeling::subSource(float* p, const float* source,
+    const ShotPosition& pos, int nm) const {
+  pos.spreadTable(vel->nx, vel->nz, bx0, bz0).inject(p, source, -1.0f, nm);
+}
+
+/**
+ * the table of pos is built once per geometry, see ShotPosition::spreadTable
+ */
+void ForwardModeling::manipSource(float* p, const float* source,
+    const ShotPosition& pos, float sign) const {
+  pos.spreadTable(vel->nx, vel->nz, bx0, bz0).inject(p, source, sign);
 }
 
 void ForwardModeling::bornMaskGradient(float* grad, int H) const {
@@ -515,15 +775,23 @@ void ForwardModeling::refillBoundary(float* gradient) const {
 
 void ForwardModeling::sfWriteVel(const std::vector<float> &exvel, sf_file file) const {
   //assert(exvel.size() == vel->dat.size());
+  std::vector<float> vv = outputVel(exvel);
+  sf_floatwrite(&vv[0], vv.size(), file);
+}
+
+std::vector<float> ForwardModeling::outputVel(const std::vector<float> &exvel) const {
   int nzpad = vel->nz;
   int nxpad = vel->nx;
   int nz = nzpad - bz0 - bzn;
 
   std::vector<float> vv = exvel;
   recoverVel(vv, dx, dt);
+  std::vector<float> out;
+  out.reserve((nxpad - bx0 - bxn) * nz);
   for (int ix = bx0; ix < nxpad - bxn; ix++) {
-    sf_floatwrite(&vv[ix * nzpad + EXFDBNDRYLEN], nz, file);
+    out.insert(out.end(), &vv[ix * nzpad + EXFDBNDRYLEN], &vv[ix * nzpad + EXFDBNDRYLEN] + nz);
   }
+  return out;
 }
 
 void ForwardModeling::refillVelStencilBndry() {
@@ -533,13 +801,26 @@ void ForwardModeling::refillVelStencilBndry() {
 
 void ForwardModeling::FwiForwardModeling(const std::vector<float>& encSrc,
     std::vector<float>& dcal, int shot_id) const {
+  if (decomp != NULL) {
+    decomp->forwardModeling(*this, encSrc, dcal, shot_id);
+    return;
+  }
+
   int nx = getnx();
   int nz = getnz();
   int ns = getns();
   int ng = getng();
 
-  std::vector<float> p0(nz * nx, 0);
-  std::vector<float> p1(nz * nx, 0);
+  std::vector<float> p0;
+  WorkBuffer p0Buf(p0, nz * nx);
+  std::vector<float> p1;
+  WorkBuffer p1Buf(p1, nz * nx);
+  if (p0Buf.fresh()) {
+    firstTouch(p0, false);
+  }
+  if (p1Buf.fresh()) {
+    firstTouch(p1, false);
+  }
   ShotPosition curSrcPos = allSrcPos->clipRange(shot_id, shot_id);
 
   /*
@@ -587,11 +868,89 @@ void ForwardModeling::FwiForwardModeling(const std::vector<float>& encSrc,
 
 
 
+/**
+ * the scattered data of the model perturbation exvel_m, the background and
+ * the scattered fields advance together in fd4t10s_born_fused_2d_vtrans.
+ * dbg, if not NULL, gets the background data as well. The rapid expansion
+ * keeps the separate steps of bornForwardModelingSteps
+ */
 void ForwardModeling::BornForwardModeling(const std::vector<float> &exvel_m, const std::vector<float>& encSrc,
-    std::vector<float>& dcal, int shot_id) const {
+    std::vector<float>& dcal, int shot_id, std::vector<float> *dbg) const {
+  if (!remCoef.empty()) {
+    bornForwardModelingSteps(exvel_m, encSrc, dcal, shot_id, dbg);
+    return;
+  }
+
+  int nx = getnx();
+  int nz = getnz();
+  int ng = getng();
+
+  std::vector<float> p0;
+  WorkBuffer p0Buf(p0, nz * nx);
+  std::vector<float> p1;
+  WorkBuffer p1Buf(p1, nz * nx);
+  std::vector<float> rp0;
+  WorkBuffer rp0Buf(rp0, nz * nx);
+  std::vector<float> rp1;
+  WorkBuffer rp1Buf(rp1, nz * nx);
+  std::vector<float> u2;
+  WorkBuffer u2Buf(u2, nz * nx);
+  std::vector<float> ru2;
+  WorkBuffer ru2Buf(ru2, nz * nx);
+
+  /// -2 dm / v on the interior, as addBornwv, without the divide in the steps
+  std::vector<float> bcoef;
+  WorkBuffer bcoefBuf(bcoef, nz * nx);
+  for (int ix = bx0; ix < nx - bxn; ix++) {
+    for (int iz = bz0; iz < nz - bzn; iz++) {
+      bcoef[ix * nz + iz] = -2 * exvel_m[ix * nz + iz] / vel->dat[ix * nz + iz];
+    }
+  }
+
+  ShotPosition curSrcPos = allSrcPos->clipRange(shot_id, shot_id);
+  const SpreadTable &srcTable = curSrcPos.spreadTable(vel->nx, vel->nz, bx0, bz0);
+  const SpreadTable &geoTable = allGeoPos->spreadTable(vel->nx, vel->nz, bx0, bz0);
+
+  /// p1 is the background at it, rp1 the scattered field at it - 1
+  srcTable.inject(&p1[0], &encSrc[0], 1.0f);
+  for (int it = 0; it < nt; it++) {
+    /// second time difference, one sided with 1 / dt at both ends as addBornwv
+    float wnext = 1, wcurr = -2, wprev = 1;
+    if (it == 0) {
+      wnext = -1 / dt; wcurr = 1 / dt; wprev = 0;
+    } else if (it == nt - 1) {
+      wnext = 0; wcurr = -1 / dt; wprev = 1 / dt;
+    }
+
+    if (dbg != NULL) {
+      geoTable.extract(&p1[0], &(*dbg)[it * ng]);
+    }
+
+    fd4t10s_born_fused_2d_vtrans(&p0[0], &p1[0], &rp0[0], &rp1[0], &vel->dat[0], &bcoef[0],
+        wnext, wcurr, wprev, &u2[0], &ru2[0], nx, nz);
+    spng->applySponge(&p0[0], &vel->dat[0], nx, nz, bx0, dt, dx, freeSurface);
+    spng->applySponge(&p1[0], &vel->dat[0], nx, nz, bx0, dt, dx, freeSurface);
+    spng->applySponge(&rp0[0], &vel->dat[0], nx, nz, bx0, dt, dx, freeSurface);
+    spng->applySponge(&rp1[0], &vel->dat[0], nx, nz, bx0, dt, dx, freeSurface);
+
+    /// the source of it + 1 belongs to the new background and to its Born term
+    if (it + 1 < nt) {
+      srcTable.inject(&p0[0], &encSrc[it + 1], 1.0f);
+      if (wnext != 0) {
+        srcTable.inject(&rp0[0], &encSrc[it + 1], wnext, &bcoef[0]);
+      }
+    }
+
+    std::swap(p0, p1);
+    std::swap(rp0, rp1);
+    geoTable.extract(&rp1[0], &dcal[it * ng]);
+  }
+}
+
+void ForwardModeling::bornForwardModelingSteps(const std::vector<float> &exvel_m, const std::vector<float>& encSrc,
+    std::vector<float>& dcal, int shot_id, std::vector<float> *dbg) const {
   int nx = getnx();
   int nz = getnz();
-  int ns = getns();
   int ng = getng();
 
   std::vector<float> fullwv(3 * nz * nx, 0);
@@ -599,7 +958,7 @@ void ForwardModeling::BornForwardModeling(const std::vector<float> &exvel_m, con
   std::vector<float> p1(nz * nx, 0);
   std::vector<float> rp0(nz * nx, 0);
   std::vector<float> rp1(nz * nx, 0);
-	float *fullwv_t0, *fullwv_t1, *fullwv_t2, *fullwv_t;	
+	float *fullwv_t0, *fullwv_t1, *fullwv_t2;
 	fullwv_t0 = &fullwv[0];
 	fullwv_t1 = &fullwv[nz * nx];
 	fullwv_t2 = &fullwv[2 * nz * nx];
@@ -607,9 +966,14 @@ void ForwardModeling::BornForwardModeling(const std::vector<float> &exvel_m, con
   ShotPosition curSrcPos = allSrcPos->clipRange(shot_id, shot_id);
 	int it = 0;
 	for(int it0 = 0 ; it0 < nt + 1 ; it0 ++) {
-		addSource(&p1[0], &encSrc[it0], curSrcPos);
+		if (it0 < nt) {
+			addSource(&p1[0], &encSrc[it0], curSrcPos);
+		}
 		stepForward(p0,p1);
 		std::swap(p1, p0);
+		if (dbg != NULL && it0 < nt) {
+			recordSeis(&(*dbg)[it0*ng], &p0[0]);
+		}
 		swap3(fullwv_t0, fullwv_t1, fullwv_t2);
 		std::copy(p0.begin(), p0.end(), fullwv_t2);
 
@@ -617,7 +981,6 @@ void ForwardModeling::BornForwardModeling(const std::vector<float> &exvel_m, con
 		if(it < 0) 
 			continue;
 		addBornwv(fullwv_t0, fullwv_t1, fullwv_t2, &exvel_m[0], dt, it, &rp1[0]);
-		//fmMethod.addSource(&p1[0], &wlt[it], curSrcPos);
 		stepForward(rp0,rp1);
 		std::swap(rp1, rp0);
 		recordSeis(&dcal[it*ng], &rp0[0]);
@@ -626,6 +989,11 @@ void ForwardModeling::BornForwardModeling(const std::vector<float> &exvel_m, con
 
 void ForwardModeling::EssForwardModeling(const std::vector<float>& encSrc,
     std::vector<float>& dcal) const {
+  if (decomp != NULL) {
+    decomp->essForwardModeling(*this, encSrc, dcal);
+    return;
+  }
+
   int nx = getnx();
   int nz = getnz();
   int ns = getns();
@@ -685,7 +1053,7 @@ void ForwardModeling::removeDirectArrival(const ShotPosition &allSrcPos, const S
 //  printf("dt %f, half_len %d, sx %d, selav %d, gelav %d\n", dt, half_len, sx, sz, gz);
 //  printf("gmin %d, gmax %d\n", gmin, gmax);
 
-  const std::vector<float> &vv = this->vel->dat;
+  const VelocityData &vv = this->vel->dat;
   int nx = this->vel->nx;
   int nz = this->vel->nz;
   for (int i = 0; i < nx; i ++) {
@@ -719,7 +1087,7 @@ void ForwardModeling::removeDirectArrival(const ShotPosition &allSrcPos, const S
 ForwardModeling::ForwardModeling(const ShotPosition& _allSrcPos, const ShotPosition& _allGeoPos,
     float _dt, float _dx, float _fm, int _nb, int _nt, int _freeSurface) :
       vel(NULL),vel_real(NULL), bcoff(NULL), allSrcPos(&_allSrcPos), allGeoPos(&_allGeoPos),
-      dt(_dt), dx(_dx), fm(_fm),  nt(_nt), freeSurface(_freeSurface)
+      dt(_dt), dx(_dx), fm(_fm),  nt(_nt), freeSurface(_freeSurface), remMaxInvVel(0), decomp(NULL)
 {
 	if(freeSurface)
 		bz0 = EXFDBNDRYLEN;
@@ -748,6 +1116,10 @@ void ForwardModeling::recordSeis(float* seis_it, const float* p) const {
   this->recordSeis(seis_it, p, *this->allGeoPos);
 }
 
+void ForwardModeling::recordSeis(float* seis_it, const float* p, int nm) const {
+  allGeoPos->spreadTable(vel->nx, vel->nz, bx0, bz0).extract(p, seis_it, nm);
+}
+
 void ForwardModeling::fwiRemoveDirectArrival(float* data, int shot_id) const {
   float t_width = 1.5 / fm;
   ShotPosition curSrcPos = allSrcPos->clipRange(shot_id, shot_id);
@@ -832,11 +1204,30 @@ Velocity& ForwardModeling::getVelocity() {
 const std::vector<float> ForwardModeling::getVelocityDiff() const
 {
 	std::vector<float> vel_m(vel->nx * vel->nz, 0.0f);
-	vectorMinus(vel_real->dat, vel->dat, vel_m);
+	std::transform(vel_real->dat.begin(), vel_real->dat.end(), vel->dat.begin(), vel_m.begin(), std::minus<float>());
 	return vel_m;
 }
 
+/**
+ * the width of the strip one time step reads from the boundary, FDCOEF_LEN for
+ * fd4t10s, the stencil applied once per term with the rapid expansion
+ */
+int ForwardModeling::stepReach() const {
+  if (remCoef.empty()) {
+    return FDCOEF_LEN;
+  }
+  return (FDCOEF_LEN - 1) * (int)remCoef.size() + 1;
+}
+
 std::vector<float> ForwardModeling::initBndryVector(int nt) const {
+  return std::vector<float>(initBndryLength(nt), 0);
+}
+
+/**
+ * the length of the boundary store initBndryVector would return, for callers
+ * which bring their own storage
+ */
+size_t ForwardModeling::initBndryLength(int nt) const {
   if (vel == NULL) {
     ERROR() << __PRETTY_FUNCTION__ << ": you should bind velocity first";
     exit(1);
@@ -855,7 +1246,7 @@ std::vector<float> ForwardModeling::initBndryVector(int nt) const {
 //             2 * nz /* left + right */
 //             );
 
-  bndrWidth = 6;
+  bndrWidth = stepReach();
   int nx = nxpad - (bx0 - bndrWidth + bxn - bndrWidth);
   int nz = nzpad - bz0 - bzn;
 
@@ -864,10 +1255,14 @@ std::vector<float> ForwardModeling::initBndryVector(int nt) const {
       2 * nz /* left + right */
   );
 
-  return std::vector<float>(nt*bndrSize, 0);
+  return (size_t)nt * bndrSize;
 }
 
 void ForwardModeling::writeBndry(float* _bndr, const float* p, int it) const {
+  writeBndry(_bndr, p, it, 1);
+}
+
+void ForwardModeling::writeBndry(float* _bndr, const float* p, int it, int nm) const {
   /**
      * say the FDLEN = 2, then the boundary we should save is mark by (*)
      * we omit the upper layer
@@ -889,40 +1284,52 @@ void ForwardModeling::writeBndry(float* _bndr, const float* p, int it) const {
     int nx = nxpad - (bx0 - bndrWidth + bxn - bndrWidth);
     int nz = nzpad - bz0 - bzn;
 
-    float *bndr = &_bndr[it * bndrSize];
+    float *bndr = &_bndr[(size_t)it * bndrSize * nm];
 
     for (int ix = 0; ix < nx; ix++) {
       for(int iz = 0; iz < bndrWidth; iz++) {
-        bndr[iz + bndrWidth*ix] = p[(ix+bx0-bndrWidth)*nzpad + (nzpad - bzn + iz)]; // bottom
+        for (int im = 0; im < nm; im++) {
+          bndr[(iz + bndrWidth*ix)*nm + im] = p[((ix+bx0-bndrWidth)*nzpad + (nzpad - bzn + iz))*nm + im]; // bottom
+        }
       }
     }
 
     for (int iz = 0; iz < nz; iz++) {
       for(int ix=0; ix < bndrWidth; ix++) {
-        bndr[bndrWidth*nx+iz+nz*ix]         = p[(bx0-bndrWidth + ix)*nzpad + (bz0 + iz)];   // left
-        bndr[bndrWidth*nx+iz+nz*(ix+bndrWidth)] = p[(nxpad - bxn + ix)*nzpad + (bz0 + iz)];  // right
+        for (int im = 0; im < nm; im++) {
+          bndr[(bndrWidth*nx+iz+nz*ix)*nm + im]         = p[((bx0-bndrWidth + ix)*nzpad + (bz0 + iz))*nm + im];   // left
+          bndr[(bndrWidth*nx+iz+nz*(ix+bndrWidth))*nm + im] = p[((nxpad - bxn + ix)*nzpad + (bz0 + iz))*nm + im];  // right
+        }
       }
     }
 }
 
 void ForwardModeling::readBndry(const float* _bndr, float* p, int it) const {
+  readBndry(_bndr, p, it, 1);
+}
+
+void ForwardModeling::readBndry(const float* _bndr, float* p, int it, int nm) const {
   int nxpad = vel->nx;
   int nzpad = vel->nz;
 
   int nx = nxpad - (bx0 - bndrWidth + bxn - bndrWidth);
   int nz = nzpad - bz0 - bzn;
-  const float *bndr = &_bndr[it * bndrSize];
+  const float *bndr = &_bndr[(size_t)it * bndrSize * nm];
 
   for (int ix = 0; ix < nx; ix++) {
     for(int iz = 0; iz < bndrWidth; iz++) {
-      p[(ix+bx0-bndrWidth)*nzpad + (nzpad - bzn + iz)] = bndr[iz + bndrWidth*ix]; // bottom
+      for (int im = 0; im < nm; im++) {
+        p[((ix+bx0-bndrWidth)*nzpad + (nzpad - bzn + iz))*nm + im] = bndr[(iz + bndrWidth*ix)*nm + im]; // bottom
+      }
     }
   }
 
   for (int iz = 0; iz < nz; iz++) {
     for(int ix=0; ix < bndrWidth; ix++) {
-      p[(bx0-bndrWidth + ix)*nzpad + (bz0 + iz)] = bndr[bndrWidth*nx+iz+nz*ix];   // left
-      p[(nxpad - bxn + ix)*nzpad + (bz0 + iz)] = bndr[bndrWidth*nx+iz+nz*(ix+bndrWidth)];  // right
+      for (int im = 0; im < nm; im++) {
+        p[((bx0-bndrWidth + ix)*nzpad + (bz0 + iz))*nm + im] = bndr[(bndrWidth*nx+iz+nz*ix)*nm + im];   // left
+        p[((nxpad - bxn + ix)*nzpad + (bz0 + iz))*nm + im] = bndr[(bndrWidth*nx+iz+nz*(ix+bndrWidth))*nm + im];  // right
+      }
     }
   }
 }
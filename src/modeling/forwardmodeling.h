@@ -18,13 +18,16 @@ extern "C" {
 #include "sponge.h"
 #include "cpml.h"
 
+class DomainDecomp;
+
 class ForwardModeling {
 public:
   ForwardModeling(const ShotPosition &allSrcPos, const ShotPosition &allGeoPos, float dt, float dx, float fm, int nb, int nt, int freeSurface);
 	~ForwardModeling();
 
   Velocity expandDomain(const Velocity &vel);
-  Velocity expandDomain_notrans(const Velocity &vel);
+  Velocity expandDomain_notrans(const Velocity &vel) const;
+  Velocity shrinkDomain(const Velocity &exvel) const;
 
 
 	void addBornwv(float *fullwv_t0, float *fullwv_t1, float *fullwv_t2, const float *exvel_m, float dt, int it, float *rp1) const;
@@ -34,6 +37,33 @@ public:
   void stepForward(std::vector<float> &p0, std::vector<float> &p1, bool vtrans) const;
   void stepForward(std::vector<float> &p0, std::vector<float> &p1, int cpmlId) const;
   void stepBackward(std::vector<float> &p0, std::vector<float> &p1) const;
+  void stepForward(std::vector<float> &p0, std::vector<float> &p1, std::vector<float> &u2) const;
+  void stepBackward(std::vector<float> &p0, std::vector<float> &p1, std::vector<float> &u2) const;
+  bool concurrentSteps() const;
+
+  /**
+   * nm wavefields of the grid stepped together, each with its own velocity,
+   * interleaved with the member innermost as p[(ix * nz + iz) * nm + m], the
+   * velocities in vels and the scratch u2 of the caller as well. Sources and
+   * receivers are [point][nm], a boundary step is [bndrSize][nm]. Only the
+   * OpenMP loops, see concurrentSteps
+   */
+  void stepForward(std::vector<float> &p0, std::vector<float> &p1, const std::vector<float> &vels, std::vector<float> &u2, int nm) const;
+  void stepBackward(std::vector<float> &p0, std::vector<float> &p1, const std::vector<float> &vels, std::vector<float> &u2, int nm) const;
+  void addSource(float *p, const float *source, const ShotPosition &pos, int nm) const;
+  void subSource(float *p, const float *source, const ShotPosition &pos, int nm) const;
+  void recordSeis(float *seis_it, const float *p, int nm) const;
+  void writeBndry(float* _bndr, const float* p, int it, int nm) const;
+  void readBndry(const float* _bndr, float* p, int it, int nm) const;
+  void enableRapidExpansion(float vmax, int stepRatio);
+  void enableThreadPool(int nthreads);
+  void setAffinity(const char *policy);
+  void firstTouch(std::vector<float> &v, bool keep) const;
+  void selectFdCoef(const char *spec, float vmin, float vmax, float fmax);
+  void reportDispersion(float vmin, float vmax, float fmax) const;
+  void setDecomposition(DomainDecomp *decomp);
+  DomainDecomp *getDecomposition() const;
+  void spongeFactors(std::vector<float> &f) const;
   void bindVelocity(const Velocity &_vel);
   void bindRealVelocity(const Velocity &_vel);
   void bindBornCoff(std::vector<float> &b);
@@ -48,6 +78,7 @@ public:
   void scaleGradient(float *grad) const;
   void refillBoundary(float *vel) const;
   void sfWriteVel(const std::vector<float> &exvel, sf_file file) const;
+  std::vector<float> outputVel(const std::vector<float> &exvel) const;  /// nz x nx as sfWriteVel writes it
 
   void fwiRemoveDirectArrival(float* data, int shot_id) const;
   void removeDirectArrival(float* data) const;
@@ -55,13 +86,15 @@ public:
   void refillVelStencilBndry();
 
   std::vector<float> initBndryVector(int nt) const;
+  size_t initBndryLength(int nt) const;
   std::vector<float> getBornCoff(const Velocity &localvel, const Velocity &localvel_real, float dx, float dt);
   void writeBndry(float* _bndr, const float* p, int it) const;
   void readBndry(const float* _bndr, float* p, int it) const;
 
   void FwiForwardModeling(const std::vector<float> &encsrc, std::vector<float> &dcal, int shot_id) const;
   void EssForwardModeling(const std::vector<float> &encsrc, std::vector<float> &dcal) const;
-	void BornForwardModeling(const std::vector<float>& exvel, const std::vector<float>& encSrc, std::vector<float>& dcal, int shot_id) const;
+	void BornForwardModeling(const std::vector<float>& exvel, const std::vector<float>& encSrc, std::vector<float>& dcal, int shot_id,
+	    std::vector<float> *dbg = NULL) const;
 
 public:
   const Velocity &getVelocity() const;
@@ -83,8 +116,13 @@ public:
 	int getFDLEN() const;
 
 private:
-  void manipSource(float *p, const float *source, const ShotPosition &pos, boost::function2<float, float, float> op) const;
+  void stepRapidExpansion(std::vector<float> &p0, std::vector<float> &p1) const;
+  int stepReach() const;
+  void bornForwardModelingSteps(const std::vector<float> &exvel, const std::vector<float> &encSrc, std::vector<float> &dcal,
+      int shot_id, std::vector<float> *dbg) const;
+  void manipSource(float *p, const float *source, const ShotPosition &pos, float sign) const;
   void recordSeis(float *seis_it, const float *p, const ShotPosition &geoPos) const;
+  std::vector<float> &stepScratch(int i = 0) const;
   void removeDirectArrival(const ShotPosition &allSrcPos, const ShotPosition &allGeoPos, float* data, int nt, float t_width) const;
 
 public:
@@ -113,7 +151,11 @@ private:
 private:
 	std::vector<float> bndr;
 	std::vector<float> bcoff;
+	std::vector<float> remCoef;	/// Chebyshev coefficients of the rapid expansion, empty for fd4t10s
+	float remMaxInvVel;
+	DomainDecomp *decomp;	/// NULL unless a shot runs on several ranks
 	mutable Sponge *spng;
+	mutable std::vector<float> scratch[3];	/// u2 of stepForward and stepBackward, q0 and q1 of the rapid expansion, each copy has its own so that copies step on threads of their own
 	mutable CPML **cpml;
 
 	struct fdm2 *fd;
@@ -0,0 +1,351 @@
+/*
+ * numa-util.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+#include "numa-util.h"
+#include "tpool.h"
+
+#define MAX_CPUS 1024
+#define MAX_NODES 64
+
+static int policy_cpus[MAX_CPUS];
+static int npolicy_cpus = 0;
+
+#ifdef __linux__
+/// the mask before any pinning, the threads only ever narrow their own
+static cpu_set_t initial_mask;
+static int has_initial_mask = 0;
+
+static const cpu_set_t *process_mask(void) {
+  if (!has_initial_mask) {
+    if (sched_getaffinity(0, sizeof(initial_mask), &initial_mask) != 0) {
+      return NULL;
+    }
+    has_initial_mask = 1;
+  }
+  return &initial_mask;
+}
+#endif
+
+static int in_mask(int cpu) {
+#ifdef __linux__
+  const cpu_set_t *mask = process_mask();
+  return mask == NULL || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, mask));
+#else
+  return 1;
+#endif
+}
+
+int numautil_nodes(void) {
+  char path[128];
+  int n = 0;
+
+  while (n < MAX_NODES) {
+    sprintf(path, "/sys/devices/system/node/node%d/cpulist", n);
+    if (access(path, R_OK) != 0) {
+      break;
+    }
+    n++;
+  }
+
+  return n > 0 ? n : 1;
+}
+
+int numautil_node_cpus(int node, int *cpus, int maxcpus) {
+  char path[128];
+  char list[4096];
+  int n = 0;
+  FILE *f;
+
+  sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+  f = fopen(path, "r");
+  if (f == NULL) {
+    /// no numa information, the whole mask is node 0
+    int cpu;
+    for (cpu = 0; node == 0 && cpu < MAX_CPUS && n < maxcpus; cpu++) {
+      if (in_mask(cpu)) {
+        cpus[n++] = cpu;
+      }
+    }
+    return n;
+  }
+
+  if (fgets(list, sizeof(list), f) != NULL) {
+    char *tok = strtok(list, ",\n");
+    while (tok != NULL) {
+      int lo, hi, cpu;
+      if (sscanf(tok, "%d-%d", &lo, &hi) != 2) {
+        hi = lo = atoi(tok);
+      }
+      for (cpu = lo; cpu <= hi && n < maxcpus; cpu++) {
+        if (in_mask(cpu)) {
+          cpus[n++] = cpu;
+        }
+      }
+      tok = strtok(NULL, ",\n");
+    }
+  }
+  fclose(f);
+
+  return n;
+}
+
+static void pin_self(int cpu) {
+#ifdef __linux__
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CPU_SET(cpu, &mask);
+  if (sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+    fprintf(stderr, "numautil: cannot pin on cpu %d\n", cpu);
+  }
+#endif
+}
+
+static void unpin_openmp(void) {
+#ifdef __linux__
+  const cpu_set_t *mask = process_mask();
+  if (mask == NULL) {
+    return;
+  }
+#ifdef USE_OPENMP
+  #pragma omp parallel
+#endif
+  sched_setaffinity(0, sizeof(*mask), mask);
+#endif
+}
+
+static void pin_openmp(const int *cpus, int n) {
+#ifdef USE_OPENMP
+  #pragma omp parallel
+  {
+    pin_self(cpus[omp_get_thread_num() % n]);
+  }
+#else
+  pin_self(cpus[0]);
+#endif
+}
+
+int numautil_set_policy(const char *policy) {
+  static int nodeCpus[MAX_NODES][MAX_CPUS];
+  int ncpus[MAX_NODES];
+  int nnodes = numautil_nodes();
+  int inode, i, left;
+
+  in_mask(0); /// keep the mask before pinning anything
+  if (strcmp(policy, "none") == 0) {
+    npolicy_cpus = 0;
+    return 0;
+  }
+  if (strcmp(policy, "compact") != 0 && strcmp(policy, "scatter") != 0) {
+    fprintf(stderr, "numautil: unknown affinity policy %s\n", policy);
+    return -1;
+  }
+
+  left = 0;
+  for (inode = 0; inode < nnodes; inode++) {
+    ncpus[inode] = numautil_node_cpus(inode, nodeCpus[inode], MAX_CPUS);
+    left += ncpus[inode];
+  }
+
+  npolicy_cpus = 0;
+  if (strcmp(policy, "compact") == 0) {
+    for (inode = 0; inode < nnodes; inode++) {
+      for (i = 0; i < ncpus[inode] && npolicy_cpus < MAX_CPUS; i++) {
+        policy_cpus[npolicy_cpus++] = nodeCpus[inode][i];
+      }
+    }
+  } else {
+    for (i = 0; left > 0 && npolicy_cpus < MAX_CPUS; i++) {
+      for (inode = 0; inode < nnodes; inode++) {
+        if (i < ncpus[inode]) {
+          policy_cpus[npolicy_cpus++] = nodeCpus[inode][i];
+          left--;
+        }
+      }
+    }
+  }
+
+  if (npolicy_cpus == 0) {
+    return -1;
+  }
+
+  pin_openmp(policy_cpus, npolicy_cpus);
+  tpool_set_cpus(policy_cpus, npolicy_cpus);
+
+  return 0;
+}
+
+int numautil_enabled(void) {
+  return npolicy_cpus > 0;
+}
+
+struct touch_args {
+  float *p;
+  const float *save;
+  int nx;
+  int nz;
+};
+
+static void touch_task(void *arg, int tid, int nthreads) {
+  const struct touch_args *t = (const struct touch_args *)arg;
+  struct tpool_tile tile;
+  int ix;
+
+  tpool_tile(tid, nthreads, t->nx, t->nz, &tile);
+  for (ix = tile.x0; ix < tile.x1; ix++) {
+    float *dst = t->p + (long)ix * t->nz + tile.z0;
+    size_t len = (tile.z1 - tile.z0) * sizeof(float);
+    if (t->save) {
+      memcpy(dst, t->save + (long)ix * t->nz + tile.z0, len);
+    } else {
+      memset(dst, 0, len);
+    }
+  }
+}
+
+void numautil_first_touch(float *p, long n, int nz, int keep) {
+  long page = sysconf(_SC_PAGESIZE);
+  char *beg = (char *)(((unsigned long)p + page - 1) / page * page);
+  char *end = (char *)((unsigned long)(p + n) / page * page);
+  struct touch_args t;
+  float *save = NULL;
+  int ix;
+
+  if (!numautil_enabled() || end <= beg) {
+    return;
+  }
+  if (nz <= 0 || n % nz != 0) {
+    nz = 1;
+  }
+
+  if (keep) {
+    save = (float *)malloc(n * sizeof(float));
+    memcpy(save, p, n * sizeof(float));
+  }
+
+  /// the next touch of the dropped pages allocates them on the node of the toucher
+  madvise(beg, end - beg, MADV_DONTNEED);
+
+  t.p = p;
+  t.save = save;
+  t.nx = n / nz;
+  t.nz = nz;
+
+  if (tpool_size() > 0) {
+    tpool_run(touch_task, &t);
+  } else {
+#ifdef USE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (ix = 0; ix < t.nx; ix++) {
+      float *dst = p + (long)ix * nz;
+      if (save) {
+        memcpy(dst, save + (long)ix * nz, nz * sizeof(float));
+      } else {
+        memset(dst, 0, nz * sizeof(float));
+      }
+    }
+  }
+
+  free(save);
+}
+
+static double wtime(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+double numautil_node_bandwidth(int node, long n) {
+  const int nrep = 5;
+  int cpus[MAX_CPUS];
+  int ncpu = numautil_node_cpus(node, cpus, MAX_CPUS);
+  double best = 1e30;
+  float *a, *b, *c;
+  long i;
+  int rep;
+
+  if (ncpu == 0) {
+    return 0;
+  }
+
+  /// large blocks come straight from mmap, so no page is touched yet
+  a = (float *)malloc(n * sizeof(float));
+  b = (float *)malloc(n * sizeof(float));
+  c = (float *)malloc(n * sizeof(float));
+
+#ifdef USE_OPENMP
+  #pragma omp parallel num_threads(ncpu) private(i, rep)
+  {
+    pin_self(cpus[omp_get_thread_num()]);
+
+    #pragma omp for schedule(static)
+    for (i = 0; i < n; i++) {
+      a[i] = 0;
+      b[i] = 1;
+      c[i] = 2;
+    }
+
+    for (rep = 0; rep < nrep; rep++) {
+      double t0 = 0;
+      #pragma omp barrier
+      #pragma omp master
+      t0 = wtime();
+
+      #pragma omp for schedule(static)
+      for (i = 0; i < n; i++) {
+        a[i] = b[i] + 3.0f * c[i];
+      }
+
+      #pragma omp master
+      {
+        double t = wtime() - t0;
+        best = t < best ? t : best;
+      }
+    }
+  }
+#else
+  pin_self(cpus[0]);
+  for (i = 0; i < n; i++) {
+    a[i] = 0;
+    b[i] = 1;
+    c[i] = 2;
+  }
+  for (rep = 0; rep < nrep; rep++) {
+    double t0 = wtime();
+    for (i = 0; i < n; i++) {
+      a[i] = b[i] + 3.0f * c[i];
+    }
+    double t = wtime() - t0;
+    best = t < best ? t : best;
+  }
+#endif
+
+  free(a);
+  free(b);
+  free(c);
+
+  if (numautil_enabled()) {
+    pin_openmp(policy_cpus, npolicy_cpus);
+  } else {
+    unpin_openmp();
+  }
+
+  return 3.0 * n * sizeof(float) / best * 1e-9;
+}
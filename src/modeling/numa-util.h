@@ -0,0 +1,46 @@
+/*
+ * numa-util.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_MDLIB_NUMA_UTIL_H_
+#define SRC_MDLIB_NUMA_UTIL_H_
+
+/**
+ * numa placement without libnuma: the nodes are read from sysfs, threads are
+ * pinned with sched_setaffinity and pages are placed by first touch
+ */
+int numautil_nodes(void);
+
+/// cpus of node within the affinity mask of the process, returns their number
+int numautil_node_cpus(int node, int *cpus, int maxcpus);
+
+/**
+ * policy "compact" fills the nodes one after the other, "scatter" deals the
+ * threads round robin over the nodes, "none" leaves the threads alone.
+ * pins the OpenMP threads and orders the cpus of the thread pool (tpool.h),
+ * so it must come before tpool_init. returns 0 on success
+ */
+int numautil_set_policy(const char *policy);
+
+/// non zero once a policy other than "none" is set
+int numautil_enabled(void);
+
+/**
+ * places the pages of p (n floats, columns of nz) on the nodes of the threads
+ * which update them: the whole pages of p are dropped and touched again by
+ * the OpenMP threads (static schedule over the columns) or by the tiles of the
+ * thread pool. the content is kept if keep is non zero, zeroed otherwise.
+ * does nothing unless a policy is set
+ */
+void numautil_first_touch(float *p, long n, int nz, int keep);
+
+/**
+ * triad bandwidth (GB/s) of the cpus of node on arrays of n floats placed by
+ * those cpus. the OpenMP threads are pinned again with the policy afterwards
+ */
+double numautil_node_bandwidth(int node, long n);
+
+#endif /* SRC_MDLIB_NUMA_UTIL_H_ */
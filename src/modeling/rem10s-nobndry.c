@@ -0,0 +1,144 @@
+/*
+ * rem10s-nobndry.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "rem10s-nobndry.h"
+#include "fdcoef.h"
+
+/**
+ * p(t+dt) + p(t-dt) = 2 * cos(dt * sqrt(-L)) p(t), the cosine is expanded
+ * with Chebyshev polynomials (Jacobi-Anger):
+ *   cos(z x) = J0(z) + 2 * sum_k (-1)^k J2k(z) T2k(x)
+ * where z = dt * sqrt(R), R bounds the spectrum of -L and T2k(x) = Tk(2x^2 - 1).
+ * The expansion has no time dispersion and stays stable as long as enough
+ * terms are taken, so dt is limited by the sampling of the data only.
+ */
+
+static const int d = 6;
+
+/**
+ * spectral radius of the (negative) stencil of fdcoef.h, bounded by the sum
+ * of the absolute values of the weights
+ */
+static float stencil_radius() {
+  float a[FDCOEF_LEN];
+  fdcoef_load(a);
+
+  float r = 2 * a[0];
+  int i;
+  for (i = 1; i < 6; i++) {
+    r += 2 * fabsf(a[i]);
+  }
+  return 2 * r;
+}
+
+/**
+ * the step is stable for any dt, but a source sampled with dt also excites the
+ * grid modes whose frequency aliases into the source band, these modes are
+ * slow and never leave the model, so keep dt * (wgrid + wsrc) below 2 * pi
+ */
+float rem10s_max_dt(float vmax, float dx, float fmax) {
+  return 2 * M_PI * dx / (sqrtf(stencil_radius()) * vmax + 2 * M_PI * fmax * dx);
+}
+
+/**
+ * maxInvVel is the maximum of 1/vel, i.e. (vmax * dt / dx)^2
+ */
+int rem10s_nterms(float maxInvVel) {
+  const double eps = 1e-7;
+  double z = sqrt(stencil_radius() * maxInvVel);
+  int k = (int)ceil(z / 2);
+
+  while (fabs(jn(2 * k, z)) > eps || fabs(jn(2 * k + 2, z)) > eps) {
+    k++;
+  }
+
+  return k + 1;
+}
+
+/**
+ * coef[k] already contains the factor 2 of the leapfrog update
+ */
+void rem10s_coef(float *coef, int nterms, float maxInvVel) {
+  double z = sqrt(stencil_radius() * maxInvVel);
+  int k;
+
+  coef[0] = 2 * jn(0, z);
+  for (k = 1; k < nterms; k++) {
+    coef[k] = 4 * ((k & 1) ? -1 : 1) * jn(2 * k, z);
+  }
+}
+
+/**
+ * dst = s * Y src - sub, with Y = -2 / (R * vel) * stencil - I, then the new
+ * term is accumulated into wave in the same sweep
+ * src is zero outside the stencil zone
+ */
+static void cheb_apply(float *dst, const float *src, const float *sub, float *wave, float c,
+    const float *vel, float s, float invR, int nx, int nz) {
+  float a[FDCOEF_LEN];
+  int ix, iz;
+
+  fdcoef_load(a);
+
+#ifdef USE_OPENMP
+  #pragma omp parallel for default(shared) private(ix, iz)
+#endif
+  for (ix = d - 1; ix < nx - (d - 1); ix++) {
+    for (iz = d - 1; iz < nz - (d - 1); iz++) {
+      int curPos = ix * nz + iz;
+      float lap = -4.0 * a[0] * src[curPos] +
+                  a[1] * (src[curPos - 1]  +  src[curPos + 1]  +
+                          src[curPos - nz]  +  src[curPos + nz])  +
+                  a[2] * (src[curPos - 2]  +  src[curPos + 2]  +
+                          src[curPos - 2 * nz]  +  src[curPos + 2 * nz])  +
+                  a[3] * (src[curPos - 3]  +  src[curPos + 3]  +
+                          src[curPos - 3 * nz]  +  src[curPos + 3 * nz])  +
+                  a[4] * (src[curPos - 4]  +  src[curPos + 4]  +
+                          src[curPos - 4 * nz]  +  src[curPos + 4 * nz])  +
+                  a[5] * (src[curPos - 5]  +  src[curPos + 5]  +
+                          src[curPos - 5 * nz]  +  src[curPos + 5 * nz]);
+      float q = s * (-2.0f * invR / vel[curPos] * lap - src[curPos]) - sub[curPos];
+
+      dst[curPos] = q;
+      wave[curPos] += c * q;
+    }
+  }
+}
+
+/**
+ * prev_wave is overwritten by the next wavefield in [d - 1, n - d + 1), q0 and
+ * q1 are work arrays of size nx * nz which must be zero outside of that range
+ */
+void rem10s_nobndry_2d_vtrans(float *prev_wave, const float *curr_wave, const float *vel, float *q0, float *q1,
+    const float *coef, int nterms, float maxInvVel, int nx, int nz)
+{
+  float invR = 1.0f / (stencil_radius() * maxInvVel);
+  int ix, iz, k;
+
+#ifdef USE_OPENMP
+  #pragma omp parallel for default(shared) private(ix, iz)
+#endif
+  for (ix = d - 1; ix < nx - (d - 1); ix++) {
+    for (iz = d - 1; iz < nz - (d - 1); iz++) {
+      int curPos = ix * nz + iz;
+      q0[curPos] = curr_wave[curPos];
+      q1[curPos] = 0;
+      prev_wave[curPos] = coef[0] * curr_wave[curPos] - prev_wave[curPos];
+    }
+  }
+
+  /// T(k+1)(Y) p = 2 * Y * Tk(Y) p - T(k-1)(Y) p, written over T(k-1), T1(Y) p = Y p
+  for (k = 1; k < nterms; k++) {
+    cheb_apply(q1, q0, q1, prev_wave, coef[k], vel, k == 1 ? 1.0f : 2.0f, invR, nx, nz);
+
+    float *t = q0;
+    q0 = q1;
+    q1 = t;
+  }
+}
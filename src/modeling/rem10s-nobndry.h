@@ -0,0 +1,21 @@
+/*
+ * rem10s-nobndry.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_MDLIB_REM10S_NOBNDRY_H_
+#define SRC_MDLIB_REM10S_NOBNDRY_H_
+
+/**
+ * rapid expansion (Chebyshev) time stepping with the same 10th order
+ * spatial stencil as fd4t10s_*, the velocity is transformed as in fd4t10s_*
+ */
+float rem10s_max_dt(float vmax, float dx, float fmax);
+int rem10s_nterms(float maxInvVel);
+void rem10s_coef(float *coef, int nterms, float maxInvVel);
+void rem10s_nobndry_2d_vtrans(float *prev_wave, const float *curr_wave, const float *vel, float *q0, float *q1,
+    const float *coef, int nterms, float maxInvVel, int nx, int nz);
+
+#endif /* SRC_MDLIB_REM10S_NOBNDRY_H_ */
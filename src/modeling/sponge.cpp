@@ -1,13 +1,17 @@
 #include "sponge.h"
 
-void Sponge::initbndr(int nb) {
+/**
+ * the taper is applied once per step, when a step spans stepRatio native
+ * steps the taper is raised to that power to keep the damping per second
+ */
+void Sponge::initbndr(int nb, float stepRatio) {
 	bndr.resize(nb);
 	bndr.assign(nb, 0.0f);
 	//float sponge_coef = .003737;
 	float sponge_coef = 0.015;
   for(int ib=0;ib<nb;ib++){
     float tmp=sponge_coef*(nb-ib-1);
-    bndr[ib]=expf(-tmp*tmp);
+    bndr[ib]=expf(-tmp*tmp*stepRatio);
   }
 }
 
@@ -32,3 +36,35 @@ void Sponge::applySponge(float* p, const float *vel, int nx, int nz, int nb, flo
   }
 }
 
+/**
+ * the same taper on nm fields interleaved with the member innermost,
+ * p[(ix * nz + iz) * nm + m], in the same order of the cells
+ */
+void Sponge::applySponge(float* p, int nx, int nz, int nm, int nb, int freeSurface) {
+	int d = 6;
+  for(int ib=0; ib<nb; ib++) {
+    float w = bndr[ib];
+
+    int ibz = nz-ib-1;
+    for(int ix=d; ix<nx-d; ix++) {
+      for(int im=0; im<nm; im++) {
+        if(!freeSurface) {
+          p[(ix * nz + ib) * nm + im] *= w;
+        }
+        p[(ix * nz + ibz) * nm + im] *= w;
+      }
+    }
+
+    int ibx = nx-ib-1;
+    for(int iz=d; iz<nz-d; iz++) {
+      for(int im=0; im<nm; im++) {
+        p[(ib  * nz + iz) * nm + im] *= w;
+        p[(ibx * nz + iz) * nm + im] *= w;
+      }
+    }
+  }
+}
+
+const float *Sponge::getbndr() const {
+	return &bndr[0];
+}
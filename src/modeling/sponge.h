@@ -4,8 +4,10 @@
 #include <cmath>
 class Sponge {
 	public:
-		void initbndr(int nb);
+		void initbndr(int nb, float stepRatio = 1.0f);
 		void applySponge(float* p, const float *vel, int nx, int nz, int nb, float dt, float dx, int freeSurface);
+		void applySponge(float* p, int nx, int nz, int nm, int nb, int freeSurface);
+		const float *getbndr() const;
 	private:
 		std::vector<float> bndr;
 };
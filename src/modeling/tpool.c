@@ -0,0 +1,260 @@
+/*
+ * tpool.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "tpool.h"
+
+#define TPOOL_MAX 256
+#define SPIN_COUNT 20000    /// polls before a waiting thread yields or sleeps
+#define MIN_TILE_WIDTH 16   /// narrowest column strip, in grid points
+
+static int size = 0;
+static pthread_t threads[TPOOL_MAX];
+static int tids[TPOOL_MAX];
+static int cpus[TPOOL_MAX];
+static int ncpu = 0;
+static int user_cpus = 0;   /// cpus given by tpool_set_cpus
+#ifdef __linux__
+static cpu_set_t caller_mask; /// of the caller before tpool_init pinned it
+#endif
+static int caller_pinned = 0;
+
+static tpool_task cur_task;
+static void *cur_arg;
+static int generation = 0;
+static int base_generation = 0; /// generation when the workers were created
+static int quit = 0;
+
+/// idle workers go to sleep after SPIN_COUNT polls
+static int sleepers = 0;
+static pthread_mutex_t sleep_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleep_cond = PTHREAD_COND_INITIALIZER;
+
+/// sense reversing barrier
+static int bar_count = 0;
+static int bar_sense = 0;
+static __thread int local_sense = 0;
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+void tpool_barrier(void) {
+  int sense = !local_sense;
+  int i = 0;
+  local_sense = sense;
+
+  if (__atomic_add_fetch(&bar_count, 1, __ATOMIC_ACQ_REL) == size) {
+    __atomic_store_n(&bar_count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&bar_sense, sense, __ATOMIC_RELEASE);
+    return;
+  }
+
+  while (__atomic_load_n(&bar_sense, __ATOMIC_ACQUIRE) != sense) {
+    if (++i < SPIN_COUNT) {
+      cpu_relax();
+    } else {
+      sched_yield(); /// the pool is oversubscribed
+    }
+  }
+}
+
+static int wait_generation(int last) {
+  int g, i;
+
+  for (i = 0; i < SPIN_COUNT; i++) {
+    if ((g = __atomic_load_n(&generation, __ATOMIC_ACQUIRE)) != last) {
+      return g;
+    }
+    cpu_relax();
+  }
+
+  pthread_mutex_lock(&sleep_mut);
+  __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+  while ((g = __atomic_load_n(&generation, __ATOMIC_SEQ_CST)) == last) {
+    pthread_cond_wait(&sleep_cond, &sleep_mut);
+  }
+  __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&sleep_mut);
+
+  return g;
+}
+
+static void *worker(void *ptr) {
+  int tid = *(int *)ptr;
+  int g = base_generation;
+
+  local_sense = __atomic_load_n(&bar_sense, __ATOMIC_ACQUIRE);
+  while (1) {
+    g = wait_generation(g);
+    if (quit) {
+      break;
+    }
+    cur_task(cur_arg, tid, size);
+    tpool_barrier();
+  }
+
+  return NULL;
+}
+
+/// the cpus this process may run on, the threads are pinned round robin on them
+static void init_cpus(void) {
+  if (user_cpus) {
+    return;
+  }
+  ncpu = 0;
+#ifdef __linux__
+  cpu_set_t mask;
+  int i;
+  if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+    for (i = 0; i < CPU_SETSIZE && ncpu < TPOOL_MAX; i++) {
+      if (CPU_ISSET(i, &mask)) {
+        cpus[ncpu++] = i;
+      }
+    }
+  }
+#endif
+}
+
+static void pin(pthread_t thread, int tid) {
+#ifdef __linux__
+  cpu_set_t mask;
+  if (ncpu == 0) {
+    return;
+  }
+  CPU_ZERO(&mask);
+  CPU_SET(cpus[tid % ncpu], &mask);
+  if (pthread_setaffinity_np(thread, sizeof(mask), &mask) != 0) {
+    fprintf(stderr, "tpool: cannot pin thread %d\n", tid);
+  }
+#endif
+}
+
+int tpool_init(int nthreads) {
+  static int registered = 0;
+  int i;
+
+  if (size > 0) {
+    return size;
+  }
+
+  init_cpus();
+  if (nthreads <= 0) {
+    nthreads = ncpu > 0 ? ncpu : 1;
+  }
+  if (nthreads > TPOOL_MAX) {
+    nthreads = TPOOL_MAX;
+  }
+
+  size = nthreads;
+  quit = 0;
+  base_generation = generation;
+  /**
+   * the caller runs the OpenMP loops between the steps too, whose teams
+   * inherit its mask, so it is only pinned when its tile must stay on the
+   * node tpool_set_cpus placed it on
+   */
+#ifdef __linux__
+  if (user_cpus && pthread_getaffinity_np(pthread_self(), sizeof(caller_mask), &caller_mask) == 0) {
+    pin(pthread_self(), 0);
+    caller_pinned = 1;
+  }
+#endif
+  for (i = 1; i < size; i++) {
+    tids[i] = i;
+    if (pthread_create(&threads[i], NULL, worker, &tids[i]) != 0) {
+      fprintf(stderr, "tpool: cannot create thread %d\n", i);
+      exit(1);
+    }
+    pin(threads[i], i);
+  }
+
+  if (!registered) {
+    atexit(tpool_exit);
+    registered = 1;
+  }
+
+  return size;
+}
+
+void tpool_set_cpus(const int *_cpus, int n) {
+  int i;
+  ncpu = n < TPOOL_MAX ? n : TPOOL_MAX;
+  for (i = 0; i < ncpu; i++) {
+    cpus[i] = _cpus[i];
+  }
+  user_cpus = ncpu > 0;
+}
+
+int tpool_size(void) {
+  return size;
+}
+
+void tpool_run(tpool_task task, void *arg) {
+  cur_task = task;
+  cur_arg = arg;
+  __atomic_add_fetch(&generation, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&sleep_mut);
+    pthread_cond_broadcast(&sleep_cond);
+    pthread_mutex_unlock(&sleep_mut);
+  }
+
+  task(arg, 0, size);
+  tpool_barrier();
+}
+
+void tpool_exit(void) {
+  int i;
+
+  if (size == 0) {
+    return;
+  }
+
+  quit = 1;
+  __atomic_add_fetch(&generation, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_lock(&sleep_mut);
+  pthread_cond_broadcast(&sleep_cond);
+  pthread_mutex_unlock(&sleep_mut);
+
+  for (i = 1; i < size; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  size = 0;
+
+#ifdef __linux__
+  if (caller_pinned) {
+    pthread_setaffinity_np(pthread_self(), sizeof(caller_mask), &caller_mask);
+    caller_pinned = 0;
+  }
+#endif
+}
+
+void tpool_tile(int tid, int nthreads, int nx, int nz, struct tpool_tile *t) {
+  int px = nthreads;
+  int pz, ix, iz;
+
+  while (px > 1 && (nthreads % px != 0 || nx / px < MIN_TILE_WIDTH)) {
+    px--;
+  }
+  pz = nthreads / px;
+  ix = tid / pz;
+  iz = tid % pz;
+
+  t->x0 = (int)((long)nx * ix / px);
+  t->x1 = (int)((long)nx * (ix + 1) / px);
+  t->z0 = (int)((long)nz * iz / pz);
+  t->z1 = (int)((long)nz * (iz + 1) / pz);
+}
@@ -0,0 +1,53 @@
+/*
+ * tpool.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+#ifndef SRC_MDLIB_TPOOL_H_
+#define SRC_MDLIB_TPOOL_H_
+
+/**
+ * persistent pool of pinned worker threads, the portable counterpart of the
+ * master/slave scheme of fd4t10s-damp-zjh-cg.c. The caller is thread 0 and
+ * runs its share of every task, the workers spin (then sleep) between tasks
+ * and meet at a sense reversing barrier, so a step costs one dispatch instead
+ * of a fork/join per loop.
+ */
+typedef void (*tpool_task)(void *arg, int tid, int nthreads);
+
+/**
+ * nthreads <= 0 takes every cpu of the affinity mask, returns the pool size.
+ * The caller is pinned too only after tpool_set_cpus, tpool_exit gives it
+ * its mask back
+ */
+int tpool_init(int nthreads);
+
+/// thread i is pinned on cpus[i % n] instead of the affinity mask order
+void tpool_set_cpus(const int *cpus, int n);
+
+/// 0 when the pool is not running
+int tpool_size(void);
+
+/// runs task(arg, tid, size) on every thread and returns when all are done
+void tpool_run(tpool_task task, void *arg);
+
+/// all the threads of the pool, to be called inside a task only
+void tpool_barrier(void);
+
+void tpool_exit(void);
+
+/**
+ * the tile [x0, x1) x [z0, z1) of [0, nx) x [0, nz) owned by thread tid, the
+ * same thread gets the same tile at every step. tiles span whole columns
+ * (the fast axis) unless the columns get too narrow for the stencil
+ */
+struct tpool_tile {
+  int x0, x1;
+  int z0, z1;
+};
+
+void tpool_tile(int tid, int nthreads, int nx, int nz, struct tpool_tile *t);
+
+#endif /* SRC_MDLIB_TPOOL_H_ */
@@ -0,0 +1,132 @@
+/*
+ * main-bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: rice
+ */
+
+extern "C" {
+#include <rsf.h>
+#include "fd4t10s-nobndry.h"
+#include "fd4t10s-pool.h"
+#include "numa-util.h"
+#include "tpool.h"
+}
+
+#include <vector>
+#include <sys/time.h>
+#include "logger.h"
+#include "sponge.h"
+
+namespace {
+class Params {
+public:
+  Params();
+  ~Params();
+
+public:
+  int nx;
+  int nz;
+  int nb;
+  int nt;
+  int nthreads;
+  const char *affinity;
+  int mb;
+};
+
+Params::Params() {
+  if (!sf_getint("nx", &nx)) { nx = 1000; }                 /* grid size along x, with the boundary */
+  if (!sf_getint("nz", &nz)) { nz = 1000; }                 /* grid size along z, with the boundary */
+  if (!sf_getint("nb", &nb)) { nb = 36; }                   /* width of the sponge */
+  if (!sf_getint("nt", &nt)) { nt = 200; }                  /* time steps of each run */
+  if (!sf_getint("nthreads", &nthreads)) { nthreads = -1; } /* pinned thread pool size, < 0: OpenMP */
+  if (!(affinity = sf_getstring("affinity"))) { affinity = "none"; } /* none, compact or scatter */
+  if (!sf_getint("mb", &mb)) { mb = 256; }                  /* size of each triad array per node, in MB */
+}
+
+Params::~Params() {
+  sf_close();
+}
+
+double wtime() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+/**
+ * seconds per step of the fd4t10s forward step with the sponge, the grids are
+ * zero filled by the calling thread and moved with numautil_first_touch if
+ * place is true
+ */
+double timeSteps(const Params &params, Sponge &spng, bool place) {
+  int nx = params.nx;
+  int nz = params.nz;
+  std::vector<float> vel(nx * nz, 1.0f / (0.3f * 0.3f)); /// courant 0.3, transformed as in fd4t10s
+  std::vector<float> p0(nx * nz, 0);
+  std::vector<float> p1(nx * nz, 0);
+  std::vector<float> u2(nx * nz, 0);
+
+  if (place) {
+    numautil_first_touch(&vel[0], vel.size(), nz, 1);
+    numautil_first_touch(&p0[0], p0.size(), nz, 0);
+    numautil_first_touch(&p1[0], p1.size(), nz, 0);
+    numautil_first_touch(&u2[0], u2.size(), nz, 0);
+  }
+  p1[nx / 2 * nz + nz / 2] = 1;
+
+  double t0 = wtime();
+  for (int it = 0; it < params.nt; it++) {
+    if (tpool_size() > 0) {
+      fd4t10s_pool_2d_vtrans(&p0[0], &p1[0], &vel[0], &u2[0], nx, nz, spng.getbndr(), params.nb, 0);
+    } else {
+      fd4t10s_nobndry_2d_vtrans(&p0[0], &p1[0], &vel[0], &u2[0], nx, nz, params.nb, 0);
+      spng.applySponge(&p0[0], &vel[0], nx, nz, params.nb, 0, 0, 0);
+      spng.applySponge(&p1[0], &vel[0], nx, nz, params.nb, 0, 0, 0);
+    }
+    p0.swap(p1);
+  }
+
+  return (wtime() - t0) / params.nt;
+}
+
+} /// end of name space
+
+int main(int argc, char *argv[]) {
+  sf_init(argc, argv);
+
+  Params params;
+
+  /// measured before any pinning of the policy, each node with its own cpus
+  int nnodes = numautil_nodes();
+  long n = (long)params.mb * 1024 * 1024 / sizeof(float);
+  for (int inode = 0; inode < nnodes; inode++) {
+    std::vector<int> cpus(1024);
+    int ncpu = numautil_node_cpus(inode, &cpus[0], cpus.size());
+    double bw = numautil_node_bandwidth(inode, n);
+    INFO() << format("node %d: %d cpus, triad bandwidth %.2f GB/s") % inode % ncpu % bw;
+  }
+
+  if (numautil_set_policy(params.affinity) != 0) {
+    sf_error("unknown affinity policy %s", params.affinity);
+  }
+  if (params.nthreads >= 0) {
+    INFO() << format("thread pool of %d threads") % tpool_init(params.nthreads);
+  }
+
+  Sponge spng;
+  spng.initbndr(params.nb);
+
+  /// vel and p1 are read, p0 and u2 are both read and written each step
+  double bytes = 6.0 * sizeof(float) * params.nx * params.nz;
+  double tserial = timeSteps(params, spng, false);
+  INFO() << format("%d x %d, affinity %s, serial placement: %.3f ms/step, %.2f GB/s")
+      % params.nx % params.nz % params.affinity % (tserial * 1e3) % (bytes / tserial * 1e-9);
+  if (numautil_enabled()) {
+    double tplaced = timeSteps(params, spng, true);
+    INFO() << format("%d x %d, affinity %s, first touch placement: %.3f ms/step, %.2f GB/s")
+        % params.nx % params.nz % params.affinity % (tplaced * 1e3) % (bytes / tplaced * 1e-9);
+  }
+
+  return 0;
+}
@@ -20,16 +20,19 @@ extern "C" {
 #include "sfutil.h"
 #include "timer.h"
 #include "environment.h"
+#include "param-bcast.h"
+#include "shotdata-writer.h"
 #include "math.h"
 
-#define OFFSET 1000000
 namespace {
 class Params {
 public:
   Params();
   ~Params();
+  void share(ParamBcast &pb);
 
 private:
+  void parse();
   Params(const Params &);
   void operator=(const Params &);
   void check();
@@ -68,7 +71,24 @@ public:
 };
 
 
-Params::Params() {
+/// rank 0 parses the parameters and creates the outputs, the others get the fields
+Params::Params() : vinit(NULL), vreal(NULL), shots_rf(NULL), shots_bg(NULL) {
+  MPI_Comm_size(MPI_COMM_WORLD, &np);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  ParamBcast pb(MPI_COMM_WORLD);
+  if (pb.reader()) {
+    parse();
+  }
+  pb.sync(*this);
+
+  k = std::ceil(ns * 1.0 / np);
+  ntask = std::min(k, ns - rank*k);
+
+  check();
+}
+
+void Params::parse() {
   /*< set up I/O files >*/
   vinit=sf_input ("vinit");   /* initial velocity model, unit=m/s */
   vreal=sf_input ("vreal");   /* initial velocity model, unit=m/s */
@@ -175,13 +195,11 @@ Params::Params() {
 
   sf_putfloat(shots_bg, "vmin", vmin);
   sf_putfloat(shots_bg, "vmax", vmax);
+}
 
-  MPI_Comm_size(MPI_COMM_WORLD, &np);
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-  k = std::ceil(ns * 1.0 / np);
-  ntask = std::min(k, ns - rank*k);
-
-  check();
+void Params::share(ParamBcast &pb) {
+  pb(nb)(nz)(nx)(dz)(dx)(nt)(ng)(ns)(dt)(amp)(fm);
+  pb(sxbeg)(szbeg)(gxbeg)(gzbeg)(jsx)(jsz)(jgx)(jgz)(freeSurface);
 }
 
 Params::~Params() {
@@ -205,8 +223,6 @@ void Params::check() {
 
 int main(int argc, char* argv[]) {
   MPI_Init(&argc, &argv);
-	MPI_Status status;
-	MPI_Request request;
   /* initialize Madagascar */
   sf_init(argc,argv);
   Environment::setDatapath();
@@ -228,7 +244,6 @@ int main(int argc, char* argv[]) {
   int ns = params.ns;
   float dt = params.dt;
   float fm = params.fm;
-  int np = params.np;
   int rank = params.rank;
   int k = params.k;
   int ntask = params.ntask;
@@ -237,8 +252,12 @@ int main(int argc, char* argv[]) {
   ShotPosition allGeoPos(params.gzbeg, params.gxbeg, params.jgz, params.jgx, ng, nz);
   ForwardModeling fmMethod(allSrcPos, allGeoPos, dt, params.dx, params.fm, nb, nt, params.freeSurface);
 
-  Velocity exvel = fmMethod.expandDomain(SfVelocityReader::read(params.vinit, nx, nz));
-  Velocity exvel_real = fmMethod.expandDomain(SfVelocityReader::read(params.vreal, nx, nz));
+  /// each rank writes its gathers, rank 0 holds the header
+  ShotDataWriter rfWriter(MPI_COMM_WORLD, params.shots_rf, nt, ng, ns);
+  ShotDataWriter bgWriter(MPI_COMM_WORLD, params.shots_bg, nt, ng, ns);
+
+  Velocity exvel = fmMethod.expandDomain(SfVelocityReader::bcastRead(params.vinit, nx, nz));
+  Velocity exvel_real = fmMethod.expandDomain(SfVelocityReader::bcastRead(params.vreal, nx, nz));
 
 	nx = exvel.nx;
 	nz = exvel.nz;
@@ -282,7 +301,7 @@ int main(int argc, char* argv[]) {
 #define gradient_test
 #ifdef gradient_test
 	std::vector<float> exvel_m(nx * nz, 0);
-	vectorMinus(exvel_real.dat, exvel.dat, exvel_m);
+	std::transform(exvel_real.dat.begin(), exvel_real.dat.end(), exvel.dat.begin(), exvel_m.begin(), std::minus<float>());
 
   fmMethod.bindVelocity(exvel);
 
@@ -291,86 +310,27 @@ int main(int argc, char* argv[]) {
 
   std::vector<float> dobs(params.ntask * params.nt * params.ng, 0);
   std::vector<float> dobs_t(params.ntask * params.nt * params.ng, 0);
-  std::vector<float> fullwv(3 * nz * nx, 0);
-	// fullwv_t0: t - 1 timestep; fulllwv_t1: t timestep; fullwv_t2: t + 1 timestep
-	float *fullwv_t0, *fullwv_t1, *fullwv_t2;	
-	fullwv_t0 = &fullwv[0];
-	fullwv_t1 = &fullwv[nz * nx];
-	fullwv_t2 = &fullwv[2 * nz * nx];
   for(int is=rank*k; is<rank*k+ntask; is++) {
     int local_is = is - rank * k;
     Timer timer;
     std::vector<float> dobs_trans(params.nt * params.ng, 0);
     std::vector<float> dobs_trans_t(params.nt * params.ng, 0);
-		//fmMethod.BornForwardModeling(exvel_m, wlt, dobs_trans, is);
-    std::vector<float> p0(nz * nx, 0);
-    std::vector<float> p1(nz * nx, 0);
-    std::vector<float> rp0(nz * nx, 0);
-    std::vector<float> rp1(nz * nx, 0);
-    ShotPosition curSrcPos = allSrcPos.clipRange(is, is);
-
-    for(int it0 = 0 ; it0 < nt + 1 ; it0 ++) {
-      fmMethod.addSource(&p1[0], &wlt[it0], curSrcPos);
-      fmMethod.stepForward(p0,p1,0);
-      std::swap(p1, p0);
-			if(it0 < nt)
-				fmMethod.recordSeis(&dobs_trans_t[it0*ng], &p0[0]);
-
-			swap3(fullwv_t0, fullwv_t1, fullwv_t2);
-			std::copy(p0.begin(), p0.end(), fullwv_t2);
-
-			int it = it0 - 1;
-			if(it < 0)
-				continue;
-			fmMethod.addBornwv(fullwv_t0, fullwv_t1, fullwv_t2, &exvel_m[0], dt, it, &rp1[0]);
-      fmMethod.stepForward(rp0,rp1,1);
-      std::swap(rp1, rp0);
-      fmMethod.recordSeis(&dobs_trans[it*ng], &rp0[0]);
-    }
+    /// background and scattered fields in one fused step
+    fmMethod.BornForwardModeling(exvel_m, wlt, dobs_trans, is, &dobs_trans_t);
 
     matrix_transpose(&dobs_trans[0], &dobs[local_is * ng * nt], ng, nt);
-		if(np == 1) {
-			sf_floatwrite(&dobs[local_is * ng * nt], ng*nt, params.shots_rf);
-		}
-		else {
-			if(rank == 0) {
-				sf_floatwrite(&dobs[local_is * ng * nt], ng*nt, params.shots_rf);
-				if(is == rank * k + ntask - 1) {
-					for(int other_is = rank * k + ntask ; other_is < ns ; other_is ++) {
-						MPI_Recv(&dobs[0], ng*nt, MPI_FLOAT, other_is / k, other_is, MPI_COMM_WORLD, &status);
-						sf_floatwrite(&dobs[0], ng*nt, params.shots_rf);
-					}
-				}
-			}
-			else {
-				MPI_Isend(&dobs[local_is * ng * nt], ng*nt, MPI_FLOAT, 0, is, MPI_COMM_WORLD, &request);
-			}
-		}
+    rfWriter.write(is, &dobs[local_is * ng * nt]);
 
     matrix_transpose(&dobs_trans_t[0], &dobs_t[local_is * ng * nt], ng, nt);
-		if(np == 1) {
-			sf_floatwrite(&dobs_t[local_is * ng * nt], ng*nt, params.shots_bg);
-		}
-		else {
-			if(rank == 0) {
-				sf_floatwrite(&dobs_t[local_is * ng * nt], ng*nt, params.shots_bg);
-				if(is == rank * k + ntask - 1) {
-					for(int other_is = rank * k + ntask ; other_is < ns ; other_is ++) {
-						MPI_Recv(&dobs_t[0], ng*nt, MPI_FLOAT, other_is / k, other_is + OFFSET, MPI_COMM_WORLD, &status);
-						sf_floatwrite(&dobs_t[0], ng*nt, params.shots_bg);
-					}
-				}
-			}
-			else {
-				MPI_Isend(&dobs_t[local_is * ng * nt], ng*nt, MPI_FLOAT, 0, is + OFFSET, MPI_COMM_WORLD, &request);
-			}
-		}
+    bgWriter.write(is, &dobs_t[local_is * ng * nt]);
     INFO() << format("shot %d, elapsed time %fs") % is % timer.elapsed();
   }
 
   INFO() << format("total elapsed time %fs") % totalTimer.elapsed();
 #endif
 
+  rfWriter.close();
+  bgWriter.close();
   MPI_Finalize();
   return 0;
 }
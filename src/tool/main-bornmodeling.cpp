@@ -21,14 +21,18 @@ extern "C" {
 #include "sfutil.h"
 #include "timer.h"
 #include "environment.h"
+#include "param-bcast.h"
+#include "shotdata-writer.h"
 
 namespace {
 class Params {
 public:
   Params();
   ~Params();
+  void share(ParamBcast &pb);
 
 private:
+  void parse();
   Params(const Params &);
   void operator=(const Params &);
   void check();
@@ -67,7 +71,24 @@ public:
 };
 
 
-Params::Params() {
+/// rank 0 parses the parameters and creates the outputs, the others get the fields
+Params::Params() : vinit(NULL), vreal(NULL), shots(NULL), shotsborn(NULL) {
+  MPI_Comm_size(MPI_COMM_WORLD, &np);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  ParamBcast pb(MPI_COMM_WORLD);
+  if (pb.reader()) {
+    parse();
+  }
+  pb.sync(*this);
+
+  k = std::ceil(ns * 1.0 / np);
+  ntask = std::min(k, ns - rank*k);
+
+  check();
+}
+
+void Params::parse() {
   /*< set up I/O files >*/
   vinit=sf_input ("vinit");   /* initial velocity model, unit=m/s */
   vreal=sf_input ("vreal");   /* real velocity model, unit=m/s */
@@ -172,13 +193,11 @@ Params::Params() {
   sf_putfloat(shots, "vmax", vmax);
   sf_putfloat(shotsborn, "vmin", vmin);
   sf_putfloat(shotsborn, "vmax", vmax);
+}
 
-  MPI_Comm_size(MPI_COMM_WORLD, &np);
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-  k = std::ceil(ns * 1.0 / np);
-  ntask = std::min(k, ns - rank*k);
-
-  check();
+void Params::share(ParamBcast &pb) {
+  pb(nb)(nz)(nx)(dz)(dx)(nt)(ng)(ns)(dt)(amp)(fm);
+  pb(sxbeg)(szbeg)(gxbeg)(gzbeg)(jsx)(jsz)(jgx)(jgz)(freeSurface);
 }
 
 Params::~Params() {
@@ -202,8 +221,6 @@ void Params::check() {
 
 int main(int argc, char* argv[]) {
   MPI_Init(&argc, &argv);
-	MPI_Status status;
-	MPI_Request request;
   /* initialize Madagascar */
   sf_init(argc,argv);
   Environment::setDatapath();
@@ -227,7 +244,6 @@ int main(int argc, char* argv[]) {
   int ns = params.ns;
   float dt = params.dt;
   float fm = params.fm;
-  int np = params.np;
   int rank = params.rank;
   int k = params.k;
   int ntask = params.ntask;
@@ -236,8 +252,12 @@ int main(int argc, char* argv[]) {
   ShotPosition allGeoPos(params.gzbeg, params.gxbeg, params.jgz, params.jgx, ng, nz);
   ForwardModeling fmMethod(allSrcPos, allGeoPos, dt, params.dx, params.fm, nb, nt, params.freeSurface);
 
-  Velocity exvel = fmMethod.expandDomain(SfVelocityReader::read(params.vinit, nx, nz));
-  Velocity exvel_real = fmMethod.expandDomain(SfVelocityReader::read(params.vreal, nx, nz));
+  /// each rank writes its gathers, rank 0 holds the header
+  ShotDataWriter shotWriter(MPI_COMM_WORLD, params.shots, nt, ng, ns);
+  ShotDataWriter bornWriter(MPI_COMM_WORLD, params.shotsborn, nt, ng, ns);
+
+  Velocity exvel = fmMethod.expandDomain(SfVelocityReader::bcastRead(params.vinit, nx, nz));
+  Velocity exvel_real = fmMethod.expandDomain(SfVelocityReader::bcastRead(params.vreal, nx, nz));
   std::vector<float> bcoff(exvel.nz * exvel.nx, 0.0);
   //bcoff = fmMethod.getBornCoff();
   //bcoff = fmMethod.getBornCoff(exvel, exvel_real, params.dx, params.dt);
@@ -301,33 +321,15 @@ int main(int argc, char* argv[]) {
     matrix_transpose(&dobs_trans_born[0], &dobs_born[local_is * ng * nt], ng, nt);
 
 		//fmMethod.fwiRemoveDirectArrival(&dobs[local_is * ng * nt], local_is);
-		if(np == 1) {
-			sf_floatwrite(&dobs[local_is * ng * nt], ng*nt, params.shots);
-			sf_floatwrite(&dobs_born[local_is * ng * nt], ng*nt, params.shotsborn);
-		}
-		else {
-			if(rank == 0) {
-				sf_floatwrite(&dobs[local_is * ng * nt], ng*nt, params.shots);
-				sf_floatwrite(&dobs_born[local_is * ng * nt], ng*nt, params.shotsborn);
-				if(is == rank * k + ntask - 1) {
-					for(int other_is = rank * k + ntask ; other_is < ns ; other_is ++) {
-						MPI_Recv(&dobs[0], ng*nt, MPI_FLOAT, other_is / k, other_is, MPI_COMM_WORLD, &status);
-						sf_floatwrite(&dobs[0], ng*nt, params.shots);
-						MPI_Recv(&dobs_born[0], ng*nt, MPI_FLOAT, other_is / k, other_is, MPI_COMM_WORLD, &status);
-						sf_floatwrite(&dobs_born[0], ng*nt, params.shotsborn);
-					}
-				}
-			}
-			else {
-				MPI_Isend(&dobs[local_is * ng * nt], ng*nt, MPI_FLOAT, 0, is, MPI_COMM_WORLD, &request);
-				MPI_Isend(&dobs_born[local_is * ng * nt], ng*nt, MPI_FLOAT, 0, is, MPI_COMM_WORLD, &request);
-			}
-		}
+    shotWriter.write(is, &dobs[local_is * ng * nt]);
+    bornWriter.write(is, &dobs_born[local_is * ng * nt]);
     INFO() << format("shot %d, elapsed time %fs") % is % timer.elapsed();
   }
 
   INFO() << format("total elapsed time %fs") % totalTimer.elapsed();
 
+  shotWriter.close();
+  bornWriter.close();
   MPI_Finalize();
   return 0;
 }
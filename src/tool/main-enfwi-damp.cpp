@@ -23,6 +23,7 @@ extern "C" {
 #include "sf-velocity-reader.h"
 #include "ricker-wavelet.h"
 #include "essfwiframework.h"
+#include "essfwi-batch.h"
 #include "shotdata-reader.h"
 #include "sfutil.h"
 #include "sum.h"
@@ -30,16 +31,26 @@ extern "C" {
 #include "updatevelop.h"
 #include "updatesteplenop.h"
 #include "enkfanalyze.h"
+#include "enkf-async.h"
 #include "common.h"
 #include "environment.h"
 #include "random-code.h"
 #include "encoder.h"
+#include "checkpoint.h"
+#include "param-bcast.h"
+#include "async-writer.h"
+#include "ensemble.h"
+#include "velocity-perturb.h"
+#include "shotdata-writer.h"
+#include "domain-decomp.h"
 
 namespace {
 class Params {
 public:
   Params();
   ~Params();
+  void parse();
+  void share(ParamBcast &pb);
   void check();
 
 public:
@@ -49,6 +60,7 @@ public:
   sf_file vupdates;     /* updated velocity in iterations */
   sf_file absobjs;         /* absolute values of objective function in iterations */
   sf_file norobjs;         /* normalize values of objective function in iterations */
+  sf_file perout;       /* the generated perturbations, NULL: not written */
   int niter;            /* # of iterations */
   int nb;               /* size of the boundary */
   float vmin;
@@ -59,7 +71,19 @@ public:
   int nsample;
   int niterenkf;
   float sigfac;
-  char *perin;
+  const char *perin;    /* perturbation file, NULL: generated in process */
+  float maxper;         /* max absolute value of the generated perturbations */
+  int perseed;          /* seed of the generated perturbations */
+  int dumpper;          /* 1: the generated perturbations to perout */
+  const char *restart;  /* checkpoint prefix to resume from, NULL: start anew */
+  const char *ckpt;     /* prefix of the checkpoints */
+  int ckptevery;        /* iterations between checkpoints, 0: none */
+  int nbatch;           /* members of a rank modeled together, 0: all */
+  int svdrank;          /* singular triplets kept by the enkf analysis, 0: full svd */
+  int svdpower;         /* power iterations of the randomized svd */
+  int enkffloat;        /* 1: the ensemble update in single precision */
+  int objsub;           /* ranks modeling the mean model together, 1: rank 0 alone */
+  int enkfasync;        /* 1: the enkf analysis overlapped with the next fwi iteration */
 
 public: // parameters from input files
   int nz;
@@ -89,7 +113,24 @@ public:
   int ntask; /// exactly the # of task each process owns
 };
 
-Params::Params() {
+/// rank 0 parses the parameters and creates the outputs, the others get the fields
+Params::Params() : vinit(NULL), vreal(NULL), shots(NULL), vupdates(NULL), absobjs(NULL), norobjs(NULL), perout(NULL) {
+  MPI_Comm_size(MPI_COMM_WORLD, &np);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  ParamBcast pb(MPI_COMM_WORLD);
+  if (pb.reader()) {
+    parse();
+  }
+  pb.sync(*this);
+
+  k = std::ceil(nsample * 1.0 / np);
+  ntask = std::min(k, nsample - rank*k);
+
+  check();
+}
+
+void Params::parse() {
   vinit = sf_input ("vin");       /* initial velocity model, unit=m/s */
   vreal	= sf_input ("vreal");       /* real	velocity model, unit=m/s */
   shots = sf_input("shots");      /* recorded shots from exact velocity model */
@@ -102,9 +143,21 @@ Params::Params() {
   if (!sf_getint("nita", &nita))   { sf_error("no nita"); }       /* max iter refining alpha */
   if (!sf_getint("nsample", &nsample)){ sf_error("no nsample"); } /* # of samples for enkf */
   if (!sf_getint("niterenkf", &niterenkf)){ sf_error("no niterenkf"); } /* # of iteration between two enkf analyze */
-  if (!(perin = sf_getstring("perin"))) { sf_error("no perin"); } /* perturbation file */
+  perin = sf_getstring("perin");                                /* perturbation file of the nsample members, nz * nx each, without it they are generated in process */
+  if (!sf_getfloat("maxper", &maxper)) { maxper = 0; }          /* max absolute value of the generated perturbations, m/s */
+  if (!sf_getint("perseed", &perseed)) { perseed = 1; }         /* seed of the generated perturbations, member i depends only on perseed and i */
+  if (!sf_getint("dumpper", &dumpper)) { dumpper = 0; }         /* 1: the generated perturbations to perout, nz * nx * nsample */
   if (!sf_getint("seed", &seed))   { seed = 10; }                 /* seed for random numbers */
   if (!sf_getfloat("sigfac", &sigfac))   { sf_error("no sigfac"); } /* sigma factor */
+  restart = sf_getstring("restart");                            /* resume from the checkpoints of this prefix */
+  if (!(ckpt = sf_getstring("ckpt"))) { ckpt = restart ? restart : "enfwi-damp.ckpt"; } /* prefix of the checkpoints, <prefix>-<rank>.<0|1> */
+  if (!sf_getint("ckptevery", &ckptevery)) { ckptevery = 0; }   /* iterations between checkpoints, 0: none */
+  if (!sf_getint("nbatch", &nbatch)) { nbatch = 0; }            /* members of a rank modeled together, 0: all of them, 1: one by one */
+  if (!sf_getint("svdrank", &svdrank)) { svdrank = 0; }         /* singular triplets kept by the enkf analysis from a randomized svd, 0: full svd */
+  if (!sf_getint("svdpower", &svdpower)) { svdpower = 2; }      /* power iterations of the randomized svd, more are more accurate */
+  if (!sf_getint("enkffloat", &enkffloat)) { enkffloat = 0; }   /* 1: the members are updated by the gain in single precision, 0: double */
+  if (!sf_getint("objsub", &objsub)) { objsub = 0; }            /* the objective of the mean model on objsub subdomains, the ranks in groups of objsub, 0: all the ranks, 1: rank 0 alone */
+  if (!sf_getint("enkfasync", &enkfasync)) { enkfasync = 0; }   /* 1: the enkf analysis runs on a thread during the next fwi iteration and its correction is added after it, 0: the fwi waits for it */
 
   /* get parameters from velocity model and recorded shots */
   if (!sf_histint(vinit, "n1", &nz)) { sf_error("no n1"); }       /* nz */
@@ -156,12 +209,26 @@ Params::Params() {
   sf_putfloat(norobjs, "o1", 1);
   sf_putstring(norobjs, "label1", "Normalize");
 
-  MPI_Comm_size(MPI_COMM_WORLD, &np);
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-  k = std::ceil(nsample * 1.0 / np);
-  ntask = std::min(k, nsample - rank*k);
+  if (!perin && dumpper) {
+    perout = sf_output("perout");
+    sf_putint(perout,   "n1", nz);
+    sf_putint(perout,   "n2", nx);
+    sf_putint(perout,   "n3", nsample);
+    sf_putfloat(perout, "d1", dz);
+    sf_putfloat(perout, "d2", dx);
+    sf_putint(perout,   "d3", 1);
+    sf_putint(perout,   "o1", 0);
+    sf_putint(perout,   "o2", 0);
+    sf_putint(perout,   "o3", 0);
+    sf_putstring(perout, "label3", "Member");
+  }
+}
 
-  check();
+void Params::share(ParamBcast &pb) {
+  pb(niter)(nb)(vmin)(vmax)(maxdv)(nita)(seed)(nsample)(niterenkf)(sigfac)(perin)(maxper)(perseed)(dumpper);
+  pb(restart)(ckpt)(ckptevery)(nbatch)(svdrank)(svdpower)(enkffloat)(objsub)(enkfasync);
+  pb(nz)(nx)(dz)(dx)(nt)(ng)(ns)(dt)(amp)(fm);
+  pb(sxbeg)(szbeg)(gxbeg)(gzbeg)(jsx)(jsz)(jgx)(jgz)(freeSurface);
 }
 
 Params::~Params() {
@@ -169,6 +236,40 @@ Params::~Params() {
 }
 
 void Params::check() {
+  if (ckptevery < 0) {
+    sf_warning("invalid ckptevery %d\n", ckptevery);
+    exit(1);
+  }
+
+  if (nbatch < 0) {
+    sf_warning("invalid nbatch %d\n", nbatch);
+    exit(1);
+  }
+
+  if (svdrank < 0 || svdpower < 0) {
+    sf_warning("invalid svdrank %d or svdpower %d\n", svdrank, svdpower);
+    exit(1);
+  }
+
+  /// the EnKF analysis gathers the same number of members from every rank
+  if (nsample % np != 0) {
+    sf_warning("nsample %d is not a multiple of the %d ranks\n", nsample, np);
+    exit(1);
+  }
+
+  if (objsub == 0) {
+    objsub = np;
+  }
+  if (objsub < 1 || np % objsub != 0) {
+    sf_warning("objsub %d does not divide the %d ranks\n", objsub, np);
+    exit(1);
+  }
+
+  if (!perin && maxper <= 0) {
+    sf_warning("no perin, maxper must be > 0 to generate the perturbations\n");
+    exit(1);
+  }
+
   if (!(sxbeg >= 0 && szbeg >= 0 && sxbeg + (ns - 1)*jsx < nx && szbeg + (ns - 1)*jsz < nz)) {
     sf_warning("sources exceeds the computing zone!\n");
     exit(1);
@@ -194,7 +295,7 @@ std::vector<Velocity *> createVelDB(const Velocity &vel, const char *perin, int
   }
 
   std::vector<float> tmp(modelSize);
-  std::vector<float> velOrig = vel.dat;
+  std::vector<float> velOrig = vel.dat.toVector();
   std::transform(velOrig.begin(), velOrig.end(), velOrig.begin(), boost::bind(velRecover<float>, _1, dx, dt));
 
   for (int iv = 0; iv < N; iv++) {
@@ -210,55 +311,90 @@ std::vector<Velocity *> createVelDB(const Velocity &vel, const char *perin, int
   return veldb;
 }
 
-std::vector<Velocity *> pCreateVelDB(const Velocity &vel, const char *perin, int N, float dx, float dt, int rank, int size) {
-  std::vector<Velocity *> veldb(N);   /// here is all the velocity samples resides, others are pointer to this
+/// pads the nz * nx perturbations of the members into the ensemble as expandDomain pads the velocity
+void padPerturb(Ensemble &ens, const ForwardModeling &fmMethod, std::vector<float> &per, int nx, int nz) {
+  int modelSize = ens.modelSize();
+
+  for (int iv = 0; iv < ens.size(); iv++) {
+    Velocity expert = fmMethod.expandDomain_notrans(Velocity(&per[(size_t)iv * nx * nz], nx, nz));
+    std::copy(&expert.dat[0], &expert.dat[0] + modelSize, ens.member(iv));
+  }
+}
+
+/**
+ * the perturbations of the members of this process read in one piece, perin
+ * holds nz * nx samples per member as perout and genVelPerturb.m write them
+ */
+void pReadPerturb(Ensemble &ens, const ForwardModeling &fmMethod, const Params &params, int first) {
+  int nx = params.nx;
+  int nz = params.nz;
+  int N = ens.size();
+  std::vector<float> per((size_t)N * nx * nz);
 
-  int modelSize = vel.nx * vel.nz;
 	MPI_File fh;
-	MPI_Offset file_size, offset;
-	MPI_Comm_size(MPI_COMM_WORLD, &size);
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-	MPI_File_open(MPI_COMM_WORLD, perin, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+	MPI_Offset offset;
+	int err = MPI_File_open(MPI_COMM_WORLD, params.perin, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
 	MPI_Status status;
-	offset = modelSize * sizeof(float) * N * rank;
+	offset = (MPI_Offset)nx * nz * sizeof(float) * first;
 
-  TRACE() << "parallel: add perturbation to initial velocity";
-  if (!fh) {
-    ERROR() << "cannot open file: " << perin;
+  if (err != MPI_SUCCESS) {
+    ERROR() << "cannot open file: " << params.perin;
     exit(EXIT_FAILURE);
   }
 
-  std::vector<float> tmp(modelSize);
-  std::vector<float> velOrig = vel.dat;
-  std::transform(velOrig.begin(), velOrig.end(), velOrig.begin(), boost::bind(velRecover<float>, _1, dx, dt));
+	MPI_File_read_at(fh, offset, &per[0], N * nx * nz, MPI_FLOAT, &status);
+	MPI_File_close(&fh);
 
-	int readSize = modelSize;
+  padPerturb(ens, fmMethod, per, nx, nz);
+}
 
-	printf("%d %d %d\n", modelSize, readSize, offset);
+/**
+ * each process generates the perturbations of its own members on the model
+ * grid, writes them to perout if it is given and pads them into the members
+ */
+void pGenPerturb(Ensemble &ens, const ForwardModeling &fmMethod, const Params &params, int first) {
+  int nx = params.nx;
+  int nz = params.nz;
+  int N = ens.size();
+  std::vector<float> per((size_t)N * nx * nz);
 
+  TRACE() << format("generate the perturbations of the members %d to %d") % first % (first + N - 1);
+#pragma omp parallel for schedule(dynamic)
   for (int iv = 0; iv < N; iv++) {
-    std::vector<float> ret(modelSize);
-		MPI_File_seek(fh, offset, MPI_SEEK_SET);
-		offset += readSize * sizeof(float);
-		MPI_File_read(fh, &tmp[0], readSize, MPI_FLOAT, &status);
-    std::transform(tmp.begin(), tmp.end(), velOrig.begin(), ret.begin(), std::plus<float>());
-    std::transform(ret.begin(), ret.end(), ret.begin(), boost::bind(velTrans<float>, _1, dx, dt));
-    veldb[iv] = new Velocity(ret, vel.nx, vel.nz);
-
+    genVelPerturb(&per[(size_t)iv * nx * nz], nx, nz, params.maxper, params.perseed, first + iv);
   }
 
-	MPI_File_close(&fh);
+  if (params.dumpper) {
+    ShotDataWriter writer(MPI_COMM_WORLD, params.perout, nz, nx, params.nsample);
+    for (int iv = 0; iv < N; iv++) {
+      writer.write(first + iv, &per[(size_t)iv * nx * nz]);
+    }
+  }
 
-  return veldb;
+  padPerturb(ens, fmMethod, per, nx, nz);
 }
 
-std::vector<float *> generateVelSet(std::vector<Velocity *> &veldb) {
-  std::vector<float *> velSet(veldb.size());
-  for (size_t iv = 0; iv < veldb.size(); iv++) {
-    velSet[iv] = &veldb[iv]->dat[0];
+/// the members of this process, the initial velocity plus their perturbations
+void pCreateEnsemble(Ensemble &ens, const ForwardModeling &fmMethod, const Velocity &vel, const Params &params, float dx, float dt) {
+  int N = ens.size();
+  int modelSize = vel.nx * vel.nz;
+  int first = params.rank * params.k;   /// the global index of the first member of this process
+
+  TRACE() << "parallel: add perturbation to initial velocity";
+  if (params.perin) {
+    pReadPerturb(ens, fmMethod, params, first);
+  } else {
+    pGenPerturb(ens, fmMethod, params, first);
   }
 
-  return velSet;
+  std::vector<float> velOrig = vel.dat.toVector();
+  std::transform(velOrig.begin(), velOrig.end(), velOrig.begin(), boost::bind(velRecover<float>, _1, dx, dt));
+
+  for (int iv = 0; iv < N; iv++) {
+    float *p = ens.member(iv);
+    std::transform(p, p + modelSize, velOrig.begin(), p, std::plus<float>());
+    std::transform(p, p + modelSize, p, boost::bind(velTrans<float>, _1, dx, dt));
+  }
 }
 
 float calobj(const ForwardModeling &fmMethod, const std::vector<float> wlt,
@@ -284,6 +420,41 @@ float calobj(const ForwardModeling &fmMethod, const std::vector<float> wlt,
   return obj;
 }
 
+/**
+ * the objective of the mean model, on rank 0. With a decomposition every
+ * rank models its subdomain of the supershot, without it rank 0 models the
+ * whole grid and the others go on
+ */
+void meanObjective(ForwardModeling &meanfm, const std::vector<float> &mean, const std::vector<float> &wlt,
+    std::vector<float> &dobs, int ns, int ng, int nt, int rank, std::vector<float> &absobj, std::vector<float> &norobj) {
+  if (meanfm.getDecomposition() == NULL && rank != 0) {
+    return;
+  }
+
+  Velocity newvel(mean, meanfm.getnx(), meanfm.getnz());
+  meanfm.bindVelocity(newvel);
+  float obj = calobj(meanfm, wlt, dobs, ns, ng, nt);
+  if (rank == 0) {
+    INFO() << format("objval for mean model %e") % obj;
+    absobj.push_back(obj);
+    norobj.push_back(obj / absobj[0]);
+  }
+}
+
+/// the mean of the members of an iteration to vupdates, and its objective
+void recordMean(const EnkfAnalyze &enkfAnly, const std::vector<float *> &members, const ForwardModeling &fmMethod,
+    AsyncWriter &writer, const Params &params, ForwardModeling &meanfm, const std::vector<float> &wlt,
+    std::vector<float> &dobs, std::vector<float> &absobj, std::vector<float> &norobj) {
+  std::vector<float> vvt = enkfAnly.pCreateAMean(members, params.nsample);
+  if (params.rank == 0) {
+    std::vector<float> vout = fmMethod.outputVel(vvt);
+    writer.write(params.vupdates, vout);
+  }
+
+  /// calculate the objective function for the updated velocity
+  meanObjective(meanfm, vvt, wlt, dobs, params.ns, params.ng, params.nt, params.rank, absobj, norobj);
+}
+
 void scatterVelocity(std::vector<Velocity *> &veldb, const std::vector<Velocity *> &totalveldb, const Params &params) {
   int N = params.nsample;
   int rank = params.rank;
@@ -367,6 +538,36 @@ void gatherVelocity(std::vector<Velocity *> &totalveldb, const std::vector<Veloc
    }
 }
 
+/**
+ * the state of the ensemble members of this rank, their FWI, the
+ * regularization weights and the EnKF. The objectives are on rank 0 only
+ */
+void saveEnsemble(CheckpointData &state, const std::vector<EssFwiFramework *> &essfwis,
+    const Matrix &lambdaSet, const Matrix &ratioSet, const EnkfAnalyze &enkfAnly,
+    const std::vector<float> &absobj, const std::vector<float> &norobj) {
+  for (size_t i = 0; i < essfwis.size(); i++) {
+    essfwis[i]->saveState(state, "essfwi" + boost::lexical_cast<std::string>(i));
+  }
+  state.put("lambdaSet", lambdaSet.getData(), lambdaSet.size() * sizeof(Matrix::value_type));
+  state.put("ratioSet", ratioSet.getData(), ratioSet.size() * sizeof(Matrix::value_type));
+  enkfAnly.saveState(state, "enkf");
+  state.put("absobj", absobj);
+  state.put("norobj", norobj);
+}
+
+void loadEnsemble(const CheckpointData &state, std::vector<EssFwiFramework *> &essfwis,
+    Matrix &lambdaSet, Matrix &ratioSet, EnkfAnalyze &enkfAnly,
+    std::vector<float> &absobj, std::vector<float> &norobj) {
+  for (size_t i = 0; i < essfwis.size(); i++) {
+    essfwis[i]->loadState(state, "essfwi" + boost::lexical_cast<std::string>(i));
+  }
+  state.get("lambdaSet", lambdaSet.getData(), lambdaSet.size() * sizeof(Matrix::value_type));
+  state.get("ratioSet", ratioSet.getData(), ratioSet.size() * sizeof(Matrix::value_type));
+  enkfAnly.loadState(state, "enkf");
+  state.get("absobj", absobj);
+  state.get("norobj", norobj);
+}
+
 void slownessL1L2Norm(const float *accurate2, const float *curr, const Params &params, float &l1norm, float &l2norm) {
 	int bz = params.nb;
 	int bx = bz;
@@ -406,17 +607,23 @@ void slownessL1L2Norm(const float *accurate2, const float *curr, const Params &p
 
 
 int main(int argc, char *argv[]) {
-  MPI_Init(&argc, &argv);
+  int provided = MPI_THREAD_SINGLE;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
   sf_init(argc, argv); /* initialize Madagascar */
   Environment::setDatapath();
 
   Params params;
+  AsyncWriter writer;   /// the mean model of each iteration
   /// configure logger
   std::string logfile = std::string("enfwi-damp-") + boost::lexical_cast<std::string>(params.rank) + ".log";
   FILELog::setLogFile(logfile);
 #ifndef USE_SW
 	printGitInfo();
 #endif
+  if (params.enkfasync && provided < MPI_THREAD_MULTIPLE) {
+    WARNING() << "no MPI_THREAD_MULTIPLE, the enkf analysis runs synchronously";
+    params.enkfasync = 0;
+  }
 
   int nz = params.nz;
   int nx = params.nx;
@@ -470,14 +677,15 @@ int main(int argc, char *argv[]) {
 	printf("1.2\n");
 
   //std::vector<Velocity *> totalveldb;  /// only for rank 0
-  std::vector<Velocity *> veldb(ntask); /// each process owns # of velocity
+  Ensemble ens(ntask, exvel.nx, exvel.nz); /// each process owns # of velocity, the FWI and the EnKF update them in place
 
 
 	int size;
 	MPI_Comm_size(MPI_COMM_WORLD, &size);
   //std::vector<Velocity *> veldb2(ntask); /// each process owns # of velocity
 	printf("2\n");
-	veldb = pCreateVelDB(exvel, params.perin, veldb.size(), dx, dt, rank, size);
+	pCreateEnsemble(ens, fmMethod, exvel, params, dx, dt);
+  std::vector<Velocity *> veldb = ens.velocities();
 	printf("3\n");
   //EnkfAnalyze enkfAnly2(fmMethod, wlt, dobs, sigfac);
 
@@ -494,10 +702,8 @@ int main(int argc, char *argv[]) {
   }
 	*/
 
-  /// it is a bad implementation. one process send each velocity to all other processes
-  /// if the number of samples become large, it would be the bottleneck.
-  /// TODO: refactor the Velocity class. keep the real data of all velocity in ONE array and
-  /// each Velocity has a pointer that points to the correct location.
+  /// the velocities of the rank are views of ONE array in ens, the EnKF
+  /// analysis updates them in place.
 
   //TODO: need modifying, delete scatter and gather, make processes reading files in parallel
   //scatterVelocity(veldb, totalveldb, params);
@@ -523,13 +729,25 @@ int main(int argc, char *argv[]) {
     essfwis[i] = new EssFwiFramework(*fms[i], *usl[i], updatevelop, wlt, dobs);
   }
 
+  EssFwiBatch batch(fms, essfwis, params.nbatch);
+
   EnkfAnalyze enkfAnly(fmMethod, wlt, dobs, sigfac);
 
+  /// the mean model is modeled on the subdomains of the ranks instead of by rank 0 alone
+  ForwardModeling meanfm(fmMethod);
+  DomainDecomp *decomp = NULL;
+  if (params.objsub > 1) {
+    decomp = new DomainDecomp(MPI_COMM_WORLD, params.objsub, exvel.nx, exvel.nz);
+    meanfm.setDecomposition(decomp);
+  }
+  enkfAnly.setLowRankSvd(params.svdrank, params.svdpower);
+  enkfAnly.setSinglePrecision(params.enkffloat);
+
 
   /// collect all the data from other process to rank 0
   //gatherVelocity(totalveldb, veldb, params);
 
-  std::vector<float *> velset = generateVelSet(veldb);
+  std::vector<float *> velset = ens.members();
   //std::vector<float *> totalVelSet;
 
 	/*
@@ -538,7 +756,7 @@ int main(int argc, char *argv[]) {
   }
 	*/
 
-  //enkfAnly.analyze(totalVelSet, velset);
+  //enkfAnly.analyze(velset);
 
   /// for regulalization
   float initLambdaRatio = 0.5;
@@ -546,48 +764,66 @@ int main(int argc, char *argv[]) {
   Matrix ratioSet(local_n, 2);  /// 0 for muX, 1 for muZ
   Matrix lambdaSet(local_n, 2); /// 0 for lambdaX, 1 for lambdaZ
   std::fill(ratioSet.getData(), ratioSet.getData() + ratioSet.size(), initLambdaRatio);
-  enkfAnly.initLambdaSet(velset, lambdaSet, ratioSet);
-  enkfAnly.pAnalyze(velset, lambdaSet, ratioSet);
 
+  /// the analysis talks on a communicator of its own while the FWI goes on with the world
+  MPI_Comm enkfComm = MPI_COMM_NULL;
+  if (params.enkfasync) {
+    MPI_Comm_dup(MPI_COMM_WORLD, &enkfComm);
+    enkfAnly.setComm(enkfComm);
+  }
+  AsyncEnkf asyncEnkf(enkfAnly, ens, lambdaSet, ratioSet, exvel.nx, exvel.nz, dx, dt);
+
+  /// a restart takes the members, the weights and the EnKF of the checkpoint
+  Checkpoint ckpt(MPI_COMM_WORLD, params.ckpt, params.ckptevery);
+  int iter0 = 0;
+  if (params.restart) {
+    CheckpointData state;
+    iter0 = ckpt.restore(params.restart, state);
+    loadEnsemble(state, essfwis, lambdaSet, ratioSet, enkfAnly, absobj, norobj);
+    asyncEnkf.loadState(state, "asyncenkf");
+
+    /// the outputs of an analysis the checkpoint kept come after its correction
+    int pending = asyncEnkf.running() ? 1 : 0;
+    if (rank == 0) {
+      sf_putint(params.vupdates, "n3", params.niter - iter0 + pending);
+      sf_putint(params.vupdates, "o3", iter0 - pending);
+    }
+  } else {
+    enkfAnly.initLambdaSet(velset, lambdaSet, ratioSet);
+    enkfAnly.pAnalyze(ens, lambdaSet, ratioSet);
 
-//  enkfAnly.pAnalyze(velset);
-
+    //enkfAnly.pAnalyze(velset);
 
-  //TODO: need modifying, createAMean
-	std::vector<float> vvt = enkfAnly.pCreateAMean(velset, N);
+    //TODO: need modifying, createAMean
+    std::vector<float> vvt = enkfAnly.pCreateAMean(velset, N);
 
-  if (rank == 0) {
     /// calculate objective function
-
-    //std::vector<float> vv = enkfAnly.createAMean(totalVelSet);
-    std::vector<float> vv = vvt;
-		//enkfAnly.check(vvt, vv);
-		//exit(1);
-    Velocity newvel(vv, fmMethod.getnx(), fmMethod.getnz());
-    fmMethod.bindVelocity(newvel);
-    float obj = calobj(fmMethod, wlt, dobs, ns, ng, nt);
-    absobj.push_back(obj);
-    norobj.push_back(obj / absobj[0]);
+    meanObjective(meanfm, vvt, wlt, dobs, ns, ng, nt, rank, absobj, norobj);
   }
 
   /// after enkf, we should scatter velocities
   //scatterVelocity(veldb, totalveldb, params);
 
-
-
-
   srand(params.seed + params.rank);
   TRACE() << "iterate the remaining iteration";
-  for (int iter = 0; iter < params.niter; iter++) {
+  for (int iter = iter0; iter < params.niter; iter++) {
     TRACE() << "FWI for each velocity";
     DEBUG() << "\n\n\n\n\n\n\n";
 
+    std::vector<float> lambdaX(essfwis.size());
+    std::vector<float> lambdaZ(essfwis.size());
     for (size_t ivel = 0; ivel < essfwis.size(); ivel++)		{
       int absvel = rank * k + ivel + 1;
       INFO() << format("iter %d, rank %d on %dth velocity, sum %f") % iter % rank % absvel % sum(veldb[ivel]->dat);
-      double lambdaX = lambdaSet.getData()[ivel * lambdaSet.getNumRow()];
-      double lambdaZ = lambdaSet.getData()[ivel * lambdaSet.getNumRow() + 1];
-      essfwis[ivel]->epoch(iter, lambdaX, lambdaZ);
+      lambdaX[ivel] = lambdaSet.getData()[ivel * lambdaSet.getNumRow()];
+      lambdaZ[ivel] = lambdaSet.getData()[ivel * lambdaSet.getNumRow() + 1];
+    }
+    batch.epoch(iter, lambdaX, lambdaZ);
+
+    /// the analysis started after the previous iteration, its outputs are the ones of the analyzed members
+    if (asyncEnkf.running()) {
+      asyncEnkf.finish();
+      recordMean(enkfAnly, asyncEnkf.analyzed(), fmMethod, writer, params, meanfm, wlt, dobs, absobj, norobj);
     }
 
     TRACE() << "enkf analyze and update velocity";
@@ -603,31 +839,33 @@ int main(int argc, char *argv[]) {
 				INFO() << format("%4d/%d iter, velset[%d/%d] slowness l1norm: %g, slowness l2norm: %g") % iter % params.niter % absvel % N % l1norm % l2norm;
 			}
 
-      //enkfAnly.analyze(totalVelSet, velset);
-			enkfAnly.pAnalyze(velset, lambdaSet, ratioSet);
+      //enkfAnly.analyze(velset);
+      if (params.enkfasync) {
+        asyncEnkf.start();
+      } else {
+        enkfAnly.pAnalyze(ens, lambdaSet, ratioSet);
+      }
 
     }
 
-		std::vector<float> vvt = enkfAnly.pCreateAMean(velset, N);
-    if (rank == 0) {
-      /// output velocity
-      //std::vector<float> vv = enkfAnly.createAMean(totalVelSet);
-      std::vector<float> vv = vvt;
-
-      fmMethod.sfWriteVel(vv, params.vupdates);
-
-      /// calculate the objective function for the updated velocity
-      Velocity newvel(vv, fmMethod.getnx(), fmMethod.getnz());
-      fmMethod.bindVelocity(newvel);
-
-      float obj = calobj(fmMethod, wlt, dobs, ns, ng, nt);
-      INFO() << format("iter %d, objval for meam model %e") % iter % obj;
-
-      absobj.push_back(obj);
-      norobj.push_back(obj / absobj[0]);
+    /// an analysis on its thread records the mean once it is done
+    if (!asyncEnkf.running()) {
+      recordMean(enkfAnly, velset, fmMethod, writer, params, meanfm, wlt, dobs, absobj, norobj);
     }
     //scatterVelocity(veldb, totalveldb, params);
+
+    if (ckpt.due(iter + 1)) {
+      CheckpointData state;
+      asyncEnkf.saveState(state, "asyncenkf");
+      saveEnsemble(state, essfwis, lambdaSet, ratioSet, enkfAnly, absobj, norobj);
+      ckpt.save(iter + 1, state);
+    }
+  }
+  if (asyncEnkf.running()) {
+    asyncEnkf.finish();
+    recordMean(enkfAnly, asyncEnkf.analyzed(), fmMethod, writer, params, meanfm, wlt, dobs, absobj, norobj);
   }
+  ckpt.wait();
 
   /// write objective function values
   if (rank == 0) {
@@ -644,11 +882,14 @@ int main(int argc, char *argv[]) {
   }
 	*/
   for (int i = 0; i < ntask; i++) {
-    delete veldb[i];
     delete fms[i];
     delete usl[i];
     delete essfwis[i];
   }
+  delete decomp;
+  if (enkfComm != MPI_COMM_NULL) {
+    MPI_Comm_free(&enkfComm);
+  }
 
 
   MPI_Finalize();
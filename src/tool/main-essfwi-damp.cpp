@@ -21,6 +21,7 @@ extern "C" {
 #include "shotdata-reader.h"
 #include "updatevelop.h"
 #include "environment.h"
+#include "checkpoint.h"
 
 namespace {
 class Params {
@@ -43,6 +44,9 @@ public:
   float maxdv;
   int nita;
   int seed;
+  const char *restart;  /* checkpoint prefix to resume from, NULL: start anew */
+  const char *ckpt;     /* prefix of the checkpoints */
+  int ckptevery;        /* iterations between checkpoints, 0: none */
 
 public: // parameters from input files
   int nz;
@@ -82,6 +86,9 @@ Params::Params() {
   if (!sf_getint("seed", &seed))   { seed = 10; }                 /* seed for random numbers */
   if (!sf_getint("flo", &flo))   { flo = -1; }                 /* low frequency in bandpass */
   if (!sf_getint("fhi", &fhi))   { fhi = -1; }                 /* high frequency in bandpass */
+  restart = sf_getstring("restart");                            /* resume from the checkpoints of this prefix */
+  if (!(ckpt = sf_getstring("ckpt"))) { ckpt = restart ? restart : "essfwi-damp.ckpt"; } /* prefix of the checkpoints, <prefix>-0.<0|1> */
+  if (!sf_getint("ckptevery", &ckptevery)) { ckptevery = 0; }   /* iterations between checkpoints, 0: none */
 
   /* get parameters from velocity model and recorded shots */
   if (!sf_histint(vinit, "n1", &nz)) { sf_error("no n1"); }       /* nz */
@@ -138,6 +145,11 @@ Params::~Params() {
 }
 
 void Params::check() {
+  if (ckptevery < 0) {
+    sf_warning("invalid ckptevery %d\n", ckptevery);
+    exit(1);
+  }
+
   if (!(sxbeg >= 0 && szbeg >= 0 && sxbeg + (ns - 1)*jsx < nx && szbeg + (ns - 1)*jsz < nz)) {
     sf_warning("sources exceeds the computing zone!\n");
     exit(1);
@@ -228,8 +240,22 @@ int main(int argc, char *argv[]) {
   std::vector<float> absobj;
   std::vector<float> norobj;
   float obj_desc = 0.0;
+
+  /// a single process, the checkpoints need no communicator
+  Checkpoint ckpt(MPI_COMM_NULL, params.ckpt, params.ckptevery);
+  int iter0 = 0;
+  if (params.restart) {
+    CheckpointData state;
+    iter0 = ckpt.restore(params.restart, state);
+    essfwi.loadState(state, "essfwi");
+    state.get("absobj", absobj);
+    state.get("norobj", norobj);
+    sf_putint(params.vupdates, "n3", params.niter - iter0);
+    sf_putint(params.vupdates, "o3", iter0 + 1);
+  }
+
   FILE *f = fopen("iters.txt", "w");
-  for (int iter = 0; iter < params.niter ; iter++) {
+  for (int iter = iter0; iter < params.niter ; iter++) {
     essfwi.epoch(iter, 0, 0, fhi);
     essfwi.writeVel(params.vupdates);
     float obj = essfwi.getUpdateObj();
@@ -240,6 +266,14 @@ int main(int argc, char *argv[]) {
     }
     absobj.push_back(obj);
     norobj.push_back(obj / absobj[0]);
+
+    if (ckpt.due(iter + 1)) {
+      CheckpointData state;
+      essfwi.saveState(state, "essfwi");
+      state.put("absobj", absobj);
+      state.put("norobj", norobj);
+      ckpt.save(iter + 1, state);
+    }
     /*
     if(iter == 9) {
       obj_desc = absobj[0] - absobj[9];
@@ -264,6 +298,7 @@ int main(int argc, char *argv[]) {
     }
     */
   } /// end of iteration
+  ckpt.wait();
 
   sf_floatwrite(&absobj[0], absobj.size(), params.absobjs);
   sf_floatwrite(&norobj[0], norobj.size(), params.norobjs);
@@ -21,21 +21,33 @@ extern "C" {
 #include "sfutil.h"
 #include "timer.h"
 #include "environment.h"
+#include "time-resample.h"
+#include "param-bcast.h"
+#include "shotdata-writer.h"
+#include "shot-container.h"
+#include "async-writer.h"
 
 namespace {
 class Params {
 public:
   Params();
   ~Params();
+  void share(ParamBcast &pb);
 
 private:
+  void parse();
   Params(const Params &);
   void operator=(const Params &);
   void check();
 
+public:
+  ShotPosition srcPositions() const;
+  ShotPosition geoPositions() const;
+
 public:
   sf_file vinit;
   sf_file shots;
+  sf_file snaps;        /* wavefield snapshots of shot 0, NULL: none */
   int nb;
   int nz;
   int nx;
@@ -56,6 +68,21 @@ public:
   int jgx;
   int jgz;
 	int freeSurface;
+  int dtratio;
+  float vmin;
+  float vmax;
+  const char *fdcoef;
+  float fdfmax;
+  int nthreads;
+  const char *affinity;
+  const char *srcfile;
+  const char *geofile;
+  int jsnap;
+  const char *container;  /* the shots also to a shot container, NULL: none */
+  int codec;
+  float tol;
+  std::vector<float> srczx;  /// of srcfile
+  std::vector<float> geozx;  /// of geofile
 
 public:
   int rank;
@@ -65,7 +92,24 @@ public:
 };
 
 
-Params::Params() {
+/// rank 0 parses the parameters and creates the shots, the others get the fields
+Params::Params() : vinit(NULL), shots(NULL), snaps(NULL) {
+  MPI_Comm_size(MPI_COMM_WORLD, &np);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  ParamBcast pb(MPI_COMM_WORLD);
+  if (pb.reader()) {
+    parse();
+  }
+  pb.sync(*this);
+
+  k = std::ceil(ns * 1.0 / np);
+  ntask = std::min(k, ns - rank*k);
+
+  check();
+}
+
+void Params::parse() {
   /*< set up I/O files >*/
   vinit=sf_input ("vinit");   /* initial velocity model, unit=m/s */
   shots=sf_output("shots");
@@ -108,6 +152,31 @@ Params::Params() {
   /* z-begining index of receivers, starting from 0 */
 	if (!sf_getint("free", &freeSurface)) sf_error("no freeSurface");
 	/* whether it is freeSurface */
+  if (!sf_getint("dtratio",&dtratio))   dtratio=1;
+  /* > 1: model with the rapid expansion on dt*dtratio, shots are still sampled on dt */
+  if (!(fdcoef = sf_getstring("fdcoef"))) fdcoef = "zjh";
+  /* fd coefficients: zjh, lsq (designed for fdfmax) or a rsf file */
+  if (!sf_getfloat("fdfmax",&fdfmax)) fdfmax = 2.5f * fm;
+  /* max frequency the fd coefficients are designed for */
+  if (!sf_getint("nthreads",&nthreads)) nthreads = -1;
+  /* size of the pinned thread pool stepping the wavefields, 0: all cpus, < 0: OpenMP loops */
+  if (!(affinity = sf_getstring("affinity"))) affinity = "none";
+  /* thread placement over the numa nodes: none, compact or scatter */
+  srcfile = sf_getstring("srcfile");
+  /* optional rsf file of ns (z, x) source positions in grid units, overrides szbeg/sxbeg/jsz/jsx */
+  geofile = sf_getstring("geofile");
+  /* optional rsf file of ng (z, x) receiver positions in grid units, fractional ones use sinc weights */
+  if (!sf_getint("jsnap",&jsnap)) jsnap = 0;
+  /* > 0: the padded wavefield of every jsnap-th modeling step of shot 0 to snaps */
+  if (jsnap > 0) {
+    snaps = sf_output("snaps");
+  }
+  container = sf_getstring("container");
+  /* optional path of a shot container the shots are written to as well, with their geometry */
+  if (!sf_getint("codec",&codec)) codec = SHOT_LOSSLESS;
+  /* compression of the container traces: 0 none, 1 lossless, 2 error bounded by tol */
+  if (!sf_getfloat("tol",&tol)) tol = 0;
+  /* max absolute error of codec=2 */
 
   sf_putint(shots,"n1",nt);
   sf_putint(shots,"n2",ng);
@@ -134,19 +203,28 @@ Params::Params() {
   sf_putint(shots,"jgz",jgz);
   sf_putint(shots, "nb", nb);
   sf_putint(shots, "free", freeSurface);
+  if (srcfile) {
+    sf_putstring(shots, "srcfile", srcfile);
+  }
+  if (geofile) {
+    sf_putstring(shots, "geofile", geofile);
+  }
 
   Velocity v = SfVelocityReader::read(vinit, nx, nz);
-  float vmin = *std::min_element(v.dat.begin(), v.dat.end());
-  float vmax = *std::max_element(v.dat.begin(), v.dat.end());
+  vmin = *std::min_element(v.dat.begin(), v.dat.end());
+  vmax = *std::max_element(v.dat.begin(), v.dat.end());
   sf_putfloat(shots, "vmin", vmin);
   sf_putfloat(shots, "vmax", vmax);
 
-  MPI_Comm_size(MPI_COMM_WORLD, &np);
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-  k = std::ceil(ns * 1.0 / np);
-  ntask = std::min(k, ns - rank*k);
+  if (srcfile) { srczx = sfFloatRead(srcfile, 2 * ns); }
+  if (geofile) { geozx = sfFloatRead(geofile, 2 * ng); }
+}
 
-  check();
+void Params::share(ParamBcast &pb) {
+  pb(nb)(nz)(nx)(dz)(dx)(nt)(ng)(ns)(dt)(amp)(fm);
+  pb(sxbeg)(szbeg)(gxbeg)(gzbeg)(jsx)(jsz)(jgx)(jgz)(freeSurface)(dtratio)(vmin)(vmax);
+  pb(fdcoef)(fdfmax)(nthreads)(affinity)(srcfile)(geofile)(srczx)(geozx)(jsnap);
+  pb(container)(codec)(tol);
 }
 
 Params::~Params() {
@@ -154,29 +232,74 @@ Params::~Params() {
 }
 
 void Params::check() {
-  if (!(sxbeg >= 0 && szbeg >= 0 && sxbeg + (ns - 1)*jsx < nx && szbeg + (ns - 1)*jsz < nz)) {
+  if (dtratio < 1 || nt / dtratio < 2) {
+    sf_warning("invalid dtratio %d for nt %d\n", dtratio, nt);
+    exit(1);
+  }
+
+  if (!srcfile && !(sxbeg >= 0 && szbeg >= 0 && sxbeg + (ns - 1)*jsx < nx && szbeg + (ns - 1)*jsz < nz)) {
     sf_warning("sources exceeds the computing zone!\n");
     exit(1);
   }
 
-  if (!(gxbeg >= 0 && gzbeg >= 0 && gxbeg + (ng - 1)*jgx < nx && gzbeg + (ng - 1)*jgz < nz)) {
+  if (container && (codec < SHOT_RAW || codec > SHOT_BOUNDED || (codec == SHOT_BOUNDED && tol <= 0))) {
+    sf_warning("invalid codec %d or tol %g of the container\n", codec, tol);
+    exit(1);
+  }
+
+  if (!geofile && !(gxbeg >= 0 && gzbeg >= 0 && gxbeg + (ng - 1)*jgx < nx && gzbeg + (ng - 1)*jgz < nz)) {
     sf_warning("geophones exceeds the computing zone!\n");
     exit(1);
   }
 
 }
 
+/// the (z, x) pairs zx of fn, all inside the model
+ShotPosition checkPositions(const std::vector<float> &zx, const char *fn, int n, int nx, int nz) {
+  for (int i = 0; i < n; i++) {
+    if (!(zx[2 * i] >= 0 && zx[2 * i] <= nz - 1 && zx[2 * i + 1] >= 0 && zx[2 * i + 1] <= nx - 1)) {
+      sf_error("position %d of %s exceeds the computing zone", i, fn);
+    }
+  }
+  return ShotPosition(zx, n, nz);
+}
+
+ShotPosition Params::srcPositions() const {
+  if (srcfile) {
+    return checkPositions(srczx, srcfile, ns, nx, nz);
+  }
+  return ShotPosition(szbeg, sxbeg, jsz, jsx, ns, nz);
+}
+
+/// the (z, x) of the source of shot is and of all the receivers, in grid units
+ShotGeometry shotGeometry(const ShotPosition &srcPos, const ShotPosition &geoPos, int is) {
+  ShotGeometry geo;
+  geo.sz = srcPos.getz(is) + srcPos.getfz(is);
+  geo.sx = srcPos.getx(is) + srcPos.getfx(is);
+  for (int ig = 0; ig < geoPos.ns; ig++) {
+    geo.geozx.push_back(geoPos.getz(ig) + geoPos.getfz(ig));
+    geo.geozx.push_back(geoPos.getx(ig) + geoPos.getfx(ig));
+  }
+  return geo;
+}
+
+ShotPosition Params::geoPositions() const {
+  if (geofile) {
+    return checkPositions(geozx, geofile, ng, nx, nz);
+  }
+  return ShotPosition(gzbeg, gxbeg, jgz, jgx, ng, nz);
+}
+
 } /// end of name space
 
 int main(int argc, char* argv[]) {
   MPI_Init(&argc, &argv);
-	MPI_Status status;
-	MPI_Request request;
   /* initialize Madagascar */
   sf_init(argc,argv);
   Environment::setDatapath();
 
   Params params;
+  AsyncWriter writer;   /// the snapshots
   Timer totalTimer;
 
   /// configure logger
@@ -195,21 +318,54 @@ int main(int argc, char* argv[]) {
   int ns = params.ns;
   float dt = params.dt;
   float fm = params.fm;
-  int np = params.np;
   int rank = params.rank;
   int k = params.k;
   int ntask = params.ntask;
 
-  ShotPosition allSrcPos(params.szbeg, params.sxbeg, params.jsz, params.jsx, ns, nz);
-  ShotPosition allGeoPos(params.gzbeg, params.gxbeg, params.jgz, params.jgx, ng, nz);
-  ForwardModeling fmMethod(allSrcPos, allGeoPos, dt, params.dx, params.fm, nb, nt, params.freeSurface);
+  /// the modeling runs on dtm, the shots are interpolated back to dt
+  int dtratio = params.dtratio;
+  int ntm = coarseTimeSamples(nt, dtratio);
+  float dtm = dt * dtratio;
+
+  ShotPosition allSrcPos = params.srcPositions();
+  ShotPosition allGeoPos = params.geoPositions();
+  ForwardModeling fmMethod(allSrcPos, allGeoPos, dtm, params.dx, params.fm, nb, ntm, params.freeSurface);
+  fmMethod.selectFdCoef(params.fdcoef, params.vmin, params.vmax, params.fdfmax);
+  fmMethod.setAffinity(params.affinity);
+  if (params.nthreads >= 0) {
+    fmMethod.enableThreadPool(params.nthreads);
+  }
+  if (dtratio > 1) {
+    fmMethod.enableRapidExpansion(params.vmax, dtratio);
+  }
+
+  /// each rank writes its gathers, rank 0 holds the header
+  ShotDataWriter shotWriter(MPI_COMM_WORLD, params.shots, nt, ng, ns);
+  ShotContainerWriter *container = NULL;
+  if (params.container) {
+    container = new ShotContainerWriter(MPI_COMM_WORLD, params.container, ns, nt, dt, params.codec, params.tol);
+  }
 
-  Velocity exvel = fmMethod.expandDomain(SfVelocityReader::read(params.vinit, nx, nz));
+  Velocity exvel = fmMethod.expandDomain(SfVelocityReader::bcastRead(params.vinit, nx, nz));
 
   fmMethod.bindVelocity(exvel);
+  fmMethod.firstTouch(exvel.dat.vector(), true);
+
+  if (params.snaps) {
+    sf_putint(params.snaps, "n1", exvel.nz);
+    sf_putint(params.snaps, "n2", exvel.nx);
+    sf_putint(params.snaps, "n3", (ntm + params.jsnap - 1) / params.jsnap);
+    sf_putfloat(params.snaps, "d1", params.dz);
+    sf_putfloat(params.snaps, "d2", params.dx);
+    sf_putfloat(params.snaps, "d3", dtm * params.jsnap);
+    sf_putstring(params.snaps, "label3", "Time");
+  }
 
   std::vector<float> wlt(nt);
   rickerWavelet(&wlt[0], nt, fm, dt, params.amp);
+  if (dtratio > 1) {
+    wlt = coarseSourceWavelet(wlt, dtratio);
+  }
 
   std::vector<float> dobs(params.ntask * params.nt * params.ng, 0);
   for(int is=rank*k; is<rank*k+ntask; is++) {
@@ -217,54 +373,41 @@ int main(int argc, char* argv[]) {
     Timer timer;
     std::vector<float> p0(exvel.nz * exvel.nx, 0);
     std::vector<float> p1(exvel.nz * exvel.nx, 0);
-    std::vector<float> dobs_trans(params.nt * params.ng, 0);
+    std::vector<float> dobs_trans(ntm * params.ng, 0);
     ShotPosition curSrcPos = allSrcPos.clipRange(is, is);
-		/*
-		int dn = 10;
-		sf_file fullwv = sf_output("fullwv.rsf");
-		sf_putint(fullwv, "n1" , exvel.nz);
-		sf_putint(fullwv, "n2" , exvel.nx);
-		sf_putint(fullwv, "n3" , nt / dn);
-		*/
-
 		//fmMethod.initFdUtil(params.vinit, &exvel, nb, params.dx, dt);
-    for(int it=0; it<nt; it++) {
+    for(int it=0; it<ntm; it++) {
       fmMethod.addSource(&p1[0], &wlt[it], curSrcPos);
       fmMethod.stepForward(p0, p1);
       //fmMethod.stepForward(p0, p1, 0);
       std::swap(p1, p0);
       fmMethod.recordSeis(&dobs_trans[it*ng], &p0[0]);
-			/*
-			if(it % dn == 0)
-				sf_floatwrite(&p0[0], exvel.nx * exvel.nz, fullwv);
-				*/
+      if (params.snaps && is == 0 && it % params.jsnap == 0) {
+        writer.write(params.snaps, &p0[0], p0.size());
+      }
     }
 		//exit(1);
-    matrix_transpose(&dobs_trans[0], &dobs[local_is * ng * nt], ng, nt);
+    if (dtratio > 1) {
+      std::vector<float> dobsm(ng * ntm);
+      matrix_transpose(&dobs_trans[0], &dobsm[0], ng, ntm);
+      interpolateTraces(&dobsm[0], &dobs[local_is * ng * nt], nt, ng, dtratio);
+    } else {
+      matrix_transpose(&dobs_trans[0], &dobs[local_is * ng * nt], ng, nt);
+    }
 
 		//fmMethod.fwiRemoveDirectArrival(&dobs[local_is * ng * nt], local_is);
-		if(np == 1) {
-			sf_floatwrite(&dobs[local_is * ng * nt], ng*nt, params.shots);
-		}
-		else {
-			if(rank == 0) {
-				sf_floatwrite(&dobs[local_is * ng * nt], ng*nt, params.shots);
-				if(is == rank * k + ntask - 1) {
-					for(int other_is = rank * k + ntask ; other_is < ns ; other_is ++) {
-						MPI_Recv(&dobs[0], ng*nt, MPI_FLOAT, other_is / k, other_is, MPI_COMM_WORLD, &status);
-						sf_floatwrite(&dobs[0], ng*nt, params.shots);
-					}
-				}
-			}
-			else {
-				MPI_Isend(&dobs[local_is * ng * nt], ng*nt, MPI_FLOAT, 0, is, MPI_COMM_WORLD, &request);
-			}
-		}
+    shotWriter.write(is, &dobs[local_is * ng * nt]);
+    if (container) {
+      container->write(is, &dobs[local_is * ng * nt], shotGeometry(allSrcPos, allGeoPos, is));
+    }
     INFO() << format("shot %d, elapsed time %fs") % is % timer.elapsed();
   }
 
   INFO() << format("total elapsed time %fs") % totalTimer.elapsed();
 
+  shotWriter.close();
+  delete container;
+  writer.flush();
   MPI_Finalize();
   return 0;
 }
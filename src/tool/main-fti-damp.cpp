@@ -25,12 +25,16 @@ extern "C" {
 #include "shotdata-reader.h"
 #include "updatevelop.h"
 #include "environment.h"
+#include "param-bcast.h"
+#include "async-writer.h"
 
 namespace {
 class Params {
 public:
   Params();
   ~Params();
+  void parse();
+  void share(ParamBcast &pb);
   void check();
 
 public:
@@ -76,7 +80,24 @@ public:
   int ntask; /// exactly the # of task each process owns
 };
 
-Params::Params() {
+/// rank 0 parses the parameters and creates the outputs, the others get the fields
+Params::Params() : vinit(NULL), vreal(NULL), shots(NULL), vupdates(NULL), absobjs(NULL), norobjs(NULL) {
+  MPI_Comm_size(MPI_COMM_WORLD, &np);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  ParamBcast pb(MPI_COMM_WORLD);
+  if (pb.reader()) {
+    parse();
+  }
+  pb.sync(*this);
+
+  k = std::ceil(ns * 1.0 / np);
+  ntask = std::min(k, ns - rank*k);
+
+  check();
+}
+
+void Params::parse() {
   vinit = sf_input ("vin");       /* initial velocity model, unit=m/s */
   vreal	= sf_input ("vreal");       /* initial velocity model, unit=m/s */
   shots = sf_input("shots");      /* recorded shots from exact velocity model */
@@ -135,13 +156,12 @@ Params::Params() {
   sf_putfloat(norobjs, "d1", 1);
   sf_putfloat(norobjs, "o1", 1);
   sf_putstring(norobjs, "label1", "Normalize");
+}
 
-  MPI_Comm_size(MPI_COMM_WORLD, &np);
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-  k = std::ceil(ns * 1.0 / np);
-  ntask = std::min(k, ns - rank*k);
-
-  check();
+void Params::share(ParamBcast &pb) {
+  pb(niter)(nb)(vmin)(vmax)(maxdv)(nita)(seed);
+  pb(nz)(nx)(dz)(dx)(nt)(ng)(ns)(dt)(amp)(fm);
+  pb(sxbeg)(szbeg)(gxbeg)(gzbeg)(jsx)(jsz)(jgx)(jgz)(freeSurface);
 }
 
 Params::~Params() {
@@ -168,6 +188,7 @@ int main(int argc, char *argv[]) {
   sf_init(argc, argv);                /* initialize Madagascar */
   Environment::setDatapath();
   Params params;
+  AsyncWriter writer;   /// the model of each iteration
 
   /// configure logger
 	char logfile[64];
@@ -195,10 +216,9 @@ int main(int argc, char *argv[]) {
   ShotPosition allGeoPos(params.gzbeg, params.gxbeg, params.jgz, params.jgx, ng, nz);
   ForwardModeling fmMethod(allSrcPos, allGeoPos, dt, dx, fm, nb, nt, params.freeSurface);
 
-  SfVelocityReader velReader(params.vinit);
-  Velocity v0 = SfVelocityReader::read(params.vinit, nx, nz);
+  Velocity v0 = SfVelocityReader::bcastRead(params.vinit, nx, nz);
   Velocity exvel = fmMethod.expandDomain(v0);
-  Velocity v0_t = SfVelocityReader::read(params.vreal, nx, nz);
+  Velocity v0_t = SfVelocityReader::bcastRead(params.vreal, nx, nz);
   Velocity exvel_real = fmMethod.expandDomain(v0_t);
   fmMethod.bindVelocity(exvel);
   fmMethod.bindRealVelocity(exvel_real);
@@ -208,7 +228,7 @@ int main(int argc, char *argv[]) {
 	INFO() << "sum encsrc: " << std::accumulate(wlt.begin(), wlt.begin() + nt, 0.0f);
 
   std::vector<float> dobs(ns * nt * ng);     /* all observed data */
-  ShotDataReader::serialRead(params.shots, &dobs[0], ns, nt, ng);
+  ShotDataReader::bcastRead(params.shots, &dobs[0], ns, nt, ng);
 
   FwiUpdateVelOp updatevelop(vmin, vmax, dx, dt);
   FwiUpdateSteplenOp updateSteplenOp(fmMethod, updatevelop, nita, maxdv, ns, ng, nt, &wlt);
@@ -220,7 +240,9 @@ int main(int argc, char *argv[]) {
   for (int iter = 0; iter < params.niter; iter++) {
 		INFO() << format("Conventional FWI, iter %d") % iter;
 		fti.epoch(iter);
-    fti.writeVel(params.vupdates);
+    if (params.rank == 0) {
+      fti.writeVel(writer, params.vupdates);
+    }
     float obj = fti.getUpdateObj();
     if (iter == 0) {
       float obj0 = fti.getInitObj();
@@ -231,9 +253,12 @@ int main(int argc, char *argv[]) {
     norobj.push_back(obj / absobj[0]);
   } /// end of iteration
 
-  sf_floatwrite(&absobj[0], absobj.size(), params.absobjs);
-  sf_floatwrite(&norobj[0], norobj.size(), params.norobjs);
+  if (params.rank == 0) {
+    sf_floatwrite(&absobj[0], absobj.size(), params.absobjs);
+    sf_floatwrite(&norobj[0], norobj.size(), params.norobjs);
+  }
 
+  writer.flush();
   sf_close();
 
   MPI_Finalize();
@@ -23,20 +23,32 @@ extern "C" {
 #include "sf-velocity-reader.h"
 #include "ricker-wavelet.h"
 #include "fwiframework.h"
+#include "domain-decomp.h"
 #include "shotdata-reader.h"
 #include "updatevelop.h"
 #include "environment.h"
+#include "time-resample.h"
+#include "grid-coarsen.h"
+#include "sfutil.h"
+#include "checkpoint.h"
+#include "param-bcast.h"
+#include "async-writer.h"
 
 namespace {
 class Params {
 public:
   Params();
   ~Params();
+  void parse();
+  void share(ParamBcast &pb);
   void check();
+  ShotPosition srcPositions() const;
+  ShotPosition geoPositions() const;
 
 public:
   sf_file vinit;        /* initial velocity model, unit=m/s */
   sf_file shots;        /* recorded shots from exact velocity model */
+  const char *container; /* the gathers of shots in a shot container, NULL: the payload of shots */
   sf_file vupdates;     /* updated velocity in iterations */
   sf_file absobjs;         /* absolute values of objective function in iterations */
   sf_file norobjs;         /* normalize values of objective function in iterations */
@@ -47,6 +59,22 @@ public:
   float maxdv;
   int nita;
   int seed;
+  int dtratio;          /* modeling time step over the data time step */
+  int nstage;           /* # of multiscale stages, 0: single scale */
+  std::vector<int> fhis;  /* high cut frequency of each stage */
+  float ppw;            /* points per shortest wavelength on the coarse grids */
+  const char *fdcoef;   /* fd coefficients: zjh, lsq or a rsf file */
+  float fdfmax;         /* max frequency the fd coefficients are designed for */
+  int nthreads;         /* threads of the stepping pool, < 0: OpenMP loops */
+  const char *affinity; /* thread placement: none, compact or scatter */
+  int nsub;             /* subdomains of each shot */
+  const char *gradcomp; /* compression of the gradient sum between nodes */
+  int pipeline;         /* shots in flight between the forward and the adjoint pass */
+  const char *srcfile;  /* (z, x) source positions in grid units, NULL: regular */
+  const char *geofile;  /* (z, x) receiver positions in grid units, NULL: regular */
+  const char *restart;  /* checkpoint prefix to resume from, NULL: start anew */
+  const char *ckpt;     /* prefix of the checkpoints */
+  int ckptevery;        /* iterations between checkpoints, 0: none */
 
 public: // parameters from input files
   int nz;
@@ -70,6 +98,8 @@ public: // parameters from input files
 	int freeSurface;
 	int flo;
 	int fhi;
+  std::vector<float> srczx;  /// of srcfile
+  std::vector<float> geozx;  /// of geofile
 
 public:
   int rank;
@@ -78,9 +108,27 @@ public:
   int ntask; /// exactly the # of task each process owns
 };
 
-Params::Params() {
+/// rank 0 parses the parameters and creates the outputs, the others get the fields
+Params::Params() : vinit(NULL), shots(NULL), container(NULL), vupdates(NULL), absobjs(NULL), norobjs(NULL) {
+  MPI_Comm_size(MPI_COMM_WORLD, &np);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  ParamBcast pb(MPI_COMM_WORLD);
+  if (pb.reader()) {
+    parse();
+  }
+  pb.sync(*this);
+
+  k = std::ceil(ns * 1.0 / np);
+  ntask = std::min(k, ns - rank*k);
+
+  check();
+}
+
+void Params::parse() {
   vinit = sf_input ("vin");       /* initial velocity model, unit=m/s */
   shots = sf_input("shots");      /* recorded shots from exact velocity model */
+  container = sf_getstring("container"); /* shot container of shotconv with the gathers, shots then only gives the header */
   vupdates = sf_output("vout");   /* updated velocity in iterations */
   absobjs = sf_output("absobjs"); /* absolute values of objective function in iterations */
   norobjs = sf_output("norobjs"); /* normalized values of objective function in iterations */
@@ -91,6 +139,22 @@ Params::Params() {
   if (!sf_getint("seed", &seed))   { seed = 10; }                 /* seed for random numbers */
   if (!sf_getint("flo", &flo))   { flo = -1; }                 /* low frequency in bandpass */
   if (!sf_getint("fhi", &fhi))   { fhi = -1; }                 /* high frequency in bandpass */
+  if (!sf_getint("dtratio", &dtratio)) { dtratio = 1; }        /* > 1: rapid expansion with dt*dtratio */
+  if (!sf_getint("nstage", &nstage)) { nstage = 0; }           /* # of multiscale stages */
+  if (nstage > 0) {
+    fhis.resize(nstage);
+    if (!sf_getints("fhis", &fhis[0], nstage)) { sf_error("no fhis"); } /* high cut frequency of each stage */
+    if (!sf_getfloat("ppw", &ppw)) { ppw = 6; }                   /* points per shortest wavelength */
+  }
+  if (!(fdcoef = sf_getstring("fdcoef"))) { fdcoef = "zjh"; }   /* fd coefficients: zjh, lsq or a rsf file */
+  if (!sf_getint("nthreads", &nthreads)) { nthreads = -1; }     /* pinned thread pool size, 0: all cpus, < 0: OpenMP */
+  if (!(affinity = sf_getstring("affinity"))) { affinity = "none"; } /* none, compact or scatter over the numa nodes */
+  if (!(gradcomp = sf_getstring("gradcomp"))) { gradcomp = "none"; } /* none or bf16 with error feedback */
+  if (!sf_getint("nsub", &nsub)) { nsub = 1; }                  /* > 1: each shot on nsub ranks, the ranks in groups of nsub */
+  if (!sf_getint("pipeline", &pipeline)) { pipeline = 0; }      /* > 0: forward of the next shot during the adjoint, on half the threads each */
+  restart = sf_getstring("restart");                            /* resume from the checkpoints of this prefix */
+  if (!(ckpt = sf_getstring("ckpt"))) { ckpt = restart ? restart : "fwi-damp.ckpt"; } /* prefix of the checkpoints, <prefix>-<rank>.<0|1> */
+  if (!sf_getint("ckptevery", &ckptevery)) { ckptevery = 0; }   /* iterations between checkpoints, 0: none */
 
   /* get parameters from velocity model and recorded shots */
   if (!sf_histint(vinit, "n1", &nz)) { sf_error("no n1"); }       /* nz */
@@ -115,6 +179,11 @@ Params::Params() {
   if (!sf_histint(shots,  "free",&freeSurface))        { sf_error("no free"); }  /* whether there is free surface */
   if (!sf_histfloat(shots, "vmin", &vmin)) { sf_error("no vmin"); } /* minimal velocity in real model*/
   if (!sf_histfloat(shots, "vmax", &vmax)) { sf_error("no vmax"); } /* maximal velocity in real model*/
+  if (!sf_getfloat("fdfmax", &fdfmax)) { fdfmax = fhi > 0 ? fhi : 2.5f * fm; } /* max frequency for the fd coefficients */
+  if (!(srcfile = sf_getstring("srcfile"))) { srcfile = sf_histstring(shots, "srcfile"); } /* source positions of fm-damp */
+  if (!(geofile = sf_getstring("geofile"))) { geofile = sf_histstring(shots, "geofile"); } /* receiver positions of fm-damp */
+  if (srcfile) { srczx = sfFloatRead(srcfile, 2 * ns); }
+  if (geofile) { geozx = sfFloatRead(geofile, 2 * ng); }
 
 
   /**
@@ -127,24 +196,26 @@ Params::Params() {
   sf_putstring(vupdates, "label1", "Depth");
   sf_putstring(vupdates, "label2", "Distance");
   sf_putstring(vupdates, "label3", "Iteration");
-  sf_putint(vupdates, "n3", niter);
+  sf_putint(vupdates, "n3", niter * std::max(nstage, 1));
   sf_putint(vupdates, "d3", 1);
   sf_putint(vupdates, "o3", 1);
-  sf_putint(absobjs, "n1", niter + 1);
+  sf_putint(absobjs, "n1", (niter + 1) * std::max(nstage, 1));
   sf_putfloat(absobjs, "d1", 1);
   sf_putfloat(absobjs, "o1", 1);
   sf_putstring(absobjs, "label1", "Absolute");
-  sf_putint(norobjs, "n1", niter + 1);
+  sf_putint(norobjs, "n1", (niter + 1) * std::max(nstage, 1));
   sf_putfloat(norobjs, "d1", 1);
   sf_putfloat(norobjs, "o1", 1);
   sf_putstring(norobjs, "label1", "Normalize");
+}
 
-  MPI_Comm_size(MPI_COMM_WORLD, &np);
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-  k = std::ceil(ns * 1.0 / np);
-  ntask = std::min(k, ns - rank*k);
-
-  check();
+void Params::share(ParamBcast &pb) {
+  pb(niter)(nb)(vmin)(vmax)(maxdv)(nita)(seed)(dtratio)(nstage)(fhis)(ppw);
+  pb(fdcoef)(fdfmax)(nthreads)(affinity)(nsub)(gradcomp)(pipeline);
+  pb(srcfile)(geofile)(restart)(ckpt)(ckptevery)(container);
+  pb(nz)(nx)(dz)(dx)(nt)(ng)(ns)(dt)(amp)(fm);
+  pb(sxbeg)(szbeg)(gxbeg)(gzbeg)(jsx)(jsz)(jgx)(jgz)(freeSurface)(flo)(fhi);
+  pb(srczx)(geozx);
 }
 
 Params::~Params() {
@@ -152,17 +223,251 @@ Params::~Params() {
 }
 
 void Params::check() {
-  if (!(sxbeg >= 0 && szbeg >= 0 && sxbeg + (ns - 1)*jsx < nx && szbeg + (ns - 1)*jsz < nz)) {
+  if (nsub < 1 || np % nsub != 0) {
+    sf_warning("nsub %d does not divide the %d ranks\n", nsub, np);
+    exit(1);
+  }
+
+  if (nsub > 1 && (dtratio > 1 || nthreads >= 0)) {
+    sf_warning("nsub > 1 steps with the OpenMP loops only, without dtratio and nthreads\n");
+    exit(1);
+  }
+
+  if (pipeline > 0 && (nsub > 1 || dtratio > 1 || nthreads >= 0)) {
+    sf_warning("pipeline > 0 steps with the OpenMP loops only, without nsub, dtratio and nthreads\n");
+    exit(1);
+  }
+
+  if (ckptevery < 0) {
+    sf_warning("invalid ckptevery %d\n", ckptevery);
+    exit(1);
+  }
+
+  if (dtratio < 1 || nt / dtratio < 2) {
+    sf_warning("invalid dtratio %d for nt %d\n", dtratio, nt);
+    exit(1);
+  }
+
+  if (!srcfile && !(sxbeg >= 0 && szbeg >= 0 && sxbeg + (ns - 1)*jsx < nx && szbeg + (ns - 1)*jsz < nz)) {
     sf_warning("sources exceeds the computing zone!\n");
     exit(1);
   }
 
-  if (!(gxbeg >= 0 && gzbeg >= 0 && gxbeg + (ng - 1)*jgx < nx && gzbeg + (ng - 1)*jgz < nz)) {
+  if (!geofile && !(gxbeg >= 0 && gzbeg >= 0 && gxbeg + (ng - 1)*jgx < nx && gzbeg + (ng - 1)*jgz < nz)) {
     sf_warning("geophones exceeds the computing zone!\n");
     exit(1);
   }
 }
 
+/// the (z, x) pairs zx of fn, all inside the model
+ShotPosition checkPositions(const std::vector<float> &zx, const char *fn, int n, int nx, int nz) {
+  for (int i = 0; i < n; i++) {
+    if (!(zx[2 * i] >= 0 && zx[2 * i] <= nz - 1 && zx[2 * i + 1] >= 0 && zx[2 * i + 1] <= nx - 1)) {
+      sf_error("position %d of %s exceeds the computing zone", i, fn);
+    }
+  }
+  return ShotPosition(zx, n, nz);
+}
+
+ShotPosition Params::srcPositions() const {
+  if (srcfile) {
+    return checkPositions(srczx, srcfile, ns, nx, nz);
+  }
+  return ShotPosition(szbeg, sxbeg, jsz, jsx, ns, nz);
+}
+
+ShotPosition Params::geoPositions() const {
+  if (geofile) {
+    return checkPositions(geozx, geofile, ng, nx, nz);
+  }
+  return ShotPosition(gzbeg, gxbeg, jgz, jgx, ng, nz);
+}
+
+/// the model of an iteration to vout, rank 0 keeps all of them for the checkpoints
+void writeModel(const Params &params, AsyncWriter &writer, std::vector<float> &vouts, const float *model) {
+  if (params.rank != 0) {
+    return;
+  }
+  size_t n = (size_t)params.nx * params.nz;
+  vouts.insert(vouts.end(), model, model + n);
+  writer.write(params.vupdates, model, n);
+}
+
+/// a restart writes the models of the iterations before it again, vout is then the one of a run without stop
+void restartOutput(const Params &params, const CheckpointData &state, AsyncWriter &writer, std::vector<float> &vouts) {
+  state.get("vout", vouts);
+  if (params.rank == 0 && !vouts.empty()) {
+    writer.write(params.vupdates, &vouts[0], vouts.size());
+  }
+}
+
+/**
+ * multiscale FWI, stage i inverts the band [flo, fhis[i]] on a grid coarsened
+ * to ppw points per shortest wavelength, both dx and dt grow by the coarsening
+ * factor. The update of each stage is prolonged onto the fine model
+ */
+void multiscaleFwi(const Params &params, const Velocity &v0, const std::vector<float> &dobs0, AsyncWriter &writer) {
+  int nz = params.nz;
+  int nx = params.nx;
+  int ng = params.ng;
+  int nt = params.nt;
+  int ns = params.ns;
+  float dt = params.dt;
+  float dx = params.dx;
+  bool phase = false;
+  bool verb = false;
+
+  ShotPosition allSrcPos = params.srcPositions();
+  ShotPosition allGeoPos = params.geoPositions();
+
+  Velocity vfine = v0;
+  std::vector<float> absobj;
+  std::vector<float> norobj;
+  std::vector<float> vouts;   /// the models written, rank 0 only
+
+  /// step counts the iterations of all stages, a checkpoint at the end of a
+  /// stage has no FwiFramework state, the next stage starts from vfine
+  Checkpoint ckpt(MPI_COMM_WORLD, params.ckpt, params.ckptevery);
+  CheckpointData state;
+  int step0 = 0;
+  if (params.restart) {
+    step0 = ckpt.restore(params.restart, state);
+    state.get("vfine", vfine.dat.data(), vfine.dat.size() * sizeof(float));
+    state.get("absobj", absobj);
+    state.get("norobj", norobj);
+    restartOutput(params, state, writer, vouts);
+  }
+
+  for (int istage = step0 / params.niter; istage < params.nstage; istage++) {
+    int fhi = params.fhis[istage];
+    int factor = coarsenFactor(params.vmin, fhi, dx, params.ppw);
+    int tratio = factor * params.dtratio;
+    int nxc = coarseGridSize(nx, factor);
+    int nzc = coarseGridSize(nz, factor);
+    int ntc = coarseTimeSamples(nt, tratio);
+    float dxc = dx * factor;
+    float dtc = dt * tratio;
+
+    INFO() << format("multiscale stage %d, fhi %d, grid %d x %d (factor %d), nt %d, dt %f")
+        % istage % fhi % nxc % nzc % factor % ntc % dtc;
+
+    ShotPosition srcPos = allSrcPos.coarsen(factor, nxc, nzc);
+    ShotPosition geoPos = allGeoPos.coarsen(factor, nxc, nzc);
+    ForwardModeling fmMethod(srcPos, geoPos, dtc, dxc, params.fm, params.nb, ntc, params.freeSurface);
+    fmMethod.selectFdCoef(params.fdcoef, params.vmin, params.vmax, fhi);
+    fmMethod.setAffinity(params.affinity);
+    if (params.nthreads >= 0) {
+      fmMethod.enableThreadPool(params.nthreads);
+    }
+    if (params.dtratio > 1) {
+      fmMethod.enableRapidExpansion(params.vmax, params.dtratio);
+    }
+
+    Velocity vc0 = restrictVelocity(vfine, factor);
+    Velocity exvel = fmMethod.expandDomain(vc0);
+    fmMethod.bindVelocity(exvel);
+    fmMethod.firstTouch(exvel.dat.vector(), true);
+
+    /// the padded grid of each stage is decomposed again
+    DomainDecomp *decomp = NULL;
+    if (params.nsub > 1) {
+      decomp = new DomainDecomp(MPI_COMM_WORLD, params.nsub, exvel.nx, exvel.nz);
+      fmMethod.setDecomposition(decomp);
+    }
+
+    std::vector<float> wlt(nt);
+    rickerWavelet(&wlt[0], nt, params.fm, dt, params.amp);
+    filter(&wlt[0], nt, dt, params.flo, fhi, phase, verb);
+
+    std::vector<float> dobs = dobs0;
+    filter(&dobs[0], nt, dt, params.flo, fhi, phase, verb, ng, ns);
+
+    if (tratio > 1) {
+      /// the compensation of coarseSourceWavelet is the one of the rapid expansion
+      if (params.dtratio > 1) {
+        wlt = coarseSourceWavelet(wlt, tratio, factor);
+      } else {
+        std::vector<float> wltc(ntc);
+        decimateTraces(&wlt[0], &wltc[0], nt, 1, tratio);
+        wlt.swap(wltc);
+      }
+      std::vector<float> dobsc(ns * ntc * ng);
+      decimateGathers(&dobs[0], &dobsc[0], nt, ng, ns, tratio);
+      dobs.swap(dobsc);
+    }
+
+    FwiUpdateVelOp updatevelop(params.vmin, params.vmax, dxc, dtc);
+    FwiUpdateSteplenOp updateSteplenOp(fmMethod, updatevelop, params.nita, params.maxdv, ns, ng, ntc, &wlt);
+    FwiFramework fwi(fmMethod, updateSteplenOp, updatevelop, wlt, dobs);
+    fwi.setGradCompression(params.gradcomp);
+    fwi.setShotPipeline(params.pipeline, 0, 0);
+
+    Velocity vstage = vfine;
+    int obj0 = absobj.size();
+    int iter0 = 0;
+    if (state.has("fwi.vel")) {
+      iter0 = step0 % params.niter;
+      obj0 = state.getValue<int>("obj0");
+      fwi.loadState(state, "fwi");
+      state.clear();
+    }
+    for (int iter = iter0; iter < params.niter; iter++) {
+      INFO() << format("Multiscale FWI, stage %d, iter %d") % istage % iter;
+      fwi.epoch(iter);
+
+      /// fine model = fine model of the last stage + prolonged update of this stage
+      Velocity vc = fmMethod.shrinkDomain(fmMethod.getVelocity());
+      for (size_t i = 0; i < vc.dat.size(); i++) {
+        vc.dat[i] -= vc0.dat[i];
+      }
+      Velocity dv = prolongVelocity(vc, nx, nz, factor);
+      /// the bilinear prolongation may overshoot, the bounds are the ones of FwiUpdateVelOp
+      for (size_t i = 0; i < vstage.dat.size(); i++) {
+        vstage.dat[i] = std::min(params.vmax, std::max(params.vmin, vfine.dat[i] + dv.dat[i]));
+      }
+      writeModel(params, writer, vouts, &vstage.dat[0]);
+
+      float obj = fwi.getUpdateObj();
+      if (iter == 0) {
+        absobj.push_back(fwi.getInitObj());
+        norobj.push_back(1);
+      }
+      absobj.push_back(obj);
+      norobj.push_back(obj / absobj[obj0]);
+
+      int step = istage * params.niter + iter + 1;
+      if (iter + 1 < params.niter && ckpt.due(step)) {
+        CheckpointData s;
+        s.put("vfine", vfine.dat.data(), vfine.dat.size() * sizeof(float));
+        s.put("absobj", absobj);
+        s.put("norobj", norobj);
+        s.put("vout", vouts);
+        s.putValue("obj0", obj0);
+        fwi.saveState(s, "fwi");
+        ckpt.save(step, s);
+      }
+    }
+
+    vfine = vstage;
+    delete decomp;
+
+    if (ckpt.due((istage + 1) * params.niter)) {
+      CheckpointData s;
+      s.put("vfine", vfine.dat.data(), vfine.dat.size() * sizeof(float));
+      s.put("absobj", absobj);
+      s.put("norobj", norobj);
+      s.put("vout", vouts);
+      ckpt.save((istage + 1) * params.niter, s);
+    }
+  }
+  ckpt.wait();
+
+  if (params.rank == 0) {
+    sf_floatwrite(&absobj[0], absobj.size(), params.absobjs);
+    sf_floatwrite(&norobj[0], norobj.size(), params.norobjs);
+  }
+}
+
 } /// end of name space
 
 
@@ -171,6 +476,7 @@ int main(int argc, char *argv[]) {
   sf_init(argc, argv);                /* initialize Madagascar */
   Environment::setDatapath();
   Params params;
+  AsyncWriter writer;   /// the model of each iteration
 
   /// configure logger
 	char logfile[64];
@@ -198,16 +504,29 @@ int main(int argc, char *argv[]) {
 	bool phase = false;
 	bool verb = false;
 
+  /// the modeling runs on dtm, the data are resampled from dt
+  int dtratio = params.dtratio;
+  int ntm = coarseTimeSamples(nt, dtratio);
+  float dtm = dt * dtratio;
+
   srand(params.seed);
 
-  ShotPosition allSrcPos(params.szbeg, params.sxbeg, params.jsz, params.jsx, ns, nz);
-  ShotPosition allGeoPos(params.gzbeg, params.gxbeg, params.jgz, params.jgx, ng, nz);
-  ForwardModeling fmMethod(allSrcPos, allGeoPos, dt, dx, fm, nb, nt, params.freeSurface);
+  ShotPosition allSrcPos = params.srcPositions();
+  ShotPosition allGeoPos = params.geoPositions();
+  ForwardModeling fmMethod(allSrcPos, allGeoPos, dtm, dx, fm, nb, ntm, params.freeSurface);
+  fmMethod.selectFdCoef(params.fdcoef, vmin, vmax, params.fdfmax);
+  fmMethod.setAffinity(params.affinity);
+  if (params.nthreads >= 0) {
+    fmMethod.enableThreadPool(params.nthreads);
+  }
+  if (dtratio > 1) {
+    fmMethod.enableRapidExpansion(vmax, dtratio);
+  }
 
-  SfVelocityReader velReader(params.vinit);
-  Velocity v0 = SfVelocityReader::read(params.vinit, nx, nz);
+  Velocity v0 = SfVelocityReader::bcastRead(params.vinit, nx, nz);
   Velocity exvel = fmMethod.expandDomain(v0);
   fmMethod.bindVelocity(exvel);
+  fmMethod.firstTouch(exvel.dat.vector(), true);
 
   std::vector<float> wlt(nt);
   rickerWavelet(&wlt[0], nt, fm, dt, params.amp);
@@ -215,21 +534,63 @@ int main(int argc, char *argv[]) {
 		filter(&wlt[0], nt, dt, flo, fhi, phase, verb);
 
   std::vector<float> dobs(ns * nt * ng);     /* all observed data */
-  ShotDataReader::serialRead(params.shots, &dobs[0], ns, nt, ng);
+  if (params.container) {
+    ShotDataReader::bcastContainerRead(params.container, &dobs[0], ns, nt, ng);
+  } else {
+    ShotDataReader::bcastRead(params.shots, &dobs[0], ns, nt, ng);
+  }
+
+  if (params.nstage > 0) {
+    multiscaleFwi(params, v0, dobs, writer);
+    writer.flush();
+    sf_close();
+    MPI_Finalize();
+    return 0;
+  }
+
 	if(flo != -1 && fhi != -1) 
 		filter(&dobs[0], nt, dt, flo, fhi, phase, verb, ng, ns);
 
-  FwiUpdateVelOp updatevelop(vmin, vmax, dx, dt);
-  FwiUpdateSteplenOp updateSteplenOp(fmMethod, updatevelop, nita, maxdv, ns, ng, nt, &wlt);
+  if (dtratio > 1) {
+    wlt = coarseSourceWavelet(wlt, dtratio);
+    std::vector<float> dobsm(ns * ntm * ng);
+    decimateGathers(&dobs[0], &dobsm[0], nt, ng, ns, dtratio);
+    dobs.swap(dobsm);
+    INFO() << format("modeling with dt %f, nt %d instead of dt %f, nt %d") % dtm % ntm % dt % nt;
+  }
+
+  DomainDecomp *decomp = NULL;
+  if (params.nsub > 1) {
+    decomp = new DomainDecomp(MPI_COMM_WORLD, params.nsub, exvel.nx, exvel.nz);
+    fmMethod.setDecomposition(decomp);
+  }
+
+  FwiUpdateVelOp updatevelop(vmin, vmax, dx, dtm);
+  FwiUpdateSteplenOp updateSteplenOp(fmMethod, updatevelop, nita, maxdv, ns, ng, ntm, &wlt);
 
   FwiFramework fwi(fmMethod, updateSteplenOp, updatevelop, wlt, dobs);
+  fwi.setGradCompression(params.gradcomp);
+  fwi.setShotPipeline(params.pipeline, 0, 0);
 
   std::vector<float> absobj;
   std::vector<float> norobj;
-  for (int iter = 0; iter < params.niter; iter++) {
+  std::vector<float> vouts;   /// the models written, rank 0 only
+  Checkpoint ckpt(MPI_COMM_WORLD, params.ckpt, params.ckptevery);
+  int iter0 = 0;
+  if (params.restart) {
+    CheckpointData state;
+    iter0 = ckpt.restore(params.restart, state);
+    fwi.loadState(state, "fwi");
+    state.get("absobj", absobj);
+    state.get("norobj", norobj);
+    restartOutput(params, state, writer, vouts);
+  }
+
+  for (int iter = iter0; iter < params.niter; iter++) {
 		INFO() << format("Conventional FWI, iter %d") % iter;
 		fwi.epoch(iter);
-    fwi.writeVel(params.vupdates);
+    std::vector<float> vv = fmMethod.outputVel(fmMethod.getVelocity().dat.toVector());
+    writeModel(params, writer, vouts, &vv[0]);
     float obj = fwi.getUpdateObj();
     if (iter == 0) {
       float obj0 = fwi.getInitObj();
@@ -238,11 +599,26 @@ int main(int argc, char *argv[]) {
     }
     absobj.push_back(obj);
     norobj.push_back(obj / absobj[0]);
+
+    if (ckpt.due(iter + 1)) {
+      CheckpointData state;
+      fwi.saveState(state, "fwi");
+      state.put("absobj", absobj);
+      state.put("norobj", norobj);
+      state.put("vout", vouts);
+      ckpt.save(iter + 1, state);
+    }
   } /// end of iteration
+  ckpt.wait();
 
-  sf_floatwrite(&absobj[0], absobj.size(), params.absobjs);
-  sf_floatwrite(&norobj[0], norobj.size(), params.norobjs);
+  if (params.rank == 0) {
+    sf_floatwrite(&absobj[0], absobj.size(), params.absobjs);
+    sf_floatwrite(&norobj[0], norobj.size(), params.norobjs);
+  }
 
+  fmMethod.setDecomposition(NULL);
+  delete decomp;
+  writer.flush();
   sf_close();
 
   MPI_Finalize();
@@ -0,0 +1,223 @@
+extern "C" {
+#include <rsf.h>
+}
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "environment.h"
+#include "logger.h"
+#include "sfutil.h"
+#include "shot-container.h"
+#include "sf-mapped-data.h"
+
+/**
+ * the shots of an rsf cube to a shot container and back:
+ *
+ *   shotconv mode=import shots=shots.rsf container=shots.ssc codec=1
+ *   shotconv mode=export container=shots.ssc shots=shots.rsf srcfile=src.rsf geofile=geo.rsf
+ *
+ * import takes the geometry from the header fm-damp writes, the srcfile and
+ * geofile it names or szbeg/sxbeg/jsz/jsx and gzbeg/gxbeg/jgz/jgx
+ *
+ * fwi-damp reads the gathers of an imported container with container=, the
+ * rsf shots still give it the header
+ */
+namespace {
+class Params {
+public:
+  Params();
+  ~Params();
+
+private:
+  Params(const Params &);
+  void operator=(const Params &);
+
+public:
+  bool import;
+  sf_file shots;
+  const char *container;
+  int codec;
+  float tol;
+  const char *srcfile;  /* export: the (z, x) of the sources, NULL: not written */
+  const char *geofile;  /* export: the (z, x) of the receivers, NULL: not written */
+};
+
+Params::Params() : shots(NULL), srcfile(NULL), geofile(NULL) {
+  const char *mode = sf_getstring("mode");
+  /* import: rsf shots to a container, export: a container to rsf shots */
+  if (mode == NULL || (strcmp(mode, "import") != 0 && strcmp(mode, "export") != 0)) {
+    sf_error("mode=import or mode=export");
+  }
+  import = strcmp(mode, "import") == 0;
+
+  if (!(container = sf_getstring("container"))) sf_error("no container");
+  /* path of the shot container */
+  if (!sf_getint("codec", &codec)) codec = SHOT_LOSSLESS;
+  /* import: compression of the traces, 0 none, 1 lossless, 2 error bounded by tol */
+  if (!sf_getfloat("tol", &tol)) tol = 0;
+  /* import: max absolute error of codec=2 */
+
+  if (import) {
+    shots = sf_input("shots");
+  } else {
+    shots = sf_output("shots");
+    srcfile = sf_getstring("srcfile");
+    geofile = sf_getstring("geofile");
+  }
+}
+
+Params::~Params() {
+  sf_close();
+}
+
+/// the geometry of the ns shots of an rsf cube of ng receivers
+std::vector<ShotGeometry> rsfGeometry(sf_file shots, int ns, int ng) {
+  std::vector<ShotGeometry> geos(ns);
+  std::vector<float> srczx(2 * ns, 0);
+  std::vector<float> geozx(2 * ng, 0);
+
+  char *fn = sf_histstring(shots, "srcfile");
+  if (fn) {
+    srczx = sfFloatRead(fn, 2 * ns);
+    free(fn);
+  } else {
+    int szbeg = 0, sxbeg = 0, jsz = 0, jsx = 0;
+    if (!sf_histint(shots, "sxbeg", &sxbeg)) {
+      sf_warning("no srcfile or sxbeg in shots, the sources are at 0\n");
+    }
+    sf_histint(shots, "szbeg", &szbeg);
+    sf_histint(shots, "jsz", &jsz);
+    sf_histint(shots, "jsx", &jsx);
+    for (int is = 0; is < ns; is++) {
+      srczx[2 * is] = szbeg + is * jsz;
+      srczx[2 * is + 1] = sxbeg + is * jsx;
+    }
+  }
+
+  fn = sf_histstring(shots, "geofile");
+  if (fn) {
+    geozx = sfFloatRead(fn, 2 * ng);
+    free(fn);
+  } else {
+    int gzbeg = 0, gxbeg = 0, jgz = 0, jgx = 1;
+    if (!sf_histint(shots, "gxbeg", &gxbeg)) {
+      sf_warning("no geofile or gxbeg in shots, the receivers are at 0\n");
+    }
+    sf_histint(shots, "gzbeg", &gzbeg);
+    sf_histint(shots, "jgz", &jgz);
+    sf_histint(shots, "jgx", &jgx);
+    for (int ig = 0; ig < ng; ig++) {
+      geozx[2 * ig] = gzbeg + ig * jgz;
+      geozx[2 * ig + 1] = gxbeg + ig * jgx;
+    }
+  }
+
+  for (int is = 0; is < ns; is++) {
+    geos[is].sz = srczx[2 * is];
+    geos[is].sx = srczx[2 * is + 1];
+    geos[is].geozx = geozx;
+  }
+  return geos;
+}
+
+void importShots(const Params &params) {
+  int nt, ng, ns;
+  float dt;
+  if (!sf_histint(params.shots, "n1", &nt)) sf_error("no n1 in shots");
+  if (!sf_histint(params.shots, "n2", &ng)) sf_error("no n2 in shots");
+  if (!sf_histint(params.shots, "n3", &ns)) ns = 1;
+  if (!sf_histfloat(params.shots, "d1", &dt)) sf_error("no d1 in shots");
+
+  std::vector<ShotGeometry> geos = rsfGeometry(params.shots, ns, ng);
+  ShotContainerWriter writer(MPI_COMM_NULL, params.container, ns, nt, dt, params.codec, params.tol);
+
+  /// the gathers straight from the page cache when the payload can be mapped
+  size_t shotSize = (size_t)nt * ng;
+  SfMappedData map(params.shots);
+  bool mapped = map.mapped() && map.size() >= ns * shotSize;
+  if (mapped) {
+    map.adviseSequential();
+  }
+  std::vector<float> gather(mapped ? 0 : shotSize);
+  for (int is = 0; is < ns; is++) {
+    const float *p = mapped ? map.data() + is * shotSize : &gather[0];
+    if (!mapped) {
+      sf_floatread(&gather[0], shotSize, params.shots);
+    }
+    writer.write(is, p, geos[is]);
+    if (mapped) {
+      map.drop((is + 1) * shotSize);
+    }
+  }
+  writer.close();
+}
+
+void exportShots(const Params &params) {
+  ShotContainerReader reader(params.container);
+  int ns = reader.getns();
+  int nt = reader.getnt();
+  int ng = reader.getng(0);
+  for (int is = 1; is < ns; is++) {
+    if (reader.getng(is) != ng) {
+      sf_error("shot %d has %d receivers and shot 0 %d, they do not fit an rsf cube", is, reader.getng(is), ng);
+    }
+  }
+
+  sf_putint(params.shots, "n1", nt);
+  sf_putint(params.shots, "n2", ng);
+  sf_putint(params.shots, "n3", ns);
+  sf_putfloat(params.shots, "d1", reader.getdt());
+  sf_putfloat(params.shots, "o1", 0);
+  sf_putstring(params.shots, "label1", "Time");
+  sf_putstring(params.shots, "label3", "Shot");
+  sf_putint(params.shots, "ng", ng);
+  if (params.srcfile) {
+    sf_putstring(params.shots, "srcfile", params.srcfile);
+  }
+  if (params.geofile) {
+    sf_putstring(params.shots, "geofile", params.geofile);
+  }
+
+  std::vector<float> gather((size_t)nt * ng);
+  for (int is = 0; is < ns; is++) {
+    reader.read(is, &gather[0]);
+    sf_floatwrite(&gather[0], gather.size(), params.shots);
+  }
+
+  if (params.srcfile) {
+    std::vector<float> srczx(2 * ns);
+    for (int is = 0; is < ns; is++) {
+      srczx[2 * is] = reader.geometry(is).sz;
+      srczx[2 * is + 1] = reader.geometry(is).sx;
+    }
+    sfFloatWrite2d(params.srcfile, &srczx[0], 2, ns);
+  }
+
+  if (params.geofile) {
+    const std::vector<float> &geozx = reader.geometry(0).geozx;
+    for (int is = 1; is < ns; is++) {
+      if (reader.geometry(is).geozx != geozx) {
+        sf_error("the receivers of shot %d are not those of shot 0, no geofile for all of them", is);
+      }
+    }
+    sfFloatWrite2d(params.geofile, &geozx[0], 2, ng);
+  }
+}
+
+} /// end of name space
+
+int main(int argc, char* argv[]) {
+  /* initialize Madagascar */
+  sf_init(argc, argv);
+  Environment::setDatapath();
+  Params params;
+
+  if (params.import) {
+    importShots(params);
+  } else {
+    exportShots(params);
+  }
+
+  return 0;
+}